@@ -32,10 +32,14 @@
 #include "bgpstream_int.h"
 #include "bgpstream_di_mgr.h"
 #include "bgpstream_log.h"
+#include "bgpstream_reader.h"
+#include "bgpstream_stats.h"
 #include "utils.h"
 #include <assert.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 struct bgpstream {
 
@@ -47,10 +51,38 @@ struct bgpstream {
 
   /* set to 1 once BGPStream has been started */
   int started;
+
+  /* set if the position of the stream may be checkpointed */
+  int checkpointing;
+
+  /* records returned by the last call to bgpstream_get_next_records. these
+     have been detached from their readers and must be released before the
+     next batch is read */
+  bgpstream_record_t **batch;
+  int batch_cnt;
+  int batch_alloc_cnt;
+
+  /* attribute store used to set the attrs_id of elems (NULL if attribute
+     interning is disabled) */
+  bgpstream_attr_store_t *attrs;
 };
 
 /* ========== INTERNAL METHODS (see bgpstream_int.h) ========== */
 
+static void release_batch(bgpstream_t *bs)
+{
+  int i;
+
+  for (i = 0; i < bs->batch_cnt; i++) {
+    // records taken by the user are released by the user
+    if (bs->batch[i]->__int->user_owned == 0) {
+      bgpstream_reader_release_record(bs->batch[i]);
+    }
+    bs->batch[i] = NULL;
+  }
+  bs->batch_cnt = 0;
+}
+
 /* ========== PUBLIC METHODS (see bgpstream_int.h) ========== */
 
 bgpstream_t *bgpstream_create()
@@ -228,10 +260,220 @@ int bgpstream_start(bgpstream_t *bs)
 
 int bgpstream_get_next_record(bgpstream_t *bs, bgpstream_record_t **record)
 {
+  int rc;
+
   assert(bs->started);
   *record = NULL;
+  release_batch(bs);
   // simply ask the DI manager to get us a record
-  return bgpstream_di_mgr_get_next_record(bs->di_mgr, record);
+  if ((rc = bgpstream_di_mgr_get_next_record(bs->di_mgr, record)) > 0) {
+    (*record)->__int->attrs = bs->attrs;
+  }
+  // the user may not call back for a while
+  bgpstream_log_flush();
+  return rc;
+}
+
+int bgpstream_get_next_record_nb(bgpstream_t *bs, bgpstream_record_t **record)
+{
+  int rc;
+
+  assert(bs->started);
+  *record = NULL;
+  release_batch(bs);
+  if ((rc = bgpstream_di_mgr_get_next_record_nb(bs->di_mgr, record)) > 0) {
+    (*record)->__int->attrs = bs->attrs;
+  }
+  bgpstream_log_flush();
+  return rc;
+}
+
+int bgpstream_get_fd(bgpstream_t *bs)
+{
+  return bgpstream_di_mgr_get_fd(bs->di_mgr);
+}
+
+int bgpstream_get_next_records(bgpstream_t *bs, bgpstream_record_t **records,
+                               int records_cnt)
+{
+  bgpstream_record_t **batch;
+  bgpstream_record_t *record;
+  int rc;
+
+  assert(bs->started);
+  release_batch(bs);
+
+  if (records_cnt > bs->batch_alloc_cnt) {
+    if ((batch = realloc(bs->batch, sizeof(bgpstream_record_t *) *
+                                      records_cnt)) == NULL) {
+      return -1;
+    }
+    bs->batch = batch;
+    bs->batch_alloc_cnt = records_cnt;
+  }
+
+  while (bs->batch_cnt < records_cnt) {
+    if ((rc = bgpstream_di_mgr_get_next_record(bs->di_mgr, &record)) <= 0) {
+      if (rc < 0) {
+        goto err;
+      }
+      // end-of-stream, return what we have (if anything)
+      break;
+    }
+    // take the record from the reader so that the next read does not
+    // overwrite it
+    if (bgpstream_reader_detach_record(record) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not detach record from reader");
+      goto err;
+    }
+    record->__int->attrs = bs->attrs;
+    bs->batch[bs->batch_cnt] = record;
+    records[bs->batch_cnt] = record;
+    bs->batch_cnt++;
+  }
+
+  bgpstream_log_flush();
+  return bs->batch_cnt;
+
+err:
+  release_batch(bs);
+  bgpstream_log_flush();
+  return -1;
+}
+
+int bgpstream_get_filter_stats(bgpstream_t *bs,
+                               bgpstream_filter_stats_t *stats,
+                               int stats_cnt)
+{
+  bgpstream_filter_mgr_t *filter_mgr = bs->filter_mgr;
+  bgpstream_filter_op_t *op;
+  int i;
+
+  for (i = 0; i < filter_mgr->program_len && i < stats_cnt; i++) {
+    op = &filter_mgr->program[i];
+    stats[i].name = bgpstream_filter_mgr_op_name(op->type);
+    stats[i].cost = op->cost;
+    stats[i].evaluated = op->evaluated;
+    stats[i].passed = op->passed;
+  }
+
+  return filter_mgr->program_len;
+}
+
+void bgpstream_set_stats_timing(bgpstream_t *bs, int enabled)
+{
+  bs->filter_mgr->stats_timing = (enabled != 0);
+}
+
+int bgpstream_set_attr_interning(bgpstream_t *bs, int enabled)
+{
+  assert(!bs->started);
+
+  if (enabled == 0) {
+    bgpstream_attr_store_destroy(bs->attrs);
+    bs->attrs = NULL;
+    return 0;
+  }
+  if (bs->attrs == NULL) {
+    if ((bs->attrs = bgpstream_attr_store_create()) == NULL) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+bgpstream_attr_store_t *bgpstream_get_attr_store(bgpstream_t *bs)
+{
+  return bs->attrs;
+}
+
+int bgpstream_get_stats(bgpstream_t *bs, bgpstream_stats_t *stats,
+                        int stats_cnt)
+{
+  return bgpstream_di_mgr_get_stats(bs->di_mgr, stats, stats_cnt);
+}
+
+void bgpstream_set_checkpointing(bgpstream_t *bs, int enabled)
+{
+  assert(!bs->started);
+  bs->checkpointing = (enabled != 0);
+  bgpstream_di_mgr_set_checkpointing(bs->di_mgr, bs->checkpointing);
+}
+
+int bgpstream_save_checkpoint(bgpstream_t *bs, const char *path)
+{
+  char tmp_path[PATH_MAX];
+  FILE *fh = NULL;
+
+  if (bs->checkpointing == 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Checkpointing has not been enabled");
+    return -1;
+  }
+
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >=
+      (int)sizeof(tmp_path)) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Checkpoint path too long");
+    return -1;
+  }
+
+  if ((fh = fopen(tmp_path, "w")) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not open %s for writing",
+                  tmp_path);
+    return -1;
+  }
+
+  if (bgpstream_di_mgr_write_checkpoint(bs->di_mgr, fh) != 0) {
+    goto err;
+  }
+
+  // make sure the new checkpoint is on disk before it replaces the old one
+  if (fflush(fh) != 0 || fsync(fileno(fh)) != 0) {
+    goto err;
+  }
+  if (fclose(fh) != 0) {
+    fh = NULL;
+    goto err;
+  }
+  fh = NULL;
+
+  if (rename(tmp_path, path) != 0) {
+    goto err;
+  }
+
+  return 0;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Could not write checkpoint to %s", path);
+  if (fh != NULL) {
+    fclose(fh);
+  }
+  unlink(tmp_path);
+  return -1;
+}
+
+int bgpstream_load_checkpoint(bgpstream_t *bs, const char *path)
+{
+  FILE *fh;
+  int rc;
+
+  assert(!bs->started);
+
+  if ((fh = fopen(path, "r")) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not open %s for reading", path);
+    return -1;
+  }
+
+  rc = bgpstream_di_mgr_read_checkpoint(bs->di_mgr, fh);
+  fclose(fh);
+
+  if (rc != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not load checkpoint from %s", path);
+    return rc;
+  }
+
+  // a resumed stream will be checkpointed again
+  bgpstream_set_checkpointing(bs, 1);
+  return 0;
 }
 
 /* destroy a bgpstream interface instance */
@@ -241,12 +483,20 @@ void bgpstream_destroy(bgpstream_t *bs)
     return;
   }
 
+  release_batch(bs);
+  free(bs->batch);
+  bs->batch = NULL;
+  bs->batch_alloc_cnt = 0;
+
   bgpstream_di_mgr_destroy(bs->di_mgr);
   bs->di_mgr = NULL;
 
   bgpstream_filter_mgr_destroy(bs->filter_mgr);
   bs->filter_mgr = NULL;
 
+  bgpstream_attr_store_destroy(bs->attrs);
+  bs->attrs = NULL;
+
   bs->started = 0;
 
   free(bs);
@@ -33,7 +33,9 @@
 #define __BGPSTREAM_H
 
 #include "bgpstream_elem.h"
+#include "bgpstream_elem_block.h"
 #include "bgpstream_record.h"
+#include "bgpstream_rib.h"
 #include "bgpstream_utils.h"
 
 /** @file
@@ -55,6 +57,24 @@
     mode). */
 #define BGPSTREAM_FOREVER 0
 
+/** Returned by bgpstream_get_next_record_nb when no record is available
+    yet. */
+#define BGPSTREAM_AGAIN (-2)
+
+/** Log levels, from the most to the least severe (see
+    bgpstream_set_log_level) */
+#define BGPSTREAM_LOG_ERR 0
+#define BGPSTREAM_LOG_WARN 10
+#define BGPSTREAM_LOG_INFO 20
+#define BGPSTREAM_LOG_CONFIG 30
+#define BGPSTREAM_LOG_FINE 40
+#define BGPSTREAM_LOG_VFINE 50
+#define BGPSTREAM_LOG_FINEST 60
+
+/** Default number of messages that each log statement may write per second
+    (see bgpstream_set_log_rate_limit) */
+#define BGPSTREAM_LOG_RATE_LIMIT_DEFAULT 10
+
 /** @} */
 
 /**
@@ -194,6 +214,93 @@ typedef struct struct_bgpstream_data_interface_option {
 
 } bgpstream_data_interface_option_t;
 
+/** Selectivity statistics of one predicate of the elem filter */
+typedef struct struct_bgpstream_filter_stats {
+
+  /** The name of the predicate (e.g., "prefix", "aspath") */
+  const char *name;
+
+  /** The estimated relative cost of one evaluation of the predicate */
+  uint32_t cost;
+
+  /** The number of elems the predicate was evaluated on */
+  uint64_t evaluated;
+
+  /** The number of elems that passed the predicate */
+  uint64_t passed;
+
+} bgpstream_filter_stats_t;
+
+/** Counters and timers describing the work done to read records from one
+ * collector (or from all collectors)
+ *
+ * Times are in nanoseconds, and are only measured if timing has been enabled
+ * using bgpstream_set_stats_timing. */
+typedef struct struct_bgpstream_stats {
+
+  /** The project name ("" for the totals) */
+  char project[BGPSTREAM_UTILS_STR_NAME_LEN];
+
+  /** The collector name ("" for the totals) */
+  char collector[BGPSTREAM_UTILS_STR_NAME_LEN];
+
+  /** The number of resources (dump files, streams) that were opened */
+  uint64_t resources;
+
+  /** The number of records returned to the user */
+  uint64_t records;
+
+  /** The number of bytes read from the transport (after decompression) */
+  uint64_t bytes_read;
+
+  /** The number of messages that were read and passed the record filters */
+  uint64_t msgs_read;
+
+  /** The number of messages that were dropped by the record filters */
+  uint64_t msgs_filtered;
+
+  /** The number of messages that were skipped (e.g., unsupported types) */
+  uint64_t msgs_skipped;
+
+  /** The number of corrupted or truncated messages */
+  uint64_t msgs_corrupted;
+
+  /** The number of elems that were extracted from records */
+  uint64_t elems;
+
+  /** The number of elems that were dropped by the elem filters */
+  uint64_t elems_filtered;
+
+  /** Time spent waiting for resources to be opened */
+  uint64_t open_wait_nsec;
+
+  /** Time spent reading (and decompressing) data from the transport */
+  uint64_t read_nsec;
+
+  /** Time spent decoding messages */
+  uint64_t decode_nsec;
+
+  /** Time spent checking the record filters */
+  uint64_t filter_nsec;
+
+  /** Time spent checking the elem filters */
+  uint64_t elem_filter_nsec;
+
+} bgpstream_stats_t;
+
+/** Callback that receives log messages (see bgpstream_set_log_sink)
+ *
+ * @param level         the level of the message (BGPSTREAM_LOG_*)
+ * @param msg           the formatted message, including a timestamp and a
+ *                      trailing newline
+ * @param msg_len       the length of the message
+ * @param user          the user pointer given to bgpstream_set_log_sink
+ *
+ * The callback may be called concurrently from several threads.
+ */
+typedef void(bgpstream_log_sink_t)(int level, const char *msg, size_t msg_len,
+                                   void *user);
+
 /** @} */
 
 /**
@@ -387,16 +494,236 @@ int bgpstream_start(bgpstream_t *bs);
  * @return >0 if a record was read successfully, 0 if end-of-stream has been
  * reached, <0 if an error occurred.
  *
- * The record passed to this function may be reused for subsequent calls if
- * state for previous records is not needed (i.e. the records are processed
- * independently of each other). If records are not processed independently,
- * then a new record must be created for each call to this function.
+ * The returned record is only valid until the next call to this function. If
+ * records are not processed independently of each other, a record can be kept
+ * (without copying) using bgpstream_record_take.
  */
 int bgpstream_get_next_record(bgpstream_t *bs, bgpstream_record_t **record);
 
+/** Retrieve from the stream the next record that matches configured filters,
+ * without waiting for new data.
+ *
+ * @param bs            pointer to a BGP Stream instance to get record from
+ * @param[out] record   set to point to a retrieved record, NULL if
+ *                      end-of-stream has been reached or no record is
+ *                      available yet
+ * @return >0 if a record was read successfully, 0 if end-of-stream has been
+ * reached, BGPSTREAM_AGAIN if no record is available yet, -1 if an error
+ * occurred.
+ *
+ * This behaves like bgpstream_get_next_record, except that in live mode it
+ * returns BGPSTREAM_AGAIN rather than sleeping while waiting for the data
+ * interface or a stream resource to have new data. Use the descriptor
+ * returned by bgpstream_get_fd to find out when to call this function again.
+ *
+ * Opening a resource and reading from an open resource may still block on
+ * I/O.
+ */
+int bgpstream_get_next_record_nb(bgpstream_t *bs, bgpstream_record_t **record);
+
+/** Get a file descriptor that becomes readable when bgpstream_get_next_record_nb
+ * should be called again
+ *
+ * @param bs            pointer to a BGP Stream instance
+ * @return a file descriptor owned by the stream, or -1 if the platform does
+ * not support it or an error occurred
+ *
+ * The descriptor may be added to a select/poll/epoll set. It stays readable
+ * until bgpstream_get_next_record_nb returns BGPSTREAM_AGAIN, after which it
+ * becomes readable again once some source is due to be polled. It must not be
+ * read from or closed by the caller.
+ */
+int bgpstream_get_fd(bgpstream_t *bs);
+
+/** Retrieve from the stream a batch of records that match configured filters.
+ *
+ * @param bs            pointer to a BGP Stream instance to get records from
+ * @param[out] records  array of at least records_cnt record pointers, filled
+ *                      with borrowed pointers to the records read
+ * @param records_cnt   maximum number of records to read
+ * @return the number of records read (>0), 0 if end-of-stream has been reached,
+ * <0 if an error occurred.
+ *
+ * This is equivalent to calling bgpstream_get_next_record up to records_cnt
+ * times, except that all of the records returned by one call are valid at the
+ * same time. They remain owned by BGPStream, and are valid until the next call
+ * to this function or to bgpstream_get_next_record, unless they are taken
+ * using bgpstream_record_take.
+ *
+ * Fewer than records_cnt records are only returned when the end of the stream
+ * has been reached. In live mode this function therefore blocks until
+ * records_cnt records are available, so small batches should be used if
+ * latency is important.
+ */
+int bgpstream_get_next_records(bgpstream_t *bs, bgpstream_record_t **records,
+                               int records_cnt);
+
+/** Get the selectivity statistics of the elem filter predicates
+ *
+ * @param bs            pointer to a BGP Stream instance
+ * @param stats         array to fill with the statistics of each predicate
+ * @param stats_cnt     number of entries available in the stats array
+ * @return the number of elem filter predicates
+ *
+ * The configured elem filters (peer, origin, prefix, AS path, etc.) are
+ * compiled into a program of predicates when the stream is started. Elems are
+ * checked against the predicates one at a time, starting from those that
+ * reject the most elems for the least work, and the order is adapted as
+ * elems are read. Only the elems of records read on the thread that calls
+ * bgpstream_get_next_record are counted and used to adapt the order; taken
+ * and batched records keep the order in effect when they were detached. The
+ * statistics are returned in the current evaluation order. If stats_cnt is
+ * smaller than the number of predicates, only the first stats_cnt are filled
+ * in.
+ */
+int bgpstream_get_filter_stats(bgpstream_t *bs,
+                               bgpstream_filter_stats_t *stats,
+                               int stats_cnt);
+
+/** Enable or disable the timers of the stream statistics
+ *
+ * @param bs            pointer to a BGP Stream instance
+ * @param enabled       if non-zero, time spent in each stage of reading
+ *                      records is measured
+ *
+ * Counters are always maintained, but timing adds a clock read to each stage
+ * of each message, so it is disabled by default. The setting only applies to
+ * the given BGP Stream instance, and should be changed before the stream is
+ * started.
+ */
+void bgpstream_set_stats_timing(bgpstream_t *bs, int enabled);
+
+/** Enable or disable interning of elem attributes
+ *
+ * @param bs            pointer to a BGP Stream instance
+ * @param enabled       if non-zero, the attrs_id field of RIB and announcement
+ *                      elems is set to the ID of their (AS path, communities,
+ *                      next-hop) attribute set
+ * @return 0 if successful, -1 otherwise
+ *
+ * IDs are assigned by an attribute store owned by the stream (see
+ * bgpstream_get_attr_store), and are stable for the lifetime of the stream.
+ * The store is not thread-safe, so the elems of the records of an interning
+ * stream must all be read from the same thread. This must be called before
+ * the stream is started.
+ */
+int bgpstream_set_attr_interning(bgpstream_t *bs, int enabled);
+
+/** Get a borrowed pointer to the attribute store of the stream
+ *
+ * @param bs            pointer to a BGP Stream instance
+ * @return borrowed pointer to the store that elem attrs_id values refer to,
+ * or NULL if attribute interning is disabled
+ */
+bgpstream_attr_store_t *bgpstream_get_attr_store(bgpstream_t *bs);
+
+/** Get the counters and timers of the work done to read the stream
+ *
+ * @param bs            pointer to a BGP Stream instance
+ * @param stats         array to fill with the statistics
+ * @param stats_cnt     number of entries available in the stats array
+ * @return the number of entries available, or -1 if an error occurred
+ *
+ * The first entry holds the totals for the whole stream, and it is followed
+ * by one entry for each collector that has been read from, in the order in
+ * which they were first opened. If stats_cnt is smaller than the number of
+ * entries, only the first stats_cnt are filled in. Statistics of resources
+ * that are still open are included, except for the elems of records that
+ * have been taken by the user or returned by bgpstream_get_next_records,
+ * since they may be processed in another thread.
+ */
+int bgpstream_get_stats(bgpstream_t *bs, bgpstream_stats_t *stats,
+                        int stats_cnt);
+
+/** Enable or disable checkpointing of the position of the stream
+ *
+ * @param bs            pointer to a BGP Stream instance
+ * @param enabled       if non-zero, the resources that are read to the end
+ *                      are remembered so that bgpstream_save_checkpoint can
+ *                      record them
+ *
+ * Checkpointing is disabled by default, since the resources that have been
+ * read accumulate for as long as the stream runs. It must be enabled before
+ * the stream is started if checkpoints are to be saved, and is enabled by
+ * bgpstream_load_checkpoint.
+ */
+void bgpstream_set_checkpointing(bgpstream_t *bs, int enabled);
+
+/** Save the position of the stream to a checkpoint file
+ *
+ * @param bs            pointer to a BGP Stream instance
+ * @param path          path of the file to write
+ * @return 0 if the checkpoint was saved successfully, -1 otherwise (including
+ * if checkpointing has not been enabled)
+ *
+ * The checkpoint records the resources that have been read to the end, the
+ * position of the last record returned from each resource that is partially
+ * read, and any state the data interface needs to find the remaining
+ * resources. It should be saved once every record returned so far has been
+ * processed. The file is replaced atomically, so a crash while saving leaves
+ * the previous checkpoint intact. Stream resources (e.g., Kafka, RIS Live) are
+ * not checkpointed.
+ */
+int bgpstream_save_checkpoint(bgpstream_t *bs, const char *path);
+
+/** Restore the position of the stream from a checkpoint file
+ *
+ * @param bs            pointer to a BGP Stream instance
+ * @param path          path of the file written by bgpstream_save_checkpoint
+ * @return 0 if the checkpoint was loaded successfully, -1 otherwise
+ *
+ * This must be called after the stream has been configured (with the same
+ * data interface and filters that were used when the checkpoint was saved),
+ * and before bgpstream_start. Resources that were read to the end are
+ * skipped the first time they are found again, and partially read resources
+ * continue with the record that follows the last one returned.
+ */
+int bgpstream_load_checkpoint(bgpstream_t *bs, const char *path);
+
+/** Set the most verbose level of messages that are logged
+ *
+ * @param level         one of the BGPSTREAM_LOG_* levels
+ *
+ * The level applies to all BGP Stream instances in the process, and may be
+ * changed at any time. The default is BGPSTREAM_LOG_INFO.
+ */
+void bgpstream_set_log_level(int level);
+
+/** Get the most verbose level of messages that are logged
+ *
+ * @return the current log level
+ */
+int bgpstream_get_log_level(void);
+
+/** Send log messages to the given callback rather than to stderr
+ *
+ * @param sink          pointer to the callback to use, or NULL to restore
+ *                      the default (buffered writes to stderr)
+ * @param user          user pointer to pass to the callback
+ *
+ * This should be called before any BGP Stream instance is started, since
+ * reader threads may already be logging.
+ */
+void bgpstream_set_log_sink(bgpstream_log_sink_t *sink, void *user);
+
+/** Set how many messages each log statement may write per second
+ *
+ * @param msgs_per_sec  maximum number of messages per second, or 0 to
+ *                      disable rate limiting
+ *
+ * Messages over the limit are counted rather than written, and the count is
+ * appended to the next message written by the same statement. Errors are
+ * never suppressed. The default is BGPSTREAM_LOG_RATE_LIMIT_DEFAULT messages
+ * per second.
+ */
+void bgpstream_set_log_rate_limit(int msgs_per_sec);
+
 /** Destroy the given BGP Stream instance
  *
  * @param bs            pointer to a BGP Stream instance to destroy
+ *
+ * Any records taken using bgpstream_record_take must have been released
+ * before this is called.
  */
 void bgpstream_destroy(bgpstream_t *bs);
 
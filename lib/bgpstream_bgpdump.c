@@ -32,9 +32,11 @@
 #include "bgpstream_elem_int.h"
 #include "bgpstream_int.h"
 #include "bgpstream_log.h"
+#include "bgpstream_utils_fmt.h"
 #include <assert.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
 
 #define B_REMAIN (len - written)
 #define B_FULL (written >= len)
@@ -50,6 +52,27 @@
     }                                                                          \
   } while (0)
 
+#define ADD_STR(str)                                                           \
+  do {                                                                         \
+    c = strlen(str);                                                           \
+    if (B_REMAIN > (size_t)c) {                                                \
+      memcpy(buf_p, str, c + 1);                                               \
+      written += c;                                                            \
+      buf_p += c;                                                              \
+    } else {                                                                   \
+      return NULL;                                                             \
+    }                                                                          \
+  } while (0)
+
+#define ADD_UINT32(val)                                                        \
+  do {                                                                         \
+    c = bgpstream_fmt_uint32_snprintf(buf_p, B_REMAIN, val);                   \
+    written += c;                                                              \
+    buf_p += c;                                                                \
+    if (B_FULL)                                                                \
+      return NULL;                                                             \
+  } while (0)
+
 #define SEEK_STR_END                                                           \
   do {                                                                         \
     while (*buf_p != '\0') {                                                   \
@@ -72,43 +95,40 @@ char *bgpstream_record_elem_bgpdump_snprintf(char *buf, size_t len,
   /* Record type */
   switch (elem->type) {
   case BGPSTREAM_ELEM_TYPE_RIB:
-    c = snprintf(buf_p, B_REMAIN, "TABLE_DUMP2|%" PRIu32, record->time_sec);
+    ADD_STR("TABLE_DUMP2|");
+    ADD_UINT32(record->time_sec);
     break;
   case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
   case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
   case BGPSTREAM_ELEM_TYPE_PEERSTATE:
-    c = snprintf(buf_p, B_REMAIN, "BGP4MP|%" PRIu32, record->time_sec);
+    ADD_STR("BGP4MP|");
+    ADD_UINT32(record->time_sec);
     break;
   default:
     break;
   }
-  written += c;
-  buf_p += c;
   ADD_PIPE;
 
   switch (elem->type) {
   case BGPSTREAM_ELEM_TYPE_RIB:
-    c = snprintf(buf_p, B_REMAIN, "B");
+    ADD_STR("B");
     break;
   case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
-    c = snprintf(buf_p, B_REMAIN, "A");
+    ADD_STR("A");
     break;
   case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
-    c = snprintf(buf_p, B_REMAIN, "W");
+    ADD_STR("W");
     break;
   case BGPSTREAM_ELEM_TYPE_PEERSTATE:
-    c = snprintf(buf_p, B_REMAIN, "STATE");
+    ADD_STR("STATE");
     break;
   default:
     break;
   }
-
-  written += c;
-  buf_p += c;
   ADD_PIPE;
 
   /* PEER IP */
-  if (bgpstream_addr_ntop(buf_p, B_REMAIN, &elem->peer_ip) == NULL) {
+  if (bgpstream_fmt_addr_ntop(buf_p, B_REMAIN, &elem->peer_ip) == NULL) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed peer address");
     return NULL;
   }
@@ -116,9 +136,7 @@ char *bgpstream_record_elem_bgpdump_snprintf(char *buf, size_t len,
   ADD_PIPE;
 
   /* PEER ASN */
-  c = snprintf(buf_p, B_REMAIN, "%" PRIu32, elem->peer_asn);
-  written += c;
-  buf_p += c;
+  ADD_UINT32(elem->peer_asn);
   ADD_PIPE;
 
   switch (elem->type) {
@@ -144,23 +162,21 @@ char *bgpstream_record_elem_bgpdump_snprintf(char *buf, size_t len,
     /* SOURCE (IGP) */
     switch (elem->origin) {
     case BGPSTREAM_ELEM_BGP_UPDATE_ORIGIN_IGP:
-      c = snprintf(buf_p, B_REMAIN, "IGP");
+      ADD_STR("IGP");
       break;
     case BGPSTREAM_ELEM_BGP_UPDATE_ORIGIN_EGP:
-      c = snprintf(buf_p, B_REMAIN, "EGP");
+      ADD_STR("EGP");
       break;
     case BGPSTREAM_ELEM_BGP_UPDATE_ORIGIN_INCOMPLETE:
-      c = snprintf(buf_p, B_REMAIN, "INCOMPLETE");
+      ADD_STR("INCOMPLETE");
       break;
     default:
       break;
     }
-    written += c;
-    buf_p += c;
     ADD_PIPE;
 
     /* NEXT HOP */
-    if (bgpstream_addr_ntop(buf_p, B_REMAIN, &elem->nexthop) == NULL) {
+    if (bgpstream_fmt_addr_ntop(buf_p, B_REMAIN, &elem->nexthop) == NULL) {
       bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed next_hop IP address");
       return NULL;
     }
@@ -168,15 +184,11 @@ char *bgpstream_record_elem_bgpdump_snprintf(char *buf, size_t len,
     ADD_PIPE;
 
     /* LOCAL_PREF */
-    c = snprintf(buf_p, B_REMAIN, "%" PRIu32, elem->local_pref);
-    written += c;
-    buf_p += c;
+    ADD_UINT32(elem->local_pref);
     ADD_PIPE;
 
     /* MED */
-    c = snprintf(buf_p, B_REMAIN, "%" PRIu32, elem->med);
-    written += c;
-    buf_p += c;
+    ADD_UINT32(elem->med);
     ADD_PIPE;
 
     /* COMMUNITIES */
@@ -189,21 +201,17 @@ char *bgpstream_record_elem_bgpdump_snprintf(char *buf, size_t len,
 
     /* AGGREGATE AG/NAG */
     if (elem->atomic_aggregate == 1) {
-      c = snprintf(buf_p, B_REMAIN, "AG");
+      ADD_STR("AG");
     } else {
-      c = snprintf(buf_p, B_REMAIN, "NAG");
+      ADD_STR("NAG");
     }
-    written += c;
-    buf_p += c;
     ADD_PIPE;
 
     /* AGGREGATOR AS AND IP */
     if (elem->aggregator.has_aggregator > 0) {
-      c = snprintf(buf_p, B_REMAIN, "%" PRIu32 " ",
-                   elem->aggregator.aggregator_asn);
-      written += c;
-      buf_p += c;
-      if (bgpstream_addr_ntop(buf_p, B_REMAIN,
+      ADD_UINT32(elem->aggregator.aggregator_asn);
+      ADD_STR(" ");
+      if (bgpstream_fmt_addr_ntop(buf_p, B_REMAIN,
                               &elem->aggregator.aggregator_addr) == NULL) {
         bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed aggregator IP address");
         return NULL;
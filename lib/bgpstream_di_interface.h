@@ -85,6 +85,8 @@
     NULL,                                                                      \
     NULL,                                                                      \
     NULL,                                                                      \
+    NULL,                                                                      \
+    NULL,                                                                      \
   };                                                                           \
   bsdi_t *bsdi_##classname##_alloc()                                           \
   {                                                                            \
@@ -164,6 +166,30 @@ struct bsdi {
    */
   int (*update_resources)(bsdi_t *di);
 
+  /** Get the state needed to resume the stream from its current position
+   *
+   * @param di          pointer to the data interface
+   * @param buf         pointer to the buffer to write the state into
+   * @param len         length of the buffer
+   * @return the number of characters that would have been written if len was
+   * unlimited, or -1 if an error occurred
+   *
+   * The state must be a single line of text. This method is optional, and is
+   * NULL for interfaces that do not need any state to be resumed (resources
+   * that have already been read are skipped by the resource manager).
+   */
+  int (*get_checkpoint)(bsdi_t *di, char *buf, size_t len);
+
+  /** Restore state written by get_checkpoint
+   *
+   * @param di          pointer to the data interface
+   * @param state       borrowed pointer to the state string
+   * @return 0 if the state was restored successfully, -1 otherwise
+   *
+   * This method is called before the interface is started.
+   */
+  int (*set_checkpoint)(bsdi_t *di, const char *state);
+
   /** }@ */
 
   /**
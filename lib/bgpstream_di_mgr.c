@@ -25,18 +25,24 @@
  */
 
 #include "bgpstream_di_mgr.h"
+#include "bgpstream_log.h"
 #include "config.h"
 #include "utils.h"
 #include <assert.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#ifdef HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#endif
+
 #ifdef WITH_DATA_INTERFACE_SINGLEFILE
 #include "bsdi_singlefile.h"
 #endif
@@ -74,6 +80,12 @@
 
 #define ACTIVE_DI (di_mgr->interfaces[di_mgr->active_di])
 
+/* First line of a checkpoint file */
+#define CHECKPOINT_HEADER "# bgpstream checkpoint v1"
+
+/* Maximum length of a line in a checkpoint file */
+#define CHECKPOINT_LINE_LEN 4096
+
 struct bgpstream_di_mgr {
 
   bsdi_t *interfaces[_BGPSTREAM_DATA_INTERFACE_CNT];
@@ -94,6 +106,16 @@ struct bgpstream_di_mgr {
   int blocking;
   int backoff_time;
   int retry_cnt;
+
+  // non-blocking mode: time (in msec) before which the DI should not be asked
+  // for more resources
+  uint64_t next_update;
+
+  // readiness descriptor (a timer), -1 if not created
+  int fd;
+
+  // is the readiness descriptor set to be readable now?
+  int fd_ready;
 };
 
 /** Convenience typedef for the interface alloc function type */
@@ -216,6 +238,40 @@ static bsdi_t *di_alloc(bgpstream_filter_mgr_t *filter_mgr,
   return di;
 }
 
+/* Make the readiness descriptor readable at the given time (in msec since the
+ * epoch), or right away if it is 0 */
+static void arm_fd(bgpstream_di_mgr_t *di_mgr, uint64_t when)
+{
+#ifdef HAVE_SYS_TIMERFD_H
+  struct itimerspec its;
+  uint64_t expirations;
+  int flags = 0;
+
+  if (di_mgr->fd < 0 || (when == 0 && di_mgr->fd_ready != 0)) {
+    return;
+  }
+
+  // clear any previous expiration so the descriptor reflects the new time
+  if (read(di_mgr->fd, &expirations, sizeof(expirations)) < 0) {
+    // nothing to clear
+  }
+
+  memset(&its, 0, sizeof(its));
+  if (when == 0 || when <= epoch_msec()) {
+    its.it_value.tv_nsec = 1;
+    di_mgr->fd_ready = 1;
+  } else {
+    its.it_value.tv_sec = when / 1000;
+    its.it_value.tv_nsec = (when % 1000) * 1000000;
+    flags = TFD_TIMER_ABSTIME;
+    di_mgr->fd_ready = 0;
+  }
+  if (timerfd_settime(di_mgr->fd, flags, &its, NULL) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_WARN, "Could not arm readiness descriptor");
+  }
+#endif
+}
+
 static bsdi_t *get_di(bgpstream_di_mgr_t *di_mgr,
                       bgpstream_data_interface_id_t id)
 {
@@ -242,6 +298,7 @@ bgpstream_di_mgr_t *bgpstream_di_mgr_create(bgpstream_filter_mgr_t *filter_mgr)
   }
   mgr->active_di = BGPSTREAM_DATA_INTERFACE_BROKER;
   mgr->backoff_time = DATA_INTERFACE_BLOCKING_MIN_WAIT;
+  mgr->fd = -1;
 
   /* allocate the interfaces (some may/will be NULL) */
   for (id = 0; id < _BGPSTREAM_DATA_INTERFACE_CNT; id++) {
@@ -351,26 +408,43 @@ void bgpstream_di_mgr_set_blocking(bgpstream_di_mgr_t *di_mgr)
   di_mgr->blocking = 1;
 }
 
-int bgpstream_di_mgr_get_next_record(bgpstream_di_mgr_t *di_mgr,
-                                     bgpstream_record_t **record)
+static int get_next_record(bgpstream_di_mgr_t *di_mgr,
+                           bgpstream_record_t **record, int blocking)
 {
   // this function is responsible for blocking if we're in live mode
   int rc;
+  uint64_t when;
 
   while (1) {
-    // if our queue is empty, ask the DI for more
-    if (bgpstream_resource_mgr_empty(di_mgr->res_mgr) != 0 &&
-        ACTIVE_DI->update_resources(ACTIVE_DI) != 0) {
-      // an error occurred
-      return -1;
+    // if our queue is empty, ask the DI for more (unless we are still backing
+    // off in non-blocking mode)
+    if (bgpstream_resource_mgr_empty(di_mgr->res_mgr) != 0) {
+      if (blocking == 0 && di_mgr->next_update > epoch_msec()) {
+        arm_fd(di_mgr, di_mgr->next_update);
+        return BGPSTREAM_AGAIN;
+      }
+      if (ACTIVE_DI->update_resources(ACTIVE_DI) != 0) {
+        // an error occurred
+        goto err;
+      }
     }
 
     // if the queue is not empty, then grab a record
     if (bgpstream_resource_mgr_empty(di_mgr->res_mgr) == 0) {
-      if ((rc = bgpstream_resource_mgr_get_record(di_mgr->res_mgr, record)) <
-          0) {
+      if (blocking != 0) {
+        rc = bgpstream_resource_mgr_get_record(di_mgr->res_mgr, record);
+      } else {
+        rc = bgpstream_resource_mgr_get_record_nb(di_mgr->res_mgr, record);
+      }
+      if (rc == BGPSTREAM_AGAIN) {
+        // all open stream resources are waiting
+        when = bgpstream_resource_mgr_get_next_poll_time(di_mgr->res_mgr);
+        arm_fd(di_mgr, when);
+        return BGPSTREAM_AGAIN;
+      }
+      if (rc < 0) {
         // an error occurred
-        return -1;
+        goto err;
       }
       if (rc > 0) {
         break;
@@ -387,10 +461,16 @@ int bgpstream_di_mgr_get_next_record(bgpstream_di_mgr_t *di_mgr,
     // either the queue was empty, or it is now
     assert(bgpstream_resource_mgr_empty(di_mgr->res_mgr) != 0);
 
-    // we're in blocking mode, so we sleep
-    if (sleep(di_mgr->backoff_time) != 0) {
-      // interrupted
-      break;
+    if (blocking != 0) {
+      // we're in blocking mode, so we sleep
+      bgpstream_log_flush();
+      if (sleep(di_mgr->backoff_time) != 0) {
+        // interrupted
+        break;
+      }
+    } else {
+      // come back once the back-off time has passed
+      di_mgr->next_update = epoch_msec() + di_mgr->backoff_time * 1000;
     }
     // adjust our sleep time, perhaps
     if (di_mgr->retry_cnt >= DATA_INTERFACE_BLOCKING_RETRY_CNT) {
@@ -400,12 +480,167 @@ int bgpstream_di_mgr_get_next_record(bgpstream_di_mgr_t *di_mgr,
       }
     }
     di_mgr->retry_cnt++;
+
+    if (blocking == 0) {
+      arm_fd(di_mgr, di_mgr->next_update);
+      return BGPSTREAM_AGAIN;
+    }
   }
 
   di_mgr->backoff_time = DATA_INTERFACE_BLOCKING_MIN_WAIT;
   di_mgr->retry_cnt = 0;
+  di_mgr->next_update = 0;
+  arm_fd(di_mgr, 0);
 
   return rc;
+
+err:
+  arm_fd(di_mgr, 0);
+  return -1;
+}
+
+int bgpstream_di_mgr_get_next_record(bgpstream_di_mgr_t *di_mgr,
+                                     bgpstream_record_t **record)
+{
+  return get_next_record(di_mgr, record, 1);
+}
+
+int bgpstream_di_mgr_get_next_record_nb(bgpstream_di_mgr_t *di_mgr,
+                                        bgpstream_record_t **record)
+{
+  return get_next_record(di_mgr, record, 0);
+}
+
+int bgpstream_di_mgr_get_fd(bgpstream_di_mgr_t *di_mgr)
+{
+#ifdef HAVE_SYS_TIMERFD_H
+  if (di_mgr->fd < 0) {
+    if ((di_mgr->fd = timerfd_create(CLOCK_REALTIME,
+                                     TFD_NONBLOCK | TFD_CLOEXEC)) < 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR,
+                    "Could not create readiness descriptor");
+      return -1;
+    }
+    // the caller should start by asking for a record
+    di_mgr->fd_ready = 0;
+    arm_fd(di_mgr, 0);
+  }
+  return di_mgr->fd;
+#else
+  return -1;
+#endif
+}
+
+int bgpstream_di_mgr_get_stats(bgpstream_di_mgr_t *di_mgr,
+                               bgpstream_stats_t *stats, int stats_cnt)
+{
+  return bgpstream_resource_mgr_get_stats(di_mgr->res_mgr, stats, stats_cnt);
+}
+
+void bgpstream_di_mgr_set_checkpointing(bgpstream_di_mgr_t *di_mgr,
+                                        int enabled)
+{
+  bgpstream_resource_mgr_set_checkpointing(di_mgr->res_mgr, enabled);
+}
+
+int bgpstream_di_mgr_write_checkpoint(bgpstream_di_mgr_t *di_mgr, FILE *fh)
+{
+  char buf[CHECKPOINT_LINE_LEN];
+
+  if (ACTIVE_DI == NULL) {
+    return -1;
+  }
+
+  buf[0] = '\0';
+  if (ACTIVE_DI->get_checkpoint != NULL &&
+      ACTIVE_DI->get_checkpoint(ACTIVE_DI, buf, sizeof(buf)) >=
+        (int)sizeof(buf)) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Data interface checkpoint too long");
+    return -1;
+  }
+
+  if (fprintf(fh, "%s\ndi %s %s\n", CHECKPOINT_HEADER, ACTIVE_DI->info.name,
+              buf) < 0) {
+    return -1;
+  }
+
+  return bgpstream_resource_mgr_write_checkpoint(di_mgr->res_mgr, fh);
+}
+
+int bgpstream_di_mgr_read_checkpoint(bgpstream_di_mgr_t *di_mgr, FILE *fh)
+{
+  char line[CHECKPOINT_LINE_LEN];
+  char *p;
+  char *end;
+  size_t len;
+  uint64_t offset;
+  int line_num = 0;
+
+  if (ACTIVE_DI == NULL) {
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), fh) != NULL) {
+    line_num++;
+    len = strlen(line);
+    if (len == 0 || line[len - 1] != '\n') {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Checkpoint line %d is too long",
+                    line_num);
+      return -1;
+    }
+    line[len - 1] = '\0';
+
+    if (line_num == 1) {
+      if (strcmp(line, CHECKPOINT_HEADER) != 0) {
+        bgpstream_log(BGPSTREAM_LOG_ERR, "Not a bgpstream checkpoint file");
+        return -1;
+      }
+    } else if (strncmp(line, "di ", 3) == 0) {
+      // "di <name> <state>"
+      p = line + 3;
+      len = strlen(ACTIVE_DI->info.name);
+      if (strncmp(p, ACTIVE_DI->info.name, len) != 0 ||
+          (p[len] != ' ' && p[len] != '\0')) {
+        bgpstream_log(BGPSTREAM_LOG_ERR,
+                      "Checkpoint was not created by the %s data interface",
+                      ACTIVE_DI->info.name);
+        return -1;
+      }
+      p += len;
+      if (*p == ' ') {
+        p++;
+      }
+      if (*p != '\0' && ACTIVE_DI->set_checkpoint != NULL &&
+          ACTIVE_DI->set_checkpoint(ACTIVE_DI, p) != 0) {
+        return -1;
+      }
+    } else if (strncmp(line, "done ", 5) == 0) {
+      // "done <uri>"
+      if (bgpstream_resource_mgr_set_done(di_mgr->res_mgr, line + 5) != 0) {
+        return -1;
+      }
+    } else if (strncmp(line, "partial ", 8) == 0) {
+      // "partial <offset> <uri>"
+      offset = strtoull(line + 8, &end, 10);
+      if (end == line + 8 || *end != ' ' ||
+          bgpstream_resource_mgr_set_resume_offset(di_mgr->res_mgr, end + 1,
+                                                   offset) != 0) {
+        bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid checkpoint line %d",
+                      line_num);
+        return -1;
+      }
+    } else {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid checkpoint line %d", line_num);
+      return -1;
+    }
+  }
+
+  if (line_num == 0 || ferror(fh) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not read checkpoint");
+    return -1;
+  }
+
+  return 0;
 }
 
 void bgpstream_di_mgr_destroy(bgpstream_di_mgr_t *di_mgr)
@@ -417,6 +652,11 @@ void bgpstream_di_mgr_destroy(bgpstream_di_mgr_t *di_mgr)
   bgpstream_resource_mgr_destroy(di_mgr->res_mgr);
   di_mgr->res_mgr = NULL;
 
+  if (di_mgr->fd >= 0) {
+    close(di_mgr->fd);
+    di_mgr->fd = -1;
+  }
+
   free(di_mgr->available_dis);
   di_mgr->available_dis = NULL;
   di_mgr->available_dis_cnt = 0;
@@ -155,6 +155,69 @@ int bgpstream_di_mgr_start(bgpstream_di_mgr_t *di_mgr);
 int bgpstream_di_mgr_get_next_record(bgpstream_di_mgr_t *di_mgr,
                                      bgpstream_record_t **record);
 
+/** Get the next record from the stream without sleeping
+ *
+ * @param di_mgr          pointer to a data interface manager instance
+ * @param[out] record     set to a borrowed pointer to a record if the return
+ *                        code is >0
+ * @return >0 if a record was read successfully, 0 if end-of-stream has been
+ * reached, BGPSTREAM_AGAIN if no data is available yet, -1 if an error
+ * occurred.
+ *
+ * In live mode, instead of sleeping until the data interface or a stream
+ * resource may have new data, this returns BGPSTREAM_AGAIN and arms the
+ * readiness descriptor (see bgpstream_di_mgr_get_fd) for that time.
+ */
+int bgpstream_di_mgr_get_next_record_nb(bgpstream_di_mgr_t *di_mgr,
+                                        bgpstream_record_t **record);
+
+/** Get the readiness descriptor of the data interface manager
+ *
+ * @param di_mgr          pointer to a data interface manager instance
+ * @return a file descriptor that is readable when
+ * bgpstream_di_mgr_get_next_record_nb should be called, or -1 if it is not
+ * supported or could not be created
+ */
+int bgpstream_di_mgr_get_fd(bgpstream_di_mgr_t *di_mgr);
+
+/** Get the statistics of the resources read so far
+ *
+ * @param di_mgr        pointer to a data interface manager instance
+ * @param stats         array to fill with the statistics
+ * @param stats_cnt     number of entries available in the stats array
+ * @return the number of entries available (see bgpstream_get_stats)
+ */
+int bgpstream_di_mgr_get_stats(bgpstream_di_mgr_t *di_mgr,
+                               bgpstream_stats_t *stats, int stats_cnt);
+
+/** Enable or disable tracking of the position of the stream for checkpoints
+ *
+ * @param di_mgr        pointer to the DI manager instance
+ * @param enabled       if non-zero, the resources that are read to the end
+ *                      are remembered so that they can be checkpointed
+ */
+void bgpstream_di_mgr_set_checkpointing(bgpstream_di_mgr_t *di_mgr,
+                                        int enabled);
+
+/** Write the position of the stream to the given checkpoint file
+ *
+ * @param di_mgr        pointer to the DI manager instance
+ * @param fh            file handle to write to
+ * @return 0 if successful, -1 otherwise
+ */
+int bgpstream_di_mgr_write_checkpoint(bgpstream_di_mgr_t *di_mgr, FILE *fh);
+
+/** Restore the position of the stream from the given checkpoint file
+ *
+ * @param di_mgr        pointer to the DI manager instance
+ * @param fh            file handle to read from
+ * @return 0 if successful, -1 otherwise
+ *
+ * Must be called after the data interface has been selected and configured,
+ * but before it is started.
+ */
+int bgpstream_di_mgr_read_checkpoint(bgpstream_di_mgr_t *di_mgr, FILE *fh);
+
 /** Destroy the given data interface manager
  *
  * @param di_mgr        pointer to a data interface manager instance to destroy
@@ -28,6 +28,7 @@
 #include "bgpstream_log.h"
 #include "bgpstream_record.h"
 #include "bgpstream_utils.h"
+#include "bgpstream_utils_fmt.h"
 #include "config.h"
 #ifdef WITH_RPKI
 #include "bgpstream_utils_rpki.h"
@@ -263,13 +264,13 @@ char *bgpstream_elem_custom_snprintf(char *buf, size_t len,
   }
 
   /* PEER ASN */
-  c = snprintf(buf_p, B_REMAIN, "%" PRIu32, elem->peer_asn);
+  c = bgpstream_fmt_uint32_snprintf(buf_p, B_REMAIN, elem->peer_asn);
   written += c;
   buf_p += c;
   ADD_PIPE;
 
   /* PEER IP */
-  if (bgpstream_addr_ntop(buf_p, B_REMAIN, &elem->peer_ip) == NULL) {
+  if (bgpstream_fmt_addr_ntop(buf_p, B_REMAIN, &elem->peer_ip) == NULL) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed peer address");
     return NULL;
   }
@@ -294,7 +295,7 @@ char *bgpstream_elem_custom_snprintf(char *buf, size_t len,
     ADD_PIPE;
 
     /* NEXT HOP */
-    if (bgpstream_addr_ntop(buf_p, B_REMAIN, &elem->nexthop) != NULL) {
+    if (bgpstream_fmt_addr_ntop(buf_p, B_REMAIN, &elem->nexthop) != NULL) {
       SEEK_STR_END;
     }
     ADD_PIPE;
@@ -258,6 +258,19 @@ typedef struct bgpstream_elem {
   /** Atomic aggregate attribute */
   bgpstream_elem_aggregator_t aggregator;
 
+  /** Attribute set ID
+   *
+   * ID of the (AS path, communities, next-hop) attribute set of the elem in
+   * the attribute store returned by bgpstream_get_attr_store. Elems with the
+   * same ID have the same attributes, so per-attribute work can be done once
+   * per ID.
+   *
+   * Available only for RIB and Announcement elem types, and only if attribute
+   * interning has been enabled using bgpstream_set_attr_interning (0
+   * otherwise).
+   */
+  uint32_t attrs_id;
+
 } bgpstream_elem_t;
 
 /** @} */
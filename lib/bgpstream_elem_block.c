@@ -0,0 +1,460 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_elem_block.h"
+#include "bgpstream_record_int.h"
+#include "config.h"
+#include "khash.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* initial number of elems allocated in a block */
+#define ELEMS_INIT_CNT 256
+
+#define peer_hash_val(p)                                                       \
+  ((khint32_t)(bgpstream_addr_storage_hash(&(p).peer_ip) ^ (p).peer_asn))
+#define peer_equal_val(p1, p2)                                                 \
+  ((p1).peer_asn == (p2).peer_asn &&                                           \
+   bgpstream_addr_storage_equal(&(p1).peer_ip, &(p2).peer_ip))
+
+/** Map from peer to index in the peers array */
+KHASH_INIT(bsblk_peer, bgpstream_elem_block_peer_t, uint32_t, 1, peer_hash_val,
+           peer_equal_val);
+
+/** Map from AS path to index in the paths array (keys are owned by the paths
+    array) */
+KHASH_INIT(bsblk_path, bgpstream_as_path_t *, uint32_t, 1,
+           bgpstream_as_path_hash, bgpstream_as_path_equal);
+
+struct bgpstream_elem_block_internal {
+
+  /** Number of elems allocated in each column */
+  int elems_alloc_cnt;
+
+  /** Filter result of each elem (1 if it is still wanted) */
+  uint8_t *pass;
+
+  /** Filter result of each distinct peer and AS path, for the predicate
+      being evaluated (-1 if not evaluated yet) */
+  int8_t *peer_pass;
+  int8_t *path_pass;
+
+  /** Elem used to evaluate the filter predicates on a single field */
+  bgpstream_elem_t *scratch;
+
+  /** Number of peers allocated */
+  int peers_alloc_cnt;
+
+  /** Number of AS path objects allocated (these are re-used between
+      populates) */
+  int paths_alloc_cnt;
+
+  /** Peer to peer index */
+  khash_t(bsblk_peer) * peer_map;
+
+  /** AS path to path ID */
+  khash_t(bsblk_path) * path_map;
+};
+
+#define GROW(ptr, cnt)                                                         \
+  do {                                                                         \
+    void *tmp_ptr;                                                             \
+    if ((tmp_ptr = realloc((ptr), sizeof(*(ptr)) * (cnt))) == NULL) {          \
+      return -1;                                                               \
+    }                                                                          \
+    (ptr) = tmp_ptr;                                                           \
+  } while (0)
+
+static int grow_elems(bgpstream_elem_block_t *block)
+{
+  int cnt = block->__int->elems_alloc_cnt * 2;
+
+  if (cnt == 0) {
+    cnt = ELEMS_INIT_CNT;
+  }
+
+  GROW(block->type, cnt);
+  GROW(block->peer_idx, cnt);
+  GROW(block->prefix, cnt);
+  GROW(block->origin_asn, cnt);
+  GROW(block->path_id, cnt);
+  GROW(block->__int->pass, cnt);
+
+  block->__int->elems_alloc_cnt = cnt;
+  return 0;
+}
+
+static int get_peer_idx(bgpstream_elem_block_t *block, bgpstream_elem_t *elem,
+                        uint32_t *idx)
+{
+  bgpstream_elem_block_internal_t *bi = block->__int;
+  bgpstream_elem_block_peer_t peer;
+  khiter_t k;
+  int khret;
+  int cnt;
+
+  // zero first so that the unused part of the address is deterministic
+  memset(&peer, 0, sizeof(peer));
+  bgpstream_addr_copy((bgpstream_ip_addr_t *)&peer.peer_ip,
+                      (bgpstream_ip_addr_t *)&elem->peer_ip);
+  peer.peer_asn = elem->peer_asn;
+
+  if ((k = kh_get(bsblk_peer, bi->peer_map, peer)) != kh_end(bi->peer_map)) {
+    *idx = kh_val(bi->peer_map, k);
+    return 0;
+  }
+
+  if (block->peers_cnt == bi->peers_alloc_cnt) {
+    cnt = (bi->peers_alloc_cnt == 0) ? 8 : bi->peers_alloc_cnt * 2;
+    GROW(block->peers, cnt);
+    GROW(bi->peer_pass, cnt);
+    bi->peers_alloc_cnt = cnt;
+  }
+  block->peers[block->peers_cnt] = peer;
+
+  k = kh_put(bsblk_peer, bi->peer_map, peer, &khret);
+  if (khret < 0) {
+    return -1;
+  }
+  *idx = kh_val(bi->peer_map, k) = block->peers_cnt++;
+  return 0;
+}
+
+static int get_path_id(bgpstream_elem_block_t *block, bgpstream_elem_t *elem,
+                       uint32_t *id)
+{
+  bgpstream_elem_block_internal_t *bi = block->__int;
+  bgpstream_as_path_t *path;
+  khiter_t k;
+  int khret;
+  int cnt;
+
+  if ((k = kh_get(bsblk_path, bi->path_map, elem->as_path)) !=
+      kh_end(bi->path_map)) {
+    *id = kh_val(bi->path_map, k);
+    return 0;
+  }
+
+  if (block->paths_cnt == bi->paths_alloc_cnt) {
+    cnt = (bi->paths_alloc_cnt == 0) ? 8 : bi->paths_alloc_cnt * 2;
+    GROW(block->paths, cnt);
+    GROW(bi->path_pass, cnt);
+    for (; bi->paths_alloc_cnt < cnt; bi->paths_alloc_cnt++) {
+      if ((block->paths[bi->paths_alloc_cnt] = bgpstream_as_path_create()) ==
+          NULL) {
+        return -1;
+      }
+    }
+  }
+  path = block->paths[block->paths_cnt];
+  if (bgpstream_as_path_copy(path, elem->as_path) != 0) {
+    return -1;
+  }
+
+  k = kh_put(bsblk_path, bi->path_map, path, &khret);
+  if (khret < 0) {
+    return -1;
+  }
+  *id = kh_val(bi->path_map, k) = block->paths_cnt++;
+  return 0;
+}
+
+/* evaluate a predicate that only depends on the peer, once per distinct
+   peer */
+static void filter_peers(bgpstream_elem_block_t *block,
+                         bgpstream_filter_mgr_t *filter_mgr,
+                         bgpstream_filter_op_type_t type)
+{
+  bgpstream_elem_block_internal_t *bi = block->__int;
+  int8_t *peer_pass;
+  int i;
+
+  memset(bi->peer_pass, -1, block->peers_cnt);
+  for (i = 0; i < block->elems_cnt; i++) {
+    if (bi->pass[i] == 0) {
+      continue;
+    }
+    peer_pass = &bi->peer_pass[block->peer_idx[i]];
+    if (*peer_pass < 0) {
+      bi->scratch->peer_asn = block->peers[block->peer_idx[i]].peer_asn;
+      *peer_pass =
+        bgpstream_record_check_elem_filter_op(filter_mgr, type, bi->scratch);
+    }
+    bi->pass[i] = *peer_pass;
+  }
+}
+
+/* evaluate a predicate that only depends on the AS path, once per distinct
+   path (these predicates never pass withdrawals or peer state messages) */
+static void filter_paths(bgpstream_elem_block_t *block,
+                         bgpstream_filter_mgr_t *filter_mgr,
+                         bgpstream_filter_op_type_t type)
+{
+  bgpstream_elem_block_internal_t *bi = block->__int;
+  bgpstream_as_path_t *scratch_path = bi->scratch->as_path;
+  int8_t *path_pass;
+  int i;
+
+  bi->scratch->type = BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT;
+  memset(bi->path_pass, -1, block->paths_cnt);
+  for (i = 0; i < block->elems_cnt; i++) {
+    if (bi->pass[i] == 0) {
+      continue;
+    }
+    if (block->type[i] == BGPSTREAM_ELEM_TYPE_WITHDRAWAL ||
+        block->type[i] == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
+      bi->pass[i] = 0;
+      continue;
+    }
+    path_pass = &bi->path_pass[block->path_id[i]];
+    if (*path_pass < 0) {
+      bi->scratch->as_path = block->paths[block->path_id[i]];
+      *path_pass =
+        bgpstream_record_check_elem_filter_op(filter_mgr, type, bi->scratch);
+    }
+    bi->pass[i] = *path_pass;
+  }
+  bi->scratch->as_path = scratch_path;
+}
+
+/* evaluate a predicate that depends on the type and prefix of each elem */
+static void filter_elems(bgpstream_elem_block_t *block,
+                         bgpstream_filter_mgr_t *filter_mgr,
+                         bgpstream_filter_op_type_t type)
+{
+  bgpstream_elem_block_internal_t *bi = block->__int;
+  int i;
+
+  for (i = 0; i < block->elems_cnt; i++) {
+    if (bi->pass[i] == 0) {
+      continue;
+    }
+    bi->scratch->type = block->type[i];
+    if (type != BGPSTREAM_FILTER_OP_ELEMTYPE) {
+      bi->scratch->prefix = block->prefix[i];
+    }
+    bi->pass[i] =
+      bgpstream_record_check_elem_filter_op(filter_mgr, type, bi->scratch);
+  }
+}
+
+/* apply the filter program one predicate (column) at a time, and then drop
+   the elems that failed any of them. returns the number of elems dropped */
+static int filter_block(bgpstream_elem_block_t *block,
+                        bgpstream_filter_mgr_t *filter_mgr,
+                        bgpstream_filter_op_type_t *program, int program_len)
+{
+  bgpstream_elem_block_internal_t *bi = block->__int;
+  bgpstream_filter_op_type_t type;
+  int i, j;
+
+  for (i = 0; i < program_len; i++) {
+    type = program[i];
+    switch (type) {
+    case BGPSTREAM_FILTER_OP_PEER_ASN:
+      filter_peers(block, filter_mgr, type);
+      break;
+    case BGPSTREAM_FILTER_OP_ORIGIN_ASN:
+    case BGPSTREAM_FILTER_OP_ASPATH:
+      filter_paths(block, filter_mgr, type);
+      break;
+    case BGPSTREAM_FILTER_OP_COMMUNITY:
+      // already applied as the elems were decoded
+      break;
+    default:
+      filter_elems(block, filter_mgr, type);
+      break;
+    }
+  }
+
+  for (i = 0, j = 0; i < block->elems_cnt; i++) {
+    if (bi->pass[i] == 0) {
+      continue;
+    }
+    if (i != j) {
+      block->type[j] = block->type[i];
+      block->peer_idx[j] = block->peer_idx[i];
+      block->prefix[j] = block->prefix[i];
+      block->origin_asn[j] = block->origin_asn[i];
+      block->path_id[j] = block->path_id[i];
+    }
+    j++;
+  }
+  i = block->elems_cnt - j;
+  block->elems_cnt = j;
+  return i;
+}
+
+/* ========== PUBLIC FUNCTIONS ========== */
+
+bgpstream_elem_block_t *bgpstream_elem_block_create()
+{
+  bgpstream_elem_block_t *block;
+
+  if ((block = malloc_zero(sizeof(bgpstream_elem_block_t))) == NULL ||
+      (block->__int = malloc_zero(sizeof(bgpstream_elem_block_internal_t))) ==
+        NULL) {
+    goto err;
+  }
+
+  if ((block->__int->peer_map = kh_init(bsblk_peer)) == NULL ||
+      (block->__int->path_map = kh_init(bsblk_path)) == NULL ||
+      (block->__int->scratch = bgpstream_elem_create()) == NULL) {
+    goto err;
+  }
+
+  if (grow_elems(block) != 0) {
+    goto err;
+  }
+
+  return block;
+
+err:
+  bgpstream_elem_block_destroy(block);
+  return NULL;
+}
+
+void bgpstream_elem_block_destroy(bgpstream_elem_block_t *block)
+{
+  int i;
+
+  if (block == NULL) {
+    return;
+  }
+
+  free(block->type);
+  free(block->peer_idx);
+  free(block->prefix);
+  free(block->origin_asn);
+  free(block->path_id);
+  free(block->peers);
+
+  if (block->__int != NULL) {
+    for (i = 0; i < block->__int->paths_alloc_cnt; i++) {
+      bgpstream_as_path_destroy(block->paths[i]);
+    }
+    if (block->__int->peer_map != NULL) {
+      kh_destroy(bsblk_peer, block->__int->peer_map);
+    }
+    if (block->__int->path_map != NULL) {
+      kh_destroy(bsblk_path, block->__int->path_map);
+    }
+    if (block->__int->scratch != NULL) {
+      bgpstream_elem_destroy(block->__int->scratch);
+    }
+    free(block->__int->pass);
+    free(block->__int->peer_pass);
+    free(block->__int->path_pass);
+    free(block->__int);
+  }
+  free(block->paths);
+
+  free(block);
+}
+
+void bgpstream_elem_block_clear(bgpstream_elem_block_t *block)
+{
+  block->elems_cnt = 0;
+  block->peers_cnt = 0;
+  block->paths_cnt = 0;
+  // the path objects are kept for re-use
+  kh_clear(bsblk_peer, block->__int->peer_map);
+  kh_clear(bsblk_path, block->__int->path_map);
+}
+
+int bgpstream_elem_block_populate(bgpstream_elem_block_t *block,
+                                  bgpstream_record_t *record)
+{
+  bgpstream_filter_mgr_t *filter_mgr = NULL;
+  bgpstream_filter_op_type_t program[BGPSTREAM_FILTER_OP_CNT];
+  int program_len = 0;
+  bgpstream_elem_t *elem;
+  int check_community = 0;
+  int i;
+  int rc;
+
+  bgpstream_elem_block_clear(block);
+
+  // use the program of the record, since the one of the filter manager may be
+  // reordered by the stream while a detached record is read
+  if (record != NULL &&
+      (filter_mgr = bgpstream_record_get_filter_mgr(record)) != NULL) {
+    program_len = bgpstream_record_get_filter_program(record, program);
+    for (i = 0; i < program_len; i++) {
+      if (program[i] == BGPSTREAM_FILTER_OP_COMMUNITY) {
+        check_community = 1;
+      }
+    }
+  }
+
+  while ((rc = bgpstream_record_get_next_raw_elem(record, &elem)) > 0) {
+    if (block->elems_cnt == block->__int->elems_alloc_cnt &&
+        grow_elems(block) != 0) {
+      return -1;
+    }
+    i = block->elems_cnt;
+
+    block->type[i] = elem->type;
+    if (get_peer_idx(block, elem, &block->peer_idx[i]) != 0 ||
+        get_path_id(block, elem, &block->path_id[i]) != 0) {
+      return -1;
+    }
+
+    if (elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
+      memset(&block->prefix[i], 0, sizeof(bgpstream_pfx_storage_t));
+    } else {
+      block->prefix[i] = elem->prefix;
+    }
+
+    if (elem->type == BGPSTREAM_ELEM_TYPE_WITHDRAWAL ||
+        elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE ||
+        bgpstream_as_path_get_origin_val(elem->as_path,
+                                         &block->origin_asn[i]) != 0) {
+      block->origin_asn[i] = BGPSTREAM_ELEM_BLOCK_NO_ORIGIN;
+    }
+
+    // the block does not keep the communities, so this predicate is the only
+    // one evaluated elem by elem
+    block->__int->pass[i] =
+      (check_community == 0 ||
+       bgpstream_record_check_elem_filter_op(
+         filter_mgr, BGPSTREAM_FILTER_OP_COMMUNITY, elem));
+
+    block->elems_cnt++;
+  }
+
+  if (rc < 0) {
+    return -1;
+  }
+
+  if (program_len > 0) {
+    bgpstream_record_count_filtered_elems(
+      record, filter_block(block, filter_mgr, program, program_len));
+  }
+
+  return block->elems_cnt;
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_ELEM_BLOCK_H
+#define __BGPSTREAM_ELEM_BLOCK_H
+
+#include "bgpstream_elem.h"
+#include "bgpstream_record.h"
+#include "bgpstream_utils.h"
+
+/** @file
+ *
+ * @brief Header file that exposes the public interface of a bgpstream elem
+ * block.
+ *
+ * An elem block holds all of the elems of a record in struct-of-arrays form:
+ * one array (column) per field, indexed by elem. Peers and AS paths are stored
+ * once per block and referenced by index, so code that only needs to look at
+ * each distinct peer or path can do so without visiting every elem. The elem
+ * filters are applied in the same way: one predicate at a time over the whole
+ * block, and once per distinct peer or path for the predicates that only
+ * depend on those.
+ *
+ */
+
+/**
+ * @name Public Opaque Data Structures
+ *
+ * @{ */
+
+/** Opaque structure holding the private state of an elem block */
+typedef struct bgpstream_elem_block_internal bgpstream_elem_block_internal_t;
+
+/** @} */
+
+/**
+ * @name Public Constants
+ *
+ * @{ */
+
+/** Value of the origin ASN column for elems without a single origin ASN
+ * (withdrawals, peer state messages and paths ending in an AS set) */
+#define BGPSTREAM_ELEM_BLOCK_NO_ORIGIN 0
+
+/** @} */
+
+/**
+ * @name Public Data Structures
+ *
+ * @{ */
+
+/** A peer referenced by the elems in a block */
+typedef struct bgpstream_elem_block_peer {
+
+  /** IP address of the peer */
+  bgpstream_addr_storage_t peer_ip;
+
+  /** AS number of the peer */
+  uint32_t peer_asn;
+
+} bgpstream_elem_block_peer_t;
+
+/** A block of elems in struct-of-arrays form
+ *
+ * All fields are read-only, and are valid until the block is re-populated,
+ * cleared or destroyed.
+ */
+typedef struct bgpstream_elem_block {
+
+  /** Number of elems in the block (i.e., the length of each column) */
+  int elems_cnt;
+
+  /** Type of each elem */
+  bgpstream_elem_type_t *type;
+
+  /** Index of each elem's peer in the peers array */
+  uint32_t *peer_idx;
+
+  /** Prefix of each elem (undefined for peer state messages) */
+  bgpstream_pfx_storage_t *prefix;
+
+  /** Origin ASN of each elem, or BGPSTREAM_ELEM_BLOCK_NO_ORIGIN */
+  uint32_t *origin_asn;
+
+  /** Index of each elem's AS path in the paths array (withdrawals and peer
+      state messages refer to an empty path) */
+  uint32_t *path_id;
+
+  /** Distinct peers of the decoded elems (this may include peers whose elems
+      were all filtered out) */
+  bgpstream_elem_block_peer_t *peers;
+
+  /** Number of distinct peers */
+  int peers_cnt;
+
+  /** Distinct AS paths of the decoded elems (this may include paths whose
+      elems were all filtered out) */
+  bgpstream_as_path_t **paths;
+
+  /** Number of distinct AS paths */
+  int paths_cnt;
+
+  /** Private state */
+  bgpstream_elem_block_internal_t *__int;
+
+} bgpstream_elem_block_t;
+
+/** @} */
+
+/**
+ * @name Public API Functions
+ *
+ * @{ */
+
+/** Create a new, empty, elem block
+ *
+ * @return pointer to the block if successful, NULL otherwise
+ *
+ * A block can (and should) be re-used for many records, since the memory it
+ * holds is retained when it is re-populated.
+ */
+bgpstream_elem_block_t *bgpstream_elem_block_create();
+
+/** Destroy the given elem block
+ *
+ * @param block         pointer to the block to destroy
+ */
+void bgpstream_elem_block_destroy(bgpstream_elem_block_t *block);
+
+/** Empty the given elem block
+ *
+ * @param block         pointer to the block to clear
+ */
+void bgpstream_elem_block_clear(bgpstream_elem_block_t *block);
+
+/** Decode the remaining elems of a record into the given block
+ *
+ * @param block         pointer to the block to populate
+ * @param record        pointer to the record to decode the elems of
+ * @return the number of elems in the block, or -1 if an error occurred
+ *
+ * The block is cleared first. The block holds the same elems that
+ * bgpstream_record_get_next_elem would have returned, and this function
+ * consumes the record's elems in the same way. However, the filters are
+ * evaluated column-wise once all of the elems have been decoded (except the
+ * community filter, which is checked as each elem is decoded).
+ */
+int bgpstream_elem_block_populate(bgpstream_elem_block_t *block,
+                                  bgpstream_record_t *record);
+
+/** @} */
+
+#endif /* __BGPSTREAM_ELEM_BLOCK_H */
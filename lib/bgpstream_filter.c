@@ -35,6 +35,8 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define TIF filter_mgr->time_interval
 
@@ -246,16 +248,67 @@ void bgpstream_filter_mgr_rib_period_filter_add(
 {
   bgpstream_log(BGPSTREAM_LOG_VFINE, "\tBSF_MGR:: add_filter start");
   assert(bs_filter_mgr != NULL);
-  if (period != 0 && bs_filter_mgr->last_processed_ts == NULL) {
-    if ((bs_filter_mgr->last_processed_ts = kh_init(collector_ts)) == NULL) {
+  if (period != 0 && bs_filter_mgr->rib_period_collectors == NULL) {
+    if ((bs_filter_mgr->rib_period_collectors =
+           bgpstream_collector_map_create()) == NULL) {
       bgpstream_log(BGPSTREAM_LOG_ERR,
-                    "\tBSF_MGR: can't allocate memory for collectortype map");
+                    "\tBSF_MGR: can't allocate memory for collector map");
+      return;
     }
   }
   bs_filter_mgr->rib_period = period;
   bgpstream_log(BGPSTREAM_LOG_VFINE, "\tBSF_MGR:: add_filter end");
 }
 
+int bgpstream_filter_mgr_rib_period_filter_check(
+  bgpstream_filter_mgr_t *bs_filter_mgr, const char *project,
+  const char *collector, bgpstream_record_type_t record_type,
+  uint32_t dump_time)
+{
+  bgpstream_collector_id_t id;
+  uint32_t *tmp;
+  int cnt;
+
+  if (record_type != BGPSTREAM_RIB || bs_filter_mgr->rib_period == 0 ||
+      bs_filter_mgr->rib_period_collectors == NULL) {
+    // its an updates dump or there is no rib period set
+    return 1;
+  }
+
+  if ((id = bgpstream_collector_map_get_id(
+         bs_filter_mgr->rib_period_collectors, project, collector)) == 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not get ID of collector %s.%s",
+                  project, collector);
+    // err on the side of reading the dump
+    return 1;
+  }
+
+  if (id > bs_filter_mgr->rib_period_last_cnt) {
+    cnt = bgpstream_collector_map_get_size(
+      bs_filter_mgr->rib_period_collectors);
+    if ((tmp = realloc(bs_filter_mgr->rib_period_last,
+                       sizeof(uint32_t) * cnt)) == NULL) {
+      return 1;
+    }
+    memset(&tmp[bs_filter_mgr->rib_period_last_cnt], 0,
+           sizeof(uint32_t) * (cnt - bs_filter_mgr->rib_period_last_cnt));
+    bs_filter_mgr->rib_period_last = tmp;
+    bs_filter_mgr->rib_period_last_cnt = cnt;
+  }
+
+  // a last time of 0 means that no rib has been accepted for this collector
+  if (bs_filter_mgr->rib_period_last[id - 1] != 0 &&
+      dump_time < bs_filter_mgr->rib_period_last[id - 1] +
+                    bs_filter_mgr->rib_period) {
+    // still within our period
+    return 0;
+  }
+
+  // we've found a rib we like!
+  bs_filter_mgr->rib_period_last[id - 1] = dump_time;
+  return 1;
+}
+
 void bgpstream_filter_mgr_interval_filter_add(
   bgpstream_filter_mgr_t *bs_filter_mgr, uint32_t begin_time, uint32_t end_time)
 {
@@ -279,6 +332,337 @@ void bgpstream_filter_mgr_interval_filter_add(
   bgpstream_log(BGPSTREAM_LOG_VFINE, "\tBSF_MGR:: add_filter stop");
 }
 
+static void prefix_index_add(bgpstream_patricia_tree_t *pt,
+                             bgpstream_patricia_node_t *node, void *data)
+{
+  bgpstream_filter_mgr_t *filter_mgr = (bgpstream_filter_mgr_t *)data;
+  bgpstream_pfx_t *pfx = bgpstream_patricia_tree_get_pfx(node);
+
+  if (pfx->allowed_matches == BGPSTREAM_PREFIX_MATCH_ANY ||
+      pfx->allowed_matches == BGPSTREAM_PREFIX_MATCH_MORE) {
+    bgpstream_patricia_tree_insert(filter_mgr->prefixes_more, pfx);
+  }
+  if (pfx->allowed_matches == BGPSTREAM_PREFIX_MATCH_ANY ||
+      pfx->allowed_matches == BGPSTREAM_PREFIX_MATCH_LESS) {
+    filter_mgr->prefixes_less = 1;
+  }
+}
+
+/* Index the prefixes that match their more specifics. An elem prefix is
+ * covered by one of them iff it is covered by one of the least specific ones,
+ * which do not overlap, so a single longest prefix match tells */
+static int build_prefix_index(bgpstream_filter_mgr_t *filter_mgr)
+{
+  bgpstream_patricia_tree_t *least = NULL;
+  bgpstream_patricia_tree_result_set_t *res = NULL;
+  bgpstream_patricia_node_t *node;
+  bgpstream_addr_version_t versions[] = {BGPSTREAM_ADDR_VERSION_IPV4,
+                                         BGPSTREAM_ADDR_VERSION_IPV6};
+  int i;
+
+  if (filter_mgr->prefixes_more == NULL &&
+      (filter_mgr->prefixes_more = bgpstream_patricia_tree_create(NULL)) ==
+        NULL) {
+    goto err;
+  }
+  if (filter_mgr->prefixes_more_lpm == NULL &&
+      (filter_mgr->prefixes_more_lpm = bgpstream_lpm_create()) == NULL) {
+    goto err;
+  }
+  if ((least = bgpstream_patricia_tree_create(NULL)) == NULL ||
+      (res = bgpstream_patricia_tree_result_set_create()) == NULL) {
+    goto err;
+  }
+
+  /* collect all the "more" prefixes, and then keep the least specific ones */
+  bgpstream_patricia_tree_clear(filter_mgr->prefixes_more);
+  filter_mgr->prefixes_less = 0;
+  bgpstream_patricia_tree_walk(filter_mgr->prefixes, prefix_index_add,
+                               filter_mgr);
+
+  for (i = 0; i < 2; i++) {
+    if (bgpstream_patricia_tree_get_minimum_coverage(
+          filter_mgr->prefixes_more, versions[i], res) != 0) {
+      goto err;
+    }
+    while ((node = bgpstream_patricia_tree_result_set_next(res)) != NULL) {
+      if (bgpstream_patricia_tree_insert(
+            least, bgpstream_patricia_tree_get_pfx(node)) == NULL) {
+        goto err;
+      }
+    }
+  }
+  bgpstream_patricia_tree_destroy(filter_mgr->prefixes_more);
+  filter_mgr->prefixes_more = least;
+  least = NULL;
+
+  if (bgpstream_lpm_build(filter_mgr->prefixes_more_lpm,
+                          filter_mgr->prefixes_more) != 0) {
+    goto err;
+  }
+
+  bgpstream_patricia_tree_result_set_destroy(&res);
+  return 0;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Could not build the prefix filter index");
+  bgpstream_patricia_tree_result_set_destroy(&res);
+  bgpstream_patricia_tree_destroy(least);
+  /* the elem filter falls back to searching the patricia tree */
+  bgpstream_lpm_destroy(filter_mgr->prefixes_more_lpm);
+  filter_mgr->prefixes_more_lpm = NULL;
+  return -1;
+}
+
+/* Freeze the ASN sets, which are probed for every elem, into bitmaps. If this
+ * fails, the elem filter falls back to the ID sets */
+static void build_asn_index(bgpstream_filter_mgr_t *filter_mgr)
+{
+  bgpstream_id_bitmap_destroy(filter_mgr->peer_asns_bm);
+  filter_mgr->peer_asns_bm = NULL;
+  bgpstream_id_bitmap_destroy(filter_mgr->origin_asns_bm);
+  filter_mgr->origin_asns_bm = NULL;
+
+  if (filter_mgr->peer_asns != NULL &&
+      (filter_mgr->peer_asns_bm =
+         bgpstream_id_bitmap_create_from_set(filter_mgr->peer_asns)) == NULL) {
+    goto err;
+  }
+  if (filter_mgr->origin_asns != NULL &&
+      (filter_mgr->origin_asns_bm = bgpstream_id_bitmap_create_from_set(
+         filter_mgr->origin_asns)) == NULL) {
+    goto err;
+  }
+  return;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_WARN,
+                "Could not build the ASN filter index, using the ASN sets");
+  bgpstream_id_bitmap_destroy(filter_mgr->peer_asns_bm);
+  filter_mgr->peer_asns_bm = NULL;
+  bgpstream_id_bitmap_destroy(filter_mgr->origin_asns_bm);
+  filter_mgr->origin_asns_bm = NULL;
+}
+
+static void destroy_community_index(bgpstream_filter_mgr_t *filter_mgr)
+{
+  bgpstream_id_bitmap_destroy(filter_mgr->communities_exact);
+  filter_mgr->communities_exact = NULL;
+  bgpstream_id_bitmap_destroy(filter_mgr->communities_asn);
+  filter_mgr->communities_asn = NULL;
+  bgpstream_id_bitmap_destroy(filter_mgr->communities_value);
+  filter_mgr->communities_value = NULL;
+  filter_mgr->communities_any = 0;
+}
+
+/* Split the community filters by kind, so that each community of an elem can
+ * be checked against all the filters with three lookups */
+static int build_community_index(bgpstream_filter_mgr_t *filter_mgr)
+{
+  bgpstream_community_filter_t *cf = filter_mgr->communities;
+  bgpstream_community_t *c;
+  uint32_t *exact = NULL, *asn = NULL, *value = NULL;
+  int exact_cnt = 0, asn_cnt = 0, value_cnt = 0;
+  khiter_t k;
+
+  destroy_community_index(filter_mgr);
+
+  if ((exact = malloc(sizeof(uint32_t) * (kh_size(cf) + 1))) == NULL ||
+      (asn = malloc(sizeof(uint32_t) * (kh_size(cf) + 1))) == NULL ||
+      (value = malloc(sizeof(uint32_t) * (kh_size(cf) + 1))) == NULL) {
+    goto err;
+  }
+
+  for (k = kh_begin(cf); k != kh_end(cf); ++k) {
+    if (!kh_exist(cf, k)) {
+      continue;
+    }
+    c = &kh_key(cf, k);
+    switch (kh_value(cf, k)) {
+    case BGPSTREAM_COMMUNITY_FILTER_EXACT:
+      exact[exact_cnt++] = ((uint32_t)c->asn << 16) | c->value;
+      break;
+    case BGPSTREAM_COMMUNITY_FILTER_ASN:
+      asn[asn_cnt++] = c->asn;
+      break;
+    case BGPSTREAM_COMMUNITY_FILTER_VALUE:
+      value[value_cnt++] = c->value;
+      break;
+    default:
+      filter_mgr->communities_any = 1;
+      break;
+    }
+  }
+
+  if ((exact_cnt > 0 && (filter_mgr->communities_exact =
+                           bgpstream_id_bitmap_create(exact, exact_cnt)) ==
+                          NULL) ||
+      (asn_cnt > 0 && (filter_mgr->communities_asn =
+                         bgpstream_id_bitmap_create(asn, asn_cnt)) == NULL) ||
+      (value_cnt > 0 && (filter_mgr->communities_value =
+                           bgpstream_id_bitmap_create(value, value_cnt)) ==
+                          NULL)) {
+    goto err;
+  }
+
+  free(exact);
+  free(asn);
+  free(value);
+  return 0;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Could not build the community filter index");
+  free(exact);
+  free(asn);
+  free(value);
+  destroy_community_index(filter_mgr);
+  return -1;
+}
+
+static void destroy_aspath_res(bgpstream_filter_mgr_t *filter_mgr)
+{
+  int i;
+
+  for (i = 0; i < filter_mgr->aspath_res_cnt; i++) {
+    regfree(&filter_mgr->aspath_res[i].re);
+  }
+  free(filter_mgr->aspath_res);
+  filter_mgr->aspath_res = NULL;
+  filter_mgr->aspath_res_cnt = 0;
+}
+
+/* Compile the AS path expressions once, rather than for every elem. A leading
+ * '!' negates the expression, and empty expressions are ignored. */
+static int build_aspath_res(bgpstream_filter_mgr_t *filter_mgr)
+{
+  bgpstream_filter_aspath_re_t *are;
+  char *regexstr;
+  char errbuf[256];
+  int rc;
+
+  destroy_aspath_res(filter_mgr);
+
+  if ((filter_mgr->aspath_res =
+         malloc_zero(sizeof(bgpstream_filter_aspath_re_t) *
+                     bgpstream_str_set_size(filter_mgr->aspath_exprs))) ==
+      NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not allocate AS path filters");
+    return -1;
+  }
+
+  bgpstream_str_set_rewind(filter_mgr->aspath_exprs);
+  while ((regexstr = bgpstream_str_set_next(filter_mgr->aspath_exprs)) !=
+         NULL) {
+    if (strlen(regexstr) == 0) {
+      continue;
+    }
+    are = &filter_mgr->aspath_res[filter_mgr->aspath_res_cnt];
+    if (*regexstr == '!') {
+      are->negate = 1;
+      regexstr++;
+    }
+    if ((rc = regcomp(&are->re, regexstr, 0)) != 0) {
+      regerror(rc, &are->re, errbuf, sizeof(errbuf));
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid AS path regex '%s': %s",
+                    regexstr, errbuf);
+      destroy_aspath_res(filter_mgr);
+      return -1;
+    }
+    filter_mgr->aspath_res_cnt++;
+  }
+
+  return 0;
+}
+
+static void program_add(bgpstream_filter_mgr_t *filter_mgr,
+                        bgpstream_filter_op_type_t type, uint32_t cost)
+{
+  bgpstream_filter_op_t *op = &filter_mgr->program[filter_mgr->program_len++];
+  op->type = type;
+  op->cost = cost;
+  op->evaluated = 0;
+  op->passed = 0;
+}
+
+/* Compile the configured elem filters into a program of predicates. The costs
+ * are rough estimates of the work done by each check, relative to comparing
+ * two integers. */
+static void build_program(bgpstream_filter_mgr_t *filter_mgr)
+{
+  filter_mgr->program_len = 0;
+  filter_mgr->program_runs = 0;
+
+  if (filter_mgr->elemtype_mask) {
+    program_add(filter_mgr, BGPSTREAM_FILTER_OP_ELEMTYPE, 1);
+  }
+  if (filter_mgr->ipversion) {
+    program_add(filter_mgr, BGPSTREAM_FILTER_OP_IPVERSION, 1);
+  }
+  if (filter_mgr->peer_asns != NULL) {
+    program_add(filter_mgr, BGPSTREAM_FILTER_OP_PEER_ASN, 2);
+  }
+  if (filter_mgr->origin_asns != NULL) {
+    program_add(filter_mgr, BGPSTREAM_FILTER_OP_ORIGIN_ASN, 4);
+  }
+  if (filter_mgr->communities != NULL) {
+    program_add(filter_mgr, BGPSTREAM_FILTER_OP_COMMUNITY, 4);
+  }
+  if (filter_mgr->prefixes != NULL) {
+    program_add(filter_mgr, BGPSTREAM_FILTER_OP_PREFIX, 8);
+  }
+  if (filter_mgr->aspath_res_cnt > 0) {
+    program_add(filter_mgr, BGPSTREAM_FILTER_OP_ASPATH, 50);
+  }
+}
+
+/* Expected cost of evaluating the predicate per elem it rejects (scaled to
+ * stay in integer arithmetic). The observed pass rate is smoothed, so that
+ * predicates that were rarely evaluated keep roughly their static order. */
+static uint64_t op_rank(const bgpstream_filter_op_t *op)
+{
+  uint64_t rejected = op->evaluated - op->passed;
+  return ((uint64_t)op->cost * (op->evaluated + 2) * 1024) / (rejected + 1);
+}
+
+void bgpstream_filter_mgr_program_reorder(bgpstream_filter_mgr_t *filter_mgr)
+{
+  bgpstream_filter_op_t tmp;
+  int i, j;
+
+  /* the program is tiny: insertion sort, stable so that ties keep their
+   * current order */
+  for (i = 1; i < filter_mgr->program_len; i++) {
+    tmp = filter_mgr->program[i];
+    for (j = i;
+         j > 0 && op_rank(&filter_mgr->program[j - 1]) > op_rank(&tmp); j--) {
+      filter_mgr->program[j] = filter_mgr->program[j - 1];
+    }
+    filter_mgr->program[j] = tmp;
+  }
+}
+
+const char *bgpstream_filter_mgr_op_name(bgpstream_filter_op_type_t type)
+{
+  switch (type) {
+  case BGPSTREAM_FILTER_OP_ELEMTYPE:
+    return "elemtype";
+  case BGPSTREAM_FILTER_OP_PEER_ASN:
+    return "peer";
+  case BGPSTREAM_FILTER_OP_ORIGIN_ASN:
+    return "origin";
+  case BGPSTREAM_FILTER_OP_IPVERSION:
+    return "ipversion";
+  case BGPSTREAM_FILTER_OP_PREFIX:
+    return "prefix";
+  case BGPSTREAM_FILTER_OP_ASPATH:
+    return "aspath";
+  case BGPSTREAM_FILTER_OP_COMMUNITY:
+    return "community";
+  default:
+    return "unknown";
+  }
+}
+
 int bgpstream_filter_mgr_validate(bgpstream_filter_mgr_t *filter_mgr)
 {
   /* currently we only validate the interval */
@@ -291,6 +675,23 @@ int bgpstream_filter_mgr_validate(bgpstream_filter_mgr_t *filter_mgr)
     return -1;
   }
 
+  if (filter_mgr->prefixes != NULL && build_prefix_index(filter_mgr) != 0) {
+    return -1;
+  }
+
+  build_asn_index(filter_mgr);
+
+  if (filter_mgr->communities != NULL &&
+      build_community_index(filter_mgr) != 0) {
+    return -1;
+  }
+
+  if (filter_mgr->aspath_exprs != NULL && build_aspath_res(filter_mgr) != 0) {
+    return -1;
+  }
+
+  build_program(filter_mgr);
+
   return 0;
 }
 
@@ -302,7 +703,6 @@ void bgpstream_filter_mgr_destroy(bgpstream_filter_mgr_t *bs_filter_mgr)
     return; // nothing to destroy
   }
   // destroying filters
-  khiter_t k;
   // projects
   if (bs_filter_mgr->projects != NULL) {
     bgpstream_str_set_destroy(bs_filter_mgr->projects);
@@ -327,15 +727,23 @@ void bgpstream_filter_mgr_destroy(bgpstream_filter_mgr_t *bs_filter_mgr)
   if (bs_filter_mgr->origin_asns != NULL) {
     bgpstream_id_set_destroy(bs_filter_mgr->origin_asns);
   }
+  bgpstream_id_bitmap_destroy(bs_filter_mgr->peer_asns_bm);
+  bgpstream_id_bitmap_destroy(bs_filter_mgr->origin_asns_bm);
   // aspath expressions
   if (bs_filter_mgr->aspath_exprs != NULL) {
     bgpstream_str_set_destroy(bs_filter_mgr->aspath_exprs);
   }
+  destroy_aspath_res(bs_filter_mgr);
   // prefixes
   if (bs_filter_mgr->prefixes != NULL) {
     bgpstream_patricia_tree_destroy(bs_filter_mgr->prefixes);
   }
+  bgpstream_lpm_destroy(bs_filter_mgr->prefixes_more_lpm);
+  if (bs_filter_mgr->prefixes_more != NULL) {
+    bgpstream_patricia_tree_destroy(bs_filter_mgr->prefixes_more);
+  }
   // communities
+  destroy_community_index(bs_filter_mgr);
   if (bs_filter_mgr->communities != NULL) {
     kh_destroy(bgpstream_community_filter, bs_filter_mgr->communities);
   }
@@ -344,15 +752,8 @@ void bgpstream_filter_mgr_destroy(bgpstream_filter_mgr_t *bs_filter_mgr)
     free(bs_filter_mgr->time_interval);
   }
   // rib/update frequency
-  if (bs_filter_mgr->last_processed_ts != NULL) {
-    for (k = kh_begin(bs_filter_mgr->last_processed_ts);
-         k != kh_end(bs_filter_mgr->last_processed_ts); ++k) {
-      if (kh_exist(bs_filter_mgr->last_processed_ts, k)) {
-        free(kh_key(bs_filter_mgr->last_processed_ts, k));
-      }
-    }
-    kh_destroy(collector_ts, bs_filter_mgr->last_processed_ts);
-  }
+  bgpstream_collector_map_destroy(bs_filter_mgr->rib_period_collectors);
+  free(bs_filter_mgr->rib_period_last);
   // free the mgr structure
   free(bs_filter_mgr);
   bs_filter_mgr = NULL;
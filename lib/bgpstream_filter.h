@@ -35,6 +35,7 @@
 #include "bgpstream.h"
 #include "bgpstream_constants.h"
 #include "khash.h"
+#include <regex.h>
 
 #define BGPSTREAM_FILTER_ELEM_TYPE_RIB 0x1
 #define BGPSTREAM_FILTER_ELEM_TYPE_ANNOUNCEMENT 0x2
@@ -52,10 +53,38 @@ typedef struct struct_bgpstream_interval_filter_t {
   uint32_t end_time;
 } bgpstream_interval_filter_t;
 
-KHASH_INIT(collector_ts, char *, uint32_t, 1, kh_str_hash_func,
-           kh_str_hash_equal);
+/** Number of elem filter program runs between two reorderings of its
+ * predicates */
+#define BGPSTREAM_FILTER_PROGRAM_REORDER_RUNS 4096
 
-typedef khash_t(collector_ts) collector_ts_t;
+/* kinds of elem filter predicates */
+typedef enum {
+  BGPSTREAM_FILTER_OP_ELEMTYPE = 0,
+  BGPSTREAM_FILTER_OP_PEER_ASN,
+  BGPSTREAM_FILTER_OP_ORIGIN_ASN,
+  BGPSTREAM_FILTER_OP_IPVERSION,
+  BGPSTREAM_FILTER_OP_PREFIX,
+  BGPSTREAM_FILTER_OP_ASPATH,
+  BGPSTREAM_FILTER_OP_COMMUNITY,
+  BGPSTREAM_FILTER_OP_CNT,
+} bgpstream_filter_op_type_t;
+
+/* one predicate of the elem filter program */
+typedef struct struct_bgpstream_filter_op_t {
+  bgpstream_filter_op_type_t type;
+  /* estimated relative cost of one evaluation */
+  uint32_t cost;
+  /* number of elems the predicate was evaluated on, and passed */
+  uint64_t evaluated;
+  uint64_t passed;
+} bgpstream_filter_op_t;
+
+/* compiled AS path expression */
+typedef struct struct_bgpstream_filter_aspath_re_t {
+  regex_t re;
+  /* set if the path must NOT match the expression */
+  uint8_t negate;
+} bgpstream_filter_aspath_re_t;
 
 typedef struct struct_bgpstream_filter_mgr_t {
   bgpstream_str_set_t *projects;
@@ -63,15 +92,48 @@ typedef struct struct_bgpstream_filter_mgr_t {
   bgpstream_str_set_t *routers;
   bgpstream_str_set_t *bgp_types;
   bgpstream_str_set_t *aspath_exprs;
+  /* compiled AS path expressions (built by validate) */
+  bgpstream_filter_aspath_re_t *aspath_res;
+  int aspath_res_cnt;
   bgpstream_id_set_t *peer_asns;
   bgpstream_id_set_t *origin_asns;
+  /* read-only copies of the ASN sets (built by validate) */
+  bgpstream_id_bitmap_t *peer_asns_bm;
+  bgpstream_id_bitmap_t *origin_asns_bm;
   bgpstream_patricia_tree_t *prefixes;
+  /* least specific of the "more" and "any" prefixes (built by validate) */
+  bgpstream_patricia_tree_t *prefixes_more;
+  bgpstream_lpm_t *prefixes_more_lpm;
+  /* set if there are "less" or "any" prefixes */
+  uint8_t prefixes_less;
   bgpstream_community_filter_t *communities;
+  /* community filters by kind (built by validate): exact communities (as
+   * asn << 16 | value), ASNs of asn:* filters, values of *:value filters, and
+   * whether there is a *:* filter */
+  bgpstream_id_bitmap_t *communities_exact;
+  bgpstream_id_bitmap_t *communities_asn;
+  bgpstream_id_bitmap_t *communities_value;
+  uint8_t communities_any;
   bgpstream_interval_filter_t *time_interval;
-  collector_ts_t *last_processed_ts;
+  /* RIB period filter: the time of the last RIB dump accepted from each
+   * collector, indexed by the ID of the collector (0 if none yet) */
+  bgpstream_collector_map_t *rib_period_collectors;
+  uint32_t *rib_period_last;
+  int rib_period_last_cnt;
   uint32_t rib_period;
   uint8_t ipversion;
   uint8_t elemtype_mask;
+  /* elem filter program (built by validate): the predicates that are
+   * configured, in evaluation order. the statistics are updated and the
+   * program reordered only by the thread that owns the stream; detached
+   * records use a copy of the order (see bgpstream_record_internal) */
+  bgpstream_filter_op_t program[BGPSTREAM_FILTER_OP_CNT];
+  int program_len;
+  uint64_t program_runs;
+  /* set if the stream statistics should be timed (see
+   * bgpstream_set_stats_timing). it is kept here since the filter manager is
+   * the per-stream state shared by all the readers and formats */
+  int stats_timing;
 } bgpstream_filter_mgr_t;
 
 /* allocate memory for a new bgpstream filter */
@@ -85,6 +147,15 @@ void bgpstream_filter_mgr_filter_add(bgpstream_filter_mgr_t *bs_filter_mgr,
 void bgpstream_filter_mgr_rib_period_filter_add(
   bgpstream_filter_mgr_t *bs_filter_mgr, uint32_t period);
 
+/* check if a dump passes the RIB period filter (i.e., it is an updates dump,
+ * or it is the first RIB dump of its collector at least rib_period seconds
+ * after the last one accepted), in which case it becomes the last one
+ * accepted for its collector. returns 1 if the dump passes, 0 if not */
+int bgpstream_filter_mgr_rib_period_filter_check(
+  bgpstream_filter_mgr_t *bs_filter_mgr, const char *project,
+  const char *collector, bgpstream_record_type_t record_type,
+  uint32_t dump_time);
+
 void bgpstream_filter_mgr_interval_filter_add(
   bgpstream_filter_mgr_t *bs_filter_mgr, uint32_t begin_time,
   uint32_t end_time);
@@ -92,6 +163,13 @@ void bgpstream_filter_mgr_interval_filter_add(
 /* validate the current filters */
 int bgpstream_filter_mgr_validate(bgpstream_filter_mgr_t *mgr);
 
+/* reorder the elem filter program so that the predicates that reject the most
+ * elems per unit of cost are evaluated first */
+void bgpstream_filter_mgr_program_reorder(bgpstream_filter_mgr_t *filter_mgr);
+
+/* get the name of an elem filter predicate */
+const char *bgpstream_filter_mgr_op_name(bgpstream_filter_op_type_t type);
+
 /* destroy the memory allocated for bgpstream filter */
 void bgpstream_filter_mgr_destroy(bgpstream_filter_mgr_t *bs_filter_mgr);
 
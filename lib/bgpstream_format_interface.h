@@ -146,6 +146,11 @@ struct bgpstream_format {
   /** An opaque pointer to format-specific state if needed */
   void *state;
 
+  /** Counters and timers of the work done by this format instance (the
+      names and the resource and record counts are filled in by the
+      reader) */
+  bgpstream_stats_t stats;
+
   /** }@ */
 };
 
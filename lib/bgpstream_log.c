@@ -25,50 +25,276 @@
  */
 
 #include "bgpstream_log.h"
+#include "config.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <time.h>
-#include <unistd.h> // getpid()
+#include <unistd.h> // getpid(), write()
 
-void bgpstream_log_func(int level, const char *file, int line, const char *fmt,
-                        ...)
+/* maximum length of a single message */
+#define LOG_MSG_LEN 4096
+
+/* size of the per-thread output buffer */
+#define LOG_BUF_LEN (4 * LOG_MSG_LEN)
+
+/* per-thread state of the default (stderr) writer */
+struct log_buf {
+  /* messages that have not yet been written */
+  char buf[LOG_BUF_LEN];
+  size_t len;
+
+  /* when the first message in the buffer was written */
+  time_t buf_time;
+
+  /* timestamp and pid prefix, refreshed once per second */
+  time_t prefix_time;
+  char prefix[64];
+};
+
+int bgpstream_log_level = BGPSTREAM_LOG_LEVEL;
+
+static int log_rate_limit = BGPSTREAM_LOG_RATE_LIMIT_DEFAULT;
+
+static bgpstream_log_sink_t *log_sink = NULL;
+static void *log_sink_user = NULL;
+
+static __thread struct log_buf *thread_buf = NULL;
+static pthread_key_t buf_key;
+static pthread_once_t buf_key_once = PTHREAD_ONCE_INIT;
+
+static void buf_flush(struct log_buf *b)
+{
+  size_t written = 0;
+  ssize_t rc;
+
+  while (written < b->len) {
+    if ((rc = write(STDERR_FILENO, b->buf + written, b->len - written)) < 0 &&
+        errno == EINTR) {
+      continue;
+    }
+    if (rc <= 0) {
+      // nowhere left to report this
+      break;
+    }
+    written += rc;
+  }
+  b->len = 0;
+}
+
+// called when a thread that has logged exits
+static void buf_destroy(void *user)
+{
+  struct log_buf *b = (struct log_buf *)user;
+
+  buf_flush(b);
+  free(b);
+  thread_buf = NULL;
+}
+
+// the main thread does not run key destructors when the process exits
+static void buf_flush_at_exit(void)
+{
+  if (thread_buf != NULL) {
+    buf_flush(thread_buf);
+  }
+}
+
+static void buf_key_create(void)
+{
+  pthread_key_create(&buf_key, buf_destroy);
+  atexit(buf_flush_at_exit);
+}
+
+static struct log_buf *get_buf(void)
+{
+  if (thread_buf == NULL) {
+    pthread_once(&buf_key_once, buf_key_create);
+    if ((thread_buf = calloc(1, sizeof(struct log_buf))) == NULL) {
+      return NULL;
+    }
+    pthread_setspecific(buf_key, thread_buf);
+  }
+  return thread_buf;
+}
+
+static const char *level_name(int level)
+{
+  return (level <= BGPSTREAM_LOG_ERR)
+           ? "ERROR: "
+           : (level <= BGPSTREAM_LOG_WARN)
+               ? "WARNING: "
+               : (level <= BGPSTREAM_LOG_INFO)
+                   ? "INFO: "
+                   : (level <= BGPSTREAM_LOG_CONFIG)
+                       ? "CONFIG: "
+                       : (level <= BGPSTREAM_LOG_FINE)
+                           ? "FINE: "
+                           : (level <= BGPSTREAM_LOG_VFINE)
+                               ? "VERYFINE: "
+                               : (level <= BGPSTREAM_LOG_FINEST) ? "FINEST: "
+                                                                 : "";
+}
+
+static void format_prefix(char *buf, size_t len, time_t t)
+{
+  struct tm tm;
+  size_t n;
+
+  localtime_r(&t, &tm);
+  n = strftime(buf, len, "%Y-%m-%d %H:%M:%S", &tm);
+  snprintf(buf + n, len - n, " %u: ", getpid());
+}
+
+/* Decide whether the given statement may write a message now. Returns -1 if
+ * the message should be suppressed, or else the number of messages that were
+ * suppressed since the statement last wrote one. The counters are updated
+ * without locks, so with concurrent writers the limit is approximate. Errors
+ * are not checked. */
+static int64_t rate_check(bgpstream_log_site_t *site, uint32_t now)
+{
+  uint32_t limit = __atomic_load_n(&log_rate_limit, __ATOMIC_RELAXED);
+  uint32_t window;
+
+  if (limit != 0) {
+    window = __atomic_load_n(&site->window, __ATOMIC_RELAXED);
+    if (window != now &&
+        __atomic_compare_exchange_n(&site->window, &window, now, 0,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      // this thread started a new window
+      __atomic_store_n(&site->cnt, 0, __ATOMIC_RELAXED);
+    }
+    if (__atomic_add_fetch(&site->cnt, 1, __ATOMIC_RELAXED) > limit) {
+      __atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED);
+      return -1;
+    }
+  }
+
+  return __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+}
+
+void bgpstream_log_func(bgpstream_log_site_t *site, int level,
+                        const char *file, int line, const char *fmt, ...)
 {
   va_list va_ap;
+  char msgbuf[LOG_MSG_LEN];
+  char prefix[64];
+  const char *pfx;
+  time_t t = time(NULL);
+  int64_t suppressed;
+  struct log_buf *b;
+  bgpstream_log_sink_t *sink;
+  size_t len;
+  int n;
 
-  // TODO: consider make this configurable via the public API
-  FILE *bgpstream_log_file = stderr;
+  // errors are never suppressed
+  if (level <= BGPSTREAM_LOG_ERR) {
+    suppressed = 0;
+  } else if ((suppressed = rate_check(site, (uint32_t)t)) < 0) {
+    return;
+  }
+
+  // formatting the time is expensive, so do it at most once per second
+  if ((b = get_buf()) != NULL) {
+    if (b->prefix_time != t || b->prefix[0] == '\0') {
+      format_prefix(b->prefix, sizeof(b->prefix), t);
+      b->prefix_time = t;
+    }
+    pfx = b->prefix;
+  } else {
+    format_prefix(prefix, sizeof(prefix), t);
+    pfx = prefix;
+  }
 
-  if (level <= BGPSTREAM_LOG_LEVEL) {
-    char msgbuf[4096];
+  n = snprintf(msgbuf, sizeof(msgbuf), "%s%s:%d: %s", pfx, file, line,
+               level_name(level));
+  len = (n < 0) ? 0 : (size_t)n;
+  if (len < sizeof(msgbuf)) {
     va_start(va_ap, fmt);
-    vsnprintf(msgbuf, sizeof(msgbuf) - 1, fmt, va_ap);
-    msgbuf[sizeof(msgbuf) - 1] = '\0';
+    n = vsnprintf(msgbuf + len, sizeof(msgbuf) - len, fmt, va_ap);
     va_end(va_ap);
+    len += (n < 0) ? 0 : (size_t)n;
+  }
+  if (suppressed > 0 && len < sizeof(msgbuf)) {
+    n = snprintf(msgbuf + len, sizeof(msgbuf) - len,
+                 " (%" PRIi64 " similar messages suppressed)", suppressed);
+    len += (n < 0) ? 0 : (size_t)n;
+  }
+  // leave room for the newline, truncating if needed
+  if (len > sizeof(msgbuf) - 2) {
+    len = sizeof(msgbuf) - 2;
+  }
+  msgbuf[len++] = '\n';
+  msgbuf[len] = '\0';
+
+  if ((sink = __atomic_load_n(&log_sink, __ATOMIC_ACQUIRE)) != NULL) {
+    sink(level, msgbuf, len, log_sink_user);
+    return;
+  }
+
+  if (b == NULL) {
+    // no buffer, write straight out
+    if (write(STDERR_FILENO, msgbuf, len) < 0) {
+      // nowhere left to report this
+    }
+    return;
+  }
 
-    char datebuf[32];
-    time_t t = time(NULL);
-    strftime(datebuf, sizeof(datebuf), "%Y-%m-%d %H:%M:%S", localtime(&t));
-
-    const char *prefix =
-      (level <= BGPSTREAM_LOG_ERR)
-        ? "ERROR: "
-        : (level <= BGPSTREAM_LOG_WARN)
-            ? "WARNING: "
-            : (level <= BGPSTREAM_LOG_INFO)
-                ? "INFO: "
-                : (level <= BGPSTREAM_LOG_CONFIG)
-                    ? "CONFIG: "
-                    : (level <= BGPSTREAM_LOG_FINE)
-                        ? "FINE: "
-                        : (level <= BGPSTREAM_LOG_VFINE)
-                            ? "VERYFINE: "
-                            : (level <= BGPSTREAM_LOG_FINEST) ? "FINEST: " : "";
-
-    fprintf(bgpstream_log_file, "%s %u: %s:%d: %s%s\n", datebuf, getpid(), file,
-            line, prefix, msgbuf);
-
-    fflush(bgpstream_log_file);
+  // don't hold on to messages logged in an earlier second. messages are also
+  // written out by bgpstream_log_flush, which the library calls before it
+  // returns to the user or sleeps, so a quiet thread does not keep them
+  if (b->len + len > LOG_BUF_LEN || b->buf_time != t) {
+    buf_flush(b);
+    b->buf_time = t;
   }
+  memcpy(b->buf + b->len, msgbuf, len);
+  b->len += len;
+
+  // errors and warnings are written out immediately, others are batched
+  if (level <= BGPSTREAM_LOG_WARN) {
+    buf_flush(b);
+  }
+}
+
+void bgpstream_log_flush(void)
+{
+  struct log_buf *b = thread_buf;
+
+  if (b != NULL && b->len > 0) {
+    buf_flush(b);
+  }
+}
+
+/* ========== PUBLIC API FUNCTIONS ========== */
+
+void bgpstream_set_log_level(int level)
+{
+  __atomic_store_n(&bgpstream_log_level, level, __ATOMIC_RELAXED);
+}
+
+int bgpstream_get_log_level(void)
+{
+  return __atomic_load_n(&bgpstream_log_level, __ATOMIC_RELAXED);
+}
+
+void bgpstream_set_log_sink(bgpstream_log_sink_t *sink, void *user)
+{
+  struct log_buf *b;
+
+  // anything already buffered by this thread should come out first
+  if (sink != NULL && (b = thread_buf) != NULL) {
+    buf_flush(b);
+  }
+  log_sink_user = user;
+  __atomic_store_n(&log_sink, sink, __ATOMIC_RELEASE);
+}
+
+void bgpstream_set_log_rate_limit(int msgs_per_sec)
+{
+  __atomic_store_n(&log_rate_limit, (msgs_per_sec < 0) ? 0 : msgs_per_sec,
+                   __ATOMIC_RELAXED);
 }
@@ -27,28 +27,49 @@
 #ifndef _BGPSTREAM_LOG_H
 #define _BGPSTREAM_LOG_H
 
+#include "bgpstream.h" /*< for the log levels */
 #include <stdarg.h>
+#include <stdint.h>
 
-#define BGPSTREAM_LOG_ERR 0
-#define BGPSTREAM_LOG_WARN 10
-#define BGPSTREAM_LOG_INFO 20
-#define BGPSTREAM_LOG_CONFIG 30
-#define BGPSTREAM_LOG_FINE 40
-#define BGPSTREAM_LOG_VFINE 50
-#define BGPSTREAM_LOG_FINEST 60
-
-// TODO: move this to configure (or even an API call)
+/** Default runtime log level (see bgpstream_set_log_level) */
 #define BGPSTREAM_LOG_LEVEL BGPSTREAM_LOG_INFO
 
+/** Rate limiting state of a single log statement */
+typedef struct bgpstream_log_site {
+
+  /** The second that the current rate limiting window started in */
+  uint32_t window;
+
+  /** The number of messages written in the current window */
+  uint32_t cnt;
+
+  /** The number of messages suppressed since the last one was written */
+  uint32_t suppressed;
+
+} bgpstream_log_site_t;
+
+/** The current runtime log level */
+extern int bgpstream_log_level;
+
+/** Log a message if the level is enabled. Each statement has its own rate
+    limiting state, so a message that floods does not suppress others. */
 #define bgpstream_log(level, ...)                                              \
   do {                                                                         \
-    if ((level) <= BGPSTREAM_LOG_LEVEL) {                                      \
-      bgpstream_log_func((level), __FILE__, __LINE__, __VA_ARGS__);            \
+    if ((level) <= bgpstream_log_level) {                                      \
+      static bgpstream_log_site_t bgpstream_log_site_;                         \
+      bgpstream_log_func(&bgpstream_log_site_, (level), __FILE__, __LINE__,    \
+                         __VA_ARGS__);                                         \
     }                                                                          \
   } while (0)
 
-void bgpstream_log_func(int level, const char *file, int line,
-                        const char *format, ...)
-  __attribute__((format(printf, 4, 5)));
+void bgpstream_log_func(bgpstream_log_site_t *site, int level,
+                        const char *file, int line, const char *format, ...)
+  __attribute__((format(printf, 5, 6)));
+
+/** Write out the messages buffered by the calling thread. Messages below
+    BGPSTREAM_LOG_WARN are batched per thread, so this is called before the
+    library returns to the user or sleeps, so that they are not held for
+    longer than the call that logged them. */
+void bgpstream_log_flush(void);
 
 #endif /* _BGPSTREAM_DEBUG_H */
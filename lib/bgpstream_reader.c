@@ -25,8 +25,10 @@
  */
 
 #include "bgpstream_reader.h"
+#include "bgpstream_format_interface.h"
 #include "bgpstream_record_int.h"
 #include "bgpstream_log.h"
+#include "bgpstream_stats.h"
 #include "utils.h"
 #include <assert.h>
 #include <pthread.h>
@@ -60,6 +62,16 @@ struct bgpstream_reader {
   // handle for the thread that will do the actual opening
   pthread_t opener_thread;
 
+  // the number of records returned by this reader
+  uint64_t records;
+
+  // time spent waiting for the opener thread (in nsec)
+  uint64_t open_wait_nsec;
+
+  // offset in the resource of the end of the last record returned (0 if
+  // unknown)
+  uint64_t offset;
+
   // ALL BELOW HERE MUST USE MUTEX
 
   // format instance
@@ -75,6 +87,19 @@ struct bgpstream_reader {
 
   // what is the time of the next record (PREFETCH)
   uint32_t next_time;
+
+  // records that have been detached and then released, ready to replace the
+  // next detached record
+  bgpstream_record_t **rec_pool;
+  int rec_pool_cnt;
+  int rec_pool_alloc_cnt;
+
+  // number of detached records that have not yet been released
+  int detached_cnt;
+
+  // set if the reader was destroyed while records were still detached. the
+  // format is kept until the last record is released.
+  int destroyed;
 };
 
 static int prefetch_record(bgpstream_reader_t *reader)
@@ -154,6 +179,38 @@ static int prepopulate_record(bgpstream_record_t *record,
   return 0;
 }
 
+static bgpstream_record_t *create_record(bgpstream_reader_t *reader)
+{
+  bgpstream_record_t *record;
+
+  if ((record = bgpstream_record_create(reader->format)) == NULL) {
+    return NULL;
+  }
+  record->__int->reader = reader;
+  if (prepopulate_record(record, reader->res) != 0) {
+    bgpstream_record_destroy(record);
+    return NULL;
+  }
+  return record;
+}
+
+// free everything that detached records may still depend on
+static void reader_free(bgpstream_reader_t *reader)
+{
+  int i;
+
+  for (i = 0; i < reader->rec_pool_cnt; i++) {
+    bgpstream_record_destroy(reader->rec_pool[i]);
+  }
+  free(reader->rec_pool);
+  reader->rec_pool = NULL;
+  reader->rec_pool_cnt = 0;
+
+  bgpstream_format_destroy(reader->format);
+
+  free(reader);
+}
+
 static void *threaded_opener(void *user)
 {
   bgpstream_reader_t *reader = (bgpstream_reader_t *)user;
@@ -185,9 +242,7 @@ static void *threaded_opener(void *user)
   } else {
     // create the pair of records
     for (i = 0; i < 2; i++) {
-      if ((reader->rec_buf[i] = bgpstream_record_create(reader->format)) ==
-            NULL ||
-          prepopulate_record(reader->rec_buf[i], reader->res) != 0) {
+      if ((reader->rec_buf[i] = create_record(reader)) == NULL) {
         reader->status = BGPSTREAM_FORMAT_CANT_OPEN_DUMP;
         break;
       }
@@ -255,22 +310,34 @@ void bgpstream_reader_destroy(bgpstream_reader_t *reader)
     reader->rec_buf[i] = NULL;
   }
 
-  bgpstream_format_destroy(reader->format);
+  // detached records still need the format to extract elems. this is normal
+  // when a batch or a taken record spans the end of the dump, so the reader
+  // is freed once the last of them is released
+  if (reader->detached_cnt > 0) {
+    reader->destroyed = 1;
+    return;
+  }
 
-  free(reader);
+  reader_free(reader);
 }
 
 int bgpstream_reader_open_wait(bgpstream_reader_t *reader)
 {
+  uint64_t start;
+
   if (reader->skip_dump_check != 0) {
     return 0;
   }
 
+  start = BGPSTREAM_STATS_TIMER_START(reader->filter_mgr);
+  // the dump may take a while to open
+  bgpstream_log_flush();
   pthread_mutex_lock(&reader->mutex);
   while (reader->dump_ready == 0) {
     pthread_cond_wait(&reader->dump_ready_cond, &reader->mutex);
   }
   pthread_mutex_unlock(&reader->mutex);
+  BGPSTREAM_STATS_TIMER_ADD(reader->open_wait_nsec, start);
 
   if (reader->status == BGPSTREAM_FORMAT_CANT_OPEN_DUMP) {
     return -1;
@@ -322,6 +389,104 @@ int bgpstream_reader_get_next_record(bgpstream_reader_t *reader,
   // we have something in our EXPORT record, so go ahead and copy that into the
   // user's record
   *record = reader->rec_buf[EXPORTED_IDX];
+  reader->records++;
+  reader->offset = (*record)->__int->offset;
 
   return BGPSTREAM_READER_STATUS_OK;
 }
+
+uint64_t bgpstream_reader_get_offset(bgpstream_reader_t *reader)
+{
+  return reader->offset;
+}
+
+void bgpstream_reader_add_stats(bgpstream_reader_t *reader,
+                                bgpstream_stats_t *stats)
+{
+  stats->resources++;
+  stats->records += reader->records;
+  stats->open_wait_nsec += reader->open_wait_nsec;
+
+  // until the open has been waited for, the format belongs to the opener
+  // thread
+  if (reader->skip_dump_check != 0 && reader->format != NULL) {
+    bgpstream_stats_add(stats, &reader->format->stats);
+  }
+}
+
+int bgpstream_reader_detach_record(bgpstream_record_t *record)
+{
+  bgpstream_reader_t *reader = record->__int->reader;
+  bgpstream_record_t *replacement;
+  int i;
+
+  if (reader == NULL || reader->destroyed) {
+    return -1;
+  }
+
+  if (record->__int->detached != 0) {
+    return -1;
+  }
+  for (i = 0; i < 2; i++) {
+    if (reader->rec_buf[i] == record) {
+      break;
+    }
+  }
+  if (i == 2) {
+    return -1;
+  }
+
+  if (reader->rec_pool_cnt > 0) {
+    replacement = reader->rec_pool[--reader->rec_pool_cnt];
+  } else if ((replacement = create_record(reader)) == NULL) {
+    return -1;
+  }
+
+  // the replacement takes over the buffer slot. it is cleared and populated
+  // by the next prefetch, exactly like the record it replaces.
+  reader->rec_buf[i] = replacement;
+  reader->detached_cnt++;
+  bgpstream_record_save_filter_program(record);
+  record->__int->detached = 1;
+
+  return 0;
+}
+
+void bgpstream_reader_release_record(bgpstream_record_t *record)
+{
+  bgpstream_reader_t *reader;
+  bgpstream_record_t **pool;
+
+  if (record == NULL) {
+    return;
+  }
+  reader = record->__int->reader;
+  assert(reader != NULL && reader->detached_cnt > 0);
+  assert(record->__int->detached != 0);
+  reader->detached_cnt--;
+  record->__int->detached = 0;
+
+  if (reader->destroyed) {
+    bgpstream_record_destroy(record);
+    if (reader->detached_cnt == 0) {
+      reader_free(reader);
+    }
+    return;
+  }
+
+  // release the format data now rather than when the record is re-used
+  bgpstream_record_clear(record);
+
+  if (reader->rec_pool_cnt == reader->rec_pool_alloc_cnt) {
+    if ((pool = realloc(reader->rec_pool, sizeof(bgpstream_record_t *) *
+                                            (reader->rec_pool_alloc_cnt + 8))) ==
+        NULL) {
+      // we can always just destroy it
+      bgpstream_record_destroy(record);
+      return;
+    }
+    reader->rec_pool = pool;
+    reader->rec_pool_alloc_cnt += 8;
+  }
+  reader->rec_pool[reader->rec_pool_cnt++] = record;
+}
@@ -82,4 +82,46 @@ bgpstream_reader_status_t
 bgpstream_reader_get_next_record(bgpstream_reader_t *reader,
                                  bgpstream_record_t **record);
 
+/** Get the position of the reader within its resource
+ *
+ * @param reader        pointer to a reader instance
+ * @return the offset (in bytes of the decoded stream) of the end of the last
+ * record returned by the reader, 0 if no record has been returned or the
+ * format does not track offsets
+ *
+ * If the resource is re-opened with its resume_offset set to this value,
+ * reading continues with the record that follows.
+ */
+uint64_t bgpstream_reader_get_offset(bgpstream_reader_t *reader);
+
+/** Add the statistics of the given reader to the given structure
+ *
+ * @param reader        pointer to a reader instance
+ * @param stats         pointer to the structure to add to
+ *
+ * Format-level counters are only available once the reader has been waited
+ * on using bgpstream_reader_open_wait. The names are not changed.
+ */
+void bgpstream_reader_add_stats(bgpstream_reader_t *reader,
+                                bgpstream_stats_t *stats);
+
+/** Take ownership of a record returned by bgpstream_reader_get_next_record
+ *
+ * @param record        pointer to the record to detach
+ * @return 0 if the record was detached, -1 otherwise
+ *
+ * The reader replaces the record with one from its pool (or a new one), so the
+ * detached record is not overwritten by subsequent reads. It must be given
+ * back using bgpstream_reader_release_record. If the reader is destroyed while
+ * it has detached records, the format module is kept alive until the last of
+ * them is released.
+ */
+int bgpstream_reader_detach_record(bgpstream_record_t *record);
+
+/** Return a detached record to the reader that created it
+ *
+ * @param record        pointer to the record to release
+ */
+void bgpstream_reader_release_record(bgpstream_record_t *record);
+
 #endif /* __BGPSTREAM_READER_H */
@@ -34,12 +34,16 @@
 #include "bgpstream_format_interface.h" //< to access filter mgr
 #include "bgpstream_int.h"
 #include "bgpstream_log.h"
+#include "bgpstream_reader.h"
+#include "bgpstream_stats.h"
+#include "bgpstream_utils_fmt.h"
 #include "utils.h"
 #include <assert.h>
 #include <inttypes.h>
 #include <regex.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 bgpstream_record_t *bgpstream_record_create(bgpstream_format_t *format)
 {
@@ -61,12 +65,19 @@ bgpstream_record_t *bgpstream_record_create(bgpstream_format_t *format)
 
 void bgpstream_record_destroy(bgpstream_record_t *record)
 {
+  int i;
+
   if (record == NULL) {
     return;
   }
 
   bgpstream_format_destroy_data(record);
 
+  for (i = 0; i < record->__int->elem_batch_alloc_cnt; i++) {
+    bgpstream_elem_destroy(record->__int->elem_batch[i]);
+  }
+  free(record->__int->elem_batch);
+
   free(record->__int);
   free(record);
 }
@@ -81,6 +92,8 @@ void bgpstream_record_clear(bgpstream_record_t *record)
   // reset the record timestamps
   record->time_sec = 0;
   record->time_usec = 0;
+
+  record->__int->offset = 0;
 }
 
 void bgpstream_record_print_mrt_data(bgpstream_record_t *const record)
@@ -89,10 +102,10 @@ void bgpstream_record_print_mrt_data(bgpstream_record_t *const record)
   // bgpdump_print_entry(record->bd_entry);
 }
 
-static int bgpstream_elem_prefix_match(bgpstream_patricia_tree_t *prefixes,
+static int bgpstream_elem_prefix_match(bgpstream_filter_mgr_t *filter_mgr,
                                        bgpstream_pfx_t *search)
 {
-
+  bgpstream_patricia_tree_t *prefixes = filter_mgr->prefixes;
   bgpstream_patricia_tree_result_set_t *res = NULL;
   bgpstream_patricia_node_t *it;
   int matched = 0;
@@ -102,20 +115,38 @@ static int bgpstream_elem_prefix_match(bgpstream_patricia_tree_t *prefixes,
     return 1;
   }
 
+  /* Check for less specific prefixes that have the "MORE" match flag: only
+   * the least specific ones are indexed, and they do not overlap, so the
+   * longest match for the address is the only candidate */
+  if (filter_mgr->prefixes_more_lpm != NULL) {
+    it = bgpstream_lpm_lookup(filter_mgr->prefixes_more_lpm, &search->address);
+    if (it != NULL &&
+        bgpstream_patricia_tree_get_pfx(it)->mask_len <= search->mask_len) {
+      return 1;
+    }
+    if (filter_mgr->prefixes_less == 0) {
+      /* no need to look for more specifics */
+      return 0;
+    }
+  }
+
   bgpstream_patricia_node_t *n =
     bgpstream_patricia_tree_insert(prefixes, search);
 
-  /* Check for less specific prefixes that have the "MORE" match flag */
   res = bgpstream_patricia_tree_result_set_create();
-  bgpstream_patricia_tree_get_less_specifics(prefixes, n, res);
 
-  while ((it = bgpstream_patricia_tree_result_set_next(res)) != NULL) {
-    bgpstream_pfx_t *pfx = bgpstream_patricia_tree_get_pfx(it);
+  if (filter_mgr->prefixes_more_lpm == NULL) {
+    /* Check for less specific prefixes that have the "MORE" match flag */
+    bgpstream_patricia_tree_get_less_specifics(prefixes, n, res);
 
-    if (pfx->allowed_matches == BGPSTREAM_PREFIX_MATCH_ANY ||
-        pfx->allowed_matches == BGPSTREAM_PREFIX_MATCH_MORE) {
-      matched = 1;
-      goto endmatch;
+    while ((it = bgpstream_patricia_tree_result_set_next(res)) != NULL) {
+      bgpstream_pfx_t *pfx = bgpstream_patricia_tree_get_pfx(it);
+
+      if (pfx->allowed_matches == BGPSTREAM_PREFIX_MATCH_ANY ||
+          pfx->allowed_matches == BGPSTREAM_PREFIX_MATCH_MORE) {
+        matched = 1;
+        goto endmatch;
+      }
     }
   }
 
@@ -139,176 +170,317 @@ endmatch:
   return matched;
 }
 
-static int elem_check_filters(bgpstream_record_t *record,
-                              bgpstream_elem_t *elem)
+/* Elem filter predicates. Each returns 1 if the elem passes the predicate, 0
+ * otherwise. */
+
+static int check_elemtype(bgpstream_filter_mgr_t *filter_mgr,
+                          bgpstream_elem_t *elem)
 {
-  bgpstream_filter_mgr_t *filter_mgr = record->__int->format->filter_mgr;
-  int pass = 0;
+  switch (elem->type) {
+  case BGPSTREAM_ELEM_TYPE_PEERSTATE:
+    return !!(filter_mgr->elemtype_mask & BGPSTREAM_FILTER_ELEM_TYPE_PEERSTATE);
+  case BGPSTREAM_ELEM_TYPE_RIB:
+    return !!(filter_mgr->elemtype_mask & BGPSTREAM_FILTER_ELEM_TYPE_RIB);
+  case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
+    return !!(filter_mgr->elemtype_mask &
+              BGPSTREAM_FILTER_ELEM_TYPE_ANNOUNCEMENT);
+  case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
+    return !!(filter_mgr->elemtype_mask &
+              BGPSTREAM_FILTER_ELEM_TYPE_WITHDRAWAL);
+  default:
+    return 1;
+  }
+}
 
-  /* First up, check if this element is the right type */
-  if (filter_mgr->elemtype_mask) {
+static int check_peer_asn(bgpstream_filter_mgr_t *filter_mgr,
+                          bgpstream_elem_t *elem)
+{
+  if (filter_mgr->peer_asns_bm != NULL) {
+    return bgpstream_id_bitmap_exists(filter_mgr->peer_asns_bm,
+                                      elem->peer_asn);
+  }
+  return bgpstream_id_set_exists(filter_mgr->peer_asns, elem->peer_asn);
+}
 
-    if (elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE &&
-        !(filter_mgr->elemtype_mask & BGPSTREAM_FILTER_ELEM_TYPE_PEERSTATE)) {
-      return 0;
-    }
+static int check_origin_asn(bgpstream_filter_mgr_t *filter_mgr,
+                            bgpstream_elem_t *elem)
+{
+  uint32_t origin_asn;
 
-    if (elem->type == BGPSTREAM_ELEM_TYPE_RIB &&
-        !(filter_mgr->elemtype_mask & BGPSTREAM_FILTER_ELEM_TYPE_RIB)) {
-      return 0;
-    }
+  if (elem->type == BGPSTREAM_ELEM_TYPE_WITHDRAWAL ||
+      elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
+    return 0;
+  }
 
-    if (elem->type == BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT &&
-        !(filter_mgr->elemtype_mask &
-          BGPSTREAM_FILTER_ELEM_TYPE_ANNOUNCEMENT)) {
-      return 0;
-    }
+  if (bgpstream_as_path_get_origin_val(elem->as_path, &origin_asn) < 0) {
+    return 0;
+  }
 
-    if (elem->type == BGPSTREAM_ELEM_TYPE_WITHDRAWAL &&
-        !(filter_mgr->elemtype_mask & BGPSTREAM_FILTER_ELEM_TYPE_WITHDRAWAL)) {
-      return 0;
-    }
+  if (filter_mgr->origin_asns_bm != NULL) {
+    return bgpstream_id_bitmap_exists(filter_mgr->origin_asns_bm, origin_asn);
   }
+  return bgpstream_id_set_exists(filter_mgr->origin_asns, origin_asn);
+}
 
-  /* Checking peer ASNs: if the filter is on and the peer asn is not in the
-   * set, return 0 */
-  if (filter_mgr->peer_asns &&
-      bgpstream_id_set_exists(filter_mgr->peer_asns, elem->peer_asn) == 0) {
+static int check_ipversion(bgpstream_filter_mgr_t *filter_mgr,
+                           bgpstream_elem_t *elem)
+{
+  if (elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
     return 0;
   }
+  return ((bgpstream_pfx_t *)&elem->prefix)->address.version ==
+         filter_mgr->ipversion;
+}
 
-  /* Checking origin ASN */
-  if (filter_mgr->origin_asns) {
-    if (elem->type == BGPSTREAM_ELEM_TYPE_WITHDRAWAL ||
-        elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
-      return 0;
-    }
-    uint32_t origin_asn;
+static int check_prefix(bgpstream_filter_mgr_t *filter_mgr,
+                        bgpstream_elem_t *elem)
+{
+  if (elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
+    return 0;
+  }
+  return bgpstream_elem_prefix_match(filter_mgr,
+                                     (bgpstream_pfx_t *)&elem->prefix);
+}
 
-    if (bgpstream_as_path_get_origin_val(elem->as_path, &origin_asn) < 0) {
-      return 0;
-    }
+static int check_aspath(bgpstream_filter_mgr_t *filter_mgr,
+                        bgpstream_elem_t *elem)
+{
+  char aspath[65536];
+  int pathlen;
+  int result;
+  int i;
 
-    if (bgpstream_id_set_exists(filter_mgr->origin_asns, origin_asn) == 0) {
-      return 0;
-    }
+  if (elem->type == BGPSTREAM_ELEM_TYPE_WITHDRAWAL ||
+      elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
+    return 0;
   }
 
-  if (filter_mgr->ipversion) {
-    /* Determine address version for the element prefix */
+  pathlen = bgpstream_as_path_get_filterable(aspath, 65535, elem->as_path);
 
-    if (elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
-      return 0;
-    }
+  if (pathlen == 65535) {
+    bgpstream_log(BGPSTREAM_LOG_WARN,
+                  "AS Path is too long? Filter may not work well.");
+  }
 
-    bgpstream_ip_addr_t *addr = &(((bgpstream_pfx_t *)&elem->prefix)->address);
-    if (addr->version != filter_mgr->ipversion)
-      return 0;
+  if (pathlen == 0) {
+    return 0;
   }
 
-  if (filter_mgr->prefixes) {
-    if (elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
+  /* every positive expression must match, and no negated one may */
+  for (i = 0; i < filter_mgr->aspath_res_cnt; i++) {
+    result = regexec(&filter_mgr->aspath_res[i].re, aspath, 0, NULL, 0);
+    if (result != REG_NOMATCH && result != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Error while matching AS path regex");
       return 0;
     }
-    return bgpstream_elem_prefix_match(filter_mgr->prefixes,
-                                       (bgpstream_pfx_t *)&elem->prefix);
-  }
-
-  /* Checking AS Path expressions */
-  if (filter_mgr->aspath_exprs) {
-    char aspath[65536];
-    char *regexstr;
-    int pathlen;
-    regex_t re;
-    int result;
-    int negatives = 0;
-    int positives = 0;
-    int totalpositives = 0;
-
-    if (elem->type == BGPSTREAM_ELEM_TYPE_WITHDRAWAL ||
-        elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
+    if ((result == 0) == filter_mgr->aspath_res[i].negate) {
       return 0;
     }
+  }
+  return 1;
+}
 
-    pathlen = bgpstream_as_path_get_filterable(aspath, 65535, elem->as_path);
+static int check_community(bgpstream_filter_mgr_t *filter_mgr,
+                           bgpstream_elem_t *elem)
+{
+  bgpstream_community_t *c;
+  int i, n;
 
-    if (pathlen == 65535) {
-      bgpstream_log(BGPSTREAM_LOG_WARN,
-                    "AS Path is too long? Filter may not work well.");
-    }
+  if (elem->type == BGPSTREAM_ELEM_TYPE_WITHDRAWAL ||
+      elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
+    return 0;
+  }
 
-    if (pathlen == 0) {
-      return 0;
+  n = bgpstream_community_set_size(elem->communities);
+  if (filter_mgr->communities_any && n > 0) {
+    return 1;
+  }
+  /* probe each elem community once against each kind of filter */
+  for (i = 0; i < n; i++) {
+    c = bgpstream_community_set_get(elem->communities, i);
+    if ((filter_mgr->communities_asn != NULL &&
+         bgpstream_id_bitmap_exists(filter_mgr->communities_asn, c->asn)) ||
+        (filter_mgr->communities_value != NULL &&
+         bgpstream_id_bitmap_exists(filter_mgr->communities_value,
+                                    c->value)) ||
+        (filter_mgr->communities_exact != NULL &&
+         bgpstream_id_bitmap_exists(filter_mgr->communities_exact,
+                                    ((uint32_t)c->asn << 16) | c->value))) {
+      return 1;
     }
+  }
+  return 0;
+}
 
-    bgpstream_str_set_rewind(filter_mgr->aspath_exprs);
-    while ((regexstr = bgpstream_str_set_next(filter_mgr->aspath_exprs)) !=
-           NULL) {
-      int negate = 0;
+int bgpstream_record_check_elem_filter_op(bgpstream_filter_mgr_t *filter_mgr,
+                                          bgpstream_filter_op_type_t type,
+                                          bgpstream_elem_t *elem)
+{
+  switch (type) {
+  case BGPSTREAM_FILTER_OP_ELEMTYPE:
+    return check_elemtype(filter_mgr, elem);
+  case BGPSTREAM_FILTER_OP_PEER_ASN:
+    return check_peer_asn(filter_mgr, elem);
+  case BGPSTREAM_FILTER_OP_ORIGIN_ASN:
+    return check_origin_asn(filter_mgr, elem);
+  case BGPSTREAM_FILTER_OP_IPVERSION:
+    return check_ipversion(filter_mgr, elem);
+  case BGPSTREAM_FILTER_OP_PREFIX:
+    return check_prefix(filter_mgr, elem);
+  case BGPSTREAM_FILTER_OP_ASPATH:
+    return check_aspath(filter_mgr, elem);
+  case BGPSTREAM_FILTER_OP_COMMUNITY:
+    return check_community(filter_mgr, elem);
+  default:
+    assert(0);
+  }
+  return 0;
+}
 
-      if (strlen(regexstr) == 0)
-        continue;
+/* Run the filter program compiled by bgpstream_filter_mgr_validate: the elem
+ * must pass every predicate, and they are evaluated in the order that is
+ * expected to reject non-matching elems most cheaply. The statistics that
+ * drive this order are only updated (and the program only reordered) for
+ * records that have not been detached, i.e., on the thread that owns the
+ * stream */
+static int elem_check_filters(bgpstream_record_t *record,
+                              bgpstream_elem_t *elem)
+{
+  bgpstream_filter_mgr_t *filter_mgr = record->__int->format->filter_mgr;
+  bgpstream_filter_op_t *op;
+  int pass = 1;
+  int i;
+
+  if (record->__int->detached != 0) {
+    for (i = 0; pass && i < record->__int->program_len; i++) {
+      pass = bgpstream_record_check_elem_filter_op(
+        filter_mgr, record->__int->program[i], elem);
+    }
+    return pass;
+  }
 
-      if (*regexstr == '!') {
-        negate = 1;
-        regexstr++;
-      } else {
-        totalpositives += 1;
-      }
+  for (i = 0; pass && i < filter_mgr->program_len; i++) {
+    op = &filter_mgr->program[i];
+    op->evaluated++;
+    pass = bgpstream_record_check_elem_filter_op(filter_mgr, op->type, elem);
+    op->passed += pass;
+  }
 
-      if (regcomp(&re, regexstr, 0) < 0) {
-        /* XXX should really use regerror here for proper error reporting */
-        bgpstream_log(BGPSTREAM_LOG_ERR, "Failed to compile AS path regex");
-        break;
-      }
+  /* adapt the order to the selectivity observed so far */
+  if (filter_mgr->program_len > 1 &&
+      ++filter_mgr->program_runs % BGPSTREAM_FILTER_PROGRAM_REORDER_RUNS ==
+        0) {
+    bgpstream_filter_mgr_program_reorder(filter_mgr);
+  }
 
-      result = regexec(&re, aspath, 0, NULL, 0);
-      if (result == 0) {
-        if (!negate) {
-          positives++;
-        }
-        if (negate) {
-          negatives++;
-        }
-      }
+  return pass;
+}
 
-      regfree(&re);
-      if (result != REG_NOMATCH && result != 0) {
-        bgpstream_log(BGPSTREAM_LOG_ERR, "Error while matching AS path regex");
-        break;
-      }
-    }
-    if (!(positives == totalpositives && negatives == 0)){
-      return 0;
+int bgpstream_record_check_shared_elem_filters(bgpstream_record_t *record,
+                                               bgpstream_elem_t *elem)
+{
+  bgpstream_filter_mgr_t *filter_mgr = record->__int->format->filter_mgr;
+  bgpstream_filter_op_type_t program[BGPSTREAM_FILTER_OP_CNT];
+  int program_len;
+  int pass = 1;
+  int i;
+
+  program_len = bgpstream_record_get_filter_program(record, program);
+  for (i = 0; pass && i < program_len; i++) {
+    if (program[i] != BGPSTREAM_FILTER_OP_IPVERSION &&
+        program[i] != BGPSTREAM_FILTER_OP_PREFIX) {
+      pass =
+        bgpstream_record_check_elem_filter_op(filter_mgr, program[i], elem);
     }
   }
-  /* Checking communities (unless it is a withdrawal message) */
-  pass = (filter_mgr->communities != NULL) ? 0 : 1;
-  if (filter_mgr->communities) {
-    if (elem->type == BGPSTREAM_ELEM_TYPE_WITHDRAWAL ||
-        elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
-      return 0;
-    }
 
-    bgpstream_community_t *c;
-    khiter_t k;
-    for (k = kh_begin(filter_mgr->communities);
-         k != kh_end(filter_mgr->communities); ++k) {
-      if (kh_exist(filter_mgr->communities, k)) {
-        c = &(kh_key(filter_mgr->communities, k));
-        if (bgpstream_community_set_match(
-              elem->communities, c, kh_value(filter_mgr->communities, k))) {
-          pass = 1;
-          break;
-        }
-      }
-    }
-    if (pass == 0) {
-      return 0;
-    }
+  return pass;
+}
+
+int bgpstream_record_get_next_raw_elem(bgpstream_record_t *record,
+                                       bgpstream_elem_t **elemp)
+{
+  bgpstream_stats_t *stats;
+  int rc;
+
+  *elemp = NULL;
+
+  if (record == NULL ||
+      record->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD ||
+      record->__int->format == NULL) {
+    return 0; // treat as end-of-elems
   }
 
-  return 1;
+  if ((rc = bgpstream_format_get_next_elem(record->__int->format, record,
+                                           elemp)) > 0 &&
+      (stats = bgpstream_record_get_elem_stats(record)) != NULL) {
+    stats->elems++;
+  }
+  return rc;
+}
+
+bgpstream_filter_mgr_t *
+bgpstream_record_get_filter_mgr(bgpstream_record_t *record)
+{
+  if (record->__int->format == NULL) {
+    return NULL;
+  }
+  return record->__int->format->filter_mgr;
+}
+
+void bgpstream_record_save_filter_program(bgpstream_record_t *record)
+{
+  bgpstream_filter_mgr_t *filter_mgr = bgpstream_record_get_filter_mgr(record);
+  int i;
+
+  record->__int->program_len = 0;
+  if (filter_mgr == NULL) {
+    return;
+  }
+  for (i = 0; i < filter_mgr->program_len; i++) {
+    record->__int->program[i] = filter_mgr->program[i].type;
+  }
+  record->__int->program_len = filter_mgr->program_len;
+}
+
+int bgpstream_record_get_filter_program(bgpstream_record_t *record,
+                                        bgpstream_filter_op_type_t *program)
+{
+  bgpstream_filter_mgr_t *filter_mgr;
+  int i;
+
+  if (record->__int->detached != 0) {
+    memcpy(program, record->__int->program,
+           sizeof(bgpstream_filter_op_type_t) * record->__int->program_len);
+    return record->__int->program_len;
+  }
+  if ((filter_mgr = bgpstream_record_get_filter_mgr(record)) == NULL) {
+    return 0;
+  }
+  for (i = 0; i < filter_mgr->program_len; i++) {
+    program[i] = filter_mgr->program[i].type;
+  }
+  return filter_mgr->program_len;
+}
+
+bgpstream_stats_t *bgpstream_record_get_elem_stats(bgpstream_record_t *record)
+{
+  // the statistics of a format are only updated by the thread that reads from
+  // it, which detached records may be handed off from
+  if (record->__int->format == NULL || record->__int->detached != 0) {
+    return NULL;
+  }
+  return &record->__int->format->stats;
+}
+
+void bgpstream_record_count_filtered_elems(bgpstream_record_t *record,
+                                           uint64_t cnt)
+{
+  bgpstream_stats_t *stats = bgpstream_record_get_elem_stats(record);
+
+  if (stats != NULL) {
+    stats->elems_filtered += cnt;
+  }
 }
 
 int bgpstream_record_get_next_elem(bgpstream_record_t *record,
@@ -316,6 +488,9 @@ int bgpstream_record_get_next_elem(bgpstream_record_t *record,
 {
   int rc;
   bgpstream_elem_t *elem = NULL;
+  bgpstream_stats_t *stats;
+  uint64_t start = 0;
+  int pass;
   *elemp = NULL;
 
   if (record == NULL ||
@@ -324,6 +499,8 @@ int bgpstream_record_get_next_elem(bgpstream_record_t *record,
     return 0; // treat as end-of-elems
   }
 
+  stats = bgpstream_record_get_elem_stats(record);
+
   while (elem == NULL) {
     if ((rc = bgpstream_format_get_next_elem(record->__int->format, record,
                                              &elem)) <= 0) {
@@ -331,16 +508,107 @@ int bgpstream_record_get_next_elem(bgpstream_record_t *record,
       return rc;
     }
 
-    // TODO: push elem filtering down into the formats
-    if (elem_check_filters(record, elem) == 0) {
+    // the UPDATE-wide filters may also have been checked by the format (see
+    // bgpstream_record_check_shared_elem_filters), but not the prefix ones
+    if (stats != NULL) {
+      stats->elems++;
+      start = BGPSTREAM_STATS_TIMER_START(record->__int->format->filter_mgr);
+    }
+    pass = elem_check_filters(record, elem);
+    if (stats != NULL) {
+      BGPSTREAM_STATS_TIMER_ADD(stats->elem_filter_nsec, start);
+      stats->elems_filtered += (pass == 0);
+    }
+    if (pass == 0) {
       elem = NULL;
     }
   }
 
+  // the format re-uses a single elem, so this must always be (re)set
+  elem->attrs_id = 0;
+  if (record->__int->attrs != NULL &&
+      (elem->type == BGPSTREAM_ELEM_TYPE_RIB ||
+       elem->type == BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT) &&
+      bgpstream_attr_store_get_id(record->__int->attrs, elem->as_path,
+                                  elem->peer_asn, elem->communities,
+                                  &elem->nexthop, &elem->attrs_id) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not intern elem attributes");
+    return -1;
+  }
+
   *elemp = elem;
   return 1;
 }
 
+int bgpstream_record_take(bgpstream_record_t *record)
+{
+  if (record->__int->user_owned != 0) {
+    // already taken
+    return -1;
+  }
+  // records from a batch have already been detached
+  if (record->__int->detached == 0 &&
+      bgpstream_reader_detach_record(record) != 0) {
+    return -1;
+  }
+  record->__int->user_owned = 1;
+  return 0;
+}
+
+void bgpstream_record_release(bgpstream_record_t *record)
+{
+  if (record == NULL) {
+    return;
+  }
+  assert(record->__int->user_owned != 0);
+  record->__int->user_owned = 0;
+  bgpstream_reader_release_record(record);
+}
+
+int bgpstream_record_get_next_elems(bgpstream_record_t *record,
+                                    bgpstream_elem_t **elems, int elems_cnt)
+{
+  bgpstream_record_internal_t *ri = record->__int;
+  bgpstream_elem_t *elem;
+  int cnt = 0;
+  int rc;
+
+  // make sure we have enough elems to copy into
+  if (elems_cnt > ri->elem_batch_alloc_cnt) {
+    if ((ri->elem_batch = realloc(ri->elem_batch, sizeof(bgpstream_elem_t *) *
+                                                    elems_cnt)) == NULL) {
+      ri->elem_batch_alloc_cnt = 0;
+      return -1;
+    }
+    for (; ri->elem_batch_alloc_cnt < elems_cnt; ri->elem_batch_alloc_cnt++) {
+      if ((ri->elem_batch[ri->elem_batch_alloc_cnt] =
+             bgpstream_elem_create()) == NULL) {
+        return -1;
+      }
+    }
+  }
+
+  while (cnt < elems_cnt) {
+    if ((rc = bgpstream_record_get_next_elem(record, &elem)) <= 0) {
+      if (rc < 0) {
+        return -1;
+      }
+      break;
+    }
+    // the format re-uses a single elem, so take a copy. the AS path and
+    // community set re-use their memory, so this does not allocate once the
+    // batch is warm.
+    bgpstream_elem_clear(ri->elem_batch[cnt]);
+    if (bgpstream_elem_copy(ri->elem_batch[cnt], elem) == NULL) {
+      return -1;
+    }
+    elems[cnt] = ri->elem_batch[cnt];
+    cnt++;
+  }
+
+  return cnt;
+}
+
 int bgpstream_record_type_snprintf(char *buf, size_t len,
                                    bgpstream_record_type_t type)
 {
@@ -455,6 +723,42 @@ int bgpstream_record_status_snprintf(char *buf, size_t len,
     }                                                                          \
   } while (0)
 
+/* Equivalent to snprintf(buf, len, "%u.%06u|%s|%s|%s|", ...) on the record
+   timestamp and names, but without a format parse when the buffer is large
+   enough (which it almost always is) */
+static int record_ts_names_snprintf(char *buf, size_t len,
+                                    bgpstream_record_t *record)
+{
+  size_t project_len = strlen(record->project_name);
+  size_t collector_len = strlen(record->collector_name);
+  size_t router_len = strlen(record->router_name);
+  char *p = buf;
+
+  if (len <= (2 * BGPSTREAM_FMT_UINT32_MAXLEN) + 4 + project_len +
+               collector_len + router_len) {
+    return snprintf(buf, len, "%" PRIu32 ".%06" PRIu32 "|%s|%s|%s|",
+                    record->time_sec, record->time_usec, record->project_name,
+                    record->collector_name, record->router_name);
+  }
+
+  p += bgpstream_fmt_uint32(p, record->time_sec);
+  *p++ = '.';
+  p += bgpstream_fmt_uint32_pad(p, record->time_usec, 6);
+  *p++ = '|';
+  memcpy(p, record->project_name, project_len);
+  p += project_len;
+  *p++ = '|';
+  memcpy(p, record->collector_name, collector_len);
+  p += collector_len;
+  *p++ = '|';
+  memcpy(p, record->router_name, router_len);
+  p += router_len;
+  *p++ = '|';
+  *p = '\0';
+
+  return p - buf;
+}
+
 char *bgpstream_record_snprintf(char *buf, size_t len,
                                 bgpstream_record_t *record)
 {
@@ -485,9 +789,7 @@ char *bgpstream_record_snprintf(char *buf, size_t len,
     return NULL;
 
   /* Record timestamp, project, collector, router names */
-  c = snprintf(buf_p, B_REMAIN, "%" PRIu32 ".%06" PRIu32 "|%s|%s|%s|",
-               record->time_sec, record->time_usec, record->project_name,
-               record->collector_name, record->router_name);
+  c = record_ts_names_snprintf(buf_p, B_REMAIN, record);
   written += c;
   buf_p += c;
 
@@ -496,7 +798,7 @@ char *bgpstream_record_snprintf(char *buf, size_t len,
 
   /* Router IP */
   if (record->router_ip.version != 0) {
-    if (bgpstream_addr_ntop(buf_p, B_REMAIN, &record->router_ip) == NULL) {
+    if (bgpstream_fmt_addr_ntop(buf_p, B_REMAIN, &record->router_ip) == NULL) {
       bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed Router IP address");
       return NULL;
     }
@@ -554,9 +856,7 @@ char *bgpstream_record_elem_snprintf(char *buf, size_t len,
   ADD_PIPE;
 
   /* Record timestamp, project, collector, router names */
-  c = snprintf(buf_p, B_REMAIN, "%" PRIu32 ".%06" PRIu32 "|%s|%s|%s|",
-               record->time_sec, record->time_usec, record->project_name,
-               record->collector_name, record->router_name);
+  c = record_ts_names_snprintf(buf_p, B_REMAIN, record);
   written += c;
   buf_p += c;
 
@@ -565,7 +865,7 @@ char *bgpstream_record_elem_snprintf(char *buf, size_t len,
 
   /* Router IP */
   if (record->router_ip.version != 0) {
-    if (bgpstream_addr_ntop(buf_p, B_REMAIN, &record->router_ip) == NULL) {
+    if (bgpstream_fmt_addr_ntop(buf_p, B_REMAIN, &record->router_ip) == NULL) {
       bgpstream_log(BGPSTREAM_LOG_ERR, "Malformed Router IP address");
       return NULL;
     }
@@ -227,6 +227,34 @@ typedef struct bgpstream_record {
  *
  * @{ */
 
+/** Take ownership of a record returned by bgpstream_get_next_record or
+ * bgpstream_get_next_records
+ *
+ * @param record        pointer to the record to take
+ * @return 0 if the caller now owns the record, -1 otherwise
+ *
+ * By default records are borrowed from BGPStream, and are overwritten by
+ * subsequent reads. A record that has been taken is not overwritten, and can
+ * be kept (and its elems read) for as long as needed, without copying. The
+ * record must be given back using bgpstream_record_release.
+ *
+ * BGPStream replaces the taken record with one from an internal pool, so a
+ * steady stream of take/release calls does not allocate.
+ */
+int bgpstream_record_take(bgpstream_record_t *record);
+
+/** Give back a record taken using bgpstream_record_take
+ *
+ * @param record        pointer to the record to release
+ *
+ * The record (and any elems retrieved from it) must not be used after this
+ * call. Taken records must be released before the BGPStream instance they
+ * came from is destroyed: the record still refers to the stream's filters and
+ * format modules, so releasing (or reading) it after bgpstream_destroy is
+ * undefined.
+ */
+void bgpstream_record_release(bgpstream_record_t *record);
+
 /** Retrieve the next elem from the record
  *
  * @param record        pointer to the BGP Stream Record to retrieve the elem
@@ -244,6 +272,25 @@ typedef struct bgpstream_record {
 int bgpstream_record_get_next_elem(bgpstream_record_t *record,
                                    bgpstream_elem_t **elem);
 
+/** Retrieve a batch of elems from the record
+ *
+ * @param record        pointer to the BGP Stream Record to retrieve the elems
+ *                      from
+ * @param[out] elems    array of at least elems_cnt elem pointers, filled with
+ *                      borrowed pointers to the elems retrieved
+ * @param elems_cnt     maximum number of elems to retrieve
+ * @return the number of elems retrieved (0 if there are no more elems), -1 if
+ * an error occurred
+ *
+ * Unlike bgpstream_record_get_next_elem, all of the elems returned by one call
+ * are valid at the same time. They remain valid until the next call to this
+ * function for the same record, or until the record is re-used or destroyed.
+ * The two functions share the same position in the record, and so may be
+ * mixed.
+ */
+int bgpstream_record_get_next_elems(bgpstream_record_t *record,
+                                    bgpstream_elem_t **elems, int elems_cnt);
+
 /** Dump the given record to stdout in bgpdump format
  *
  * @param record        pointer to a BGP Stream Record instance to dump
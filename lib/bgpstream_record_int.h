@@ -49,6 +49,41 @@ struct bgpstream_record_internal {
 
   /** Private data-structure (optionally) populated by the format module */
   void *data;
+
+  /** Pointer to the reader that owns this record (NULL if the record was not
+      created by a reader) */
+  struct bgpstream_reader *reader;
+
+  /** Offset (in bytes of the decoded stream) of the end of the message that
+      this record was read from (0 if unknown) */
+  uint64_t offset;
+
+  /** Attribute store used to set the attrs_id field of elems (NULL if
+      attribute interning is disabled). Set by bgpstream when the record is
+      returned to the user */
+  bgpstream_attr_store_t *attrs;
+
+  /** Set if the record has been detached from its reader's buffers */
+  int detached;
+
+  /** Order of the elem filter program when the record was detached. A
+      detached record may be read on another thread while the stream keeps
+      reordering (and counting into) the program of the filter manager, so
+      it uses this copy instead */
+  bgpstream_filter_op_type_t program[BGPSTREAM_FILTER_OP_CNT];
+
+  /** Number of predicates in program */
+  int program_len;
+
+  /** Set if the record has been taken by the user (bgpstream_record_take) */
+  int user_owned;
+
+  /** Elems returned by bgpstream_record_get_next_elems (reused between
+      calls) */
+  bgpstream_elem_t **elem_batch;
+
+  /** Number of elems allocated in elem_batch */
+  int elem_batch_alloc_cnt;
 };
 
 /**
@@ -81,6 +116,93 @@ void bgpstream_record_destroy(bgpstream_record_t *record);
  */
 void bgpstream_record_clear(bgpstream_record_t *record);
 
+/** Check the elem filters that do not depend on the elem prefix
+ *
+ * @param record        pointer to the record that the elem belongs to (the
+ *                      filters of its format are checked)
+ * @param elem          pointer to the elem to check (only the type, peer and
+ *                      path attribute fields are used)
+ * @return 0 if the elem fails one of these filters, 1 otherwise
+ *
+ * All of the withdrawals (or announcements) of an UPDATE share these fields,
+ * so a format may use this to drop all of them at once. Elems that pass must
+ * still be checked by bgpstream_record_get_next_elem. The statistics used to
+ * order the filter program are not updated.
+ */
+int bgpstream_record_check_shared_elem_filters(bgpstream_record_t *record,
+                                               bgpstream_elem_t *elem);
+
+/** Check a single predicate of the elem filter program
+ *
+ * @param filter_mgr    pointer to the filter manager to check against
+ * @param type          type of the predicate to check
+ * @param elem          pointer to the elem to check (only the fields that the
+ *                      predicate depends on are used)
+ * @return 1 if the elem passes the predicate, 0 otherwise
+ */
+int bgpstream_record_check_elem_filter_op(bgpstream_filter_mgr_t *filter_mgr,
+                                          bgpstream_filter_op_type_t type,
+                                          bgpstream_elem_t *elem);
+
+/** Get the next elem of a record without checking the elem filters
+ *
+ * @param record        pointer to the record to get the next elem of
+ * @param[out] elemp    set to point to the elem (owned by the format)
+ * @return 1 if an elem was returned, 0 if there are no more elems, -1 if an
+ * error occurred
+ *
+ * The caller is responsible for applying the filters, and for reporting the
+ * elems it drops using bgpstream_record_count_filtered_elems.
+ */
+int bgpstream_record_get_next_raw_elem(bgpstream_record_t *record,
+                                       bgpstream_elem_t **elemp);
+
+/** Get the filter manager that the elems of a record are checked against
+ *
+ * @param record        pointer to the record
+ * @return pointer to the filter manager, or NULL if the record has no format
+ */
+bgpstream_filter_mgr_t *
+bgpstream_record_get_filter_mgr(bgpstream_record_t *record);
+
+/** Copy the current order of the elem filter program into a record
+ *
+ * @param record        pointer to the record that is being detached
+ *
+ * Called when a record is detached from its reader, on the thread that owns
+ * the stream, so that the elems of the record may then be filtered on any
+ * thread.
+ */
+void bgpstream_record_save_filter_program(bgpstream_record_t *record);
+
+/** Get the elem filter program that applies to a record
+ *
+ * @param record        pointer to the record
+ * @param[out] program  filled with the types of the predicates, in the order
+ *                      they should be evaluated (must hold
+ *                      BGPSTREAM_FILTER_OP_CNT entries)
+ * @return the number of predicates in the program
+ */
+int bgpstream_record_get_filter_program(bgpstream_record_t *record,
+                                        bgpstream_filter_op_type_t *program);
+
+/** Get the statistics that the elems of a record are counted in
+ *
+ * @param record        pointer to the record
+ * @return pointer to the statistics of the format of the record, or NULL if
+ * the record has been detached (and so may be read on another thread than
+ * the one that updates them) or has no format
+ */
+bgpstream_stats_t *bgpstream_record_get_elem_stats(bgpstream_record_t *record);
+
+/** Add to the number of elems of a record that were filtered out
+ *
+ * @param record        pointer to the record that the elems belong to
+ * @param cnt           number of elems that were dropped
+ */
+void bgpstream_record_count_filtered_elems(bgpstream_record_t *record,
+                                           uint64_t cnt);
+
 /** @} */
 
 #endif /* __BGPSTREAM_RECORD_INT_H */
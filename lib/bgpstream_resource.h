@@ -131,6 +131,12 @@ typedef struct bgpstream_resource {
   /** The type of records provided by the resource */
   bgpstream_record_type_t record_type;
 
+  /** Offset (in bytes of the decoded stream) at which to resume reading the
+      resource (set when restoring a checkpoint). Messages that end at or
+      before this offset have already been processed and are skipped. A value
+      of 0 indicates that the whole resource should be read. */
+  uint64_t resume_offset;
+
   /** Extra attributes provided by the data interface that can be used by the
    * transport or format layers (they are optional as some may be provided by
    * the transport or format layers)
@@ -28,23 +28,35 @@
 #include "bgpstream_filter.h"
 #include "bgpstream_log.h"
 #include "bgpstream_reader.h"
+#include "bgpstream_stats.h"
+#include "bgpstream_utils_str_set.h"
 #include "config.h"
+#include "khash.h"
 #include "utils.h"
 #include <assert.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-/** TODO: Fix the rib period filter to not need to build this string as this
-    will fail for collectors with really long names */
-#define BUFFER_LEN 1024
-
 /** Approximately how frequently should stream resources that return AGAIN be
     polled? (in msec) */
 #define AGAIN_POLL_INTERVAL 500
 #define MSEC_TO_NSEC 1000000
 
+/** Resolution of the poll timer wheel (in msec) */
+#define POLL_WHEEL_TICK 16
+
+/** Number of slots in the poll timer wheel (must be a power of two). One
+    rotation should cover AGAIN_POLL_INTERVAL so that each timer is looked at
+    only once before it expires. */
+#define POLL_WHEEL_SLOTS 64
+
+/** Map from resource URI to the offset at which to resume reading it */
+KHASH_INIT(res_offset, char *, uint64_t, 1, kh_str_hash_func,
+           kh_str_hash_equal)
+
 struct res_list_elem {
   /** The resource info */
   bgpstream_resource_t *res;
@@ -55,9 +67,20 @@ struct res_list_elem {
   /** Is the reader open? (i.e. have we waited for it to open) */
   int open;
 
-  /** Time when this resource should next be polled (if 0 then poll
-      immediately) */
-  uint32_t next_poll;
+  /** Index of the statistics of this resource's collector (if the reader has
+      been created) */
+  int stats_idx;
+
+  /** Time (in msec) when this resource should next be polled (if 0 then
+      poll immediately) */
+  uint64_t next_poll;
+
+  /** Previous/next elem in the same poll wheel slot (if next_poll is set) */
+  struct res_list_elem *wheel_prev;
+  struct res_list_elem *wheel_next;
+
+  /** Poll wheel slot that this elem is in (if next_poll is set) */
+  int wheel_slot;
 
   /** Previous list elem */
   struct res_list_elem *prev;
@@ -96,6 +119,21 @@ struct res_group {
   struct res_group *next;
 };
 
+/** Hashed timer wheel of the resources that are waiting to be polled again.
+ *
+ * Timers are hashed into slots by their expiry tick; a slot may hold timers
+ * for later rotations, which are skipped until their tick comes around. */
+struct poll_wheel {
+  /** Lists of waiting resources, indexed by expiry tick */
+  struct res_list_elem *slots[POLL_WHEEL_SLOTS];
+
+  /** The last tick that has been expired */
+  uint64_t tick;
+
+  /** The number of waiting resources */
+  int cnt;
+};
+
 struct bgpstream_resource_mgr {
 
   /** Ordered queue of resources, grouped by timestamp (i.e. group by second).
@@ -112,10 +150,194 @@ struct bgpstream_resource_mgr {
 
   // borrowed pointer to a filter manager instance
   bgpstream_filter_mgr_t *filter_mgr;
+
+  // stream resources that returned AGAIN, by the time they should be re-polled
+  struct poll_wheel wheel;
+
+  // statistics of the resources that have been read to the end, by collector
+  bgpstream_stats_t *stats;
+  int stats_cnt;
+  int stats_alloc_cnt;
+
+  // set if the position of the queue may be checkpointed
+  int checkpointing;
+
+  // URIs of the (non-stream) resources that have been read to the end (only
+  // tracked if checkpointing is enabled)
+  bgpstream_str_set_t *done;
+
+  // URIs that were read to the end when the loaded checkpoint was saved. each
+  // is only skipped the first time it is pushed: data interfaces push a
+  // resource again when it has changed (e.g., a file that was replaced)
+  bgpstream_str_set_t *skip;
+
+  // offsets at which to resume resources that have not been pushed yet
+  khash_t(res_offset) *resume;
 };
 
+/* ========== POLL TIMER WHEEL ========== */
+
+static void poll_wheel_add(struct poll_wheel *w, struct res_list_elem *el,
+                           uint64_t deadline)
+{
+  uint64_t tick = deadline / POLL_WHEEL_TICK;
+  struct res_list_elem **slot;
+
+  if (w->cnt == 0) {
+    // nothing is pending, so the wheel can jump straight to the present
+    w->tick = epoch_msec() / POLL_WHEEL_TICK;
+  }
+  if (tick <= w->tick) {
+    // make sure the timer is seen by the next expiry
+    tick = w->tick + 1;
+  }
+
+  el->wheel_slot = tick & (POLL_WHEEL_SLOTS - 1);
+  slot = &w->slots[el->wheel_slot];
+  el->next_poll = deadline;
+  el->wheel_prev = NULL;
+  el->wheel_next = *slot;
+  if (*slot != NULL) {
+    (*slot)->wheel_prev = el;
+  }
+  *slot = el;
+  w->cnt++;
+}
+
+static void poll_wheel_remove(struct poll_wheel *w, struct res_list_elem *el)
+{
+  if (el->next_poll == 0) {
+    // not waiting
+    return;
+  }
+
+  if (el->wheel_prev != NULL) {
+    el->wheel_prev->wheel_next = el->wheel_next;
+  } else {
+    w->slots[el->wheel_slot] = el->wheel_next;
+  }
+  if (el->wheel_next != NULL) {
+    el->wheel_next->wheel_prev = el->wheel_prev;
+  }
+  el->wheel_prev = NULL;
+  el->wheel_next = NULL;
+  el->next_poll = 0;
+  w->cnt--;
+}
+
+/* Mark all resources whose poll time has passed as ready (i.e. reset their
+ * next_poll) */
+static void poll_wheel_expire(struct poll_wheel *w, uint64_t now)
+{
+  uint64_t now_tick = now / POLL_WHEEL_TICK;
+  struct res_list_elem *el, *nxt;
+  uint64_t t;
+
+  if (w->cnt == 0) {
+    w->tick = now_tick;
+    return;
+  }
+
+  // the slot of the current tick may hold timers that are not due yet, and
+  // the next one may hold timers that were bumped there when added. after a
+  // full rotation every slot has been visited.
+  t = (now_tick - w->tick > POLL_WHEEL_SLOTS) ? now_tick - POLL_WHEEL_SLOTS
+                                              : w->tick;
+  for (; t <= now_tick + 1; t++) {
+    for (el = w->slots[t & (POLL_WHEEL_SLOTS - 1)]; el != NULL; el = nxt) {
+      nxt = el->wheel_next;
+      if (el->next_poll <= now) {
+        poll_wheel_remove(w, el);
+      }
+    }
+  }
+  w->tick = now_tick;
+}
+
+/* Find the earliest poll time of the waiting resources (0 if there are
+ * none) */
+static uint64_t poll_wheel_next_deadline(struct poll_wheel *w)
+{
+  struct res_list_elem *el;
+  uint64_t best = 0;
+  uint64_t t;
+
+  if (w->cnt == 0) {
+    return 0;
+  }
+
+  // walk forward from the current tick: once we have seen a timer that expires
+  // no later than the slot we are at, no later slot can hold an earlier one
+  // (except the slot after the current tick, which may hold bumped timers)
+  for (t = w->tick; t <= w->tick + POLL_WHEEL_SLOTS; t++) {
+    for (el = w->slots[t & (POLL_WHEEL_SLOTS - 1)]; el != NULL;
+         el = el->wheel_next) {
+      if (best == 0 || el->next_poll < best) {
+        best = el->next_poll;
+      }
+    }
+    if (t > w->tick && best != 0 && best / POLL_WHEEL_TICK <= t) {
+      break;
+    }
+  }
+
+  return best;
+}
+
 static int open_batch(bgpstream_resource_mgr_t *q, struct res_group *gp);
 
+// find (or create) the statistics of the collector of the given resource
+static int get_stats_idx(bgpstream_resource_mgr_t *q,
+                         bgpstream_resource_t *res)
+{
+  bgpstream_stats_t *stats;
+  int i;
+
+  for (i = 0; i < q->stats_cnt; i++) {
+    if (strcmp(q->stats[i].collector, res->collector) == 0 &&
+        strcmp(q->stats[i].project, res->project) == 0) {
+      return i;
+    }
+  }
+
+  if (q->stats_cnt == q->stats_alloc_cnt) {
+    if ((stats = realloc(q->stats, sizeof(bgpstream_stats_t) *
+                                     (q->stats_alloc_cnt + 8))) == NULL) {
+      return -1;
+    }
+    q->stats = stats;
+    q->stats_alloc_cnt += 8;
+  }
+
+  stats = &q->stats[q->stats_cnt];
+  memset(stats, 0, sizeof(bgpstream_stats_t));
+  strncpy(stats->project, res->project, BGPSTREAM_UTILS_STR_NAME_LEN);
+  stats->project[BGPSTREAM_UTILS_STR_NAME_LEN - 1] = '\0';
+  strncpy(stats->collector, res->collector, BGPSTREAM_UTILS_STR_NAME_LEN);
+  stats->collector[BGPSTREAM_UTILS_STR_NAME_LEN - 1] = '\0';
+
+  return q->stats_cnt++;
+}
+
+// fold the statistics of a resource that has reached EOS into those of its
+// collector
+static void close_stats(bgpstream_resource_mgr_t *q, struct res_list_elem *el)
+{
+  bgpstream_stats_t res_stats;
+
+  memset(&res_stats, 0, sizeof(bgpstream_stats_t));
+  bgpstream_reader_add_stats(el->reader, &res_stats);
+  bgpstream_stats_add(&q->stats[el->stats_idx], &res_stats);
+
+  bgpstream_log(BGPSTREAM_LOG_FINE,
+                "Finished %s: %" PRIu64 " records, %" PRIu64
+                " bytes, %" PRIu64 " msgs (%" PRIu64 " filtered, %" PRIu64
+                " skipped, %" PRIu64 " corrupted)",
+                el->res->uri, res_stats.records, res_stats.bytes_read,
+                res_stats.msgs_read, res_stats.msgs_filtered,
+                res_stats.msgs_skipped, res_stats.msgs_corrupted);
+}
+
 static void res_list_destroy(struct res_list_elem *l, int destroy_resource)
 {
   if (l == NULL) {
@@ -171,6 +393,10 @@ static int open_res_list(bgpstream_resource_mgr_t *q, struct res_group *gp,
                     el->res->uri);
       return -1;
     }
+    if ((el->stats_idx = get_stats_idx(q, el->res)) < 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not allocate collector stats");
+      return -1;
+    }
     // update stats
     q->res_open_cnt++;
     gp->res_open_cnt++;
@@ -631,6 +857,49 @@ static int open_batch(bgpstream_resource_mgr_t *q, struct res_group *gp)
   return 0;
 }
 
+// find a resource in the head group that may be read from now, and move it to
+// the front of its list. returns NULL if all candidates are waiting to be
+// polled again.
+static struct res_list_elem *ready_head(bgpstream_resource_mgr_t *q)
+{
+  struct res_list_elem **head;
+  struct res_list_elem *el;
+
+  if (q->head->res_list[BGPSTREAM_RIB] != NULL) {
+    head = &q->head->res_list[BGPSTREAM_RIB];
+  } else {
+    head = &q->head->res_list[BGPSTREAM_UPDATE];
+  }
+  assert(*head != NULL);
+
+  // fast path: the head has not asked to wait
+  if ((*head)->next_poll == 0) {
+    return *head;
+  }
+
+  poll_wheel_expire(&q->wheel, epoch_msec());
+
+  // resources that asked to wait are moved to the end of the list, so the
+  // ready ones are usually near the front
+  el = *head;
+  while (el != NULL && el->next_poll != 0) {
+    el = el->next;
+  }
+  if (el == NULL || el == *head) {
+    return el;
+  }
+
+  el->prev->next = el->next;
+  if (el->next != NULL) {
+    el->next->prev = el->prev;
+  }
+  el->prev = NULL;
+  el->next = *head;
+  (*head)->prev = el;
+  *head = el;
+  return el;
+}
+
 // when this is called we are guaranteed to have at least one open resource, and
 // if things have gone right, we should read from the first resource in the
 // queue. once we have read from the resource, we should check the new time of
@@ -643,37 +912,32 @@ static bgpstream_reader_status_t pop_record(bgpstream_resource_mgr_t *q,
   struct res_list_elem *el = NULL;
   struct res_list_elem *tmp_el = NULL;
   struct res_group *gp = NULL;
-  uint32_t now;
+  uint64_t now;
+  uint64_t deadline;
   uint64_t sleep_nsec;
   struct timespec rqtp;
 
   // the resource we want to read from MUST be in the first group (q->head), and
-  // will either be the head of the RIBS list if there are any ribs, otherwise
-  // it will be the head of the updates list
-  if (q->head->res_list[BGPSTREAM_RIB] != NULL) {
-    el = q->head->res_list[BGPSTREAM_RIB];
-  } else {
-    el = q->head->res_list[BGPSTREAM_UPDATE];
-  }
-  assert(el != NULL && el->res != NULL);
-  assert(el->open != 0);
-
-  // we assume that if this resource has a poll timer set that has not expired
-  // then since it would have been pushed to the end of the group and as such
-  // all other resources already polled.
-  if (el->next_poll > 0) {
+  // will either be a resource from the RIBS list if there are any ribs,
+  // otherwise from the updates list. if all of these resources are waiting to
+  // be polled again, sleep until the first of them is due.
+  while ((el = ready_head(q)) == NULL) {
     now = epoch_msec();
-    if (el->next_poll > now) {
-      sleep_nsec = (el->next_poll - now) * MSEC_TO_NSEC;
+    deadline = poll_wheel_next_deadline(&q->wheel);
+    assert(deadline != 0);
+    if (deadline > now) {
+      sleep_nsec = (deadline - now) * MSEC_TO_NSEC;
       rqtp.tv_sec = sleep_nsec / 1000000000;
       rqtp.tv_nsec = sleep_nsec % 1000000000;
+      bgpstream_log_flush();
       if (nanosleep(&rqtp, NULL) != 0) {
         // interrupted
         return -1;
       }
     }
-    el->next_poll = 0;
   }
+  assert(el->res != NULL);
+  assert(el->open != 0);
 
   // cache the current time so we can check if we need to remove and re-insert
   prev_time = get_next_time(el);
@@ -698,13 +962,15 @@ static bgpstream_reader_status_t pop_record(bgpstream_resource_mgr_t *q,
         tmp_el = tmp_el->next;
       }
       assert(el != tmp_el);
+      q->head->res_list[el->res->record_type] = el->next;
+      el->next->prev = NULL;
       el->next = NULL;
       tmp_el->next = el;
       el->prev = tmp_el;
     }
     // and then tell the caller that while we didn't get anything useful, they
     // should try again soon
-    el->next_poll = epoch_msec() + AGAIN_POLL_INTERVAL;
+    poll_wheel_add(&q->wheel, el, epoch_msec() + AGAIN_POLL_INTERVAL);
     return rs;
   }
 
@@ -733,7 +999,13 @@ static bgpstream_reader_status_t pop_record(bgpstream_resource_mgr_t *q,
     }
 
     if (rs == BGPSTREAM_READER_STATUS_EOS) {
-      // we're at EOS, so destroy the resource
+      // we're at EOS, so remember that this resource is done (if it will need
+      // to be checkpointed), and destroy it
+      if (q->checkpointing != 0 && el->res->duration != BGPSTREAM_FOREVER &&
+          bgpstream_str_set_insert(q->done, el->res->uri) < 0) {
+        return -1;
+      }
+      close_stats(q, el);
       res_list_destroy(el, 1);
     } else if (get_next_time(el) != prev_time) {
       // time has changed, so we need to re-insert
@@ -747,38 +1019,13 @@ static bgpstream_reader_status_t pop_record(bgpstream_resource_mgr_t *q,
   return rs;
 }
 
-static int wanted_resource(bgpstream_resource_t *res,
-                           bgpstream_filter_mgr_t *filter_mgr)
+static int wanted_resource(bgpstream_filter_mgr_t *filter_mgr,
+                           uint32_t initial_time, const char *project,
+                           const char *collector,
+                           bgpstream_record_type_t record_type)
 {
-  char buffer[BUFFER_LEN];
-  khiter_t k;
-  int khret;
-
-  if (res->record_type != BGPSTREAM_RIB || filter_mgr->rib_period == 0) {
-    // its an updates file or there is no rib period set
-    return 1;
-  }
-
-  snprintf(buffer, BUFFER_LEN, "%s.%s", res->project, res->collector);
-
-  if ((k = kh_get(collector_ts, filter_mgr->last_processed_ts, buffer)) ==
-      kh_end(filter_mgr->last_processed_ts)) {
-    // first time we've seen a rib for this collector
-    k = kh_put(collector_ts, filter_mgr->last_processed_ts, strdup(buffer),
-               &khret);
-    kh_value(filter_mgr->last_processed_ts, k) = res->initial_time;
-    return 1;
-  }
-
-  if (res->initial_time <
-      kh_value(filter_mgr->last_processed_ts, k) + filter_mgr->rib_period) {
-    // still within our period
-    return 0;
-  }
-
-  // we've found a rib we like!
-  kh_value(filter_mgr->last_processed_ts, k) = res->initial_time;
-  return 1;
+  return bgpstream_filter_mgr_rib_period_filter_check(
+    filter_mgr, project, collector, record_type, initial_time);
 }
 
 /* ========== PUBLIC METHODS BELOW HERE ========== */
@@ -794,11 +1041,20 @@ bgpstream_resource_mgr_create(bgpstream_filter_mgr_t *filter_mgr)
 
   q->filter_mgr = filter_mgr;
 
+  if ((q->done = bgpstream_str_set_create()) == NULL ||
+      (q->skip = bgpstream_str_set_create()) == NULL ||
+      (q->resume = kh_init(res_offset)) == NULL) {
+    bgpstream_resource_mgr_destroy(q);
+    return NULL;
+  }
+
   return q;
 }
 
 void bgpstream_resource_mgr_destroy(bgpstream_resource_mgr_t *q)
 {
+  khiter_t k;
+
   if (q == NULL) {
     return;
   }
@@ -814,6 +1070,29 @@ void bgpstream_resource_mgr_destroy(bgpstream_resource_mgr_t *q)
   // filter manager is a borrowed pointer
   q->filter_mgr = NULL;
 
+  free(q->stats);
+  q->stats = NULL;
+
+  if (q->done != NULL) {
+    bgpstream_str_set_destroy(q->done);
+    q->done = NULL;
+  }
+
+  if (q->skip != NULL) {
+    bgpstream_str_set_destroy(q->skip);
+    q->skip = NULL;
+  }
+
+  if (q->resume != NULL) {
+    for (k = kh_begin(q->resume); k != kh_end(q->resume); ++k) {
+      if (kh_exist(q->resume, k)) {
+        free(kh_key(q->resume, k));
+      }
+    }
+    kh_destroy(res_offset, q->resume);
+    q->resume = NULL;
+  }
+
   free(q);
 }
 
@@ -827,22 +1106,38 @@ int bgpstream_resource_mgr_push(
 {
   bgpstream_resource_t *res = NULL;
   struct res_list_elem *el = NULL;
+  khiter_t k;
   if (resp != NULL) {
     *resp = NULL;
   }
 
-  // first create the resource
+  // first check if it matches our RIB period filter (if we have one), so
+  // that no resource is created for the dumps that we skip
+  if (wanted_resource(q->filter_mgr, initial_time, project, collector,
+                      record_type) == 0) {
+    return 0;
+  }
+
+  // then create the resource
   if ((res = bgpstream_resource_create(transport_type, format_type, uri,
                                        initial_time, duration, project,
                                        collector, record_type)) == NULL) {
     return -1;
   }
 
-  // before we insert, lets check if it matches our RIB period filter (if we
-  // have one)
-  if (wanted_resource(res, q->filter_mgr) == 0) {
-    bgpstream_resource_destroy(res);
-    return 0;
+  // skip resources that were completed before the stream was checkpointed,
+  // and pick up partially-read ones where we left off
+  if (duration != BGPSTREAM_FOREVER) {
+    if (bgpstream_str_set_exists(q->skip, res->uri) != 0) {
+      bgpstream_str_set_remove(q->skip, res->uri);
+      bgpstream_resource_destroy(res);
+      return 0;
+    }
+    if ((k = kh_get(res_offset, q->resume, res->uri)) != kh_end(q->resume)) {
+      res->resume_offset = kh_val(q->resume, k);
+      free(kh_key(q->resume, k));
+      kh_del(res_offset, q->resume, k);
+    }
   }
 
   // now create a list element to hold the resource
@@ -873,8 +1168,8 @@ int bgpstream_resource_mgr_empty(bgpstream_resource_mgr_t *q)
   return (q->head == NULL);
 }
 
-int bgpstream_resource_mgr_get_record(bgpstream_resource_mgr_t *q,
-                                      bgpstream_record_t **record)
+static int get_record(bgpstream_resource_mgr_t *q, bgpstream_record_t **record,
+                      int blocking)
 {
   int rs = BGPSTREAM_READER_STATUS_EOS;
   int dirty_cnt = 0;
@@ -909,6 +1204,12 @@ int bgpstream_resource_mgr_get_record(bgpstream_resource_mgr_t *q,
     // to do, but for now:
     assert(q->res_open_cnt != 0);
 
+    // if every resource we could read from is waiting to be polled again, then
+    // either let pop_record sleep, or tell the caller to come back later
+    if (blocking == 0 && ready_head(q) == NULL) {
+      return BGPSTREAM_AGAIN;
+    }
+
     // we now know that we have open resources to read from, lets do it
     if ((rs = pop_record(q, record)) == BGPSTREAM_READER_STATUS_ERROR) {
       return -1;
@@ -922,3 +1223,151 @@ int bgpstream_resource_mgr_get_record(bgpstream_resource_mgr_t *q,
 err:
   return -1;
 }
+
+int bgpstream_resource_mgr_get_record(bgpstream_resource_mgr_t *q,
+                                      bgpstream_record_t **record)
+{
+  return get_record(q, record, 1);
+}
+
+int bgpstream_resource_mgr_get_record_nb(bgpstream_resource_mgr_t *q,
+                                         bgpstream_record_t **record)
+{
+  return get_record(q, record, 0);
+}
+
+uint64_t bgpstream_resource_mgr_get_next_poll_time(bgpstream_resource_mgr_t *q)
+{
+  return poll_wheel_next_deadline(&q->wheel);
+}
+
+int bgpstream_resource_mgr_get_stats(bgpstream_resource_mgr_t *q,
+                                     bgpstream_stats_t *stats, int stats_cnt)
+{
+  bgpstream_stats_t total;
+  struct res_group *gp;
+  struct res_list_elem *el;
+  int i;
+
+  memset(&total, 0, sizeof(bgpstream_stats_t));
+
+  // resources that have been read to the end
+  for (i = 0; i < q->stats_cnt; i++) {
+    bgpstream_stats_add(&total, &q->stats[i]);
+    if (i + 1 < stats_cnt) {
+      stats[i + 1] = q->stats[i];
+    }
+  }
+
+  // plus those that are still open
+  for (gp = q->head; gp != NULL; gp = gp->next) {
+    for (i = 0; i < _BGPSTREAM_RECORD_TYPE_CNT; i++) {
+      for (el = gp->res_list[i]; el != NULL; el = el->next) {
+        if (el->reader == NULL) {
+          continue;
+        }
+        bgpstream_reader_add_stats(el->reader, &total);
+        if (el->stats_idx + 1 < stats_cnt) {
+          bgpstream_reader_add_stats(el->reader, &stats[el->stats_idx + 1]);
+        }
+      }
+    }
+  }
+
+  if (stats_cnt > 0) {
+    stats[0] = total;
+  }
+
+  return q->stats_cnt + 1;
+}
+
+void bgpstream_resource_mgr_set_checkpointing(bgpstream_resource_mgr_t *q,
+                                              int enabled)
+{
+  q->checkpointing = (enabled != 0);
+  if (q->checkpointing == 0) {
+    bgpstream_str_set_clear(q->done);
+  }
+}
+
+int bgpstream_resource_mgr_set_done(bgpstream_resource_mgr_t *q,
+                                    const char *uri)
+{
+  // it stays done in the next checkpoint
+  if (bgpstream_str_set_insert(q->done, uri) < 0 ||
+      bgpstream_str_set_insert(q->skip, uri) < 0) {
+    return -1;
+  }
+  return 0;
+}
+
+int bgpstream_resource_mgr_set_resume_offset(bgpstream_resource_mgr_t *q,
+                                             const char *uri, uint64_t offset)
+{
+  khiter_t k;
+  int khret;
+  char *cpy;
+
+  if ((k = kh_get(res_offset, q->resume, (char *)uri)) == kh_end(q->resume)) {
+    if ((cpy = strdup(uri)) == NULL) {
+      return -1;
+    }
+    k = kh_put(res_offset, q->resume, cpy, &khret);
+    if (khret < 0) {
+      free(cpy);
+      return -1;
+    }
+  }
+  kh_val(q->resume, k) = offset;
+  return 0;
+}
+
+int bgpstream_resource_mgr_write_checkpoint(bgpstream_resource_mgr_t *q,
+                                            FILE *fh)
+{
+  struct res_group *gp;
+  struct res_list_elem *el;
+  uint64_t offset;
+  khiter_t k;
+  char *uri;
+  int i;
+
+  bgpstream_str_set_rewind(q->done);
+  while ((uri = bgpstream_str_set_next(q->done)) != NULL) {
+    if (fprintf(fh, "done %s\n", uri) < 0) {
+      return -1;
+    }
+  }
+
+  // resources in the queue that have been (or are to be) partially read
+  for (gp = q->head; gp != NULL; gp = gp->next) {
+    for (i = 0; i < _BGPSTREAM_RECORD_TYPE_CNT; i++) {
+      for (el = gp->res_list[i]; el != NULL; el = el->next) {
+        if (el->res->duration == BGPSTREAM_FOREVER) {
+          continue;
+        }
+        offset = el->res->resume_offset;
+        if (el->reader != NULL &&
+            bgpstream_reader_get_offset(el->reader) > offset) {
+          offset = bgpstream_reader_get_offset(el->reader);
+        }
+        if (offset != 0 &&
+            fprintf(fh, "partial %" PRIu64 " %s\n", offset, el->res->uri) <
+              0) {
+          return -1;
+        }
+      }
+    }
+  }
+
+  // and those that the data interface has not given us again yet
+  for (k = kh_begin(q->resume); k != kh_end(q->resume); ++k) {
+    if (kh_exist(q->resume, k) &&
+        fprintf(fh, "partial %" PRIu64 " %s\n", kh_val(q->resume, k),
+                kh_key(q->resume, k)) < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
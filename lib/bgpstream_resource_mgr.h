@@ -33,6 +33,7 @@
 #include "bgpstream_resource.h"
 #include "bgpstream_transport.h"
 #include <stdint.h>
+#include <stdio.h>
 
 /** Opaque pointer representing a resource manager */
 typedef struct bgpstream_resource_mgr bgpstream_resource_mgr_t;
@@ -86,4 +87,89 @@ int bgpstream_resource_mgr_empty(bgpstream_resource_mgr_t *q);
 int bgpstream_resource_mgr_get_record(bgpstream_resource_mgr_t *q,
                                       bgpstream_record_t **record);
 
+/** Get the next record from the stream without waiting for stream resources
+ *
+ * @param q             pointer to the queue
+ * @param[out] record   set to a borrowed pointer to a record if the return
+ *                      code is >0
+ * @return >0 if a record was read successfully, 0 if end-of-stream has been
+ * reached, BGPSTREAM_AGAIN if all the resources that could be read from are
+ * waiting to be polled again, or -1 if an error occurred.
+ */
+int bgpstream_resource_mgr_get_record_nb(bgpstream_resource_mgr_t *q,
+                                         bgpstream_record_t **record);
+
+/** Get the time when the first waiting stream resource should be polled again
+ *
+ * @param q             pointer to the queue
+ * @return the time (in msec since the epoch), or 0 if no resource is waiting
+ */
+uint64_t bgpstream_resource_mgr_get_next_poll_time(bgpstream_resource_mgr_t *q);
+
+/** Get the statistics of the resources read so far
+ *
+ * @param q             pointer to the queue
+ * @param stats         array to fill with the statistics
+ * @param stats_cnt     number of entries available in the stats array
+ * @return the number of entries available
+ *
+ * See bgpstream_get_stats for the layout of the array.
+ */
+int bgpstream_resource_mgr_get_stats(bgpstream_resource_mgr_t *q,
+                                     bgpstream_stats_t *stats, int stats_cnt);
+
+/** Enable or disable tracking of the resources that have been read to the end
+ *
+ * @param q             pointer to the queue
+ * @param enabled       if non-zero, the URI of each (non-stream) resource that
+ *                      is read to the end is kept for
+ *                      bgpstream_resource_mgr_write_checkpoint
+ *
+ * This is disabled by default, since the set of URIs grows for as long as
+ * the stream runs.
+ */
+void bgpstream_resource_mgr_set_checkpointing(bgpstream_resource_mgr_t *q,
+                                              int enabled);
+
+/** Mark the given resource as having been read to the end before the stream
+ * was checkpointed
+ *
+ * @param q             pointer to the queue
+ * @param uri           borrowed pointer to the URI of the resource
+ * @return 0 if successful, -1 otherwise
+ *
+ * The next resource with this URI that is pushed to the queue is ignored.
+ * Resources that are read to the end by this stream are not skipped, so that
+ * a data interface may push the same URI again when it has new data.
+ */
+int bgpstream_resource_mgr_set_done(bgpstream_resource_mgr_t *q,
+                                    const char *uri);
+
+/** Set the offset at which to resume reading the given resource
+ *
+ * @param q             pointer to the queue
+ * @param uri           borrowed pointer to the URI of the resource
+ * @param offset        offset to resume from (see
+ *                      bgpstream_reader_get_offset)
+ * @return 0 if successful, -1 otherwise
+ *
+ * The offset is applied when a resource with this URI is next pushed to the
+ * queue.
+ */
+int bgpstream_resource_mgr_set_resume_offset(bgpstream_resource_mgr_t *q,
+                                             const char *uri, uint64_t offset);
+
+/** Write the position of the queue to the given checkpoint file
+ *
+ * @param q             pointer to the queue
+ * @param fh            file handle to write to
+ * @return 0 if successful, -1 otherwise
+ *
+ * One "done <uri>" line is written for each resource that has been read to the
+ * end, and one "partial <offset> <uri>" line for each resource that has been
+ * partially read. Stream resources are not included.
+ */
+int bgpstream_resource_mgr_write_checkpoint(bgpstream_resource_mgr_t *q,
+                                            FILE *fh);
+
 #endif /* __BGPSTREAM_RESOURCE_MGR_H */
@@ -0,0 +1,689 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_rib.h"
+#include "bgpstream_log.h"
+#include "config.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* number of prefixes removed by a sweep that are buffered at once */
+#define PFXS_ALLOC_CNT 1024
+
+/* A route in the per-prefix array. Packed, since there is one of these for
+   every (prefix, peer) pair */
+typedef struct rib_entry {
+
+  /* peer that the route belongs to */
+  bgpstream_peer_id_t peer_id;
+
+  /* attribute set ID */
+  uint32_t attrs_id;
+
+  /* time of the last update */
+  uint32_t time;
+
+  /* set if the prefix was withdrawn while a RIB dump of the peer was in
+     progress. The entry is kept (and ignored by lookups) so that the dump does
+     not re-install an older route */
+  uint8_t withdrawn;
+
+  /* session generation of the peer that the route was learned in. Routes of
+     older generations were dropped when the session went down, and are
+     removed lazily (see ENTRY_LIVE) */
+  uint8_t gen;
+
+} __attribute__((packed)) rib_entry_t;
+
+/* whether the entry belongs to the current session of its peer */
+#define ENTRY_LIVE(rib, e) ((e)->gen == (rib)->peers[(e)->peer_id].gen)
+
+/* The routes of all peers to a single prefix, sorted by peer ID. This is the
+   user pointer of the patricia tree node of the prefix */
+typedef struct rib_pfx {
+
+  /* number of entries in use */
+  uint16_t entries_cnt;
+
+  /* number of entries allocated */
+  uint16_t entries_alloc;
+
+  rib_entry_t entries[];
+
+} rib_pfx_t;
+
+/* Per-peer state, indexed by peer ID */
+typedef struct rib_peer {
+
+  /* number of (not withdrawn) routes */
+  uint32_t pfx_cnt;
+
+  /* time of the RIB dump in progress (if dump_active is set) */
+  uint32_t dump_time;
+
+  /* set if a RIB dump of the peer is in progress */
+  uint8_t dump_active;
+
+  /* set if the entries of this peer must be swept by the current sweep */
+  uint8_t sweep;
+
+  /* session generation, incremented each time the session goes down */
+  uint8_t gen;
+
+} rib_peer_t;
+
+struct bgpstream_rib {
+
+  /* one node per prefix that (at least) one peer has an entry for */
+  bgpstream_patricia_tree_t *pt;
+
+  /* assigns peer IDs */
+  bgpstream_peer_sig_map_t *peersigns;
+
+  /* interns (AS path, communities, next-hop) attribute sets */
+  bgpstream_attr_store_t *attrs;
+
+  /* per-peer state, indexed by peer ID */
+  rib_peer_t *peers;
+  int peers_alloc;
+
+  /* prefixes left without entries by a sweep */
+  bgpstream_pfx_storage_t *empty_pfxs;
+  int empty_pfxs_cnt;
+  int empty_pfxs_alloc;
+
+  /* time of the last applied record */
+  uint32_t time;
+};
+
+/* state passed to the walk callbacks */
+typedef struct walk_state {
+  bgpstream_rib_t *rib;
+  bgpstream_peer_id_t peer_id;
+  bgpstream_rib_walk_cb_t *cb;
+  void *user;
+} walk_state_t;
+
+/* ========== PRIVATE FUNCTIONS ========== */
+
+static rib_peer_t *get_peer(bgpstream_rib_t *rib, bgpstream_peer_id_t peer_id)
+{
+  rib_peer_t *tmp;
+  int new_alloc;
+
+  if (peer_id >= rib->peers_alloc) {
+    new_alloc = (peer_id + 1) * 2;
+    if (new_alloc > UINT16_MAX + 1) {
+      new_alloc = UINT16_MAX + 1;
+    }
+    if ((tmp = realloc(rib->peers, sizeof(rib_peer_t) * new_alloc)) == NULL) {
+      return NULL;
+    }
+    memset(tmp + rib->peers_alloc, 0,
+           sizeof(rib_peer_t) * (new_alloc - rib->peers_alloc));
+    rib->peers = tmp;
+    rib->peers_alloc = new_alloc;
+  }
+  return &rib->peers[peer_id];
+}
+
+/* find the index of the entry of the given peer, or the index at which it
+   should be inserted (and return 0) */
+static int find_entry(rib_pfx_t *rp, bgpstream_peer_id_t peer_id, int *idx)
+{
+  int lo = 0;
+  int hi = rp->entries_cnt;
+  int mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (rp->entries[mid].peer_id < peer_id) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  *idx = lo;
+  return lo < rp->entries_cnt && rp->entries[lo].peer_id == peer_id;
+}
+
+static void remove_entry(rib_pfx_t *rp, int idx)
+{
+  rp->entries_cnt--;
+  memmove(&rp->entries[idx], &rp->entries[idx + 1],
+          sizeof(rib_entry_t) * (rp->entries_cnt - idx));
+}
+
+/* get the entry of the given peer for the prefix of the given node, adding a
+   (zeroed) entry if there is none */
+static rib_entry_t *get_entry(bgpstream_rib_t *rib,
+                              bgpstream_patricia_node_t *node,
+                              bgpstream_peer_id_t peer_id, int *is_new)
+{
+  rib_pfx_t *rp = bgpstream_patricia_tree_get_user(node);
+  int idx = 0;
+  int new_alloc;
+
+  if (rp != NULL && find_entry(rp, peer_id, &idx)) {
+    if (ENTRY_LIVE(rib, &rp->entries[idx])) {
+      *is_new = 0;
+      return &rp->entries[idx];
+    }
+    /* a route of a previous session, reuse it */
+    memset(&rp->entries[idx], 0, sizeof(rib_entry_t));
+    rp->entries[idx].peer_id = peer_id;
+    rp->entries[idx].gen = rib->peers[peer_id].gen;
+    *is_new = 1;
+    return &rp->entries[idx];
+  }
+
+  if (rp == NULL || rp->entries_cnt == rp->entries_alloc) {
+    /* grow by half, to keep the unused space of large arrays small */
+    new_alloc =
+      (rp == NULL) ? 1 : rp->entries_alloc + rp->entries_alloc / 2 + 1;
+    if (new_alloc > UINT16_MAX) {
+      new_alloc = UINT16_MAX;
+    }
+    if ((rp = realloc(rp, sizeof(rib_pfx_t) +
+                            sizeof(rib_entry_t) * new_alloc)) == NULL) {
+      return NULL;
+    }
+    if (bgpstream_patricia_tree_get_user(node) == NULL) {
+      rp->entries_cnt = 0;
+    }
+    rp->entries_alloc = new_alloc;
+    /* the tree has no destructor, so this does not free the old pointer */
+    bgpstream_patricia_tree_set_user(rib->pt, node, rp);
+  }
+
+  memmove(&rp->entries[idx + 1], &rp->entries[idx],
+          sizeof(rib_entry_t) * (rp->entries_cnt - idx));
+  rp->entries_cnt++;
+  memset(&rp->entries[idx], 0, sizeof(rib_entry_t));
+  rp->entries[idx].peer_id = peer_id;
+  rp->entries[idx].gen = rib->peers[peer_id].gen;
+  *is_new = 1;
+  return &rp->entries[idx];
+}
+
+static int update_route(bgpstream_rib_t *rib, bgpstream_peer_id_t peer_id,
+                        rib_peer_t *peer, bgpstream_record_t *record,
+                        bgpstream_elem_t *elem)
+{
+  bgpstream_patricia_node_t *node;
+  rib_entry_t *e;
+  uint32_t attrs_id;
+  int is_new;
+
+  if (bgpstream_attr_store_get_id(rib->attrs, elem->as_path, elem->peer_asn,
+                                  elem->communities, &elem->nexthop,
+                                  &attrs_id) != 0 ||
+      (node = bgpstream_patricia_tree_insert(
+         rib->pt, (bgpstream_pfx_t *)&elem->prefix)) == NULL ||
+      (e = get_entry(rib, node, peer_id, &is_new)) == NULL) {
+    return -1;
+  }
+
+  /* a RIB dump must not override a more recent update */
+  if (!is_new && elem->type == BGPSTREAM_ELEM_TYPE_RIB &&
+      e->time > record->time_sec) {
+    return 0;
+  }
+  if (is_new || e->withdrawn) {
+    peer->pfx_cnt++;
+  }
+
+  e->attrs_id = attrs_id;
+  e->withdrawn = 0;
+  e->time = record->time_sec;
+  return 0;
+}
+
+static int withdraw_route(bgpstream_rib_t *rib, bgpstream_peer_id_t peer_id,
+                          rib_peer_t *peer, bgpstream_record_t *record,
+                          bgpstream_elem_t *elem)
+{
+  bgpstream_patricia_node_t *node;
+  rib_pfx_t *rp;
+  rib_entry_t *e;
+  int idx;
+  int is_new;
+
+  if (peer->dump_active) {
+    /* the dump may not have reached this prefix yet, so leave a withdrawn
+       entry behind, which the dump will not override */
+    if ((node = bgpstream_patricia_tree_insert(
+           rib->pt, (bgpstream_pfx_t *)&elem->prefix)) == NULL ||
+        (e = get_entry(rib, node, peer_id, &is_new)) == NULL) {
+      return -1;
+    }
+    if (!is_new && !e->withdrawn) {
+      peer->pfx_cnt--;
+    }
+    e->withdrawn = 1;
+    e->time = record->time_sec;
+    return 0;
+  }
+
+  if ((node = bgpstream_patricia_tree_search_exact(
+         rib->pt, (bgpstream_pfx_t *)&elem->prefix)) == NULL ||
+      (rp = bgpstream_patricia_tree_get_user(node)) == NULL ||
+      !find_entry(rp, peer_id, &idx)) {
+    return 0;
+  }
+
+  if (!rp->entries[idx].withdrawn && ENTRY_LIVE(rib, &rp->entries[idx])) {
+    peer->pfx_cnt--;
+  }
+  remove_entry(rp, idx);
+  if (rp->entries_cnt == 0) {
+    free(rp);
+    bgpstream_patricia_tree_set_user(rib->pt, node, NULL);
+    bgpstream_patricia_tree_remove_node(rib->pt, node);
+  }
+  return 0;
+}
+
+static int buffer_empty_pfx(bgpstream_rib_t *rib, bgpstream_pfx_t *pfx)
+{
+  bgpstream_pfx_storage_t *tmp;
+
+  if (rib->empty_pfxs_cnt == rib->empty_pfxs_alloc) {
+    if ((tmp = realloc(rib->empty_pfxs,
+                       sizeof(bgpstream_pfx_storage_t) *
+                         (rib->empty_pfxs_alloc + PFXS_ALLOC_CNT))) == NULL) {
+      return -1;
+    }
+    rib->empty_pfxs = tmp;
+    rib->empty_pfxs_alloc += PFXS_ALLOC_CNT;
+  }
+  bgpstream_pfx_copy((bgpstream_pfx_t *)&rib->empty_pfxs[rib->empty_pfxs_cnt],
+                     pfx);
+  rib->empty_pfxs_cnt++;
+  return 0;
+}
+
+/* remove the entries of the peers marked for sweeping that were not updated
+   since the peer's dump started (or all of them, for peers with no dump), and
+   the entries left behind by previous sessions of any peer */
+static void sweep_node(bgpstream_patricia_tree_t *pt,
+                       bgpstream_patricia_node_t *node, void *data)
+{
+  bgpstream_rib_t *rib = (bgpstream_rib_t *)data;
+  rib_pfx_t *rp = bgpstream_patricia_tree_get_user(node);
+  rib_peer_t *peer;
+  rib_entry_t *e;
+  int i, j;
+
+  if (rp == NULL) {
+    return;
+  }
+
+  for (i = 0, j = 0; i < rp->entries_cnt; i++) {
+    e = &rp->entries[i];
+    peer = &rib->peers[e->peer_id];
+    if (!ENTRY_LIVE(rib, e)) {
+      /* not counted in pfx_cnt */
+      continue;
+    }
+    if (peer->sweep &&
+        (e->withdrawn || !peer->dump_active || e->time < peer->dump_time)) {
+      if (!e->withdrawn) {
+        peer->pfx_cnt--;
+      }
+      continue;
+    }
+    if (i != j) {
+      rp->entries[j] = *e;
+    }
+    j++;
+  }
+  rp->entries_cnt = j;
+
+  if (rp->entries_cnt == 0) {
+    free(rp);
+    bgpstream_patricia_tree_set_user(pt, node, NULL);
+    if (buffer_empty_pfx(rib, bgpstream_patricia_tree_get_pfx(node)) != 0) {
+      /* the node is left in the tree, and will be reused or removed later */
+      bgpstream_log(BGPSTREAM_LOG_WARN, "Could not buffer an empty prefix");
+    }
+  }
+}
+
+/* sweep the peers whose sweep flag is set, and reset their flags */
+static void sweep(bgpstream_rib_t *rib)
+{
+  int i;
+
+  rib->empty_pfxs_cnt = 0;
+  bgpstream_patricia_tree_walk(rib->pt, sweep_node, rib);
+
+  /* nodes are removed after the walk, so that it is not disturbed */
+  for (i = 0; i < rib->empty_pfxs_cnt; i++) {
+    bgpstream_patricia_tree_remove(rib->pt,
+                                   (bgpstream_pfx_t *)&rib->empty_pfxs[i]);
+  }
+
+  for (i = 0; i < rib->peers_alloc; i++) {
+    if (rib->peers[i].sweep) {
+      rib->peers[i].sweep = 0;
+      rib->peers[i].dump_active = 0;
+    }
+  }
+}
+
+/* drop all the routes of the given peer, by starting a new session
+   generation. The routes of the old generation are removed by the next sweep,
+   or when the peer updates their prefix again */
+static void peer_down(bgpstream_rib_t *rib, rib_peer_t *peer)
+{
+  peer->dump_active = 0;
+  if (peer->gen == UINT8_MAX) {
+    /* the generation is about to wrap, so the routes of all the previous
+       generations must be gone first */
+    peer->sweep = 1;
+    sweep(rib);
+  }
+  peer->pfx_cnt = 0;
+  peer->gen++;
+}
+
+static void fill_route(bgpstream_rib_t *rib, rib_entry_t *e,
+                       bgpstream_rib_route_t *route)
+{
+  bgpstream_attr_store_attrs_t *attrs =
+    bgpstream_attr_store_get_attrs(rib->attrs, e->attrs_id);
+
+  route->attrs_id = e->attrs_id;
+  route->path_id = attrs->path_id;
+  route->communities_id = attrs->communities_id;
+  route->time = e->time;
+}
+
+static void walk_node(bgpstream_patricia_tree_t *pt,
+                      bgpstream_patricia_node_t *node, void *data)
+{
+  walk_state_t *ws = (walk_state_t *)data;
+  rib_pfx_t *rp = bgpstream_patricia_tree_get_user(node);
+  bgpstream_pfx_t *pfx = bgpstream_patricia_tree_get_pfx(node);
+  bgpstream_rib_route_t route;
+  rib_entry_t *e;
+  int i;
+
+  if (rp == NULL) {
+    return;
+  }
+
+  if (ws->peer_id != 0) {
+    if (!find_entry(rp, ws->peer_id, &i)) {
+      return;
+    }
+    e = &rp->entries[i];
+    if (!e->withdrawn && ENTRY_LIVE(ws->rib, e)) {
+      fill_route(ws->rib, e, &route);
+      ws->cb(pfx, e->peer_id, &route, ws->user);
+    }
+    return;
+  }
+
+  for (i = 0; i < rp->entries_cnt; i++) {
+    e = &rp->entries[i];
+    if (e->withdrawn || !ENTRY_LIVE(ws->rib, e)) {
+      continue;
+    }
+    fill_route(ws->rib, e, &route);
+    ws->cb(pfx, e->peer_id, &route, ws->user);
+  }
+}
+
+static void free_node_user(bgpstream_patricia_tree_t *pt,
+                           bgpstream_patricia_node_t *node, void *data)
+{
+  free(bgpstream_patricia_tree_get_user(node));
+}
+
+/* ========== PUBLIC FUNCTIONS ========== */
+
+bgpstream_rib_t *bgpstream_rib_create()
+{
+  bgpstream_rib_t *rib;
+
+  if ((rib = malloc_zero(sizeof(bgpstream_rib_t))) == NULL) {
+    return NULL;
+  }
+
+  /* entries are reallocated in place, so the tree must not free them */
+  if ((rib->pt = bgpstream_patricia_tree_create(NULL)) == NULL ||
+      (rib->peersigns = bgpstream_peer_sig_map_create()) == NULL ||
+      (rib->attrs = bgpstream_attr_store_create()) == NULL) {
+    goto err;
+  }
+
+  return rib;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create RIB state engine");
+  bgpstream_rib_destroy(rib);
+  return NULL;
+}
+
+void bgpstream_rib_destroy(bgpstream_rib_t *rib)
+{
+  if (rib == NULL) {
+    return;
+  }
+
+  if (rib->pt != NULL) {
+    bgpstream_patricia_tree_walk(rib->pt, free_node_user, NULL);
+    bgpstream_patricia_tree_destroy(rib->pt);
+    rib->pt = NULL;
+  }
+
+  bgpstream_peer_sig_map_destroy(rib->peersigns);
+  rib->peersigns = NULL;
+
+  bgpstream_attr_store_destroy(rib->attrs);
+  rib->attrs = NULL;
+
+  free(rib->peers);
+  rib->peers = NULL;
+
+  free(rib->empty_pfxs);
+  rib->empty_pfxs = NULL;
+
+  free(rib);
+}
+
+int bgpstream_rib_apply_record(bgpstream_rib_t *rib,
+                               bgpstream_record_t *record)
+{
+  bgpstream_elem_t *elem;
+  int rc;
+
+  if (record->status == BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+    while ((rc = bgpstream_record_get_next_elem(record, &elem)) > 0) {
+      if (bgpstream_rib_apply_elem(rib, record, elem) != 0) {
+        return -1;
+      }
+    }
+    if (rc < 0) {
+      return -1;
+    }
+  }
+
+  rib->time = record->time_sec;
+
+  /* the end marker may also be on a record without elems */
+  if (record->type == BGPSTREAM_RIB &&
+      record->dump_pos == BGPSTREAM_DUMP_END) {
+    bgpstream_rib_dump_end(rib, record->collector_name);
+  }
+
+  return 0;
+}
+
+int bgpstream_rib_apply_elem(bgpstream_rib_t *rib, bgpstream_record_t *record,
+                             bgpstream_elem_t *elem)
+{
+  bgpstream_peer_id_t peer_id;
+  rib_peer_t *peer;
+
+  if ((peer_id = bgpstream_peer_sig_map_get_id(
+         rib->peersigns, record->collector_name,
+         (bgpstream_ip_addr_t *)&elem->peer_ip, elem->peer_asn)) == 0 ||
+      (peer = get_peer(rib, peer_id)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not get peer state");
+    return -1;
+  }
+
+  rib->time = record->time_sec;
+
+  switch (elem->type) {
+  case BGPSTREAM_ELEM_TYPE_RIB:
+    if (!peer->dump_active) {
+      peer->dump_active = 1;
+      peer->dump_time = record->time_sec;
+    }
+    /* fall through */
+  case BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT:
+    if (update_route(rib, peer_id, peer, record, elem) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not update route");
+      return -1;
+    }
+    break;
+
+  case BGPSTREAM_ELEM_TYPE_WITHDRAWAL:
+    if (withdraw_route(rib, peer_id, peer, record, elem) != 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not withdraw route");
+      return -1;
+    }
+    break;
+
+  case BGPSTREAM_ELEM_TYPE_PEERSTATE:
+    /* a session that is not established has no routes */
+    if (elem->new_state != BGPSTREAM_ELEM_PEERSTATE_ESTABLISHED &&
+        peer->pfx_cnt != 0) {
+      peer_down(rib, peer);
+    }
+    break;
+
+  default:
+    break;
+  }
+
+  return 0;
+}
+
+void bgpstream_rib_dump_end(bgpstream_rib_t *rib, const char *collector)
+{
+  bgpstream_peer_sig_t *sig;
+  int i;
+  int found = 0;
+
+  for (i = 1; i < rib->peers_alloc; i++) {
+    if (!rib->peers[i].dump_active ||
+        (sig = bgpstream_peer_sig_map_get_sig(rib->peersigns, i)) == NULL ||
+        strcmp(sig->collector_str, collector) != 0) {
+      continue;
+    }
+    rib->peers[i].sweep = 1;
+    found = 1;
+  }
+
+  if (found) {
+    sweep(rib);
+  }
+}
+
+uint32_t bgpstream_rib_get_time(bgpstream_rib_t *rib)
+{
+  return rib->time;
+}
+
+int bgpstream_rib_get_route(bgpstream_rib_t *rib, bgpstream_peer_id_t peer_id,
+                            bgpstream_pfx_t *pfx, bgpstream_rib_route_t *route)
+{
+  bgpstream_patricia_node_t *node;
+  rib_pfx_t *rp;
+  int idx;
+
+  if ((node = bgpstream_patricia_tree_search_exact(rib->pt, pfx)) == NULL ||
+      (rp = bgpstream_patricia_tree_get_user(node)) == NULL ||
+      !find_entry(rp, peer_id, &idx) || rp->entries[idx].withdrawn ||
+      !ENTRY_LIVE(rib, &rp->entries[idx])) {
+    return 0;
+  }
+
+  if (route != NULL) {
+    fill_route(rib, &rp->entries[idx], route);
+  }
+  return 1;
+}
+
+uint32_t bgpstream_rib_get_peer_pfx_cnt(bgpstream_rib_t *rib,
+                                        bgpstream_peer_id_t peer_id)
+{
+  if (peer_id >= rib->peers_alloc) {
+    return 0;
+  }
+  return rib->peers[peer_id].pfx_cnt;
+}
+
+void bgpstream_rib_walk(bgpstream_rib_t *rib, bgpstream_peer_id_t peer_id,
+                        bgpstream_rib_walk_cb_t *cb, void *user)
+{
+  walk_state_t ws;
+
+  ws.rib = rib;
+  ws.peer_id = peer_id;
+  ws.cb = cb;
+  ws.user = user;
+
+  bgpstream_patricia_tree_walk(rib->pt, walk_node, &ws);
+}
+
+bgpstream_peer_sig_map_t *bgpstream_rib_get_peer_sig_map(bgpstream_rib_t *rib)
+{
+  return rib->peersigns;
+}
+
+bgpstream_attr_store_t *bgpstream_rib_get_attr_store(bgpstream_rib_t *rib)
+{
+  return rib->attrs;
+}
+
+bgpstream_as_path_store_t *
+bgpstream_rib_get_as_path_store(bgpstream_rib_t *rib)
+{
+  return bgpstream_attr_store_get_as_path_store(rib->attrs);
+}
+
+bgpstream_community_set_t *
+bgpstream_rib_get_communities(bgpstream_rib_t *rib, uint32_t communities_id)
+{
+  return bgpstream_attr_store_get_communities(rib->attrs, communities_id);
+}
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_RIB_H
+#define __BGPSTREAM_RIB_H
+
+#include "bgpstream_elem.h"
+#include "bgpstream_record.h"
+#include "bgpstream_utils.h"
+
+/** @file
+ *
+ * @brief Header file that exposes the public interface of the BGPStream RIB
+ * state engine.
+ *
+ * The engine reconstructs the routing table of every peer from the elem
+ * stream: RIB and announcement elems install routes, withdrawal elems remove
+ * them, and a peer leaving the established state (a PEERSTATE elem) clears
+ * all of its routes. When a RIB dump of a collector ends (a record with
+ * dump_pos BGPSTREAM_DUMP_END), the routes of the peers that appeared in the
+ * dump and that were neither refreshed by the dump nor announced since it
+ * started are removed.
+ *
+ * Prefixes are stored once, in a single Patricia Tree shared by all peers.
+ * Each prefix holds a compact array of (peer ID, attribute set ID, time)
+ * entries, where (AS path, communities, next-hop) attribute sets are interned
+ * in an Attribute Store, and peers are identified using a Peer Signature
+ * Map. A route therefore costs 12 bytes per peer, which allows dozens of
+ * full-feed peers to be held in memory at once.
+ *
+ * The state of the engine after a record has been applied is the state of the
+ * routing tables at the time of that record, so a snapshot at an arbitrary
+ * time T is taken by applying all records up to (and including) T, and then
+ * walking the engine using bgpstream_rib_walk.
+ *
+ */
+
+/**
+ * @name Public Opaque Data Structures
+ *
+ * @{ */
+
+/** Opaque structure containing a RIB state engine instance */
+typedef struct bgpstream_rib bgpstream_rib_t;
+
+/** @} */
+
+/**
+ * @name Public Data Structures
+ *
+ * @{ */
+
+/** A route to a prefix, as observed by a single peer */
+typedef struct bgpstream_rib_route {
+
+  /** ID of the attribute set of the route in the Attribute Store of the engine
+      (see bgpstream_rib_get_attr_store) */
+  uint32_t attrs_id;
+
+  /** ID of the AS path of the route in the AS Path Store of the engine (see
+      bgpstream_rib_get_as_path_store) */
+  bgpstream_as_path_store_path_id_t path_id;
+
+  /** ID of the community set of the route (see
+      bgpstream_rib_get_communities) */
+  uint32_t communities_id;
+
+  /** Time of the record that the route was last updated by */
+  uint32_t time;
+
+} bgpstream_rib_route_t;
+
+/** Callback invoked by bgpstream_rib_walk for every route
+ *
+ * @param pfx           pointer to the prefix of the route
+ * @param peer_id       ID of the peer that observed the route
+ * @param route         pointer to the route
+ * @param user          user pointer passed to bgpstream_rib_walk
+ */
+typedef void(bgpstream_rib_walk_cb_t)(bgpstream_pfx_t *pfx,
+                                      bgpstream_peer_id_t peer_id,
+                                      bgpstream_rib_route_t *route, void *user);
+
+/** @} */
+
+/**
+ * @name Public API Functions
+ *
+ * @{ */
+
+/** Create a new (empty) RIB state engine
+ *
+ * @return a pointer to the engine, or NULL if an error occurred
+ */
+bgpstream_rib_t *bgpstream_rib_create();
+
+/** Destroy the given RIB state engine
+ *
+ * @param rib           pointer to the engine to destroy
+ */
+void bgpstream_rib_destroy(bgpstream_rib_t *rib);
+
+/** Apply all the elems of the given record to the engine
+ *
+ * @param rib           pointer to the engine
+ * @param record        pointer to the record to apply
+ * @return 0 if the record was applied successfully, -1 otherwise
+ *
+ * If the record is the last record of a RIB dump, the end of the dump is also
+ * handled (see bgpstream_rib_dump_end). Records must be applied in the order
+ * in which they are returned by bgpstream.
+ */
+int bgpstream_rib_apply_record(bgpstream_rib_t *rib,
+                               bgpstream_record_t *record);
+
+/** Apply a single elem to the engine
+ *
+ * @param rib           pointer to the engine
+ * @param record        pointer to the record that the elem belongs to
+ * @param elem          pointer to the elem to apply
+ * @return 0 if the elem was applied successfully, -1 otherwise
+ *
+ * Unlike bgpstream_rib_apply_record, this function does not handle the end
+ * of RIB dumps: bgpstream_rib_dump_end must be called once all the elems of
+ * the last record of a dump have been applied.
+ */
+int bgpstream_rib_apply_elem(bgpstream_rib_t *rib, bgpstream_record_t *record,
+                             bgpstream_elem_t *elem);
+
+/** Handle the end of a RIB dump of the given collector
+ *
+ * @param rib           pointer to the engine
+ * @param collector     name of the collector that the dump belongs to
+ *
+ * For every peer of the collector that appeared in the dump, the routes that
+ * were last updated before the dump started are removed.
+ */
+void bgpstream_rib_dump_end(bgpstream_rib_t *rib, const char *collector);
+
+/** Get the time of the last record applied to the engine
+ *
+ * @param rib           pointer to the engine
+ * @return the time of the last record applied, 0 if none have been applied
+ */
+uint32_t bgpstream_rib_get_time(bgpstream_rib_t *rib);
+
+/** Get the route of the given peer to the given prefix
+ *
+ * @param rib           pointer to the engine
+ * @param peer_id       ID of the peer
+ * @param pfx           pointer to the prefix to look up
+ * @param[out] route    if not NULL, filled with the route
+ * @return 1 if the peer has a route to the prefix, 0 otherwise
+ */
+int bgpstream_rib_get_route(bgpstream_rib_t *rib, bgpstream_peer_id_t peer_id,
+                            bgpstream_pfx_t *pfx,
+                            bgpstream_rib_route_t *route);
+
+/** Get the number of prefixes that the given peer has a route to
+ *
+ * @param rib           pointer to the engine
+ * @param peer_id       ID of the peer
+ * @return the number of routes of the peer
+ */
+uint32_t bgpstream_rib_get_peer_pfx_cnt(bgpstream_rib_t *rib,
+                                        bgpstream_peer_id_t peer_id);
+
+/** Walk all the routes in the engine
+ *
+ * @param rib           pointer to the engine
+ * @param peer_id       ID of the peer to walk the routes of, or 0 to walk the
+ *                      routes of all peers
+ * @param cb            callback to invoke for every route
+ * @param user          user pointer to pass to the callback
+ *
+ * Routes are visited in prefix order (IPv4 first), and in peer ID order for
+ * each prefix. The callback must not modify the engine.
+ */
+void bgpstream_rib_walk(bgpstream_rib_t *rib, bgpstream_peer_id_t peer_id,
+                        bgpstream_rib_walk_cb_t *cb, void *user);
+
+/** Get a borrowed pointer to the Peer Signature Map of the engine
+ *
+ * @param rib           pointer to the engine
+ * @return borrowed pointer to the map used to assign peer IDs
+ */
+bgpstream_peer_sig_map_t *bgpstream_rib_get_peer_sig_map(bgpstream_rib_t *rib);
+
+/** Get a borrowed pointer to the Attribute Store of the engine
+ *
+ * @param rib           pointer to the engine
+ * @return borrowed pointer to the store that route attribute set IDs refer to
+ */
+bgpstream_attr_store_t *bgpstream_rib_get_attr_store(bgpstream_rib_t *rib);
+
+/** Get a borrowed pointer to the AS Path Store of the engine
+ *
+ * @param rib           pointer to the engine
+ * @return borrowed pointer to the store that route path IDs refer to
+ *
+ * The AS path of a route can be retrieved by passing the path ID of the route
+ * to bgpstream_as_path_store_get_store_path, and the result (along with the
+ * ASN of the peer) to bgpstream_as_path_store_path_get_path.
+ */
+bgpstream_as_path_store_t *
+bgpstream_rib_get_as_path_store(bgpstream_rib_t *rib);
+
+/** Get the community set with the given ID
+ *
+ * @param rib           pointer to the engine
+ * @param communities_id  ID of the community set (from a route)
+ * @return borrowed pointer to the community set, NULL if the ID is unknown
+ */
+bgpstream_community_set_t *
+bgpstream_rib_get_communities(bgpstream_rib_t *rib, uint32_t communities_id);
+
+/** @} */
+
+#endif /* __BGPSTREAM_RIB_H */
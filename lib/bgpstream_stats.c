@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_stats.h"
+#include "config.h"
+#include <time.h>
+
+uint64_t bgpstream_stats_nsec(void)
+{
+  struct timespec ts;
+
+  // on linux this is read through the vDSO, so no system call is made
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec) | 1;
+}
+
+void bgpstream_stats_add(bgpstream_stats_t *dst, const bgpstream_stats_t *src)
+{
+  dst->resources += src->resources;
+  dst->records += src->records;
+  dst->bytes_read += src->bytes_read;
+  dst->msgs_read += src->msgs_read;
+  dst->msgs_filtered += src->msgs_filtered;
+  dst->msgs_skipped += src->msgs_skipped;
+  dst->msgs_corrupted += src->msgs_corrupted;
+  dst->elems += src->elems;
+  dst->elems_filtered += src->elems_filtered;
+  dst->open_wait_nsec += src->open_wait_nsec;
+  dst->read_nsec += src->read_nsec;
+  dst->decode_nsec += src->decode_nsec;
+  dst->filter_nsec += src->filter_nsec;
+  dst->elem_filter_nsec += src->elem_filter_nsec;
+}
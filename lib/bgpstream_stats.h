@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_STATS_H
+#define __BGPSTREAM_STATS_H
+
+#include "bgpstream.h"
+#include "bgpstream_filter.h"
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Header file that exposes the private helpers used to collect the
+ * stream statistics returned by bgpstream_get_stats.
+ *
+ * Counters are kept in the format and reader instances, so they are only ever
+ * updated by the thread that is reading from the resource (the opener thread
+ * until the resource is open, and then the user's thread). They are merged
+ * into per-collector statistics by the resource manager.
+ *
+ */
+
+/**
+ * @name Private Macros
+ *
+ * @{ */
+
+/** Start a timer (evaluates to 0 if timing is disabled, i.e., if the
+ * stats_timing field of the given filter manager is not set) */
+#define BGPSTREAM_STATS_TIMER_START(filter_mgr)                                \
+  ((filter_mgr)->stats_timing != 0 ? bgpstream_stats_nsec() : 0)
+
+/** Add the time since the given timer was started to the given counter */
+#define BGPSTREAM_STATS_TIMER_ADD(counter, start)                              \
+  do {                                                                         \
+    if ((start) != 0) {                                                        \
+      (counter) += bgpstream_stats_nsec() - (start);                           \
+    }                                                                          \
+  } while (0)
+
+/** @} */
+
+/**
+ * @name Private API Functions
+ *
+ * @{ */
+
+/** Get the current time from a monotonic clock
+ *
+ * @return the time in nanoseconds (never 0)
+ */
+uint64_t bgpstream_stats_nsec(void);
+
+/** Add the counters and timers of one stats structure to another
+ *
+ * @param dst           pointer to the structure to add to
+ * @param src           pointer to the structure to add
+ *
+ * The project and collector names are not changed.
+ */
+void bgpstream_stats_add(bgpstream_stats_t *dst, const bgpstream_stats_t *src);
+
+/** @} */
+
+#endif /* __BGPSTREAM_STATS_H */
@@ -110,6 +110,15 @@ int64_t bgpstream_transport_read(bgpstream_transport_t *transport, void *buffer,
   return transport->read(transport, buffer, len);
 }
 
+uint64_t bgpstream_transport_get_time_offset(bgpstream_transport_t *transport,
+                                             uint32_t time)
+{
+  if (transport->get_time_offset == NULL) {
+    return 0;
+  }
+  return transport->get_time_offset(transport, time);
+}
+
 void bgpstream_transport_destroy(bgpstream_transport_t *transport)
 {
   if (transport == NULL) {
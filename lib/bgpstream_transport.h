@@ -60,6 +60,18 @@ int64_t bgpstream_transport_read(bgpstream_transport_t *transport, void *buffer,
 int64_t bgpstream_transport_readline(bgpstream_transport_t *transport,
                                      void *buffer, int64_t len);
 
+/** Find where to start reading to get the records from the given time
+ *
+ * @param transport     pointer to a transport handler
+ * @param time          time of the first record wanted
+ * @return the offset of a record such that every record before it is older
+ * than the given time, or 0 if the transport does not know of one
+ *
+ * Data up to the returned offset can be skipped without being decoded.
+ */
+uint64_t bgpstream_transport_get_time_offset(bgpstream_transport_t *transport,
+                                             uint32_t time);
+
 /** Shutdown and destroy the given transport handler
  *
  * @param transport     pointer to a transport handler to destroy
@@ -98,6 +98,19 @@ struct bgpstream_transport {
    */
   void (*destroy)(struct bgpstream_transport *transport);
 
+  /** Find where to start reading to get the records from the given time
+   *
+   * @param t           The data transport object to look up
+   * @param time        The time of the first record wanted
+   * @return the offset (in bytes of the data returned by read) of a record
+   * such that every record before it is older than the given time, 0 if no
+   * such record is known
+   *
+   * This method is optional (NULL if the transport does not index the data it
+   * reads).
+   */
+  uint64_t (*get_time_offset)(struct bgpstream_transport *t, uint32_t time);
+
   /** }@ */
 
   /**
@@ -133,6 +133,12 @@ typedef struct bsdi_broker_state {
   // the max (file_time + duration) that we have seen
   uint32_t current_window_end;
 
+  // the values of last_response_time and current_window_end that were used
+  // for the most recent query (re-issuing this query after a checkpoint is
+  // restored yields every resource that may not have been read yet)
+  uint32_t query_response_time;
+  uint32_t query_window_end;
+
 } bsdi_broker_state_t;
 
 // the max time we will wait between retries to the broker
@@ -573,6 +579,23 @@ err:
 
 /* ========== PUBLIC METHODS BELOW HERE ========== */
 
+static int get_checkpoint(bsdi_t *di, char *buf, size_t len)
+{
+  return snprintf(buf, len, "%" PRIu32 " %" PRIu32, STATE->query_response_time,
+                  STATE->query_window_end);
+}
+
+static int set_checkpoint(bsdi_t *di, const char *state)
+{
+  if (sscanf(state, "%" SCNu32 " %" SCNu32, &STATE->last_response_time,
+             &STATE->current_window_end) != 2) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Invalid broker checkpoint state '%s'",
+                  state);
+    return -1;
+  }
+  return 0;
+}
+
 int bsdi_broker_init(bsdi_t *di)
 {
   bsdi_broker_state_t *state;
@@ -582,6 +605,10 @@ int bsdi_broker_init(bsdi_t *di)
   }
   BSDI_SET_STATE(di, state);
 
+  /* the broker is the only interface that needs state to resume a stream */
+  di->get_checkpoint = get_checkpoint;
+  di->set_checkpoint = set_checkpoint;
+
   /* set default state */
   if ((state->broker_url = strdup(BGPSTREAM_DI_BROKER_URL)) == NULL) {
     goto err;
@@ -683,6 +710,9 @@ int bsdi_broker_update_resources(bsdi_t *di)
 
   int success = 0;
 
+  STATE->query_response_time = STATE->last_response_time;
+  STATE->query_window_end = STATE->current_window_end;
+
   if (STATE->last_response_time > 0) {
     // need to add dataAddedSince
     if (snprintf(buf, BUFLEN, "%" PRIu32, STATE->last_response_time) >=
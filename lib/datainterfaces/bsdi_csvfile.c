@@ -112,55 +112,27 @@ enum {
 static int filters_match(bsdi_t *di)
 {
   bgpstream_filter_mgr_t *filter_mgr = BSDI_GET_FILTER_MGR(di);
-  int all_false;
-
-  char *f;
 
   // projects
-  all_false = 1;
-  if (filter_mgr->projects != NULL) {
-    bgpstream_str_set_rewind(filter_mgr->projects);
-    while ((f = bgpstream_str_set_next(filter_mgr->projects)) != NULL) {
-      if (strcmp(f, STATE->project) == 0) {
-        all_false = 0;
-        break;
-      }
-    }
-    if (all_false != 0) {
-      return 0;
-    }
+  if (filter_mgr->projects != NULL &&
+      bgpstream_str_set_exists(filter_mgr->projects, STATE->project) == 0) {
+    return 0;
   }
 
   // collectors
-  all_false = 1;
-  if (filter_mgr->collectors != NULL) {
-    bgpstream_str_set_rewind(filter_mgr->collectors);
-    while ((f = bgpstream_str_set_next(filter_mgr->collectors)) != NULL) {
-      if (strcmp(f, STATE->collector) == 0) {
-        all_false = 0;
-        break;
-      }
-    }
-    if (all_false != 0) {
-      return 0;
-    }
+  if (filter_mgr->collectors != NULL &&
+      bgpstream_str_set_exists(filter_mgr->collectors, STATE->collector) ==
+        0) {
+    return 0;
   }
 
   // bgp_types
-  all_false = 1;
-  if (filter_mgr->bgp_types != NULL) {
-    bgpstream_str_set_rewind(filter_mgr->bgp_types);
-    while ((f = bgpstream_str_set_next(filter_mgr->bgp_types)) != NULL) {
-      if ((STATE->record_type == BGPSTREAM_UPDATE &&
-           strcmp("updates", f) == 0) ||
-          (STATE->record_type == BGPSTREAM_RIB && strcmp("ribs", f) == 0)) {
-        all_false = 0;
-        break;
-      }
-    }
-    if (all_false != 0) {
-      return 0;
-    }
+  if (filter_mgr->bgp_types != NULL &&
+      bgpstream_str_set_exists(filter_mgr->bgp_types,
+                               STATE->record_type == BGPSTREAM_RIB
+                                 ? "ribs"
+                                 : "updates") == 0) {
+    return 0;
   }
 
   // time_interval
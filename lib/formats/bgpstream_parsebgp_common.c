@@ -31,6 +31,7 @@
 #include "bgpstream_utils_as_path_int.h"
 #include "bgpstream_utils_community_int.h"
 #include "bgpstream_log.h"
+#include "bgpstream_stats.h"
 #include <assert.h>
 #include <string.h>
 #include <errno.h>
@@ -180,10 +181,11 @@ static int handle_as_paths(bgpstream_as_path_t *path,
 }
 
 static ssize_t refill_buffer(bgpstream_parsebgp_decode_state_t *state,
-                             bgpstream_transport_t *transport)
+                             bgpstream_format_t *format)
 {
   size_t len = 0;
   int64_t new_read = 0;
+  uint64_t start;
 
   if (state->remain > 0) {
     // need to move remaining data to start of buffer
@@ -194,18 +196,42 @@ static ssize_t refill_buffer(bgpstream_parsebgp_decode_state_t *state,
   }
 
   // try and do a read
-  if ((new_read = bgpstream_transport_read(transport, state->buffer + len,
-                                           BGPSTREAM_PARSEBGP_BUFLEN - len)) <
-      0) {
+  start = BGPSTREAM_STATS_TIMER_START(format->filter_mgr);
+  new_read = bgpstream_transport_read(format->transport, state->buffer + len,
+                                      BGPSTREAM_PARSEBGP_BUFLEN - len);
+  BGPSTREAM_STATS_TIMER_ADD(format->stats.read_nsec, start);
+  if (new_read < 0) {
     // read failed
     return new_read;
   }
+  format->stats.bytes_read += new_read;
 
   // new_read could be 0, indicating EOF, so need to check returned len is
   // larger than passed in remain
   return len + new_read;
 }
 
+// once the first message has been decoded, work out how much of the rest of
+// the resource can be skipped
+static void first_msg_done(bgpstream_parsebgp_decode_state_t *state,
+                           bgpstream_format_t *format)
+{
+  bgpstream_interval_filter_t *tif = format->filter_mgr->time_interval;
+  uint64_t offset;
+
+  if (state->first_done != 0) {
+    return;
+  }
+  state->first_done = 1;
+
+  state->skip_offset = format->res->resume_offset;
+  if (tif != NULL && tif->begin_time > 0 &&
+      (offset = bgpstream_transport_get_time_offset(
+         format->transport, tif->begin_time)) > state->skip_offset) {
+    state->skip_offset = offset;
+  }
+}
+
 static bgpstream_format_status_t
 handle_eof(bgpstream_parsebgp_decode_state_t *state, bgpstream_record_t *record,
            uint64_t skipped_cnt)
@@ -264,6 +290,40 @@ static int handle_prefix(bgpstream_elem_t *elem,
   return 1;
 }
 
+/* All the withdrawals (or announcements) of an UPDATE share the peer and path
+ * attributes, so check the filters that only depend on those once, and drop
+ * all of the elems if they fail */
+static void filter_shared(bgpstream_record_t *record, bgpstream_elem_t *elem,
+                          bgpstream_elem_type_t elem_type, int *v4_cnt,
+                          int *v6_cnt)
+{
+  bgpstream_stats_t *stats = bgpstream_record_get_elem_stats(record);
+  uint64_t start = 0;
+  int pass;
+
+  if (*v4_cnt == 0 && *v6_cnt == 0) {
+    return;
+  }
+
+  if (stats != NULL) {
+    start = BGPSTREAM_STATS_TIMER_START(record->__int->format->filter_mgr);
+  }
+  elem->type = elem_type;
+  pass = bgpstream_record_check_shared_elem_filters(record, elem);
+  if (stats != NULL) {
+    BGPSTREAM_STATS_TIMER_ADD(stats->elem_filter_nsec, start);
+  }
+
+  if (pass == 0) {
+    if (stats != NULL) {
+      stats->elems += *v4_cnt + *v6_cnt;
+      stats->elems_filtered += *v4_cnt + *v6_cnt;
+    }
+    *v4_cnt = 0;
+    *v6_cnt = 0;
+  }
+}
+
 #define WITHDRAWAL_GENERATOR(nlri_type, prefixes)                              \
   do {                                                                         \
     rc = 0;                                                                    \
@@ -310,7 +370,8 @@ static int handle_prefix(bgpstream_elem_t *elem,
     }                                                                          \
   } while (0)
 
-int bgpstream_parsebgp_process_update(bgpstream_parsebgp_upd_state_t *upd_state,
+int bgpstream_parsebgp_process_update(bgpstream_record_t *record,
+                                      bgpstream_parsebgp_upd_state_t *upd_state,
                                       bgpstream_elem_t *elem,
                                       parsebgp_bgp_msg_t *bgp)
 {
@@ -349,6 +410,9 @@ int bgpstream_parsebgp_process_update(bgpstream_parsebgp_upd_state_t *upd_state,
 
     // all other flags left set to zero
 
+    filter_shared(record, elem, BGPSTREAM_ELEM_TYPE_WITHDRAWAL,
+                  &upd_state->withdrawal_v4_cnt, &upd_state->withdrawal_v6_cnt);
+
     upd_state->ready = 1;
   }
 
@@ -374,6 +438,9 @@ int bgpstream_parsebgp_process_update(bgpstream_parsebgp_upd_state_t *upd_state,
       return -1;
     }
     upd_state->path_attr_done = 1;
+
+    filter_shared(record, elem, BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT,
+                  &upd_state->announce_v4_cnt, &upd_state->announce_v6_cnt);
   }
 
   // IPv4 Announcements (will also trigger next-hop extraction)
@@ -508,8 +575,10 @@ bgpstream_format_status_t bgpstream_parsebgp_populate_record(
   ssize_t fill_len = 0;
   size_t dec_len = 0, hdr_len = 0;
   uint64_t skipped_cnt = 0;
+  uint64_t skip;
   parsebgp_error_t err;
   int filter;
+  uint64_t start;
 
   record->status = BGPSTREAM_RECORD_STATUS_CORRUPTED_SOURCE;
 
@@ -528,7 +597,7 @@ refill:
   // shifted to the beginning of the buffer, and the rest filled).
   if (state->remain == 0 || refill != 0) {
     // try to refill the buffer
-    if ((fill_len = refill_buffer(state, format->transport)) == 0) {
+    if ((fill_len = refill_buffer(state, format)) == 0) {
       // EOF
       return handle_eof(state, record, skipped_cnt);
     }
@@ -542,6 +611,7 @@ refill:
       if(errno == EIO){
         bgpstream_log(BGPSTREAM_LOG_WARN, "Unexpected EOF. Input file potentially truncated or corrupted.");
         // return corrupted dump
+        format->stats.msgs_corrupted++;
         record->status = BGPSTREAM_RECORD_STATUS_CORRUPTED_RECORD;
         return BGPSTREAM_FORMAT_CORRUPTED_DUMP;
       }
@@ -550,6 +620,7 @@ refill:
       return BGPSTREAM_FORMAT_READ_ERROR;
     }
     if (fill_len == state->remain) {
+      format->stats.msgs_corrupted++;
       record->status = BGPSTREAM_RECORD_STATUS_CORRUPTED_RECORD;
       return BGPSTREAM_FORMAT_CORRUPTED_DUMP;
     }
@@ -567,6 +638,31 @@ refill:
     return handle_eof(state, record, skipped_cnt);
   }
 
+  // skip over the data that has already been processed (if we are resuming
+  // from a checkpoint) or that is older than our interval (if the transport
+  // has an index). the first message is always decoded since it may carry
+  // state needed by the rest of the dump (e.g., the RIB peer index table)
+  if (state->first_done != 0 && state->offset < state->skip_offset) {
+    skip = state->skip_offset - state->offset;
+    if (skip > state->remain) {
+      skip = state->remain;
+    }
+    state->ptr += skip;
+    state->remain -= skip;
+    state->offset += skip;
+    // the skipped messages count as read (and, if resuming, as returned), so
+    // that the records that follow are not treated as the start of the dump,
+    // and EOF is not treated as an empty dump
+    if (state->successful_read_cnt == 0) {
+      state->successful_read_cnt = 1;
+    }
+    if (state->valid_read_cnt == 0 &&
+        state->offset <= format->res->resume_offset) {
+      state->valid_read_cnt = 1;
+    }
+    goto refill;
+  }
+
   // see if the caller wants to parse some special headers (openbmp...)
   if (prep_cb != NULL) {
     hdr_len = state->remain;
@@ -576,11 +672,15 @@ refill:
     }
     state->ptr += hdr_len;
     state->remain -= hdr_len;
+    state->offset += hdr_len;
   }
 
   dec_len = state->remain;
-  if ((err = parsebgp_decode(state->parser_opts, state->msg_type, msg,
-                             state->ptr, &dec_len)) != PARSEBGP_OK) {
+  start = BGPSTREAM_STATS_TIMER_START(format->filter_mgr);
+  err = parsebgp_decode(state->parser_opts, state->msg_type, msg, state->ptr,
+                        &dec_len);
+  BGPSTREAM_STATS_TIMER_ADD(format->stats.decode_nsec, start);
+  if (err != PARSEBGP_OK) {
     parsebgp_clear_msg(msg);
     if (err == PARSEBGP_PARTIAL_MSG) {
       // refill the buffer and try again
@@ -592,8 +692,11 @@ refill:
                     state->successful_read_cnt,
                     format->res->uri);
       state->successful_read_cnt++;
+      format->stats.msgs_corrupted++;
       state->ptr += dec_len;
       state->remain -= dec_len;
+      state->offset += dec_len;
+      first_msg_done(state, format);
       goto refill; // skip to the next message (not a forced refill)
     }
     // else: its a fatal error
@@ -607,25 +710,41 @@ refill:
     fclose(fp);
 #endif
 
+    format->stats.msgs_corrupted++;
     record->status = BGPSTREAM_RECORD_STATUS_CORRUPTED_RECORD;
     return BGPSTREAM_FORMAT_CORRUPTED_DUMP;
   }
   // else: successful read
   state->ptr += dec_len;
   state->remain -= dec_len;
+  state->offset += dec_len;
+  first_msg_done(state, format);
 
   // got a message!
   // let the caller decide if they want it
-  if ((filter = filter_cb(format, record, msg)) < 0) {
+  start = BGPSTREAM_STATS_TIMER_START(format->filter_mgr);
+  filter = filter_cb(format, record, msg);
+  BGPSTREAM_STATS_TIMER_ADD(format->stats.filter_nsec, start);
+  if (filter < 0) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "Format-specific filtering failed");
     return BGPSTREAM_FORMAT_UNKNOWN_ERROR;
   }
 
-  if (filter == BGPSTREAM_PARSEBGP_KEEP) {
+  if (filter == BGPSTREAM_PARSEBGP_KEEP &&
+      state->offset <= format->res->resume_offset) {
+    // this message was already returned before the checkpoint was taken
+    state->valid_read_cnt++;
+    state->successful_read_cnt++;
+    parsebgp_clear_msg(msg);
+    refill = 0;
+    goto refill;
+  } else if (filter == BGPSTREAM_PARSEBGP_KEEP) {
     // valid message, and it passes our filters
     state->valid_read_cnt++;
     state->successful_read_cnt++;
+    format->stats.msgs_read++;
     record->status = BGPSTREAM_RECORD_STATUS_VALID_RECORD;
+    record->__int->offset = state->offset;
   } else if (filter == BGPSTREAM_PARSEBGP_EOS) {
     if (state->successful_read_cnt > 0) {
       // we can't tell if it is the end since we're not going to read any more,
@@ -645,6 +764,9 @@ refill:
       }
       skipped_cnt++;
       state->successful_read_cnt++;
+      format->stats.msgs_filtered++;
+    } else {
+      format->stats.msgs_skipped++;
     }
     parsebgp_clear_msg(msg);
     // there is a cool corner case here when our buffer ends perfectly at the
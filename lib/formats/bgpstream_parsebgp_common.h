@@ -121,13 +121,19 @@ void bgpstream_parsebgp_upd_state_reset(
 
 /** Process the given UPDATE message and extract a single elem from it
  *
+ * @param record        pointer to the record that the UPDATE was read into
+ *                      (its format's elem filters and statistics are used)
  * @param upd_state     pointer to the generator state
  * @param elem          pointer to the elem to populate
  * @param bgp           pointer to a parsed BGP message
  * @return 1 if the elem was populated, 0 if there are no more elems, -1 if an
  * error occurred.
+ *
+ * If the peer or path attributes of the UPDATE fail the elem filters, none of
+ * its withdrawals (or announcements) are extracted.
  */
-int bgpstream_parsebgp_process_update(bgpstream_parsebgp_upd_state_t *upd_state,
+int bgpstream_parsebgp_process_update(bgpstream_record_t *record,
+                                      bgpstream_parsebgp_upd_state_t *upd_state,
                                       bgpstream_elem_t *elem,
                                       parsebgp_bgp_msg_t *bgp);
 
@@ -156,6 +162,16 @@ typedef struct bgpstream_parsebgp_decode_state {
   // the number of non-filtered reads (i.e. "useful")
   uint64_t valid_read_cnt;
 
+  // the number of (decompressed) bytes of the resource that have been consumed
+  uint64_t offset;
+
+  // has the first message of the resource been decoded
+  int first_done;
+
+  // offset up to which data can be skipped without being decoded (set once
+  // the first message has been decoded)
+  uint64_t skip_offset;
+
 } bgpstream_parsebgp_decode_state_t;
 
 typedef enum {
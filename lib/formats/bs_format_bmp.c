@@ -64,12 +64,13 @@ typedef struct state {
 
 } state_t;
 
-static int handle_update(rec_data_t *rd, parsebgp_bgp_msg_t *bgp)
+static int handle_update(bgpstream_record_t *record, rec_data_t *rd,
+                         parsebgp_bgp_msg_t *bgp)
 {
   int rc;
 
-  if ((rc = bgpstream_parsebgp_process_update(&rd->upd_state, rd->elem, bgp)) <
-      0) {
+  if ((rc = bgpstream_parsebgp_process_update(record, &rd->upd_state, rd->elem,
+                                              bgp)) < 0) {
     return rc;
   }
   if (rc == 0) {
@@ -431,7 +432,7 @@ int bs_format_bmp_get_next_elem(bgpstream_format_t *format,
   switch (bmp->type) {
   case PARSEBGP_BMP_TYPE_ROUTE_MON:
     // TODO: explicitly handle end-of-RIB marker
-    rc = handle_update(RDATA, bmp->types.route_mon);
+    rc = handle_update(record, RDATA, bmp->types.route_mon);
     break;
 
   case PARSEBGP_BMP_TYPE_PEER_DOWN:
@@ -228,7 +228,8 @@ static int handle_bgp4mp_state_change(rec_data_t *rd,
   return 1;
 }
 
-static int handle_bgp4mp(rec_data_t *rd, parsebgp_mrt_msg_t *mrt)
+static int handle_bgp4mp(bgpstream_record_t *record, rec_data_t *rd,
+                         parsebgp_mrt_msg_t *mrt)
 {
   int rc = 0;
   parsebgp_mrt_bgp4mp_t *bgp4mp = mrt->types.bgp4mp;
@@ -251,7 +252,7 @@ static int handle_bgp4mp(rec_data_t *rd, parsebgp_mrt_msg_t *mrt)
   case PARSEBGP_MRT_BGP4MP_MESSAGE_AS4:
   case PARSEBGP_MRT_BGP4MP_MESSAGE_LOCAL:
   case PARSEBGP_MRT_BGP4MP_MESSAGE_AS4_LOCAL:
-    rc = bgpstream_parsebgp_process_update(&rd->upd_state, rd->elem,
+    rc = bgpstream_parsebgp_process_update(record, &rd->upd_state, rd->elem,
                                            bgp4mp->data.bgp_msg);
     if (rc == 0) {
       rd->end_of_elems = 1;
@@ -417,7 +418,7 @@ int bs_format_mrt_get_next_elem(bgpstream_format_t *format,
 
   case PARSEBGP_MRT_TYPE_BGP4MP:
   case PARSEBGP_MRT_TYPE_BGP4MP_ET:
-    rc = handle_bgp4mp(RDATA, mrt);
+    rc = handle_bgp4mp(record, RDATA, mrt);
     break;
 
   default:
@@ -29,6 +29,7 @@
 #include "bgpstream_record_int.h"
 #include "bgpstream_log.h"
 #include "bgpstream_parsebgp_common.h"
+#include "bgpstream_stats.h"
 #include "utils.h"
 #include "jsmn_utils.h"
 #include "libjsmn/jsmn.h"
@@ -286,6 +287,7 @@ process_unsupported_message(bgpstream_format_t *format,
 {
   bgpstream_log(BGPSTREAM_LOG_WARN, "unsupported ris-stream message: %s",
                 STATE->json_string_buffer);
+  format->stats.msgs_skipped++;
   record->status = BGPSTREAM_RECORD_STATUS_UNSUPPORTED_RECORD;
   record->collector_name[0] = '\0';
   return BGPSTREAM_FORMAT_UNSUPPORTED_MSG;
@@ -297,6 +299,7 @@ process_corrupted_message(bgpstream_format_t *format,
 {
   bgpstream_log(BGPSTREAM_LOG_WARN, "corrupted ris-stream message: %s",
                 STATE->json_string_buffer);
+  format->stats.msgs_corrupted++;
   record->status = BGPSTREAM_RECORD_STATUS_CORRUPTED_RECORD;
   record->collector_name[0] = '\0';
   return BGPSTREAM_FORMAT_CORRUPTED_MSG;
@@ -554,15 +557,19 @@ bs_format_rislive_populate_record(bgpstream_format_t *format,
 {
   int rc;
   int filter;
+  uint64_t start;
 
 retry:
+  start = BGPSTREAM_STATS_TIMER_START(format->filter_mgr);
   STATE->json_string_buffer_len = bgpstream_transport_readline(
     format->transport, STATE->json_string_buffer, BGPSTREAM_PARSEBGP_BUFLEN);
+  BGPSTREAM_STATS_TIMER_ADD(format->stats.read_nsec, start);
 
   assert(STATE->json_string_buffer_len < BGPSTREAM_PARSEBGP_BUFLEN);
 
   if (STATE->json_string_buffer_len < 0) {
     // corrupted record
+    format->stats.msgs_corrupted++;
     record->status = BGPSTREAM_RECORD_STATUS_CORRUPTED_RECORD;
     record->collector_name[0] = '\0';
     return BGPSTREAM_FORMAT_CORRUPTED_DUMP;
@@ -570,22 +577,31 @@ retry:
     // end of dump
     return BGPSTREAM_FORMAT_END_OF_DUMP;
   }
+  format->stats.bytes_read += STATE->json_string_buffer_len;
 
-  if ((rc = bs_format_process_json_fields(format, record)) != 0) {
+  start = BGPSTREAM_STATS_TIMER_START(format->filter_mgr);
+  rc = bs_format_process_json_fields(format, record);
+  BGPSTREAM_STATS_TIMER_ADD(format->stats.decode_nsec, start);
+  if (rc != 0) {
     return rc;
   }
 
   // reference: bgpstream_parsebgp_common.c:597
-  if ((filter = check_filters(record, format->filter_mgr)) < 0) {
+  start = BGPSTREAM_STATS_TIMER_START(format->filter_mgr);
+  filter = check_filters(record, format->filter_mgr);
+  BGPSTREAM_STATS_TIMER_ADD(format->stats.filter_nsec, start);
+  if (filter < 0) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "Format-specific filtering failed");
     return BGPSTREAM_FORMAT_UNKNOWN_ERROR;
   }
   if (filter != BGPSTREAM_PARSEBGP_KEEP) {
     // move on to the next record
+    format->stats.msgs_filtered++;
     parsebgp_clear_msg(RDATA->msg);
     goto retry;
   }
   // valid message, and it passes our filters
+  format->stats.msgs_read++;
   record->status = BGPSTREAM_RECORD_STATUS_VALID_RECORD;
   return BGPSTREAM_FORMAT_OK;
 }
@@ -603,8 +619,8 @@ int bs_format_rislive_get_next_elem(bgpstream_format_t *format,
 
   switch (RDATA->msg_type) {
   case RISLIVE_MSG_TYPE_UPDATE:
-    rc = bgpstream_parsebgp_process_update(&RDATA->upd_state, RDATA->elem,
-                                           RDATA->msg->types.bgp);
+    rc = bgpstream_parsebgp_process_update(record, &RDATA->upd_state,
+                                           RDATA->elem, RDATA->msg->types.bgp);
     if (rc <= 0) {
       return rc;
     }
@@ -0,0 +1,1508 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bs_http_client.h"
+#include "bgpstream_log.h"
+#include "config.h"
+#include "utils.h"
+#include "wandio.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+// https://developer.mozilla.org/en-US/docs/Web/HTTP/Headers/User-Agent
+#define HTTP_USER_AGENT "libbgpstream/" PACKAGE_VERSION
+
+/* maximum length of a host name */
+#define HOST_LEN 256
+
+/* maximum length of a request, or of a response header line */
+#define LINE_LEN 8192
+
+/* size of the receive buffer of a connection */
+#define CONN_BUF_LEN (64 * 1024)
+
+/* maximum number of idle connections kept in the pool */
+#define POOL_MAX_IDLE 16
+
+/* idle connections older than this (in seconds) are not reused, since the
+   server has likely closed them */
+#define POOL_IDLE_TIMEOUT 15
+
+/* socket connect/send/receive timeout (in seconds). a stalled transfer fails
+   after this long, and is then resumed */
+#define IO_TIMEOUT 60
+
+/* how often (in msec) the abort callback is polled while waiting */
+#define POLL_INTERVAL 250
+
+/* maximum number of times a body is resumed before giving up */
+#define MAX_RETRIES 5
+
+/* maximum number of redirects followed */
+#define MAX_REDIRECTS 5
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* A connection to a server */
+typedef struct http_conn {
+
+  /* socket */
+  int fd;
+
+  /* server the socket is connected to */
+  char host[HOST_LEN];
+  uint16_t port;
+
+  /* when the connection was returned to the pool */
+  time_t idle_since;
+
+  /* abort callback of the request that uses the connection */
+  bs_http_abort_cb_t *abort_cb;
+  void *abort_user;
+
+  /* data received but not consumed yet */
+  uint8_t buf[CONN_BUF_LEN];
+  int buf_off;
+  int buf_len;
+
+} http_conn_t;
+
+/* The pool of idle keep-alive connections, shared by all the threads */
+static struct {
+  pthread_mutex_t mutex;
+
+  /* idle connections, oldest first */
+  http_conn_t *idle[POOL_MAX_IDLE];
+  int idle_cnt;
+
+  /* number of connections opened so far */
+  uint64_t conn_cnt;
+
+} pool = {PTHREAD_MUTEX_INITIALIZER, {NULL}, 0, 0};
+
+struct bs_http_req {
+
+  /* server and path of the resource (updated when redirected) */
+  char host[HOST_LEN];
+  uint16_t port;
+  char *path;
+
+  /* offset of the byte after the last one wanted (0 for the whole rest of
+     the resource) */
+  uint64_t end;
+
+  /* offset of the next byte to return */
+  uint64_t pos;
+
+  /* length of the whole resource (-1 if unknown) */
+  int64_t length;
+
+  /* set if the server honored the range request */
+  int ranged;
+
+  /* connection the body is read from (NULL if it has to be resumed) */
+  http_conn_t *conn;
+
+  /* number of bytes of the body to discard before pos (if the server sent
+     the whole resource instead of the requested range) */
+  uint64_t skip;
+
+  /* number of bytes of the body left to read (-1 if it ends when the server
+     closes the connection) */
+  int64_t body_left;
+
+  /* chunked transfer encoding state */
+  int chunked;
+  uint64_t chunk_left;
+  int chunk_crlf;
+
+  /* set if the server allows the connection to be reused */
+  int keep_alive;
+
+  /* set once the whole body has been read from the connection */
+  int body_done;
+
+  /* set once the end of the wanted bytes has been reached */
+  int eof;
+
+  /* callback that tells whether to abandon the request (or NULL) */
+  bs_http_abort_cb_t *abort_cb;
+  void *abort_user;
+};
+
+/* ========== CONNECTIONS ========== */
+
+static void conn_close(http_conn_t *conn)
+{
+  if (conn == NULL) {
+    return;
+  }
+  close(conn->fd);
+  free(conn);
+}
+
+static int is_aborted(bs_http_abort_cb_t *abort_cb, void *abort_user)
+{
+  return abort_cb != NULL && abort_cb(abort_user) != 0;
+}
+
+/* wait for the given events on the socket, for at most IO_TIMEOUT seconds,
+   polling the abort callback every POLL_INTERVAL msec. returns 0 once the
+   socket is ready, -1 if it timed out or was aborted */
+static int sock_wait(int fd, short events, bs_http_abort_cb_t *abort_cb,
+                     void *abort_user)
+{
+  struct pollfd pfd;
+  int waited = 0;
+  int rc;
+
+  pfd.fd = fd;
+  pfd.events = events;
+  for (;;) {
+    if (is_aborted(abort_cb, abort_user)) {
+      errno = ECANCELED;
+      return -1;
+    }
+    if ((rc = poll(&pfd, 1, POLL_INTERVAL)) > 0) {
+      return 0;
+    }
+    if (rc < 0 && errno != EINTR) {
+      return -1;
+    }
+    if (rc == 0 && (waited += POLL_INTERVAL) >= IO_TIMEOUT * 1000) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+  }
+}
+
+/* connect the socket, giving up after IO_TIMEOUT seconds. returns 0 if the
+   socket is connected, -1 otherwise */
+static int connect_timeout(int fd, const struct sockaddr *addr,
+                           socklen_t addr_len, bs_http_abort_cb_t *abort_cb,
+                           void *abort_user)
+{
+  socklen_t len = sizeof(int);
+  int flags;
+  int err = 0;
+
+  if ((flags = fcntl(fd, F_GETFL, 0)) < 0 ||
+      fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    return -1;
+  }
+
+  if (connect(fd, addr, addr_len) != 0) {
+    if (errno != EINPROGRESS) {
+      return -1;
+    }
+    if (sock_wait(fd, POLLOUT, abort_cb, abort_user) != 0 ||
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0) {
+      // timed out, aborted, or refused
+      return -1;
+    }
+  }
+
+  // receives wait with sock_wait first, and sends rely on the send timeout
+  return (fcntl(fd, F_SETFL, flags) < 0) ? -1 : 0;
+}
+
+static http_conn_t *conn_open(const char *host, uint16_t port,
+                              bs_http_abort_cb_t *abort_cb, void *abort_user)
+{
+  struct addrinfo hints;
+  struct addrinfo *res = NULL, *ai;
+  struct timeval tv;
+  char port_str[8];
+  http_conn_t *conn;
+  int fd = -1;
+  int one = 1;
+  int rc;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  snprintf(port_str, sizeof(port_str), "%" PRIu16, port);
+
+  if ((rc = getaddrinfo(host, port_str, &hints, &res)) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not resolve %s: %s", host,
+                  gai_strerror(rc));
+    return NULL;
+  }
+  for (ai = res; ai != NULL; ai = ai->ai_next) {
+    if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0) {
+      continue;
+    }
+    if (connect_timeout(fd, ai->ai_addr, ai->ai_addrlen, abort_cb,
+                        abort_user) == 0) {
+      break;
+    }
+    close(fd);
+    fd = -1;
+    if (is_aborted(abort_cb, abort_user)) {
+      break;
+    }
+  }
+  freeaddrinfo(res);
+  if (fd < 0) {
+    if (is_aborted(abort_cb, abort_user)) {
+      return NULL;
+    }
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not connect to %s:%" PRIu16, host,
+                  port);
+    return NULL;
+  }
+
+  tv.tv_sec = IO_TIMEOUT;
+  tv.tv_usec = 0;
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+  if ((conn = malloc_zero(sizeof(http_conn_t))) == NULL) {
+    close(fd);
+    return NULL;
+  }
+  conn->fd = fd;
+  strcpy(conn->host, host);
+  conn->port = port;
+  conn->abort_cb = abort_cb;
+  conn->abort_user = abort_user;
+
+  pthread_mutex_lock(&pool.mutex);
+  pool.conn_cnt++;
+  pthread_mutex_unlock(&pool.mutex);
+
+  return conn;
+}
+
+/* take an idle connection to the given server out of the pool */
+static http_conn_t *pool_get(const char *host, uint16_t port)
+{
+  http_conn_t *conn = NULL;
+  time_t now = time(NULL);
+  int i, j;
+
+  pthread_mutex_lock(&pool.mutex);
+  // most recently used first, as it is the most likely to still be open
+  for (i = pool.idle_cnt - 1; i >= 0; i--) {
+    if (pool.idle[i]->port != port || strcmp(pool.idle[i]->host, host) != 0) {
+      continue;
+    }
+    conn = pool.idle[i];
+    for (j = i; j < pool.idle_cnt - 1; j++) {
+      pool.idle[j] = pool.idle[j + 1];
+    }
+    pool.idle_cnt--;
+    if (now - conn->idle_since > POOL_IDLE_TIMEOUT) {
+      // anything older is even more stale
+      conn_close(conn);
+      conn = NULL;
+    }
+    break;
+  }
+  pthread_mutex_unlock(&pool.mutex);
+
+  return conn;
+}
+
+/* return a connection to the pool (or close it if the pool is full) */
+static void pool_put(http_conn_t *conn)
+{
+  http_conn_t *victim = NULL;
+  int i;
+
+  if (conn->buf_off != conn->buf_len) {
+    // the server sent more than the body: the connection is out of sync
+    conn_close(conn);
+    return;
+  }
+  conn->idle_since = time(NULL);
+  conn->abort_cb = NULL;
+  conn->abort_user = NULL;
+
+  pthread_mutex_lock(&pool.mutex);
+  if (pool.idle_cnt == POOL_MAX_IDLE) {
+    victim = pool.idle[0];
+    for (i = 0; i < pool.idle_cnt - 1; i++) {
+      pool.idle[i] = pool.idle[i + 1];
+    }
+    pool.idle_cnt--;
+  }
+  pool.idle[pool.idle_cnt++] = conn;
+  pthread_mutex_unlock(&pool.mutex);
+
+  conn_close(victim);
+}
+
+/* refill the (empty) receive buffer. returns the number of bytes received, 0
+   if the server closed the connection, -1 if an error occurred */
+static int64_t conn_fill(http_conn_t *conn)
+{
+  ssize_t n;
+
+  conn->buf_off = conn->buf_len = 0;
+  if (sock_wait(conn->fd, POLLIN, conn->abort_cb, conn->abort_user) != 0) {
+    return -1;
+  }
+  do {
+    n = recv(conn->fd, conn->buf, CONN_BUF_LEN, 0);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return -1;
+  }
+  conn->buf_len = n;
+  return n;
+}
+
+static int64_t conn_read(http_conn_t *conn, void *buffer, int64_t len)
+{
+  ssize_t n;
+
+  if (conn->buf_off == conn->buf_len) {
+    if (len >= CONN_BUF_LEN) {
+      // large reads bypass the buffer
+      if (sock_wait(conn->fd, POLLIN, conn->abort_cb, conn->abort_user) !=
+          0) {
+        return -1;
+      }
+      do {
+        n = recv(conn->fd, buffer, len, 0);
+      } while (n < 0 && errno == EINTR);
+      return n;
+    }
+    if ((n = conn_fill(conn)) <= 0) {
+      return n;
+    }
+  }
+
+  n = conn->buf_len - conn->buf_off;
+  if (n > len) {
+    n = len;
+  }
+  memcpy(buffer, conn->buf + conn->buf_off, n);
+  conn->buf_off += n;
+  return n;
+}
+
+/* read a CRLF-terminated line (without the CRLF). returns its length, or -1
+   if the line is too long or could not be read */
+static int conn_readline(http_conn_t *conn, char *line, int len)
+{
+  int i = 0;
+  char c;
+
+  for (;;) {
+    if (conn->buf_off == conn->buf_len && conn_fill(conn) <= 0) {
+      return -1;
+    }
+    c = conn->buf[conn->buf_off++];
+    if (c == '\n') {
+      if (i > 0 && line[i - 1] == '\r') {
+        i--;
+      }
+      line[i] = '\0';
+      return i;
+    }
+    if (i == len - 1) {
+      return -1;
+    }
+    line[i++] = c;
+  }
+}
+
+static int conn_write(http_conn_t *conn, const char *buf, size_t len)
+{
+  ssize_t n;
+
+  while (len > 0) {
+    if ((n = send(conn->fd, buf, len, MSG_NOSIGNAL)) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/* ========== REQUESTS ========== */
+
+static int parse_url(bs_http_req_t *req, const char *url)
+{
+  const char *host, *host_end, *colon;
+  unsigned long port = 80;
+  char *endp;
+
+  if (strncmp(url, "http://", 7) != 0) {
+    return -1;
+  }
+  host = url + 7;
+  if ((host_end = strchr(host, '/')) == NULL) {
+    host_end = host + strlen(host);
+  }
+  // user info and IPv6 literals are not supported
+  if (memchr(host, '@', host_end - host) != NULL || *host == '[') {
+    return -1;
+  }
+  if ((colon = memchr(host, ':', host_end - host)) != NULL) {
+    port = strtoul(colon + 1, &endp, 10);
+    if (endp != host_end || port == 0 || port > UINT16_MAX) {
+      return -1;
+    }
+  } else {
+    colon = host_end;
+  }
+  if (colon == host || colon - host >= HOST_LEN) {
+    return -1;
+  }
+
+  memcpy(req->host, host, colon - host);
+  req->host[colon - host] = '\0';
+  req->port = port;
+  free(req->path);
+  if ((req->path = strdup(*host_end == '\0' ? "/" : host_end)) == NULL) {
+    return -1;
+  }
+  return 0;
+}
+
+/* point the request to the target of a redirect, which may be relative to
+   the current URL */
+static int follow_location(bs_http_req_t *req, const char *location)
+{
+  char url[HOST_LEN + 2 * LINE_LEN];
+  const char *dir_end;
+  int n;
+
+  if (location[0] == '\0') {
+    return -1;
+  }
+  if (strstr(location, "://") != NULL) {
+    return parse_url(req, location);
+  }
+  if (strncmp(location, "//", 2) == 0) {
+    n = snprintf(url, sizeof(url), "http:%s", location);
+  } else if (location[0] == '/') {
+    n = snprintf(url, sizeof(url), "http://%s:%" PRIu16 "%s", req->host,
+                 req->port, location);
+  } else {
+    // relative to the directory of the current path (ignoring its query)
+    dir_end = req->path + strcspn(req->path, "?");
+    while (dir_end > req->path && *(dir_end - 1) != '/') {
+      dir_end--;
+    }
+    n = snprintf(url, sizeof(url), "http://%s:%" PRIu16 "%.*s%s", req->host,
+                 req->port, (int)(dir_end - req->path), req->path, location);
+  }
+  if (n < 0 || n >= (int)sizeof(url)) {
+    return -1;
+  }
+  return parse_url(req, url);
+}
+
+static int send_request(bs_http_req_t *req, http_conn_t *conn)
+{
+  char buf[LINE_LEN];
+  int n;
+
+  n = snprintf(buf, sizeof(buf), "GET %s HTTP/1.1\r\nHost: %s", req->path,
+               req->host);
+  if (req->port != 80 && n < (int)sizeof(buf)) {
+    n += snprintf(buf + n, sizeof(buf) - n, ":%" PRIu16, req->port);
+  }
+  if (n < (int)sizeof(buf)) {
+    n += snprintf(buf + n, sizeof(buf) - n,
+                  "\r\nUser-Agent: " HTTP_USER_AGENT
+                  "\r\nAccept-Encoding: identity\r\n");
+  }
+  if ((req->pos > 0 || req->end > 0) && n < (int)sizeof(buf)) {
+    n += snprintf(buf + n, sizeof(buf) - n, "Range: bytes=%" PRIu64 "-",
+                  req->pos);
+    if (req->end > 0 && n < (int)sizeof(buf)) {
+      n += snprintf(buf + n, sizeof(buf) - n, "%" PRIu64, req->end - 1);
+    }
+    if (n < (int)sizeof(buf)) {
+      n += snprintf(buf + n, sizeof(buf) - n, "\r\n");
+    }
+  }
+  if (n < (int)sizeof(buf)) {
+    n += snprintf(buf + n, sizeof(buf) - n, "Connection: keep-alive\r\n\r\n");
+  }
+  if (n >= (int)sizeof(buf)) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "HTTP request for %s is too long",
+                  req->path);
+    return -1;
+  }
+
+  return conn_write(conn, buf, n);
+}
+
+/* read the status line and headers of a response. returns the status code,
+   or -1 if the response could not be read */
+static int read_response(bs_http_req_t *req, http_conn_t *conn,
+                         uint64_t *range_start, char *location)
+{
+  char line[LINE_LEN];
+  char *value;
+  int major, minor, status;
+  uint64_t first, last;
+  int64_t total;
+
+  if (conn_readline(conn, line, sizeof(line)) < 0 ||
+      sscanf(line, "HTTP/%d.%d %d", &major, &minor, &status) != 3) {
+    return -1;
+  }
+
+  req->keep_alive = (major == 1 && minor >= 1);
+  req->body_left = -1;
+  req->chunked = 0;
+  req->chunk_left = 0;
+  req->chunk_crlf = 0;
+  req->body_done = 0;
+  *range_start = 0;
+  location[0] = '\0';
+
+  for (;;) {
+    if (conn_readline(conn, line, sizeof(line)) < 0) {
+      return -1;
+    }
+    if (line[0] == '\0') {
+      break;
+    }
+    if ((value = strchr(line, ':')) == NULL) {
+      continue;
+    }
+    *value++ = '\0';
+    while (*value == ' ' || *value == '\t') {
+      value++;
+    }
+
+    if (strcasecmp(line, "Content-Length") == 0) {
+      req->body_left = strtoll(value, NULL, 10);
+    } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+      req->chunked = (strcasecmp(value, "chunked") == 0);
+    } else if (strcasecmp(line, "Connection") == 0) {
+      if (strcasecmp(value, "close") == 0) {
+        req->keep_alive = 0;
+      } else if (strcasecmp(value, "keep-alive") == 0) {
+        req->keep_alive = 1;
+      }
+    } else if (strcasecmp(line, "Content-Range") == 0) {
+      // "bytes first-last/total", where total may be "*"
+      if (sscanf(value, "bytes %" SCNu64 "-%" SCNu64 "/%" SCNd64, &first,
+                 &last, &total) == 3) {
+        req->length = total;
+      }
+      if (sscanf(value, "bytes %" SCNu64 "-", &first) == 1) {
+        *range_start = first;
+      } else if (sscanf(value, "bytes */%" SCNd64, &total) == 1) {
+        // the reply to an unsatisfiable range
+        req->length = total;
+      }
+    } else if (strcasecmp(line, "Location") == 0) {
+      strncpy(location, value, LINE_LEN - 1);
+      location[LINE_LEN - 1] = '\0';
+    }
+  }
+
+  if (req->chunked) {
+    // the chunks delimit the body, whatever the headers say
+    req->body_left = -1;
+  }
+  return status;
+}
+
+/* (re)send the request from the current position, on a pooled connection if
+   there is one (and fresh is not set) */
+static int req_connect(bs_http_req_t *req, int fresh)
+{
+  http_conn_t *conn;
+  char location[LINE_LEN];
+  uint64_t range_start;
+  int redirects = 0;
+  int reused;
+  int status;
+
+  for (;;) {
+    if (is_aborted(req->abort_cb, req->abort_user)) {
+      return -1;
+    }
+    conn = (fresh != 0) ? NULL : pool_get(req->host, req->port);
+    reused = (conn != NULL);
+    if (conn == NULL &&
+        (conn = conn_open(req->host, req->port, req->abort_cb,
+                          req->abort_user)) == NULL) {
+      return -1;
+    }
+    conn->abort_cb = req->abort_cb;
+    conn->abort_user = req->abort_user;
+
+    if (send_request(req, conn) != 0 ||
+        (status = read_response(req, conn, &range_start, location)) < 0) {
+      conn_close(conn);
+      if (is_aborted(req->abort_cb, req->abort_user)) {
+        return -1;
+      }
+      if (reused) {
+        // the server closed the idle connection, so try a new one
+        fresh = 1;
+        continue;
+      }
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not read HTTP response from %s",
+                    req->host);
+      return -1;
+    }
+
+    switch (status) {
+    case 200:
+      // the whole resource
+      if (req->chunked == 0 && req->body_left >= 0) {
+        req->length = req->body_left;
+      }
+      req->ranged = 0;
+      req->skip = req->pos;
+      req->conn = conn;
+      return 0;
+
+    case 206:
+      if (range_start != req->pos) {
+        bgpstream_log(BGPSTREAM_LOG_ERR,
+                      "HTTP range response for %s starts at %" PRIu64
+                      " instead of %" PRIu64,
+                      req->path, range_start, req->pos);
+        conn_close(conn);
+        return -1;
+      }
+      req->ranged = 1;
+      req->skip = 0;
+      req->conn = conn;
+      return 0;
+
+    case 416:
+      // requested range not satisfiable: fine if we are already at the end
+      if (req->length >= 0 && req->pos >= (uint64_t)req->length) {
+        conn_close(conn);
+        req->eof = 1;
+        return 0;
+      }
+      break;
+
+    case 301:
+    case 302:
+    case 303:
+    case 307:
+    case 308:
+      conn_close(conn);
+      if (++redirects > MAX_REDIRECTS ||
+          follow_location(req, location) != 0) {
+        bgpstream_log(BGPSTREAM_LOG_ERR,
+                      "Could not follow HTTP redirect to '%s'", location);
+        return -1;
+      }
+      fresh = 0;
+      continue;
+
+    default:
+      break;
+    }
+
+    bgpstream_log(BGPSTREAM_LOG_ERR, "HTTP error %d for http://%s%s", status,
+                  req->host, req->path);
+    conn_close(conn);
+    return -1;
+  }
+}
+
+/* read from the body on the current connection. returns 0 once the whole
+   body has been read, and -1 if the body was cut short */
+static int64_t body_read_raw(bs_http_req_t *req, void *buffer, int64_t len)
+{
+  http_conn_t *conn = req->conn;
+  char line[LINE_LEN];
+  int64_t n;
+
+  if (req->body_done != 0) {
+    return 0;
+  }
+
+  if (req->chunked != 0) {
+    if (req->chunk_left == 0) {
+      // the CRLF after the previous chunk
+      if (req->chunk_crlf != 0 &&
+          conn_readline(conn, line, sizeof(line)) != 0) {
+        return -1;
+      }
+      req->chunk_crlf = 0;
+      if (conn_readline(conn, line, sizeof(line)) < 0) {
+        return -1;
+      }
+      req->chunk_left = strtoull(line, NULL, 16);
+      if (req->chunk_left == 0) {
+        // skip the trailer
+        do {
+          if ((n = conn_readline(conn, line, sizeof(line))) < 0) {
+            return -1;
+          }
+        } while (n > 0);
+        req->body_done = 1;
+        return 0;
+      }
+    }
+    if ((uint64_t)len > req->chunk_left) {
+      len = req->chunk_left;
+    }
+    if ((n = conn_read(conn, buffer, len)) <= 0) {
+      return -1;
+    }
+    if ((req->chunk_left -= n) == 0) {
+      req->chunk_crlf = 1;
+    }
+    return n;
+  }
+
+  if (req->body_left == 0) {
+    req->body_done = 1;
+    return 0;
+  }
+  if (req->body_left > 0 && len > req->body_left) {
+    len = req->body_left;
+  }
+  if ((n = conn_read(conn, buffer, len)) < 0) {
+    return -1;
+  }
+  if (n == 0) {
+    if (req->body_left > 0) {
+      return -1;
+    }
+    // the body ends when the server closes the connection
+    req->keep_alive = 0;
+    req->body_done = 1;
+    return 0;
+  }
+  if (req->body_left > 0 && (req->body_left -= n) == 0) {
+    // so that the connection can be reused even if the caller stops here
+    req->body_done = 1;
+  }
+  return n;
+}
+
+static int64_t body_read(bs_http_req_t *req, void *buffer, int64_t len)
+{
+  uint8_t discard[4096];
+  int64_t n;
+
+  // the server ignored the range, so throw away what we already have
+  while (req->skip > 0) {
+    n = (req->skip < sizeof(discard)) ? req->skip : sizeof(discard);
+    if ((n = body_read_raw(req, discard, n)) <= 0) {
+      return -1;
+    }
+    req->skip -= n;
+  }
+
+  return body_read_raw(req, buffer, len);
+}
+
+/* ========== PUBLIC FUNCTIONS ========== */
+
+int bs_http_is_supported(const char *url)
+{
+  return strncmp(url, "http://", 7) == 0;
+}
+
+bs_http_req_t *bs_http_open(const char *url, uint64_t start, uint64_t end,
+                            bs_http_abort_cb_t *abort_cb, void *abort_user)
+{
+  bs_http_req_t *req;
+
+  if ((req = malloc_zero(sizeof(bs_http_req_t))) == NULL) {
+    return NULL;
+  }
+  req->pos = start;
+  req->end = end;
+  req->length = -1;
+  req->abort_cb = abort_cb;
+  req->abort_user = abort_user;
+
+  if (parse_url(req, url) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Unsupported HTTP URL %s", url);
+    goto err;
+  }
+  if (req_connect(req, 0) != 0) {
+    goto err;
+  }
+  return req;
+
+err:
+  bs_http_close(req);
+  return NULL;
+}
+
+int64_t bs_http_read(bs_http_req_t *req, void *buffer, int64_t len)
+{
+  int retries = 0;
+  int waited;
+  int64_t n;
+
+  if (req->end > 0 && req->pos >= req->end) {
+    req->eof = 1;
+  }
+  if (req->eof != 0) {
+    return 0;
+  }
+  if (req->end > 0 && (uint64_t)len > req->end - req->pos) {
+    len = req->end - req->pos;
+  }
+
+  for (;;) {
+    if (req->conn != NULL) {
+      if ((n = body_read(req, buffer, len)) > 0) {
+        req->pos += n;
+        return n;
+      }
+      if (n == 0) {
+        req->eof = 1;
+        return 0;
+      }
+      // the body was cut short
+      conn_close(req->conn);
+      req->conn = NULL;
+    }
+
+    if (is_aborted(req->abort_cb, req->abort_user)) {
+      return -1;
+    }
+    if (++retries > MAX_RETRIES) {
+      bgpstream_log(BGPSTREAM_LOG_ERR,
+                    "Giving up on http://%s:%" PRIu16 "%s at offset %" PRIu64,
+                    req->host, req->port,
+                    req->path, req->pos);
+      return -1;
+    }
+    bgpstream_log(BGPSTREAM_LOG_WARN,
+                  "Resuming http://%s%s at offset %" PRIu64 " (attempt %d/%d)",
+                  req->host, req->path, req->pos, retries, MAX_RETRIES);
+    // back off, in slices so that an abort is noticed
+    for (waited = 0; waited < (1000 << (retries - 1));
+         waited += POLL_INTERVAL) {
+      if (is_aborted(req->abort_cb, req->abort_user)) {
+        return -1;
+      }
+      poll(NULL, 0, POLL_INTERVAL);
+    }
+
+    if (req_connect(req, 1) != 0) {
+      req->conn = NULL;
+      continue;
+    }
+    if (req->eof != 0) {
+      return 0;
+    }
+  }
+}
+
+int64_t bs_http_get_length(bs_http_req_t *req)
+{
+  return req->length;
+}
+
+void bs_http_close(bs_http_req_t *req)
+{
+  if (req == NULL) {
+    return;
+  }
+
+  if (req->conn != NULL) {
+    if (req->body_done != 0 && req->keep_alive != 0) {
+      pool_put(req->conn);
+    } else {
+      conn_close(req->conn);
+    }
+    req->conn = NULL;
+  }
+
+  free(req->path);
+  free(req);
+}
+
+/* ========== DOWNLOADS ========== */
+
+/* State of a download, shared by the threads that fetch (and feed) it */
+struct bs_http_download {
+  char *url;
+  char *path;
+  int fd;
+  int parallel_cnt;
+  uint64_t length;
+
+  /* descriptor that the downloaded bytes are fed to, in order (-1 if
+     none) */
+  int out_fd;
+
+  /* threads that run and feed the download (if they were started) */
+  pthread_t run_thread;
+  int running;
+  pthread_t feed_thread;
+  int feeding;
+
+  pthread_mutex_t mutex;
+
+  /* signaled when bytes are written, and when the download ends */
+  pthread_cond_t cond;
+
+  /* next part to fetch, and number of parts */
+  uint64_t next_part;
+  uint64_t parts_cnt;
+
+  /* number of bytes written from the start of each part (each part is
+     written in order, by a single thread) */
+  uint64_t *part_written;
+
+  /* set once the server has accepted the request */
+  int opened;
+
+  /* set if any part failed */
+  int err;
+
+  /* set if the download must stop */
+  int aborted;
+
+  /* set once the download has ended */
+  int done;
+};
+
+static int pwrite_all(int fd, const uint8_t *buf, size_t len, uint64_t offset)
+{
+  ssize_t n;
+
+  while (len > 0) {
+    if ((n = pwrite(fd, buf, len, offset)) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    buf += n;
+    len -= n;
+    offset += n;
+  }
+  return 0;
+}
+
+static int write_all(int fd, const uint8_t *buf, size_t len)
+{
+  ssize_t n;
+
+  while (len > 0) {
+    if ((n = write(fd, buf, len)) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/* copy the body of the given request to the given part of the file (or
+   straight to out_fd if there is no file), after the bytes of the part that
+   were already written. returns the number of bytes of the part written, or -1
+   if an error occurred */
+static int64_t fetch_body(bs_http_req_t *req, bs_http_download_t *dl,
+                          uint64_t part)
+{
+  uint8_t buf[CONN_BUF_LEN];
+  uint64_t written;
+  int64_t n = 0;
+  int aborted;
+  int rc;
+
+  pthread_mutex_lock(&dl->mutex);
+  written = dl->part_written[part];
+  pthread_mutex_unlock(&dl->mutex);
+
+  for (;;) {
+    pthread_mutex_lock(&dl->mutex);
+    dl->part_written[part] = written;
+    aborted = dl->aborted;
+    pthread_cond_broadcast(&dl->cond);
+    pthread_mutex_unlock(&dl->mutex);
+
+    if (aborted != 0 || (n = bs_http_read(req, buf, sizeof(buf))) <= 0) {
+      break;
+    }
+    if (dl->fd == -1) {
+      rc = write_all(dl->out_fd, buf, n);
+    } else {
+      rc = pwrite_all(dl->fd, buf, n, part * BS_HTTP_PART_LEN + written);
+    }
+    if (rc != 0) {
+      if (errno != EPIPE) {
+        // (otherwise the reader has gone away)
+        bgpstream_log(BGPSTREAM_LOG_ERR, "Could not write download: %s",
+                      strerror(errno));
+      }
+      return -1;
+    }
+    written += n;
+  }
+  return (aborted != 0 || n < 0) ? -1 : (int64_t)written;
+}
+
+/* number of bytes at the start of the file that have all been written (must
+   be called with the mutex held) */
+static uint64_t written_len(bs_http_download_t *dl)
+{
+  uint64_t len = 0;
+  uint64_t i;
+
+  for (i = 0; i < dl->parts_cnt; i++) {
+    len += dl->part_written[i];
+    if (dl->part_written[i] < BS_HTTP_PART_LEN) {
+      break;
+    }
+  }
+  return len;
+}
+
+/* abort callback of the requests of a download */
+static int download_aborted(void *user)
+{
+  bs_http_download_t *dl = (bs_http_download_t *)user;
+  int aborted;
+
+  pthread_mutex_lock(&dl->mutex);
+  aborted = dl->aborted;
+  pthread_mutex_unlock(&dl->mutex);
+  return aborted;
+}
+
+static void set_err(bs_http_download_t *dl)
+{
+  pthread_mutex_lock(&dl->mutex);
+  dl->err = 1;
+  pthread_mutex_unlock(&dl->mutex);
+}
+
+static void *download_thread(void *user)
+{
+  bs_http_download_t *dl = (bs_http_download_t *)user;
+  bs_http_req_t *req;
+  uint64_t part, start, end;
+  int err;
+
+  for (;;) {
+    pthread_mutex_lock(&dl->mutex);
+    if (dl->err != 0 || dl->aborted != 0 || dl->next_part == dl->parts_cnt) {
+      pthread_mutex_unlock(&dl->mutex);
+      break;
+    }
+    part = dl->next_part++;
+    pthread_mutex_unlock(&dl->mutex);
+
+    start = part * BS_HTTP_PART_LEN;
+    end = start + BS_HTTP_PART_LEN;
+    if (end > dl->length) {
+      end = dl->length;
+    }
+    err = ((req = bs_http_open(dl->url, start, end,
+                               download_aborted, dl)) == NULL ||
+           fetch_body(req, dl, part) != (int64_t)(end - start));
+    bs_http_close(req);
+
+    if (err != 0) {
+      set_err(dl);
+    }
+  }
+
+  return NULL;
+}
+
+/* set the number of parts of the download */
+static int set_parts(bs_http_download_t *dl, uint64_t parts_cnt)
+{
+  uint64_t *part_written;
+
+  if ((part_written = calloc(parts_cnt, sizeof(uint64_t))) == NULL) {
+    return -1;
+  }
+  pthread_mutex_lock(&dl->mutex);
+  dl->part_written = part_written;
+  dl->parts_cnt = parts_cnt;
+  pthread_mutex_unlock(&dl->mutex);
+  return 0;
+}
+
+static void *download_run(void *user)
+{
+  bs_http_download_t *dl = (bs_http_download_t *)user;
+  pthread_t threads[dl->parallel_cnt > 1 ? dl->parallel_cnt - 1 : 1];
+  int threads_cnt = 0;
+  bs_http_req_t *req = NULL;
+  int64_t len;
+  sigset_t set;
+  int i;
+
+  if (dl->fd == -1) {
+    // the bytes are written straight to out_fd: a reader that goes away makes
+    // the writes fail, rather than killing the process
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+  }
+
+  // ask for the first part only: the response says whether the server
+  // supports ranges, and how long the resource is
+  if ((req = bs_http_open(dl->url, 0,
+                          dl->parallel_cnt > 1 ? BS_HTTP_PART_LEN : 0,
+                          download_aborted, dl)) == NULL) {
+    goto err;
+  }
+  pthread_mutex_lock(&dl->mutex);
+  dl->opened = 1;
+  pthread_cond_broadcast(&dl->cond);
+  pthread_mutex_unlock(&dl->mutex);
+
+  if (req->ranged == 0 || req->length <= BS_HTTP_PART_LEN) {
+    // a single stream will do (and the server may have sent it all anyway)
+    if (req->ranged == 0) {
+      req->end = 0;
+    }
+    if (set_parts(dl, 1) != 0) {
+      goto err;
+    }
+    len = fetch_body(req, dl, 0);
+    if (len < 0 || (req->length >= 0 && len != req->length)) {
+      goto err;
+    }
+    if (req->ranged != 0 && req->length < 0) {
+      // the server did not say how long the resource is, so get the rest
+      bs_http_close(req);
+      if ((req = bs_http_open(dl->url, len, 0, download_aborted,
+                              dl)) == NULL ||
+          fetch_body(req, dl, 0) < 0) {
+        goto err;
+      }
+    }
+    goto done;
+  }
+
+  dl->length = req->length;
+  dl->next_part = 1;
+  if (set_parts(dl, (dl->length + BS_HTTP_PART_LEN - 1) / BS_HTTP_PART_LEN) !=
+      0) {
+    goto err;
+  }
+
+  for (i = 0;
+       i < dl->parallel_cnt - 1 && (uint64_t)i < dl->parts_cnt - 1; i++) {
+    if (pthread_create(&threads[threads_cnt], NULL, download_thread, dl) !=
+        0) {
+      break;
+    }
+    threads_cnt++;
+  }
+
+  // this thread fetches the first part, and then helps with the others
+  if (fetch_body(req, dl, 0) != BS_HTTP_PART_LEN) {
+    set_err(dl);
+  }
+  download_thread(dl);
+
+  for (i = 0; i < threads_cnt; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  if (dl->err == 0) {
+    goto done;
+  }
+
+err:
+  set_err(dl);
+
+done:
+  bs_http_close(req);
+  if (dl->fd == -1 && dl->out_fd != -1) {
+    // so that the reader sees the end of the stream
+    close(dl->out_fd);
+    dl->out_fd = -1;
+  }
+  pthread_mutex_lock(&dl->mutex);
+  dl->done = 1;
+  pthread_cond_broadcast(&dl->cond);
+  pthread_mutex_unlock(&dl->mutex);
+  return NULL;
+}
+
+/* copy the bytes of the file to out_fd as soon as all the bytes before them
+   have been written */
+static void *feed_run(void *user)
+{
+  bs_http_download_t *dl = (bs_http_download_t *)user;
+  uint8_t buf[CONN_BUF_LEN];
+  uint64_t fed = 0;
+  uint64_t avail;
+  ssize_t n;
+  sigset_t set;
+
+  // a reader that goes away makes the writes fail, rather than killing the
+  // process
+  sigemptyset(&set);
+  sigaddset(&set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+  for (;;) {
+    pthread_mutex_lock(&dl->mutex);
+    while ((avail = written_len(dl)) == fed && dl->done == 0 &&
+           dl->aborted == 0) {
+      pthread_cond_wait(&dl->cond, &dl->mutex);
+    }
+    if (dl->aborted != 0) {
+      avail = fed;
+    }
+    pthread_mutex_unlock(&dl->mutex);
+    if (avail == fed) {
+      // the download has ended
+      break;
+    }
+
+    while (fed < avail) {
+      n = (avail - fed < sizeof(buf)) ? avail - fed : sizeof(buf);
+      if ((n = pread(dl->fd, buf, n, fed)) <= 0 ||
+          write_all(dl->out_fd, buf, n) != 0) {
+        goto done;
+      }
+      fed += n;
+    }
+  }
+
+done:
+  close(dl->out_fd);
+  dl->out_fd = -1;
+  return NULL;
+}
+
+bs_http_download_t *bs_http_download_start(const char *url, const char *path,
+                                           int parallel_cnt, int out_fd)
+{
+  bs_http_download_t *dl;
+  int opened;
+
+  if ((dl = malloc_zero(sizeof(bs_http_download_t))) == NULL) {
+    if (out_fd != -1) {
+      close(out_fd);
+    }
+    return NULL;
+  }
+  dl->fd = -1;
+  dl->out_fd = out_fd;
+  // ranges can only be fetched in parallel into a file
+  dl->parallel_cnt = (path != NULL) ? parallel_cnt : 1;
+  pthread_mutex_init(&dl->mutex, NULL);
+  pthread_cond_init(&dl->cond, NULL);
+
+  if ((dl->url = strdup(url)) == NULL) {
+    goto err;
+  }
+  if (path != NULL) {
+    if ((dl->path = strdup(path)) == NULL) {
+      goto err;
+    }
+    if ((dl->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create %s: %s", path,
+                    strerror(errno));
+      goto err;
+    }
+  }
+
+  if (pthread_create(&dl->run_thread, NULL, download_run, dl) != 0) {
+    goto err;
+  }
+  dl->running = 1;
+  if (path != NULL && out_fd != -1) {
+    if (pthread_create(&dl->feed_thread, NULL, feed_run, dl) != 0) {
+      goto err;
+    }
+    dl->feeding = 1;
+  }
+
+  // wait for the response, so that the caller can still fetch the resource
+  // some other way if the server turns the request down
+  pthread_mutex_lock(&dl->mutex);
+  while (dl->opened == 0 && dl->done == 0) {
+    pthread_cond_wait(&dl->cond, &dl->mutex);
+  }
+  opened = dl->opened;
+  pthread_mutex_unlock(&dl->mutex);
+  if (opened == 0) {
+    goto err;
+  }
+
+  return dl;
+
+err:
+  bs_http_download_finish(dl, 1);
+  return NULL;
+}
+
+void bs_http_download_stop(bs_http_download_t *dl)
+{
+  if (dl == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&dl->mutex);
+  dl->aborted = 1;
+  pthread_cond_broadcast(&dl->cond);
+  pthread_mutex_unlock(&dl->mutex);
+}
+
+int bs_http_download_finish(bs_http_download_t *dl, int abort)
+{
+  int rc;
+
+  if (dl == NULL) {
+    return -1;
+  }
+
+  if (abort != 0) {
+    bs_http_download_stop(dl);
+  }
+
+  if (dl->running != 0) {
+    pthread_join(dl->run_thread, NULL);
+  } else {
+    dl->err = 1;
+  }
+  if (dl->feeding != 0) {
+    pthread_join(dl->feed_thread, NULL);
+  } else if (dl->out_fd != -1) {
+    close(dl->out_fd);
+  }
+
+  rc = (dl->err != 0) ? -1 : 0;
+  if (dl->fd != -1) {
+    if (close(dl->fd) != 0) {
+      rc = -1;
+    }
+    if (rc != 0) {
+      remove(dl->path);
+    }
+  }
+  if (rc != 0 && dl->aborted == 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not download %s", dl->url);
+  }
+
+  pthread_mutex_destroy(&dl->mutex);
+  pthread_cond_destroy(&dl->cond);
+  free(dl->part_written);
+  free(dl->url);
+  free(dl->path);
+  free(dl);
+  return rc;
+}
+
+int bs_http_download(const char *url, const char *path, int parallel_cnt)
+{
+  return bs_http_download_finish(
+    bs_http_download_start(url, path, parallel_cnt, -1), 0);
+}
+
+io_t *bs_http_download_open(const char *url, const char *path,
+                            int parallel_cnt, bs_http_download_t **dl)
+{
+  char fd_path[64];
+  io_t *reader;
+  int fds[2];
+
+  *dl = NULL;
+  if (pipe(fds) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create pipe for %s: %s", url,
+                  strerror(errno));
+    return NULL;
+  }
+  if ((*dl = bs_http_download_start(url, path, parallel_cnt, fds[1])) ==
+      NULL) {
+    close(fds[0]);
+    return NULL;
+  }
+
+  // wandio opens its own descriptor of the pipe (and detects the compression
+  // from the first bytes)
+  snprintf(fd_path, sizeof(fd_path), "/dev/fd/%d", fds[0]);
+  reader = wandio_create(fd_path);
+  close(fds[0]);
+  if (reader == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not open %s for reading", url);
+    bs_http_download_finish(*dl, 1);
+    *dl = NULL;
+  }
+  return reader;
+}
+
+void bs_http_pool_clear(void)
+{
+  int i;
+
+  pthread_mutex_lock(&pool.mutex);
+  for (i = 0; i < pool.idle_cnt; i++) {
+    conn_close(pool.idle[i]);
+  }
+  pool.idle_cnt = 0;
+  pthread_mutex_unlock(&pool.mutex);
+}
+
+uint64_t bs_http_get_conn_cnt(void)
+{
+  uint64_t cnt;
+
+  pthread_mutex_lock(&pool.mutex);
+  cnt = pool.conn_cnt;
+  pthread_mutex_unlock(&pool.mutex);
+  return cnt;
+}
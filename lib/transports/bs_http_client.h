@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BS_HTTP_CLIENT_H
+#define __BS_HTTP_CLIENT_H
+
+#include "wandio.h"
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Header file that exposes the private interface of the HTTP client
+ * used to fetch remote dumps.
+ *
+ * The client only speaks plain HTTP/1.1 (other URLs are left to wandio). It
+ * keeps a process-wide pool of idle keep-alive connections, so that
+ * successive requests to the same server do not each pay for a new TCP
+ * connection. A body that is cut short (e.g., the connection is reset) is
+ * transparently resumed with a range request from where it stopped.
+ *
+ */
+
+/**
+ * @name Private Constants
+ *
+ * @{ */
+
+/** Length of the ranges that are fetched in parallel by bs_http_download */
+#define BS_HTTP_PART_LEN (8 * 1024 * 1024)
+
+/** @} */
+
+/**
+ * @name Opaque Data Structures
+ *
+ * @{ */
+
+/** Opaque structure representing the body of an HTTP response */
+typedef struct bs_http_req bs_http_req_t;
+
+/** Opaque structure representing a download running in the background */
+typedef struct bs_http_download bs_http_download_t;
+
+/** @} */
+
+/**
+ * @name Private Data Structures
+ *
+ * @{ */
+
+/** Callback that tells whether a request must be abandoned
+ *
+ * @param user          user data given along with the callback
+ * @return non-zero if the request must be abandoned, 0 otherwise
+ *
+ * The callback is polled (from the thread that runs the request) at least
+ * every few hundred milliseconds while the request waits for the server, and
+ * before each attempt to resume the body.
+ */
+typedef int(bs_http_abort_cb_t)(void *user);
+
+/** @} */
+
+/**
+ * @name Private API Functions
+ *
+ * @{ */
+
+/** Check if the given URL can be fetched by the HTTP client
+ *
+ * @param url           URL to check
+ * @return 1 if the URL is a plain http:// URL, 0 otherwise
+ */
+int bs_http_is_supported(const char *url);
+
+/** Request (part of) the given URL
+ *
+ * @param url           http:// URL to fetch
+ * @param start         offset of the first byte wanted
+ * @param end           offset of the byte after the last one wanted, or 0 to
+ *                      read to the end of the resource
+ * @param abort_cb      callback that tells whether to abandon the request, or
+ *                      NULL
+ * @param abort_user    user data passed to abort_cb
+ * @return pointer to the response body if successful, NULL otherwise
+ *
+ * If the server does not support range requests, the bytes before start are
+ * read and discarded. Once abort_cb returns non-zero, opening and reading the
+ * request fail without waiting any further for the server.
+ */
+bs_http_req_t *bs_http_open(const char *url, uint64_t start, uint64_t end,
+                            bs_http_abort_cb_t *abort_cb, void *abort_user);
+
+/** Read from the body of a response
+ *
+ * @param req           pointer to the response body to read from
+ * @param buffer        buffer to read into
+ * @param len           maximum number of bytes to read
+ * @return the number of bytes read, 0 at the end of the body, -1 if the body
+ * could not be read (even after resuming it)
+ */
+int64_t bs_http_read(bs_http_req_t *req, void *buffer, int64_t len);
+
+/** Get the total length of the requested resource
+ *
+ * @param req           pointer to the response body
+ * @return the length of the whole resource (not just of the requested range),
+ * or -1 if the server did not say
+ */
+int64_t bs_http_get_length(bs_http_req_t *req);
+
+/** Close the given response body
+ *
+ * @param req           pointer to the response body to close
+ *
+ * If the whole body has been read, the connection is returned to the pool.
+ */
+void bs_http_close(bs_http_req_t *req);
+
+/** Download the given URL into a local file
+ *
+ * @param url           http:// URL to download
+ * @param path          path of the file to (over)write
+ * @param parallel_cnt  maximum number of ranges to fetch in parallel
+ * @return 0 if the whole resource was downloaded, -1 otherwise
+ *
+ * If parallel_cnt is more than 1 and the server supports range requests,
+ * resources larger than BS_HTTP_PART_LEN are fetched as that many ranges in
+ * parallel, each over its own connection.
+ */
+int bs_http_download(const char *url, const char *path, int parallel_cnt);
+
+/** Start downloading the given URL into a local file, in the background
+ *
+ * @param url           http:// URL to download
+ * @param path          path of the file to (over)write, or NULL to only
+ *                      write the bytes to out_fd
+ * @param parallel_cnt  maximum number of ranges to fetch in parallel (the
+ *                      ranges are fetched one after the other if path is
+ *                      NULL)
+ * @param out_fd        descriptor to also write the downloaded bytes to, or
+ *                      -1
+ * @return pointer to the download if the server accepted the request, NULL
+ * otherwise (e.g., it replied with an error)
+ *
+ * The function returns once the server has replied, so that the caller can
+ * fall back to some other way of fetching the resource if it turns the
+ * request down. The bytes are then written to out_fd in order, as soon as all
+ * the bytes before them are in the file, so that the resource can be read
+ * (e.g., through a pipe) while it is still being downloaded. out_fd is closed
+ * at the end of the download (even if it fails, in which case the bytes stop
+ * short), or right away if the download could not be started. The download
+ * must be ended using bs_http_download_finish.
+ */
+bs_http_download_t *bs_http_download_start(const char *url, const char *path,
+                                           int parallel_cnt, int out_fd);
+
+/** Wait for a download to end
+ *
+ * @param dl            pointer to the download, as returned by
+ *                      bs_http_download_start (or NULL)
+ * @param abort         if set, stop the download rather than waiting for it
+ * @return 0 if the whole resource was downloaded, -1 otherwise (in which case
+ * the file is removed)
+ *
+ * If the download writes to an out_fd, whatever reads from it must either
+ * read to the end, or have closed its end of the pipe. The download is
+ * destroyed.
+ */
+int bs_http_download_finish(bs_http_download_t *dl, int abort);
+
+/** Tell a download to stop, without waiting for it
+ *
+ * @param dl            pointer to the download (or NULL)
+ *
+ * The download still has to be ended using bs_http_download_finish. Stopping
+ * it before destroying a reader that is blocked on its out_fd makes the reader
+ * see the end of the stream, rather than wait for the server.
+ */
+void bs_http_download_stop(bs_http_download_t *dl);
+
+/** Start downloading the given URL, and open a reader on its content
+ *
+ * @param url           http:// URL to download
+ * @param path          path of the file to (over)write, or NULL
+ * @param parallel_cnt  maximum number of ranges to fetch in parallel
+ * @param[out] dl       set to the download that feeds the reader
+ * @return wandio reader of the content if the download was started, NULL
+ * otherwise
+ *
+ * The download is started with bs_http_download_start, and feeds the reader
+ * through a pipe. Once the reader has been read to the end or destroyed, the
+ * download must be ended using bs_http_download_finish (which tells whether
+ * the content read was complete).
+ */
+io_t *bs_http_download_open(const char *url, const char *path,
+                            int parallel_cnt, bs_http_download_t **dl);
+
+/** Close all the idle connections in the pool */
+void bs_http_pool_clear(void);
+
+/** Get the number of TCP connections that the client has opened
+ *
+ * @return the number of connections opened since the process started
+ */
+uint64_t bs_http_get_conn_cnt(void);
+
+/** @} */
+
+#endif /* __BS_HTTP_CLIENT_H */
@@ -30,9 +30,13 @@
 #include "bs_transport_cache.h"
 #include "bgpstream_transport_interface.h"
 #include "bgpstream_log.h"
+#include "bs_http_client.h"
 #include "utils.h"
 #include "wandio.h"
+#include <arpa/inet.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -43,6 +47,29 @@
 #define CACHE_FILE_SUFFIX ".cache"
 #define CACHE_LOCK_FILE_SUFFIX ".lock"
 #define CACHE_TEMP_FILE_SUFFIX ".temp"
+#define CACHE_INDEX_FILE_SUFFIX ".idx"
+
+/** First line of an index file */
+#define INDEX_HEADER "# bgpstream mrt index v1"
+
+/** Minimum distance (in bytes of the decoded data) between index entries */
+#define INDEX_INTERVAL (1024 * 1024)
+
+/** Length of the MRT common header */
+#define MRT_HDR_LEN 12
+
+/** Number of ranges of a RIB dump that are downloaded in parallel */
+#define RIB_DOWNLOAD_PARALLEL_CNT 4
+
+/** An entry of the index of an MRT cache file */
+typedef struct index_entry {
+  /** Offset of the start of an MRT message */
+  uint64_t offset;
+
+  /** The latest timestamp of all the messages before it */
+  uint32_t max_time;
+
+} index_entry_t;
 
 typedef struct cache_state {
   /** A 0/1 value indicates whether current read is from a local cache
@@ -70,6 +97,36 @@ typedef struct cache_state {
   /** cache content writer */
   iow_t *writer;
 
+  /** absolute path for the index of the local cache file */
+  char *index_file_path;
+
+  /** index of the cached data, sorted by offset (and so also by max_time) */
+  index_entry_t *index;
+  int index_cnt;
+  int index_alloc_cnt;
+
+  /** A 0/1 value indicating whether the index is being built while the
+      content is read (either from remote, or from a freshly downloaded cache
+      file) */
+  int build_index;
+
+  /** offset of the next byte to be read from the remote content */
+  uint64_t pos;
+
+  /** offset of the next MRT message in the remote content */
+  uint64_t next_msg;
+
+  /** the part of the next message's header that has been read so far */
+  uint8_t hdr[MRT_HDR_LEN];
+  int hdr_len;
+
+  /** the latest timestamp of the messages read so far */
+  uint32_t max_time;
+
+  /** download of the remote file into the cache, running in the background
+      while the content is read from it (NULL if none) */
+  bs_http_download_t *download;
+
 } cache_state_t;
 
 /**
@@ -83,6 +140,7 @@ int init_state(bgpstream_transport_t *transport)
   int len_cache_file_path;
   int len_lock_file_path;
   int len_temp_file_path;
+  int len_index_file_path;
 
   // get a "hash" string from the resource
   if ((bgpstream_resource_hash_snprintf(resource_hash, sizeof(resource_hash),
@@ -166,9 +224,247 @@ int init_state(bgpstream_transport_t *transport)
     return -1;
   }
 
+  // set index file name: cache_file_path + ".idx"
+  len_index_file_path =
+    strlen(STATE->cache_file_path) + strlen(CACHE_INDEX_FILE_SUFFIX) + 2;
+  if ((STATE->index_file_path =
+         (char *)malloc(sizeof(char) * len_index_file_path)) == NULL) {
+    bgpstream_log(
+      BGPSTREAM_LOG_ERR,
+      "ERROR: Could not allocate space for index file name variable.");
+    return -1;
+  }
+  if ((snprintf(STATE->index_file_path, len_index_file_path, "%s%s",
+                STATE->cache_file_path, CACHE_INDEX_FILE_SUFFIX)) >=
+      len_index_file_path) {
+    bgpstream_log(BGPSTREAM_LOG_ERR,
+                  "ERROR: Could not set index file name variable.");
+    return -1;
+  }
+
   return 0;
 }
 
+/**
+   Append an entry to the index
+*/
+static int index_add(bgpstream_transport_t *transport, uint64_t offset,
+                     uint32_t max_time)
+{
+  index_entry_t *tmp;
+  int alloc_cnt;
+
+  if (STATE->index_cnt == STATE->index_alloc_cnt) {
+    alloc_cnt = (STATE->index_alloc_cnt == 0) ? 64 : STATE->index_alloc_cnt * 2;
+    if ((tmp = realloc(STATE->index, sizeof(index_entry_t) * alloc_cnt)) ==
+        NULL) {
+      return -1;
+    }
+    STATE->index = tmp;
+    STATE->index_alloc_cnt = alloc_cnt;
+  }
+
+  STATE->index[STATE->index_cnt].offset = offset;
+  STATE->index[STATE->index_cnt].max_time = max_time;
+  STATE->index_cnt++;
+  return 0;
+}
+
+/**
+   Walk the MRT headers in a buffer of remote content, adding an index entry
+   every INDEX_INTERVAL bytes. Only the common header of each message is
+   looked at, so this is much cheaper than decoding the messages.
+*/
+static int index_scan(bgpstream_transport_t *transport, const uint8_t *buffer,
+                      int64_t len)
+{
+  uint64_t end = STATE->pos + len;
+  uint64_t last;
+  uint64_t idx;
+  uint32_t ts;
+  uint32_t msg_len;
+  int n;
+
+  while (STATE->next_msg + STATE->hdr_len < end) {
+    // copy as much of the header as there is in this buffer
+    idx = STATE->next_msg + STATE->hdr_len - STATE->pos;
+    n = MRT_HDR_LEN - STATE->hdr_len;
+    if ((uint64_t)n > len - idx) {
+      n = len - idx;
+    }
+    memcpy(STATE->hdr + STATE->hdr_len, buffer + idx, n);
+    STATE->hdr_len += n;
+    if (STATE->hdr_len < MRT_HDR_LEN) {
+      break;
+    }
+
+    // every message before this one is no newer than max_time
+    last = (STATE->index_cnt == 0) ? 0
+                                   : STATE->index[STATE->index_cnt - 1].offset;
+    if (STATE->next_msg - last >= INDEX_INTERVAL &&
+        index_add(transport, STATE->next_msg, STATE->max_time) != 0) {
+      return -1;
+    }
+
+    memcpy(&ts, STATE->hdr, sizeof(ts));
+    ts = ntohl(ts);
+    memcpy(&msg_len, STATE->hdr + 8, sizeof(msg_len));
+    msg_len = ntohl(msg_len);
+
+    if (ts > STATE->max_time) {
+      STATE->max_time = ts;
+    }
+    STATE->next_msg += MRT_HDR_LEN + (uint64_t)msg_len;
+    STATE->hdr_len = 0;
+  }
+
+  STATE->pos = end;
+  return 0;
+}
+
+/**
+   Write the index next to the cache file (via a temporary file, so that a
+   partial index is never used)
+*/
+static int index_write(bgpstream_transport_t *transport)
+{
+  char tmp_path[1024];
+  FILE *fh;
+  int i;
+
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s%s", STATE->index_file_path,
+               CACHE_TEMP_FILE_SUFFIX) >= (int)sizeof(tmp_path)) {
+    return -1;
+  }
+  if ((fh = fopen(tmp_path, "w")) == NULL) {
+    return -1;
+  }
+
+  fprintf(fh, "%s\n", INDEX_HEADER);
+  for (i = 0; i < STATE->index_cnt; i++) {
+    fprintf(fh, "%" PRIu64 " %" PRIu32 "\n", STATE->index[i].offset,
+            STATE->index[i].max_time);
+  }
+
+  if (fclose(fh) != 0 || rename(tmp_path, STATE->index_file_path) != 0) {
+    remove(tmp_path);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+   Load the index of an existing cache file (if there is one)
+*/
+static void index_load(bgpstream_transport_t *transport)
+{
+  char line[1024];
+  uint64_t offset;
+  uint32_t max_time;
+  FILE *fh;
+
+  if ((fh = fopen(STATE->index_file_path, "r")) == NULL) {
+    // not indexed
+    return;
+  }
+
+  if (fgets(line, sizeof(line), fh) == NULL ||
+      strncmp(line, INDEX_HEADER, strlen(INDEX_HEADER)) != 0) {
+    goto err;
+  }
+  while (fgets(line, sizeof(line), fh) != NULL) {
+    if (sscanf(line, "%" SCNu64 " %" SCNu32, &offset, &max_time) != 2 ||
+        (STATE->index_cnt > 0 &&
+         offset <= STATE->index[STATE->index_cnt - 1].offset) ||
+        index_add(transport, offset, max_time) != 0) {
+      goto err;
+    }
+  }
+
+  fclose(fh);
+  return;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_WARN, "WARNING: Ignoring invalid index file %s.",
+                STATE->index_file_path);
+  fclose(fh);
+  STATE->index_cnt = 0;
+}
+
+static uint64_t get_time_offset(bgpstream_transport_t *transport,
+                                uint32_t time)
+{
+  int lo = 0, hi = STATE->index_cnt;
+  int mid;
+
+  // find the last entry whose preceding messages are all older than time
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (STATE->index[mid].max_time < time) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return (lo == 0) ? 0 : STATE->index[lo - 1].offset;
+}
+
+/**
+   Start downloading the (still compressed) remote file straight into the
+   cache, over pooled HTTP connections. Large RIB dumps are fetched as several
+   ranges in parallel. The content is read while it downloads, from a pipe that
+   the download feeds in order. Returns 0 if the reader is ready, -1 if the
+   caller should fall back to caching the content as it is read.
+*/
+static int download_start(bgpstream_transport_t *transport)
+{
+  int parallel_cnt = (transport->res->record_type == BGPSTREAM_RIB)
+                       ? RIB_DOWNLOAD_PARALLEL_CNT
+                       : 1;
+
+  if (bs_http_is_supported(transport->res->uri) == 0 ||
+      (STATE->reader = bs_http_download_open(
+         transport->res->uri, STATE->temp_file_path, parallel_cnt,
+         &STATE->download)) == NULL) {
+    return -1;
+  }
+  return 0;
+}
+
+/**
+   Wait for the download to end (or stop it), and move the downloaded file
+   and its index into the cache if it is complete. Returns 0 if the file was
+   cached, -1 otherwise.
+*/
+static int download_end(bgpstream_transport_t *transport, int abort)
+{
+  int rc = bs_http_download_finish(STATE->download, abort);
+
+  STATE->download = NULL;
+
+  // write the index before the cache file appears, so that later readers
+  // find both
+  if (rc == 0 && STATE->build_index == 1 && index_write(transport) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_WARN,
+                  "WARNING: Could not write index file %s.",
+                  STATE->index_file_path);
+  }
+  STATE->build_index = 0;
+
+  if (rc == 0 && rename(STATE->temp_file_path, STATE->cache_file_path) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "ERROR: renaming failed for file %s.",
+                  STATE->temp_file_path);
+    remove(STATE->temp_file_path);
+    rc = -1;
+  }
+  if (remove(STATE->lock_file_path) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "ERROR: removing lock file failed %s.",
+                  STATE->lock_file_path);
+  }
+  return rc;
+}
+
 int bs_transport_cache_create(bgpstream_transport_t *transport)
 {
 
@@ -176,6 +472,7 @@ int bs_transport_cache_create(bgpstream_transport_t *transport)
 
   // reset transport method
   BS_TRANSPORT_SET_METHODS(cache, transport);
+  transport->get_time_offset = get_time_offset;
 
   // initialize cache_state data structure
   if (init_state(transport) != 0) {
@@ -193,6 +490,11 @@ int bs_transport_cache_create(bgpstream_transport_t *transport)
                     STATE->cache_file_path);
       return -1;
     }
+
+    // and its index, so that readers can skip to the records they want
+    if (transport->res->format_type == BGPSTREAM_RESOURCE_FORMAT_MRT) {
+      index_load(transport);
+    }
   } else {
     // local cache file doesn't exist
 
@@ -207,6 +509,14 @@ int bs_transport_cache_create(bgpstream_transport_t *transport)
         BGPSTREAM_LOG_WARN,
         "WARNING: Cache lock file %s exists, local cache will not be used.",
         STATE->lock_file_path);
+    } else if (download_start(transport) == 0) {
+      // the content is read as it is downloaded into the cache
+      STATE->write_to_cache = 0;
+
+      // and indexed as it is read
+      STATE->build_index =
+        (transport->res->format_type == BGPSTREAM_RESOURCE_FORMAT_MRT);
+      return 0;
     } else {
       // lock file created successfully, now safe to create write cache
       // enable write_to_cache flag
@@ -223,6 +533,10 @@ int bs_transport_cache_create(bgpstream_transport_t *transport)
                       STATE->temp_file_path);
         return -1;
       }
+
+      // index MRT content as it is cached
+      STATE->build_index =
+        (transport->res->format_type == BGPSTREAM_RESOURCE_FORMAT_MRT);
     }
 
     // open reader that reads from remote file
@@ -251,6 +565,21 @@ int64_t bs_transport_cache_read(bgpstream_transport_t *transport,
   // read content
   int64_t ret = wandio_read(STATE->reader, buffer, len);
 
+  if (STATE->build_index == 1 && ret > 0 &&
+      index_scan(transport, buffer, ret) != 0) {
+    // the cache is still usable without an index
+    bgpstream_log(BGPSTREAM_LOG_WARN,
+                  "WARNING: Could not index cache content.");
+    STATE->build_index = 0;
+  }
+
+  // the whole download has been read, but it may have been cut short
+  if (STATE->download != NULL && ret == 0 && download_end(transport, 0) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "ERROR: Could not download %s.",
+                  transport->res->uri);
+    return -1;
+  }
+
   // if cache-writing is enabled
   if (STATE->write_to_cache == 1) {
 
@@ -264,6 +593,14 @@ int64_t bs_transport_cache_read(bgpstream_transport_t *transport,
       wandio_wdestroy(STATE->writer);
       STATE->writer = NULL;
 
+      // write the index before the cache file appears, so that later readers
+      // find both
+      if (STATE->build_index == 1 && index_write(transport) != 0) {
+        bgpstream_log(BGPSTREAM_LOG_WARN,
+                      "WARNING: Could not write index file %s.",
+                      STATE->index_file_path);
+      }
+
       // rename temporary file to cache file
       if (rename(STATE->temp_file_path, STATE->cache_file_path) != 0) {
         bgpstream_log(BGPSTREAM_LOG_ERR, "ERROR: renaming failed for file %s.",
@@ -298,12 +635,22 @@ void bs_transport_cache_destroy(bgpstream_transport_t *transport)
     return;
   }
 
+  // stop a download that was not read to the end, so that the reader does
+  // not wait for the rest of it
+  bs_http_download_stop(STATE->download);
+
   // close reader
   if (STATE->reader != NULL) {
     wandio_destroy(STATE->reader);
     STATE->reader = NULL;
   }
 
+  // (the reader must be closed before waiting for the download, so that the
+  // download is not blocked on feeding it)
+  if (STATE->download != NULL) {
+    download_end(transport, 1);
+  }
+
   // close writer
   if (STATE->writer != NULL) {
     // the writer should already has been closed when the reader reaches EOF
@@ -315,6 +662,8 @@ void bs_transport_cache_destroy(bgpstream_transport_t *transport)
   free(STATE->cache_file_path);
   free(STATE->lock_file_path);
   free(STATE->temp_file_path);
+  free(STATE->index_file_path);
+  free(STATE->index);
 
   // free up the cache_state_t's memory space
   free(transport->state);
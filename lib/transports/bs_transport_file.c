@@ -27,41 +27,87 @@
 #include "bs_transport_file.h"
 #include "bgpstream_transport_interface.h"
 #include "bgpstream_log.h"
+#include "bs_http_client.h"
+#include "utils.h"
 #include "wandio.h"
 
-int bs_transport_file_create(bgpstream_transport_t *transport)
+#define STATE ((file_state_t *)(transport->state))
+
+typedef struct file_state {
+
+  /* reader of the file */
+  io_t *fh;
+
+  /* download that feeds the reader, if the file is a plain http:// URL that
+     the HTTP client fetches */
+  bs_http_download_t *download;
+
+} file_state_t;
+
+/* the reader returned ret: at the end of a download, check that it was not
+   cut short */
+static int64_t check_end(bgpstream_transport_t *transport, int64_t ret)
 {
-  io_t *fh = NULL;
+  int rc;
+
+  if (ret == 0 && STATE->download != NULL) {
+    rc = bs_http_download_finish(STATE->download, 0);
+    STATE->download = NULL;
+    if (rc != 0) {
+      return -1;
+    }
+  }
+  return ret;
+}
 
+int bs_transport_file_create(bgpstream_transport_t *transport)
+{
   BS_TRANSPORT_SET_METHODS(file, transport);
 
-  if ((fh = wandio_create(transport->res->uri)) == NULL) {
+  if ((transport->state = malloc_zero(sizeof(file_state_t))) == NULL) {
+    return -1;
+  }
+
+  // remote files go through the HTTP client when it supports them, and
+  // through wandio otherwise (or if the client could not start the download)
+  if (bs_http_is_supported(transport->res->uri) == 0 ||
+      (STATE->fh = bs_http_download_open(transport->res->uri, NULL, 1,
+                                         &STATE->download)) == NULL) {
+    STATE->fh = wandio_create(transport->res->uri);
+  }
+  if (STATE->fh == NULL) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "Could not open %s for reading",
                   transport->res->uri);
+    bs_transport_file_destroy(transport);
     return -1;
   }
 
-  transport->state = fh;
-
   return 0;
 }
 
 int64_t bs_transport_file_read(bgpstream_transport_t *transport,
                                uint8_t *buffer, int64_t len)
 {
-  return wandio_read((io_t *)transport->state, buffer, len);
+  return check_end(transport, wandio_read(STATE->fh, buffer, len));
 }
 
 int64_t bs_transport_file_readline(bgpstream_transport_t *transport,
                                    uint8_t *buffer, int64_t len)
 {
-  return wandio_fgets((io_t *)transport->state, buffer, len, 1);
+  return check_end(transport, wandio_fgets(STATE->fh, buffer, len, 1));
 }
 
 void bs_transport_file_destroy(bgpstream_transport_t *transport)
 {
-  if (transport->state != NULL) {
-    wandio_destroy((io_t *)transport->state);
-    transport->state = NULL;
+  if (transport->state == NULL) {
+    return;
+  }
+  // so that the reader does not wait for the rest of the download
+  bs_http_download_stop(STATE->download);
+  if (STATE->fh != NULL) {
+    wandio_destroy(STATE->fh);
   }
+  bs_http_download_finish(STATE->download, 1);
+  free(transport->state);
+  transport->state = NULL;
 }
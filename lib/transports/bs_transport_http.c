@@ -27,6 +27,8 @@
 #include "bs_transport_http.h"
 #include "bgpstream_transport_interface.h"
 #include "bgpstream_log.h"
+#include "bs_http_client.h"
+#include "utils.h"
 #include "wandio.h"
 #include "config.h"
 #include <string.h>
@@ -35,42 +37,87 @@
 // https://developer.mozilla.org/en-US/docs/Web/HTTP/Headers/User-Agent
 #define HTTP_USER_AGENT_HDR "User-Agent: libbgpstream/"PACKAGE_VERSION
 
+#define STATE ((http_state_t *)(transport->state))
+
+typedef struct http_state {
+
+  /* reader of the response body */
+  io_t *fh;
+
+  /* download that feeds the reader, if the HTTP client fetches the URL */
+  bs_http_download_t *download;
+
+} http_state_t;
+
+/* the reader returned ret: at the end of a download, check that it was not
+   cut short */
+static int64_t check_end(bgpstream_transport_t *transport, int64_t ret)
+{
+  int rc;
+
+  if (ret == 0 && STATE->download != NULL) {
+    rc = bs_http_download_finish(STATE->download, 0);
+    STATE->download = NULL;
+    if (rc != 0) {
+      return -1;
+    }
+  }
+  return ret;
+}
+
 int bs_transport_http_create(bgpstream_transport_t *transport)
 {
-  io_t *fh = NULL;
   char *http_hdr = HTTP_USER_AGENT_HDR;
 
   BS_TRANSPORT_SET_METHODS(http, transport);
 
   assert(strncmp(transport->res->uri, "http", 4) == 0);
 
-  if ((fh = http_open_hdrs(transport->res->uri, &http_hdr, 1)) == NULL) {
+  if ((transport->state = malloc_zero(sizeof(http_state_t))) == NULL) {
+    return -1;
+  }
+
+  // plain http:// URLs go through the HTTP client (and its pooled
+  // connections), anything else (or a request the client could not start)
+  // through wandio
+  if (bs_http_is_supported(transport->res->uri) == 0 ||
+      (STATE->fh = bs_http_download_open(transport->res->uri, NULL, 1,
+                                         &STATE->download)) == NULL) {
+    STATE->fh = http_open_hdrs(transport->res->uri, &http_hdr, 1);
+  }
+  if (STATE->fh == NULL) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "Could not open %s for reading",
                   transport->res->uri);
+    bs_transport_http_destroy(transport);
     return -1;
   }
 
-  transport->state = fh;
-
   return 0;
 }
 
 int64_t bs_transport_http_read(bgpstream_transport_t *transport,
                                uint8_t *buffer, int64_t len)
 {
-  return wandio_read((io_t *)transport->state, buffer, len);
+  return check_end(transport, wandio_read(STATE->fh, buffer, len));
 }
 
 int64_t bs_transport_http_readline(bgpstream_transport_t *transport,
                                    uint8_t *buffer, int64_t len)
 {
-  return wandio_fgets((io_t *)transport->state, buffer, len, 1);
+  return check_end(transport, wandio_fgets(STATE->fh, buffer, len, 1));
 }
 
 void bs_transport_http_destroy(bgpstream_transport_t *transport)
 {
-  if (transport->state != NULL) {
-    wandio_destroy((io_t *)transport->state);
-    transport->state = NULL;
+  if (transport->state == NULL) {
+    return;
+  }
+  // so that the reader does not wait for the rest of the download
+  bs_http_download_stop(STATE->download);
+  if (STATE->fh != NULL) {
+    wandio_destroy(STATE->fh);
   }
+  bs_http_download_finish(STATE->download, 1);
+  free(transport->state);
+  transport->state = NULL;
 }
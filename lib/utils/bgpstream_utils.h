@@ -50,9 +50,13 @@
 #include "bgpstream_utils_addr_set.h"      /*< IP Address Set utilities */
 #include "bgpstream_utils_as_path.h"       /*< AS Path utilities */
 #include "bgpstream_utils_as_path_store.h" /*< AS Path Store utilities */
+#include "bgpstream_utils_attr_store.h"    /*< Attribute Store utilities */
+#include "bgpstream_utils_collector_map.h" /*< Collector Map utilities */
 #include "bgpstream_utils_community.h"     /*< Community utilities */
+#include "bgpstream_utils_id_bitmap.h"     /*< ID Bitmap utilities */
 #include "bgpstream_utils_id_set.h"        /*< ID Set utilities */
 #include "bgpstream_utils_ip_counter.h"    /*< IP Overlap Counter */
+#include "bgpstream_utils_lpm.h"           /*< Longest Prefix Match index */
 #include "bgpstream_utils_patricia.h"      /*< Patricia Tree utilities */
 #include "bgpstream_utils_peer_sig_map.h"  /*< Peer Signature utilities */
 #include "bgpstream_utils_pfx.h"           /*< Prefix utilities */
@@ -32,6 +32,7 @@
 
 #include "bgpstream_utils_as_path_int.h"
 #include "bgpstream_log.h"
+#include "bgpstream_utils_fmt.h"
 #include "config.h"
 #include "khash.h"
 #include "utils.h"
@@ -105,7 +106,8 @@ seg_set_dup(bgpstream_as_path_seg_set_t *src)
     int i;                                                                     \
     for (i = 0; i < segset->asn_cnt; i++) {                                    \
       remain = (len <= written) ? 0 : len - written;                           \
-      written += snprintf(bufp, remain, "%" PRIu32, segset->asn[i]);           \
+      written +=                                                               \
+        bgpstream_fmt_uint32_snprintf(bufp, remain, segset->asn[i]);           \
       bufp = buf + written;                                                    \
       if (i < segset->asn_cnt - 1) {                                           \
         ADD_CHAR(schr);                                                        \
@@ -137,8 +139,8 @@ int bgpstream_as_path_seg_snprintf(char *buf, size_t len,
 
   switch (seg->type) {
   case BGPSTREAM_AS_PATH_SEG_ASN:
-    written =
-      snprintf(buf, len, "%" PRIu32, ((bgpstream_as_path_seg_asn_t *)seg)->asn);
+    written = bgpstream_fmt_uint32_snprintf(
+      buf, len, ((bgpstream_as_path_seg_asn_t *)seg)->asn);
     break;
 
   case BGPSTREAM_AS_PATH_SEG_SET:
@@ -47,18 +47,31 @@ struct bgpstream_as_path_store_path {
   /** Internal index of this path within the store */
   uint32_t idx;
 
+  /** Hash of the full path (used by the pathset index) */
+  uint32_t hash;
+
   /** Underlying AS Path structure */
   bgpstream_as_path_t path;
 };
 
+/** Pathsets with more than this many paths are indexed by a hash table,
+    smaller ones are simply scanned */
+#define PATHSET_INDEX_MIN 8
+
 /** A per-origin set of AS Paths */
 typedef struct pathset {
 
   /** Array of AS Paths in the set */
   bgpstream_as_path_store_path_t *paths;
 
-  /** Number of AS paths in the set */
-  uint16_t paths_cnt;
+  /** Open-addressing hash index into the paths array. Each slot holds a path
+      ID + 1, or 0 if the slot is empty. NULL until the set grows beyond
+      PATHSET_INDEX_MIN paths. */
+  uint32_t *index;
+
+  /** Number of AS paths in the set (the sizes of the paths array and of the
+      index are derived from this, to keep the pathset small) */
+  uint32_t paths_cnt;
 
 } __attribute__((packed)) pathset_t;
 
@@ -120,9 +133,23 @@ static inline int store_path_equal(bgpstream_as_path_store_path_t *sp1,
          bgpstream_as_path_equal(&sp1->path, &sp2->path);
 }
 
+/* FNV-1a over the path data: unlike bgpstream_as_path_hash (which only looks
+ * at the first and origin segments, and so is the same for every path in a
+ * pathset), this distinguishes paths within a pathset */
+static uint32_t store_path_hash(bgpstream_as_path_store_path_t *spath)
+{
+  uint32_t h = 2166136261U ^ spath->is_core;
+  uint16_t i;
+
+  for (i = 0; i < spath->path.data_len; i++) {
+    h = (h ^ spath->path.data[i]) * 16777619U;
+  }
+  return h;
+}
+
 static void pathset_destroy(pathset_t ps)
 {
-  int i;
+  uint32_t i;
 
   /* destroy each store path */
   for (i = 0; i < ps.paths_cnt; i++) {
@@ -133,36 +160,126 @@ static void pathset_destroy(pathset_t ps)
   free(ps.paths);
   ps.paths = NULL;
   ps.paths_cnt = 0;
+
+  free(ps.index);
+  ps.index = NULL;
 }
 
-static uint16_t pathset_get_path_id(bgpstream_as_path_store_t *store,
+/* smallest power of two >= v (v > 0) */
+static inline uint32_t next_pow2(uint32_t v)
+{
+  v--;
+  v |= v >> 1;
+  v |= v >> 2;
+  v |= v >> 4;
+  v |= v >> 8;
+  v |= v >> 16;
+  return v + 1;
+}
+
+/* number of slots in the index of a pathset with paths_cnt paths: at most
+ * half full, or 0 if the pathset is small enough to be scanned */
+static inline uint32_t pathset_index_size(uint32_t paths_cnt)
+{
+  return (paths_cnt <= PATHSET_INDEX_MIN) ? 0 : next_pow2(paths_cnt) * 2;
+}
+
+/* (re)build the index of the pathset with the given number of slots */
+static int pathset_index_build(pathset_t *ps, uint32_t index_size)
+{
+  uint32_t *index;
+  uint32_t i, slot;
+  uint32_t mask = index_size - 1;
+
+  if ((index = malloc_zero(sizeof(uint32_t) * index_size)) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not malloc pathset index");
+    return -1;
+  }
+  for (i = 0; i < ps->paths_cnt; i++) {
+    slot = ps->paths[i].hash & mask;
+    while (index[slot] != 0) {
+      slot = (slot + 1) & mask;
+    }
+    index[slot] = i + 1;
+  }
+
+  free(ps->index);
+  ps->index = index;
+  return 0;
+}
+
+static uint32_t pathset_get_path_id(bgpstream_as_path_store_t *store,
                                     pathset_t *ps,
                                     bgpstream_as_path_store_path_t *findme)
 {
-  int i;
+  bgpstream_as_path_store_path_t *tmp;
+  uint32_t i;
+  uint32_t slot = 0;
+  uint32_t mask;
   uint32_t path_id;
+  uint32_t alloc_cnt;
+  uint32_t index_size;
+
+  findme->hash = store_path_hash(findme);
 
   /* check if it is already in the set */
-  for (i = 0; i < ps->paths_cnt; i++) {
-    if (store_path_equal(&ps->paths[i], findme) != 0) {
-      return i;
+  if (ps->index == NULL) {
+    for (i = 0; i < ps->paths_cnt; i++) {
+      if (ps->paths[i].hash == findme->hash &&
+          store_path_equal(&ps->paths[i], findme) != 0) {
+        return i;
+      }
+    }
+  } else {
+    mask = pathset_index_size(ps->paths_cnt) - 1;
+    slot = findme->hash & mask;
+    while (ps->index[slot] != 0) {
+      i = ps->index[slot] - 1;
+      if (ps->paths[i].hash == findme->hash &&
+          store_path_equal(&ps->paths[i], findme) != 0) {
+        return i;
+      }
+      slot = (slot + 1) & mask;
     }
   }
 
-  findme->idx = store->paths_cnt++;
+  if (ps->paths_cnt >= (UINT32_MAX >> 2)) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Too many paths in pathset");
+    return UINT32_MAX;
+  }
 
-  /* need to append this path */
-  if ((ps->paths = realloc(ps->paths, sizeof(bgpstream_as_path_store_path_t) *
-                                        (ps->paths_cnt + 1))) == NULL) {
-    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not realloc paths");
-    return UINT16_MAX;
+  /* need to append this path, the array grows each time the count reaches a
+     power of two */
+  if ((ps->paths_cnt & (ps->paths_cnt - 1)) == 0) {
+    alloc_cnt = (ps->paths_cnt == 0) ? 1 : ps->paths_cnt * 2;
+    if ((tmp = realloc(ps->paths, sizeof(bgpstream_as_path_store_path_t) *
+                                    alloc_cnt)) == NULL) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Could not realloc paths");
+      return UINT32_MAX;
+    }
+    ps->paths = tmp;
   }
+  findme->idx = store->paths_cnt;
   if (store_path_dup(&ps->paths[ps->paths_cnt], findme) != 0) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create store path");
-    return UINT16_MAX;
+    return UINT32_MAX;
   }
+  store->paths_cnt++;
   path_id = ps->paths_cnt++;
-  assert(ps->paths_cnt <= UINT16_MAX);
+
+  /* add the path to the index, or resize it */
+  index_size = pathset_index_size(ps->paths_cnt);
+  if (index_size != pathset_index_size(path_id)) {
+    if (pathset_index_build(ps, index_size) != 0) {
+      /* the old index is still valid without the new path */
+      store_path_destroy(&ps->paths[path_id]);
+      ps->paths_cnt--;
+      store->paths_cnt--;
+      return UINT32_MAX;
+    }
+  } else if (ps->index != NULL) {
+    ps->index[slot] = path_id + 1;
+  }
 
   return path_id;
 }
@@ -224,6 +341,7 @@ static int get_path_id(bgpstream_as_path_store_t *store,
     /* just added this pathset */
     /* clear the pathset fields */
     kh_val(store->path_set, k).paths = NULL;
+    kh_val(store->path_set, k).index = NULL;
     kh_val(store->path_set, k).paths_cnt = 0;
   } else if (khret != 0) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "Could not add path set to the store");
@@ -232,7 +350,7 @@ static int get_path_id(bgpstream_as_path_store_t *store,
 
   /* now get the path id from the origin set */
   if ((id->path_id = pathset_get_path_id(store, &kh_val(store->path_set, k),
-                                         findme)) == UINT16_MAX) {
+                                         findme)) == UINT32_MAX) {
     bgpstream_log(BGPSTREAM_LOG_ERR, "Could not add path to origin set");
     goto err;
   }
@@ -256,7 +374,7 @@ int bgpstream_as_path_store_get_path_id(bgpstream_as_path_store_t *store,
   /* special case for empty path */
   if (path == NULL) {
     id->path_hash = UINT32_MAX;
-    id->path_id = UINT16_MAX;
+    id->path_id = UINT32_MAX;
     return 0;
   }
 
@@ -362,7 +480,7 @@ bgpstream_as_path_store_get_store_path(bgpstream_as_path_store_t *store,
   khiter_t k;
 
   /* special case for NULL path */
-  if (id.path_hash == UINT32_MAX && id.path_id == UINT16_MAX) {
+  if (id.path_hash == UINT32_MAX && id.path_id == UINT32_MAX) {
     return NULL;
   }
 
@@ -371,7 +489,7 @@ bgpstream_as_path_store_get_store_path(bgpstream_as_path_store_t *store,
     return NULL;
   }
 
-  if (id.path_id > kh_val(store->path_set, k).paths_cnt - 1) {
+  if (id.path_id >= kh_val(store->path_set, k).paths_cnt) {
     return NULL;
   }
 
@@ -80,7 +80,7 @@ typedef struct bgpstream_as_path_store_path_id {
   uint32_t path_hash;
 
   /** ID of the path within the origin pathset */
-  uint16_t path_id;
+  uint32_t path_id;
 
 } __attribute__((packed)) bgpstream_as_path_store_path_id_t;
 
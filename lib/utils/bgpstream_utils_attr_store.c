@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_utils_attr_store.h"
+#include "bgpstream_log.h"
+#include "config.h"
+#include "khash.h"
+#include "utils.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* number of attribute sets per chunk. attribute sets are allocated in chunks
+   so that they never move, and the hash can point to them */
+#define ATTRS_CHUNK_LEN 4096
+
+/* number of community sets allocated at once */
+#define COMMS_ALLOC_CNT 1024
+
+static inline khint32_t attrs_hash(bgpstream_attr_store_attrs_t *a)
+{
+  khint32_t h = a->path_id.path_hash;
+  h = (h << 5) - h + a->path_id.path_id;
+  h = (h << 5) - h + a->peer_asn;
+  h = (h << 5) - h + a->communities_id;
+  h = (h << 5) - h + (khint32_t)bgpstream_addr_storage_hash(&a->nexthop);
+  return h;
+}
+
+static inline int attrs_equal(bgpstream_attr_store_attrs_t *a,
+                              bgpstream_attr_store_attrs_t *b)
+{
+  return a->path_id.path_hash == b->path_id.path_hash &&
+         a->path_id.path_id == b->path_id.path_id &&
+         a->peer_asn == b->peer_asn &&
+         a->communities_id == b->communities_id &&
+         a->nexthop.version == b->nexthop.version &&
+         (a->nexthop.version == BGPSTREAM_ADDR_VERSION_UNKNOWN ||
+          bgpstream_addr_storage_equal(&a->nexthop, &b->nexthop));
+}
+
+/** Map from attribute set to ID (keys point into the attrs chunks) */
+KHASH_INIT(bsas_attrs, bgpstream_attr_store_attrs_t *, uint32_t, 1,
+           attrs_hash, attrs_equal);
+
+/** Map from community set to ID (keys are owned by the comms array) */
+KHASH_INIT(bsas_comms, bgpstream_community_set_t *, uint32_t, 1,
+           bgpstream_community_set_hash, bgpstream_community_set_equal);
+
+struct bgpstream_attr_store {
+
+  /* interns AS paths */
+  bgpstream_as_path_store_t *paths;
+
+  /* attribute sets, in chunks of ATTRS_CHUNK_LEN, indexed by ID - 1 */
+  bgpstream_attr_store_attrs_t **attrs_chunks;
+  uint32_t attrs_cnt;
+  uint32_t attrs_chunks_cnt;
+  khash_t(bsas_attrs) *attrs_ids;
+
+  /* community sets, indexed by ID */
+  bgpstream_community_set_t **comms;
+  uint32_t comms_cnt;
+  uint32_t comms_alloc;
+  khash_t(bsas_comms) *comms_ids;
+
+  /* the attributes of the last lookup (valid if last_id is not 0) */
+  uint32_t last_id;
+  int last_path_null;
+  bgpstream_as_path_t *last_path;
+  uint32_t last_peer_asn;
+  bgpstream_community_set_t *last_comms;
+  bgpstream_addr_storage_t last_nexthop;
+};
+
+/* ========== PRIVATE FUNCTIONS ========== */
+
+static int comms_equal(bgpstream_community_set_t *a,
+                       bgpstream_community_set_t *b)
+{
+  int a_cnt = (a == NULL) ? 0 : bgpstream_community_set_size(a);
+  int b_cnt = (b == NULL) ? 0 : bgpstream_community_set_size(b);
+
+  if (a_cnt == 0 || b_cnt == 0) {
+    return a_cnt == b_cnt;
+  }
+  return bgpstream_community_set_equal(a, b);
+}
+
+static int nexthop_equal(bgpstream_addr_storage_t *a,
+                         bgpstream_addr_storage_t *b)
+{
+  return a->version == b->version &&
+         (a->version == BGPSTREAM_ADDR_VERSION_UNKNOWN ||
+          bgpstream_addr_storage_equal(a, b));
+}
+
+/* is this lookup the same as the last one? */
+static int is_last(bgpstream_attr_store_t *store, bgpstream_as_path_t *path,
+                   uint32_t peer_asn, bgpstream_community_set_t *comms,
+                   bgpstream_addr_storage_t *nexthop)
+{
+  return store->last_id != 0 && store->last_peer_asn == peer_asn &&
+         nexthop_equal(&store->last_nexthop, nexthop) &&
+         (path == NULL ? store->last_path_null
+                       : (!store->last_path_null &&
+                          bgpstream_as_path_equal(store->last_path, path))) &&
+         comms_equal(store->last_comms, comms);
+}
+
+static void set_last(bgpstream_attr_store_t *store, bgpstream_as_path_t *path,
+                     uint32_t peer_asn, bgpstream_community_set_t *comms,
+                     bgpstream_addr_storage_t *nexthop, uint32_t id)
+{
+  store->last_id = 0;
+  store->last_path_null = (path == NULL);
+  if (path != NULL && bgpstream_as_path_copy(store->last_path, path) != 0) {
+    return;
+  }
+  bgpstream_community_set_clear(store->last_comms);
+  if (comms != NULL && bgpstream_community_set_size(comms) != 0 &&
+      bgpstream_community_set_copy(store->last_comms, comms) != 0) {
+    return;
+  }
+  store->last_peer_asn = peer_asn;
+  store->last_nexthop = *nexthop;
+  store->last_id = id;
+}
+
+/* ========== PUBLIC FUNCTIONS ========== */
+
+bgpstream_attr_store_t *bgpstream_attr_store_create()
+{
+  bgpstream_attr_store_t *store;
+  bgpstream_community_set_t *empty = NULL;
+  uint32_t id;
+
+  if ((store = malloc_zero(sizeof(bgpstream_attr_store_t))) == NULL) {
+    return NULL;
+  }
+
+  if ((store->paths = bgpstream_as_path_store_create()) == NULL ||
+      (store->attrs_ids = kh_init(bsas_attrs)) == NULL ||
+      (store->comms_ids = kh_init(bsas_comms)) == NULL ||
+      (store->last_path = bgpstream_as_path_create()) == NULL ||
+      (store->last_comms = bgpstream_community_set_create()) == NULL) {
+    goto err;
+  }
+
+  /* the empty community set has ID 0 */
+  if ((empty = bgpstream_community_set_create()) == NULL) {
+    goto err;
+  }
+  if (bgpstream_attr_store_get_communities_id(store, empty, &id) != 0) {
+    goto err;
+  }
+  bgpstream_community_set_destroy(empty);
+
+  return store;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create attribute store");
+  bgpstream_community_set_destroy(empty);
+  bgpstream_attr_store_destroy(store);
+  return NULL;
+}
+
+void bgpstream_attr_store_destroy(bgpstream_attr_store_t *store)
+{
+  uint32_t i;
+
+  if (store == NULL) {
+    return;
+  }
+
+  bgpstream_as_path_store_destroy(store->paths);
+  store->paths = NULL;
+
+  if (store->attrs_ids != NULL) {
+    kh_destroy(bsas_attrs, store->attrs_ids);
+    store->attrs_ids = NULL;
+  }
+  for (i = 0; i < store->attrs_chunks_cnt; i++) {
+    free(store->attrs_chunks[i]);
+  }
+  free(store->attrs_chunks);
+  store->attrs_chunks = NULL;
+
+  if (store->comms_ids != NULL) {
+    kh_destroy(bsas_comms, store->comms_ids);
+    store->comms_ids = NULL;
+  }
+  for (i = 0; i < store->comms_cnt; i++) {
+    bgpstream_community_set_destroy(store->comms[i]);
+  }
+  free(store->comms);
+  store->comms = NULL;
+
+  if (store->last_path != NULL) {
+    bgpstream_as_path_destroy(store->last_path);
+    store->last_path = NULL;
+  }
+  bgpstream_community_set_destroy(store->last_comms);
+  store->last_comms = NULL;
+
+  free(store);
+}
+
+uint32_t bgpstream_attr_store_get_size(bgpstream_attr_store_t *store)
+{
+  return store->attrs_cnt;
+}
+
+int bgpstream_attr_store_get_id(bgpstream_attr_store_t *store,
+                                bgpstream_as_path_t *path, uint32_t peer_asn,
+                                bgpstream_community_set_t *comms,
+                                bgpstream_addr_storage_t *nexthop,
+                                uint32_t *id)
+{
+  bgpstream_attr_store_attrs_t findme;
+  bgpstream_attr_store_attrs_t *attrs;
+  bgpstream_attr_store_attrs_t **chunks;
+  bgpstream_addr_storage_t no_nexthop;
+  uint32_t idx;
+  khiter_t k;
+  int khret;
+
+  if (nexthop == NULL) {
+    memset(&no_nexthop, 0, sizeof(no_nexthop));
+    nexthop = &no_nexthop;
+  }
+
+  /* consecutive lookups (e.g., the prefixes of an UPDATE) usually have the
+     same attributes */
+  if (is_last(store, path, peer_asn, comms, nexthop)) {
+    *id = store->last_id;
+    return 0;
+  }
+
+  memset(&findme, 0, sizeof(findme));
+  if (bgpstream_as_path_store_get_path_id(store->paths, path, peer_asn,
+                                          &findme.path_id) != 0 ||
+      bgpstream_attr_store_get_communities_id(store, comms,
+                                              &findme.communities_id) != 0) {
+    return -1;
+  }
+  findme.peer_asn = peer_asn;
+  if (nexthop->version != BGPSTREAM_ADDR_VERSION_UNKNOWN) {
+    bgpstream_addr_copy((bgpstream_ip_addr_t *)&findme.nexthop,
+                        (bgpstream_ip_addr_t *)nexthop);
+  }
+
+  if ((k = kh_get(bsas_attrs, store->attrs_ids, &findme)) !=
+      kh_end(store->attrs_ids)) {
+    *id = kh_val(store->attrs_ids, k);
+    set_last(store, path, peer_asn, comms, nexthop, *id);
+    return 0;
+  }
+
+  /* a new attribute set */
+  if (store->attrs_cnt == UINT32_MAX - 1) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Too many attribute sets");
+    return -1;
+  }
+  idx = store->attrs_cnt;
+  if ((idx % ATTRS_CHUNK_LEN) == 0) {
+    if ((chunks = realloc(store->attrs_chunks,
+                          sizeof(bgpstream_attr_store_attrs_t *) *
+                            (store->attrs_chunks_cnt + 1))) == NULL) {
+      return -1;
+    }
+    store->attrs_chunks = chunks;
+    if ((store->attrs_chunks[store->attrs_chunks_cnt] =
+           malloc(sizeof(bgpstream_attr_store_attrs_t) * ATTRS_CHUNK_LEN)) ==
+        NULL) {
+      return -1;
+    }
+    store->attrs_chunks_cnt++;
+  }
+  attrs = &store->attrs_chunks[idx / ATTRS_CHUNK_LEN][idx % ATTRS_CHUNK_LEN];
+  *attrs = findme;
+
+  k = kh_put(bsas_attrs, store->attrs_ids, attrs, &khret);
+  if (khret == -1) {
+    return -1;
+  }
+  store->attrs_cnt++;
+  kh_val(store->attrs_ids, k) = store->attrs_cnt;
+
+  *id = store->attrs_cnt;
+  set_last(store, path, peer_asn, comms, nexthop, *id);
+  return 0;
+}
+
+bgpstream_attr_store_attrs_t *
+bgpstream_attr_store_get_attrs(bgpstream_attr_store_t *store, uint32_t id)
+{
+  if (id == 0 || id > store->attrs_cnt) {
+    return NULL;
+  }
+  id--;
+  return &store->attrs_chunks[id / ATTRS_CHUNK_LEN][id % ATTRS_CHUNK_LEN];
+}
+
+int bgpstream_attr_store_get_communities_id(bgpstream_attr_store_t *store,
+                                            bgpstream_community_set_t *comms,
+                                            uint32_t *id)
+{
+  bgpstream_community_set_t **tmp;
+  bgpstream_community_set_t *cpy = NULL;
+  khiter_t k;
+  int khret;
+
+  /* the empty set is interned first (by _create), so that it gets ID 0 */
+  if (store->comms_cnt != 0 &&
+      (comms == NULL || bgpstream_community_set_size(comms) == 0)) {
+    *id = 0;
+    return 0;
+  }
+
+  k = kh_get(bsas_comms, store->comms_ids, comms);
+  if (k != kh_end(store->comms_ids)) {
+    *id = kh_val(store->comms_ids, k);
+    return 0;
+  }
+
+  if (store->comms_cnt == UINT32_MAX) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Too many community sets");
+    return -1;
+  }
+
+  if (store->comms_cnt == store->comms_alloc) {
+    if ((tmp = realloc(store->comms,
+                       sizeof(bgpstream_community_set_t *) *
+                         (store->comms_alloc + COMMS_ALLOC_CNT))) == NULL) {
+      return -1;
+    }
+    store->comms = tmp;
+    store->comms_alloc += COMMS_ALLOC_CNT;
+  }
+
+  if ((cpy = bgpstream_community_set_create()) == NULL ||
+      (bgpstream_community_set_size(comms) != 0 &&
+       bgpstream_community_set_copy(cpy, comms) != 0)) {
+    goto err;
+  }
+  k = kh_put(bsas_comms, store->comms_ids, cpy, &khret);
+  if (khret == -1) {
+    goto err;
+  }
+  kh_val(store->comms_ids, k) = store->comms_cnt;
+  store->comms[store->comms_cnt] = cpy;
+  *id = store->comms_cnt++;
+  return 0;
+
+err:
+  bgpstream_community_set_destroy(cpy);
+  return -1;
+}
+
+bgpstream_community_set_t *
+bgpstream_attr_store_get_communities(bgpstream_attr_store_t *store,
+                                     uint32_t id)
+{
+  if (id >= store->comms_cnt) {
+    return NULL;
+  }
+  return store->comms[id];
+}
+
+bgpstream_as_path_store_t *
+bgpstream_attr_store_get_as_path_store(bgpstream_attr_store_t *store)
+{
+  return store->paths;
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_UTILS_ATTR_STORE_H
+#define __BGPSTREAM_UTILS_ATTR_STORE_H
+
+#include "bgpstream_utils_addr.h"
+#include "bgpstream_utils_as_path.h"
+#include "bgpstream_utils_as_path_store.h"
+#include "bgpstream_utils_community.h"
+
+/** @file
+ *
+ * @brief Header file that exposes the public interface of the BGPStream
+ * Attribute Store.
+ *
+ * The store assigns a stable ID to every distinct (AS path, communities,
+ * next-hop) attribute set that it is given. AS paths are interned using an AS
+ * Path Store, and community sets are interned by the store itself, so each
+ * attribute set is stored only once, however many prefixes share it.
+ *
+ * Consecutive lookups of the same attributes (e.g., for all the prefixes of an
+ * UPDATE message) are answered by comparing them with the previous lookup,
+ * without hashing.
+ *
+ */
+
+/**
+ * @name Public Opaque Data Structures
+ *
+ * @{ */
+
+/** Opaque pointer to an Attribute Store object */
+typedef struct bgpstream_attr_store bgpstream_attr_store_t;
+
+/** @} */
+
+/**
+ * @name Public Data Structures
+ *
+ * @{ */
+
+/** An attribute set, as stored in the store */
+typedef struct bgpstream_attr_store_attrs {
+
+  /** ID of the AS path in the AS Path Store of the store (see
+      bgpstream_attr_store_get_as_path_store) */
+  bgpstream_as_path_store_path_id_t path_id;
+
+  /** ASN of the peer that the path was observed by (needed to rebuild the
+      full path from the AS Path Store) */
+  uint32_t peer_asn;
+
+  /** ID of the community set (see bgpstream_attr_store_get_communities) */
+  uint32_t communities_id;
+
+  /** Next-hop address (version BGPSTREAM_ADDR_VERSION_UNKNOWN if there is no
+      next-hop) */
+  bgpstream_addr_storage_t nexthop;
+
+} bgpstream_attr_store_attrs_t;
+
+/** @} */
+
+/**
+ * @name Public API Functions
+ *
+ * @{ */
+
+/** Create a new Attribute Store
+ *
+ * @return pointer to the created store if successful, NULL otherwise
+ */
+bgpstream_attr_store_t *bgpstream_attr_store_create();
+
+/** Destroy the given Attribute Store
+ *
+ * @param store         pointer to the store to destroy
+ */
+void bgpstream_attr_store_destroy(bgpstream_attr_store_t *store);
+
+/** Get the number of attribute sets in the store
+ *
+ * @param store         pointer to the store
+ * @return the number of attribute sets in the store
+ */
+uint32_t bgpstream_attr_store_get_size(bgpstream_attr_store_t *store);
+
+/** Get the ID of the given attribute set from the store
+ *
+ * @param store         pointer to the store
+ * @param path          pointer to the AS path (may be NULL)
+ * @param peer_asn      ASN of the peer that observed the path
+ * @param comms         pointer to the community set (may be NULL)
+ * @param nexthop       pointer to the next-hop address (may be NULL)
+ * @param[out] id       set to the ID of the attribute set
+ * @return 0 if the ID was populated correctly, -1 otherwise
+ *
+ * If the attribute set is not already in the store, it will be added. IDs
+ * start at 1, and are never reused.
+ */
+int bgpstream_attr_store_get_id(bgpstream_attr_store_t *store,
+                                bgpstream_as_path_t *path, uint32_t peer_asn,
+                                bgpstream_community_set_t *comms,
+                                bgpstream_addr_storage_t *nexthop,
+                                uint32_t *id);
+
+/** Get the attribute set with the given ID
+ *
+ * @param store         pointer to the store
+ * @param id            ID of the attribute set to retrieve
+ * @return borrowed pointer to the attribute set, NULL if the ID is unknown
+ */
+bgpstream_attr_store_attrs_t *
+bgpstream_attr_store_get_attrs(bgpstream_attr_store_t *store, uint32_t id);
+
+/** Get the ID of the given community set from the store
+ *
+ * @param store         pointer to the store
+ * @param comms         pointer to the community set (may be NULL)
+ * @param[out] id       set to the ID of the community set
+ * @return 0 if the ID was populated correctly, -1 otherwise
+ *
+ * If the community set is not already in the store, a copy of it will be
+ * added. The empty set (and NULL) always has ID 0.
+ */
+int bgpstream_attr_store_get_communities_id(bgpstream_attr_store_t *store,
+                                            bgpstream_community_set_t *comms,
+                                            uint32_t *id);
+
+/** Get the community set with the given ID
+ *
+ * @param store         pointer to the store
+ * @param id            ID of the community set to retrieve
+ * @return borrowed pointer to the community set, NULL if the ID is unknown
+ */
+bgpstream_community_set_t *
+bgpstream_attr_store_get_communities(bgpstream_attr_store_t *store,
+                                     uint32_t id);
+
+/** Get a borrowed pointer to the AS Path Store used by the given store
+ *
+ * @param store         pointer to the store
+ * @return borrowed pointer to the AS Path Store that path IDs refer to
+ */
+bgpstream_as_path_store_t *
+bgpstream_attr_store_get_as_path_store(bgpstream_attr_store_t *store);
+
+/** @} */
+
+#endif /* __BGPSTREAM_UTILS_ATTR_STORE_H */
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_utils_collector_map.h"
+#include "config.h"
+#include "khash.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* number of signatures allocated at once */
+#define SIGS_ALLOC_CNT 32
+
+static inline khint32_t sig_hash(bgpstream_collector_sig_t *sig)
+{
+  return (kh_str_hash_func(sig->project) * 31) ^
+         kh_str_hash_func(sig->collector);
+}
+
+static inline int sig_equal(bgpstream_collector_sig_t *a,
+                            bgpstream_collector_sig_t *b)
+{
+  return strcmp(a->collector, b->collector) == 0 &&
+         strcmp(a->project, b->project) == 0;
+}
+
+static void sig_destroy(bgpstream_collector_sig_t *sig)
+{
+  if (sig == NULL) {
+    return;
+  }
+  free(sig->project);
+  free(sig->collector);
+  free(sig);
+}
+
+/** Map from collector signature to ID (keys are owned by the sigs array) */
+KHASH_INIT(bscm_ids, bgpstream_collector_sig_t *, bgpstream_collector_id_t, 1,
+           sig_hash, sig_equal);
+
+struct bgpstream_collector_map {
+
+  /* signatures, indexed by ID - 1 */
+  bgpstream_collector_sig_t **sigs;
+  int sigs_cnt;
+  int sigs_alloc_cnt;
+
+  /* map from signature to ID */
+  khash_t(bscm_ids) * ids;
+
+  /* ID returned by the last lookup (0 if none) */
+  bgpstream_collector_id_t last_id;
+};
+
+/* ========== PUBLIC FUNCTIONS ========== */
+
+bgpstream_collector_map_t *bgpstream_collector_map_create()
+{
+  bgpstream_collector_map_t *map;
+
+  if ((map = malloc_zero(sizeof(bgpstream_collector_map_t))) == NULL) {
+    return NULL;
+  }
+
+  if ((map->ids = kh_init(bscm_ids)) == NULL) {
+    bgpstream_collector_map_destroy(map);
+    return NULL;
+  }
+
+  return map;
+}
+
+bgpstream_collector_id_t
+bgpstream_collector_map_get_id(bgpstream_collector_map_t *map,
+                               const char *project, const char *collector)
+{
+  bgpstream_collector_sig_t key;
+  bgpstream_collector_sig_t *sig = NULL;
+  bgpstream_collector_sig_t **tmp;
+  khiter_t k;
+  int khret;
+
+  // fast path: same collector as last time
+  if (map->last_id != 0) {
+    sig = map->sigs[map->last_id - 1];
+    if (strcmp(sig->collector, collector) == 0 &&
+        strcmp(sig->project, project) == 0) {
+      return map->last_id;
+    }
+  }
+
+  // the key only borrows the names, they are copied if the collector is new
+  key.project = (char *)project;
+  key.collector = (char *)collector;
+
+  if ((k = kh_get(bscm_ids, map->ids, &key)) != kh_end(map->ids)) {
+    map->last_id = kh_val(map->ids, k);
+    return map->last_id;
+  }
+
+  // first time we see this collector
+  if (map->sigs_cnt == UINT16_MAX) {
+    return 0;
+  }
+  if (map->sigs_cnt == map->sigs_alloc_cnt) {
+    if ((tmp = realloc(map->sigs, sizeof(bgpstream_collector_sig_t *) *
+                                    (map->sigs_alloc_cnt + SIGS_ALLOC_CNT))) ==
+        NULL) {
+      return 0;
+    }
+    map->sigs = tmp;
+    map->sigs_alloc_cnt += SIGS_ALLOC_CNT;
+  }
+  if ((sig = malloc_zero(sizeof(bgpstream_collector_sig_t))) == NULL ||
+      (sig->project = strdup(project)) == NULL ||
+      (sig->collector = strdup(collector)) == NULL) {
+    goto err;
+  }
+
+  k = kh_put(bscm_ids, map->ids, sig, &khret);
+  if (khret == -1) {
+    goto err;
+  }
+  map->sigs[map->sigs_cnt++] = sig;
+  kh_val(map->ids, k) = map->sigs_cnt;
+
+  map->last_id = map->sigs_cnt;
+  return map->last_id;
+
+err:
+  sig_destroy(sig);
+  return 0;
+}
+
+bgpstream_collector_sig_t *
+bgpstream_collector_map_get_sig(bgpstream_collector_map_t *map,
+                                bgpstream_collector_id_t id)
+{
+  if (id == 0 || id > map->sigs_cnt) {
+    return NULL;
+  }
+  return map->sigs[id - 1];
+}
+
+int bgpstream_collector_map_get_size(bgpstream_collector_map_t *map)
+{
+  return map->sigs_cnt;
+}
+
+void bgpstream_collector_map_destroy(bgpstream_collector_map_t *map)
+{
+  int i;
+
+  if (map == NULL) {
+    return;
+  }
+
+  if (map->ids != NULL) {
+    kh_destroy(bscm_ids, map->ids);
+    map->ids = NULL;
+  }
+
+  for (i = 0; i < map->sigs_cnt; i++) {
+    sig_destroy(map->sigs[i]);
+  }
+  free(map->sigs);
+  map->sigs = NULL;
+
+  free(map);
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_UTILS_COLLECTOR_MAP_H
+#define __BGPSTREAM_UTILS_COLLECTOR_MAP_H
+
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Header file that exposes the public interface of the BGP Stream
+ * Collector Map.
+ *
+ * The collector map interns (project, collector) name pairs into small,
+ * dense IDs (starting at 1), so that per-collector state can be kept in an
+ * array rather than in a hash keyed by the names.
+ *
+ */
+
+/**
+ * @name Opaque Data Structures
+ *
+ * @{ */
+
+/** Type of a collector ID */
+typedef uint16_t bgpstream_collector_id_t;
+
+/** Opaque structure containing a collector map instance */
+typedef struct bgpstream_collector_map bgpstream_collector_map_t;
+
+/** @} */
+
+/**
+ * @name Public Data Structures
+ *
+ * @{ */
+
+/** Structure that uniquely identifies a single collector */
+typedef struct struct_bgpstream_collector_sig_t {
+
+  /** The name of the project that the collector belongs to (owned by the
+   * map, and never truncated) */
+  char *project;
+
+  /** The name of the collector (owned by the map, and never truncated) */
+  char *collector;
+
+} bgpstream_collector_sig_t;
+
+/** @} */
+
+/**
+ * @name Public API Functions
+ *
+ * @{ */
+
+/** Create a new collector map
+ *
+ * @return a pointer to the created collector map if successful, NULL otherwise
+ */
+bgpstream_collector_map_t *bgpstream_collector_map_create();
+
+/** Get (or set and get) the ID of the given collector
+ *
+ * @param map           pointer to the collector map to query
+ * @param project       name of the project
+ * @param collector     name of the collector
+ * @return the ID of the collector, 0 if an error occurred
+ *
+ * Consecutive lookups of the same collector only compare the names against
+ * those of the previous lookup.
+ */
+bgpstream_collector_id_t
+bgpstream_collector_map_get_id(bgpstream_collector_map_t *map,
+                               const char *project, const char *collector);
+
+/** Get the signature of the collector with the given ID
+ *
+ * @param map           pointer to the collector map to query
+ * @param id            collector ID to retrieve the signature for
+ * @return pointer to the collector signature, NULL if it was not found
+ */
+bgpstream_collector_sig_t *
+bgpstream_collector_map_get_sig(bgpstream_collector_map_t *map,
+                                bgpstream_collector_id_t id);
+
+/** Get the number of collectors in the given map
+ *
+ * @param map           pointer to the collector map
+ * @return the number of collectors in the map (i.e., the largest ID)
+ */
+int bgpstream_collector_map_get_size(bgpstream_collector_map_t *map);
+
+/** Destroy the given collector map
+ *
+ * @param map           pointer to the collector map to destroy
+ */
+void bgpstream_collector_map_destroy(bgpstream_collector_map_t *map);
+
+/** @} */
+
+#endif /* __BGPSTREAM_UTILS_COLLECTOR_MAP_H */
@@ -25,6 +25,7 @@
  */
 
 #include "bgpstream_utils_community_int.h"
+#include "bgpstream_utils_fmt.h"
 #include "config.h"
 #include "khash.h"
 #include "utils.h"
@@ -58,7 +59,19 @@ struct bgpstream_community_set {
 int bgpstream_community_snprintf(char *buf, size_t len,
                                  bgpstream_community_t *comm)
 {
-  return snprintf(buf, len, "%" PRIu16 ":%" PRIu16, comm->asn, comm->value);
+  char tmp[COMMUNITY_MAX_STR_LEN];
+  size_t n;
+
+  n = bgpstream_fmt_uint32(tmp, comm->asn);
+  tmp[n++] = ':';
+  n += bgpstream_fmt_uint32(tmp + n, comm->value);
+
+  if (len > 0) {
+    size_t cpy = (n < len) ? n : len - 1;
+    memcpy(buf, tmp, cpy);
+    buf[cpy] = '\0';
+  }
+  return n;
 }
 
 int bgpstream_str2community(const char *buf, bgpstream_community_t *comm)
@@ -330,7 +343,7 @@ int bgpstream_community_set_equal(bgpstream_community_set_t *set1,
   return (set1->communities_hash == set2->communities_hash) &&
          (set1->communities_cnt == set2->communities_cnt) &&
          bcmp(set1->communities, set2->communities,
-              sizeof(bgpstream_community_t) * set1->communities_cnt);
+              sizeof(bgpstream_community_t) * set1->communities_cnt) == 0;
 }
 
 /* ========== PROTECTED FUNCTIONS ========== */
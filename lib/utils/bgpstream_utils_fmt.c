@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_utils_fmt.h"
+#include "config.h"
+#include <string.h>
+
+/* pairs of decimal digits, "00" .. "99" */
+static const char dec_pairs[201] = "00010203040506070809"
+                                   "10111213141516171819"
+                                   "20212223242526272829"
+                                   "30313233343536373839"
+                                   "40414243444546474849"
+                                   "50515253545556575859"
+                                   "60616263646566676869"
+                                   "70717273747576777879"
+                                   "80818283848586878889"
+                                   "90919293949596979899";
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/* pow10[0] is zero so that the digit count of 0 comes out as 1 */
+static const uint32_t pow10_tbl[] = {
+  0,      10,      100,      1000,      10000,
+  100000, 1000000, 10000000, 100000000, 1000000000,
+};
+
+/* number of decimal digits in val, without a loop or a chain of compares:
+   log10(val) ~= log2(val) * 1233 / 4096, corrected by one table lookup */
+static inline int u32_digits(uint32_t val)
+{
+  int t = ((32 - __builtin_clz(val | 1)) * 1233) >> 12;
+  return t + 1 - (val < pow10_tbl[t]);
+}
+
+/* write exactly ndigits digits of val, ending at buf + ndigits */
+static inline void write_digits(char *buf, uint32_t val, int ndigits)
+{
+  char *p = buf + ndigits;
+  uint32_t idx;
+
+  while (val >= 100) {
+    idx = (val % 100) * 2;
+    val /= 100;
+    *--p = dec_pairs[idx + 1];
+    *--p = dec_pairs[idx];
+  }
+  if (val >= 10) {
+    idx = val * 2;
+    *--p = dec_pairs[idx + 1];
+    *--p = dec_pairs[idx];
+  } else {
+    *--p = '0' + val;
+  }
+  /* zero padding (if any) */
+  while (p > buf) {
+    *--p = '0';
+  }
+}
+
+/* an IPv4 octet is at most 3 digits */
+static inline size_t write_octet(char *buf, uint8_t val)
+{
+  int n = 1 + (val >= 10) + (val >= 100);
+  write_digits(buf, val, n);
+  return n;
+}
+
+/* a 16-bit IPv6 word in lower-case hex without leading zeros */
+static inline size_t write_hex16(char *buf, uint16_t val)
+{
+  int n = (35 - __builtin_clz((uint32_t)val | 1)) >> 2;
+  int i;
+  for (i = n - 1; i >= 0; i--) {
+    buf[i] = hex_digits[val & 0xf];
+    val >>= 4;
+  }
+  return n;
+}
+
+/* ========== PRIVATE FUNCTIONS ========== */
+
+size_t bgpstream_fmt_uint32(char *buf, uint32_t val)
+{
+  int n = u32_digits(val);
+  write_digits(buf, val, n);
+  return n;
+}
+
+size_t bgpstream_fmt_uint32_pad(char *buf, uint32_t val, int width)
+{
+  int n = u32_digits(val);
+  if (n < width) {
+    n = width;
+  }
+  write_digits(buf, val, n);
+  return n;
+}
+
+size_t bgpstream_fmt_ipv4(char *buf, const struct in_addr *addr)
+{
+  const uint8_t *b = (const uint8_t *)&addr->s_addr;
+  char *p = buf;
+
+  p += write_octet(p, b[0]);
+  *p++ = '.';
+  p += write_octet(p, b[1]);
+  *p++ = '.';
+  p += write_octet(p, b[2]);
+  *p++ = '.';
+  p += write_octet(p, b[3]);
+
+  return p - buf;
+}
+
+size_t bgpstream_fmt_ipv6(char *buf, const struct in6_addr *addr)
+{
+  const uint8_t *b = addr->s6_addr;
+  uint16_t words[8];
+  int best_base = -1, best_len = 0;
+  int cur_base = -1, cur_len = 0;
+  char *p = buf;
+  int i;
+
+  for (i = 0; i < 8; i++) {
+    words[i] = ((uint16_t)b[2 * i] << 8) | b[2 * i + 1];
+  }
+
+  /* find the longest run of zero words (leftmost on ties), as inet_ntop
+     does */
+  for (i = 0; i < 8; i++) {
+    if (words[i] == 0) {
+      if (cur_base == -1) {
+        cur_base = i;
+        cur_len = 1;
+      } else {
+        cur_len++;
+      }
+    } else if (cur_base != -1) {
+      if (best_base == -1 || cur_len > best_len) {
+        best_base = cur_base;
+        best_len = cur_len;
+      }
+      cur_base = -1;
+    }
+  }
+  if (cur_base != -1 && (best_base == -1 || cur_len > best_len)) {
+    best_base = cur_base;
+    best_len = cur_len;
+  }
+  /* a single zero word is not compressed */
+  if (best_base != -1 && best_len < 2) {
+    best_base = -1;
+  }
+
+  for (i = 0; i < 8; i++) {
+    /* inside the compressed run? */
+    if (best_base != -1 && i >= best_base && i < (best_base + best_len)) {
+      if (i == best_base) {
+        *p++ = ':';
+      }
+      continue;
+    }
+    if (i != 0) {
+      *p++ = ':';
+    }
+    /* IPv4-compatible (::a.b.c.d) or IPv4-mapped (::ffff:a.b.c.d) */
+    if (i == 6 && best_base == 0 &&
+        (best_len == 6 || (best_len == 5 && words[5] == 0xffff))) {
+      p += bgpstream_fmt_ipv4(p, (const struct in_addr *)&b[12]);
+      return p - buf;
+    }
+    p += write_hex16(p, words[i]);
+  }
+  /* trailing run of zeros */
+  if (best_base != -1 && (best_base + best_len) == 8) {
+    *p++ = ':';
+  }
+
+  return p - buf;
+}
+
+int bgpstream_fmt_uint32_snprintf(char *buf, size_t len, uint32_t val)
+{
+  char tmp[BGPSTREAM_FMT_UINT32_MAXLEN];
+  size_t n;
+
+  if (len > BGPSTREAM_FMT_UINT32_MAXLEN) {
+    /* fast path: plenty of room, write straight into the buffer */
+    n = bgpstream_fmt_uint32(buf, val);
+    buf[n] = '\0';
+    return n;
+  }
+
+  n = bgpstream_fmt_uint32(tmp, val);
+  if (len > 0) {
+    size_t cpy = (n < len) ? n : len - 1;
+    memcpy(buf, tmp, cpy);
+    buf[cpy] = '\0';
+  }
+  return n;
+}
+
+char *bgpstream_fmt_addr_ntop(char *buf, size_t len, const void *addr)
+{
+  const bgpstream_addr_storage_t *a = (const bgpstream_addr_storage_t *)addr;
+  char tmp[BGPSTREAM_FMT_IPV6_MAXLEN];
+  size_t n;
+
+  switch (a->version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    if (len > BGPSTREAM_FMT_IPV4_MAXLEN) {
+      buf[bgpstream_fmt_ipv4(buf, &a->ipv4)] = '\0';
+      return buf;
+    }
+    n = bgpstream_fmt_ipv4(tmp, &a->ipv4);
+    break;
+
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    if (len > BGPSTREAM_FMT_IPV6_MAXLEN) {
+      buf[bgpstream_fmt_ipv6(buf, &a->ipv6)] = '\0';
+      return buf;
+    }
+    n = bgpstream_fmt_ipv6(tmp, &a->ipv6);
+    break;
+
+  default:
+    return NULL;
+  }
+
+  /* like inet_ntop, fail if the whole string does not fit */
+  if (n >= len) {
+    return NULL;
+  }
+  memcpy(buf, tmp, n);
+  buf[n] = '\0';
+  return buf;
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_UTILS_FMT_H
+#define __BGPSTREAM_UTILS_FMT_H
+
+#include "bgpstream_utils_addr.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Header file that exposes the private text formatting helpers used by
+ * the elem, record and bgpdump string conversion functions.
+ *
+ * These functions produce exactly the same text as the corresponding
+ * printf("%"PRIu32) and inet_ntop calls, but without parsing a format string
+ * for every field.
+ *
+ */
+
+/**
+ * @name Private Constants
+ *
+ * @{ */
+
+/** Maximum number of characters needed to write a uint32_t (no nul) */
+#define BGPSTREAM_FMT_UINT32_MAXLEN 10
+
+/** Maximum number of characters needed to write an IPv4 address (no nul) */
+#define BGPSTREAM_FMT_IPV4_MAXLEN 15
+
+/** Maximum number of characters needed to write an IPv6 address (no nul) */
+#define BGPSTREAM_FMT_IPV6_MAXLEN 45
+
+/** @} */
+
+/**
+ * @name Private API Functions
+ *
+ * @{ */
+
+/** Write the decimal representation of the given value into the buffer
+ *
+ * @param buf           pointer to a buffer with at least
+ *                      BGPSTREAM_FMT_UINT32_MAXLEN bytes available
+ * @param val           value to write
+ * @return the number of characters written (the buffer is NOT nul-terminated)
+ */
+size_t bgpstream_fmt_uint32(char *buf, uint32_t val);
+
+/** Write the decimal representation of the given value, left-padded with zeros
+ * to at least `width` digits (i.e., "%0<width>"PRIu32)
+ *
+ * @param buf           pointer to a buffer with at least
+ *                      BGPSTREAM_FMT_UINT32_MAXLEN bytes available
+ * @param val           value to write
+ * @param width         minimum number of digits (at most
+ *                      BGPSTREAM_FMT_UINT32_MAXLEN)
+ * @return the number of characters written (the buffer is NOT nul-terminated)
+ */
+size_t bgpstream_fmt_uint32_pad(char *buf, uint32_t val, int width);
+
+/** Write the dotted-quad representation of the given IPv4 address
+ *
+ * @param buf           pointer to a buffer with at least
+ *                      BGPSTREAM_FMT_IPV4_MAXLEN bytes available
+ * @param addr          pointer to the address to write
+ * @return the number of characters written (the buffer is NOT nul-terminated)
+ */
+size_t bgpstream_fmt_ipv4(char *buf, const struct in_addr *addr);
+
+/** Write the RFC 5952 representation of the given IPv6 address, using the
+ * same zero-compression and embedded-IPv4 rules as inet_ntop
+ *
+ * @param buf           pointer to a buffer with at least
+ *                      BGPSTREAM_FMT_IPV6_MAXLEN bytes available
+ * @param addr          pointer to the address to write
+ * @return the number of characters written (the buffer is NOT nul-terminated)
+ */
+size_t bgpstream_fmt_ipv6(char *buf, const struct in6_addr *addr);
+
+/** Bounded, nul-terminating equivalent of snprintf(buf, len, "%"PRIu32, val)
+ *
+ * @param buf           pointer to a character buffer
+ * @param len           length of the character buffer
+ * @param val           value to write
+ * @return the number of characters that would have been written if len was
+ * unlimited
+ */
+int bgpstream_fmt_uint32_snprintf(char *buf, size_t len, uint32_t val);
+
+/** Drop-in replacement for bgpstream_addr_ntop
+ *
+ * @param buf           pointer to a character buffer
+ * @param len           length of the character buffer
+ * @param addr          pointer to the (generic) address to write
+ * @return pointer to buf if successful, NULL if the address version is unknown
+ * or the buffer is too short (in which case the buffer contents are undefined)
+ */
+char *bgpstream_fmt_addr_ntop(char *buf, size_t len, const void *addr);
+
+/** @} */
+
+#endif /* __BGPSTREAM_UTILS_FMT_H */
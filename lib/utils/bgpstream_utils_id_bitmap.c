@@ -0,0 +1,594 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_utils_id_bitmap.h"
+#include "bgpstream_log.h"
+#include "config.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* containers with more IDs than this are stored as bitmaps (at this point
+ * the sorted array is as large as the 8 KiB bitmap) */
+#define ID_ARRAY_MAX 4096
+
+/* number of uint64_t words in a container bitmap */
+#define ID_BITS_WORDS (65536 / 64)
+
+/* the IDs that share the 16 most significant bits */
+typedef struct id_container {
+
+  /* number of IDs in the container */
+  uint32_t card;
+
+  /* sorted low 16 bits of the IDs (if card <= ID_ARRAY_MAX) */
+  uint16_t *array;
+
+  /* bitmap of the low 16 bits of the IDs (if card > ID_ARRAY_MAX) */
+  uint64_t *bits;
+
+} id_container_t;
+
+struct bgpstream_id_bitmap {
+
+  /* sorted 16 most significant bits of the containers' IDs */
+  uint16_t *keys;
+
+  /* containers, in the same order as keys */
+  id_container_t *containers;
+
+  uint32_t containers_cnt;
+  uint32_t containers_alloc_cnt;
+
+  /* total number of IDs */
+  uint32_t size;
+};
+
+static int id_cmp(const void *a, const void *b)
+{
+  uint32_t ia = *(const uint32_t *)a;
+  uint32_t ib = *(const uint32_t *)b;
+  return (ia > ib) - (ia < ib);
+}
+
+static inline int container_contains(id_container_t *c, uint16_t low)
+{
+  const uint16_t *base;
+  uint32_t n, half;
+
+  if (c->bits != NULL) {
+    return (c->bits[low >> 6] >> (low & 63)) & 1;
+  }
+  /* branch-free binary search */
+  base = c->array;
+  n = c->card;
+  while (n > 1) {
+    half = n / 2;
+    base = (base[half] <= low) ? base + half : base;
+    n -= half;
+  }
+  return *base == low;
+}
+
+static inline int find_container(bgpstream_id_bitmap_t *bm, uint16_t key)
+{
+  uint32_t lo = 0, hi = bm->containers_cnt, mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (bm->keys[mid] < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return (lo < bm->containers_cnt && bm->keys[lo] == key) ? (int)lo : -1;
+}
+
+static void container_free(id_container_t *c)
+{
+  free(c->array);
+  free(c->bits);
+  c->array = NULL;
+  c->bits = NULL;
+  c->card = 0;
+}
+
+static uint64_t *array_to_bits(const uint16_t *array, uint32_t card)
+{
+  uint64_t *bits;
+  uint32_t i;
+
+  if ((bits = malloc_zero(sizeof(uint64_t) * ID_BITS_WORDS)) == NULL) {
+    return NULL;
+  }
+  for (i = 0; i < card; i++) {
+    bits[array[i] >> 6] |= 1ULL << (array[i] & 63);
+  }
+  return bits;
+}
+
+static uint16_t *bits_to_array(const uint64_t *bits, uint32_t card)
+{
+  uint16_t *array;
+  uint64_t w;
+  uint32_t i, n = 0;
+
+  if ((array = malloc(sizeof(uint16_t) * (card > 0 ? card : 1))) == NULL) {
+    return NULL;
+  }
+  for (i = 0; i < ID_BITS_WORDS; i++) {
+    for (w = bits[i]; w != 0; w &= w - 1) {
+      array[n++] = (i << 6) | __builtin_ctzll(w);
+    }
+  }
+  return array;
+}
+
+static uint32_t bits_card(const uint64_t *bits)
+{
+  uint32_t i, card = 0;
+
+  for (i = 0; i < ID_BITS_WORDS; i++) {
+    card += __builtin_popcountll(bits[i]);
+  }
+  return card;
+}
+
+/* append a container (which must have a greater key than the last one) and
+ * take ownership of its memory */
+static int bm_append(bgpstream_id_bitmap_t *bm, uint16_t key,
+                     id_container_t *c)
+{
+  uint16_t *keys;
+  id_container_t *containers;
+  uint32_t alloc_cnt;
+
+  if (bm->containers_cnt == bm->containers_alloc_cnt) {
+    alloc_cnt = (bm->containers_alloc_cnt == 0) ? 4
+                                                : bm->containers_alloc_cnt * 2;
+    if ((keys = realloc(bm->keys, sizeof(uint16_t) * alloc_cnt)) == NULL) {
+      goto err;
+    }
+    bm->keys = keys;
+    if ((containers = realloc(bm->containers,
+                              sizeof(id_container_t) * alloc_cnt)) == NULL) {
+      goto err;
+    }
+    bm->containers = containers;
+    bm->containers_alloc_cnt = alloc_cnt;
+  }
+
+  bm->keys[bm->containers_cnt] = key;
+  bm->containers[bm->containers_cnt++] = *c;
+  bm->size += c->card;
+  return 0;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Could not grow ID bitmap");
+  container_free(c);
+  return -1;
+}
+
+static int container_dup(id_container_t *dst, id_container_t *src)
+{
+  dst->card = src->card;
+  dst->array = NULL;
+  dst->bits = NULL;
+  if (src->bits != NULL) {
+    if ((dst->bits = malloc(sizeof(uint64_t) * ID_BITS_WORDS)) == NULL) {
+      return -1;
+    }
+    memcpy(dst->bits, src->bits, sizeof(uint64_t) * ID_BITS_WORDS);
+  } else {
+    if ((dst->array = malloc(sizeof(uint16_t) * src->card)) == NULL) {
+      return -1;
+    }
+    memcpy(dst->array, src->array, sizeof(uint16_t) * src->card);
+  }
+  return 0;
+}
+
+static int container_union(id_container_t *dst, id_container_t *c1,
+                           id_container_t *c2)
+{
+  uint32_t i = 0, j = 0, n = 0;
+  uint16_t *array;
+
+  dst->array = NULL;
+  dst->bits = NULL;
+
+  if (c1->bits == NULL && c2->bits == NULL) {
+    if ((array = malloc(sizeof(uint16_t) * (c1->card + c2->card))) == NULL) {
+      return -1;
+    }
+    while (i < c1->card && j < c2->card) {
+      if (c1->array[i] < c2->array[j]) {
+        array[n++] = c1->array[i++];
+      } else if (c1->array[i] > c2->array[j]) {
+        array[n++] = c2->array[j++];
+      } else {
+        array[n++] = c1->array[i++];
+        j++;
+      }
+    }
+    while (i < c1->card) {
+      array[n++] = c1->array[i++];
+    }
+    while (j < c2->card) {
+      array[n++] = c2->array[j++];
+    }
+    dst->card = n;
+    if (n <= ID_ARRAY_MAX) {
+      dst->array = array;
+      return 0;
+    }
+    dst->bits = array_to_bits(array, n);
+    free(array);
+    return (dst->bits == NULL) ? -1 : 0;
+  }
+
+  /* at least one of them is a bitmap, so the union is too */
+  if (c1->bits == NULL) {
+    id_container_t *tmp = c1;
+    c1 = c2;
+    c2 = tmp;
+  }
+  if ((dst->bits = malloc(sizeof(uint64_t) * ID_BITS_WORDS)) == NULL) {
+    return -1;
+  }
+  memcpy(dst->bits, c1->bits, sizeof(uint64_t) * ID_BITS_WORDS);
+  if (c2->bits != NULL) {
+    for (i = 0; i < ID_BITS_WORDS; i++) {
+      dst->bits[i] |= c2->bits[i];
+    }
+  } else {
+    for (i = 0; i < c2->card; i++) {
+      dst->bits[c2->array[i] >> 6] |= 1ULL << (c2->array[i] & 63);
+    }
+  }
+  dst->card = bits_card(dst->bits);
+  return 0;
+}
+
+static int container_intersect(id_container_t *dst, id_container_t *c1,
+                               id_container_t *c2)
+{
+  uint32_t i = 0, j = 0, n = 0;
+  uint64_t *bits;
+
+  dst->array = NULL;
+  dst->bits = NULL;
+  dst->card = 0;
+
+  if (c1->bits != NULL && c2->bits != NULL) {
+    if ((bits = malloc(sizeof(uint64_t) * ID_BITS_WORDS)) == NULL) {
+      return -1;
+    }
+    for (i = 0; i < ID_BITS_WORDS; i++) {
+      bits[i] = c1->bits[i] & c2->bits[i];
+    }
+    dst->card = bits_card(bits);
+    if (dst->card > ID_ARRAY_MAX) {
+      dst->bits = bits;
+      return 0;
+    }
+    dst->array = bits_to_array(bits, dst->card);
+    free(bits);
+    return (dst->array == NULL) ? -1 : 0;
+  }
+
+  /* at least one of them is an array, so the intersection is too */
+  if (c1->bits != NULL) {
+    id_container_t *tmp = c1;
+    c1 = c2;
+    c2 = tmp;
+  }
+  if ((dst->array = malloc(sizeof(uint16_t) * (c1->card > 0 ? c1->card : 1))) ==
+      NULL) {
+    return -1;
+  }
+  if (c2->bits != NULL) {
+    for (i = 0; i < c1->card; i++) {
+      if (container_contains(c2, c1->array[i])) {
+        dst->array[n++] = c1->array[i];
+      }
+    }
+  } else {
+    while (i < c1->card && j < c2->card) {
+      if (c1->array[i] < c2->array[j]) {
+        i++;
+      } else if (c1->array[i] > c2->array[j]) {
+        j++;
+      } else {
+        dst->array[n++] = c1->array[i++];
+        j++;
+      }
+    }
+  }
+  dst->card = n;
+  return 0;
+}
+
+/* ========== PUBLIC FUNCTIONS ========== */
+
+bgpstream_id_bitmap_t *bgpstream_id_bitmap_create(const uint32_t *ids,
+                                                  int ids_cnt)
+{
+  bgpstream_id_bitmap_t *bm = NULL;
+  uint32_t *sorted = NULL;
+  id_container_t c;
+  uint32_t k;
+  int i, j, n;
+
+  if ((bm = malloc_zero(sizeof(bgpstream_id_bitmap_t))) == NULL) {
+    goto err;
+  }
+  if (ids_cnt <= 0) {
+    return bm;
+  }
+
+  /* sort and de-duplicate a copy of the IDs */
+  if ((sorted = malloc(sizeof(uint32_t) * ids_cnt)) == NULL) {
+    goto err;
+  }
+  memcpy(sorted, ids, sizeof(uint32_t) * ids_cnt);
+  qsort(sorted, ids_cnt, sizeof(uint32_t), id_cmp);
+  n = 1;
+  for (i = 1; i < ids_cnt; i++) {
+    if (sorted[i] != sorted[n - 1]) {
+      sorted[n++] = sorted[i];
+    }
+  }
+
+  /* one container per run of IDs with the same key */
+  for (i = 0; i < n; i = j) {
+    j = i + 1;
+    while (j < n && (sorted[j] >> 16) == (sorted[i] >> 16)) {
+      j++;
+    }
+    c.card = j - i;
+    c.bits = NULL;
+    if ((c.array = malloc(sizeof(uint16_t) * c.card)) == NULL) {
+      goto err;
+    }
+    for (k = 0; k < c.card; k++) {
+      c.array[k] = sorted[i + k] & 0xffff;
+    }
+    if (c.card > ID_ARRAY_MAX) {
+      c.bits = array_to_bits(c.array, c.card);
+      free(c.array);
+      c.array = NULL;
+      if (c.bits == NULL) {
+        goto err;
+      }
+    }
+    if (bm_append(bm, sorted[i] >> 16, &c) != 0) {
+      goto err;
+    }
+  }
+
+  free(sorted);
+  return bm;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create ID bitmap");
+  free(sorted);
+  bgpstream_id_bitmap_destroy(bm);
+  return NULL;
+}
+
+bgpstream_id_bitmap_t *
+bgpstream_id_bitmap_create_from_set(bgpstream_id_set_t *set)
+{
+  bgpstream_id_bitmap_t *bm;
+  uint32_t *ids;
+  uint32_t *id;
+  int n = 0;
+
+  if ((ids = malloc(sizeof(uint32_t) *
+                    (bgpstream_id_set_size(set) > 0
+                       ? bgpstream_id_set_size(set)
+                       : 1))) == NULL) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not create ID bitmap");
+    return NULL;
+  }
+  bgpstream_id_set_rewind(set);
+  while ((id = bgpstream_id_set_next(set)) != NULL) {
+    ids[n++] = *id;
+  }
+  bgpstream_id_set_rewind(set);
+
+  bm = bgpstream_id_bitmap_create(ids, n);
+  free(ids);
+  return bm;
+}
+
+int bgpstream_id_bitmap_exists(bgpstream_id_bitmap_t *bm, uint32_t id)
+{
+  int i;
+
+  if ((i = find_container(bm, id >> 16)) < 0) {
+    return 0;
+  }
+  return container_contains(&bm->containers[i], id & 0xffff);
+}
+
+int bgpstream_id_bitmap_exists_many(bgpstream_id_bitmap_t *bm,
+                                    const uint32_t *ids, int ids_cnt,
+                                    uint8_t *found)
+{
+  int i, c = -1;
+  int last_key = -1;
+  int cnt = 0;
+  int f;
+
+  for (i = 0; i < ids_cnt; i++) {
+    /* consecutive IDs usually share a container */
+    if ((int)(ids[i] >> 16) != last_key) {
+      last_key = ids[i] >> 16;
+      c = find_container(bm, last_key);
+    }
+    f = (c >= 0) && container_contains(&bm->containers[c], ids[i] & 0xffff);
+    if (found != NULL) {
+      found[i] = f;
+    }
+    cnt += f;
+  }
+  return cnt;
+}
+
+uint32_t bgpstream_id_bitmap_size(bgpstream_id_bitmap_t *bm)
+{
+  return bm->size;
+}
+
+uint32_t bgpstream_id_bitmap_get_ids(bgpstream_id_bitmap_t *bm, uint32_t *ids)
+{
+  id_container_t *c;
+  uint32_t i, j, n = 0;
+  uint32_t hi;
+  uint64_t w;
+
+  for (i = 0; i < bm->containers_cnt; i++) {
+    c = &bm->containers[i];
+    hi = (uint32_t)bm->keys[i] << 16;
+    if (c->bits == NULL) {
+      for (j = 0; j < c->card; j++) {
+        ids[n++] = hi | c->array[j];
+      }
+      continue;
+    }
+    for (j = 0; j < ID_BITS_WORDS; j++) {
+      for (w = c->bits[j]; w != 0; w &= w - 1) {
+        ids[n++] = hi | (j << 6) | __builtin_ctzll(w);
+      }
+    }
+  }
+  return n;
+}
+
+bgpstream_id_bitmap_t *bgpstream_id_bitmap_union(bgpstream_id_bitmap_t *bm1,
+                                                 bgpstream_id_bitmap_t *bm2)
+{
+  bgpstream_id_bitmap_t *bm;
+  id_container_t c;
+  uint32_t i = 0, j = 0;
+  uint16_t key;
+  int ret;
+
+  if ((bm = malloc_zero(sizeof(bgpstream_id_bitmap_t))) == NULL) {
+    goto err;
+  }
+
+  while (i < bm1->containers_cnt || j < bm2->containers_cnt) {
+    if (j == bm2->containers_cnt ||
+        (i < bm1->containers_cnt && bm1->keys[i] < bm2->keys[j])) {
+      key = bm1->keys[i];
+      ret = container_dup(&c, &bm1->containers[i++]);
+    } else if (i == bm1->containers_cnt || bm2->keys[j] < bm1->keys[i]) {
+      key = bm2->keys[j];
+      ret = container_dup(&c, &bm2->containers[j++]);
+    } else {
+      key = bm1->keys[i];
+      ret = container_union(&c, &bm1->containers[i++], &bm2->containers[j++]);
+    }
+    if (ret != 0) {
+      container_free(&c);
+      goto err;
+    }
+    if (bm_append(bm, key, &c) != 0) {
+      goto err;
+    }
+  }
+
+  return bm;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Could not compute ID bitmap union");
+  bgpstream_id_bitmap_destroy(bm);
+  return NULL;
+}
+
+bgpstream_id_bitmap_t *
+bgpstream_id_bitmap_intersect(bgpstream_id_bitmap_t *bm1,
+                              bgpstream_id_bitmap_t *bm2)
+{
+  bgpstream_id_bitmap_t *bm;
+  id_container_t c;
+  uint32_t i = 0, j = 0;
+  uint16_t key;
+
+  if ((bm = malloc_zero(sizeof(bgpstream_id_bitmap_t))) == NULL) {
+    goto err;
+  }
+
+  while (i < bm1->containers_cnt && j < bm2->containers_cnt) {
+    if (bm1->keys[i] < bm2->keys[j]) {
+      i++;
+      continue;
+    }
+    if (bm2->keys[j] < bm1->keys[i]) {
+      j++;
+      continue;
+    }
+    key = bm1->keys[i];
+    if (container_intersect(&c, &bm1->containers[i++],
+                            &bm2->containers[j++]) != 0) {
+      container_free(&c);
+      goto err;
+    }
+    if (c.card == 0) {
+      container_free(&c);
+      continue;
+    }
+    if (bm_append(bm, key, &c) != 0) {
+      goto err;
+    }
+  }
+
+  return bm;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Could not compute ID bitmap intersection");
+  bgpstream_id_bitmap_destroy(bm);
+  return NULL;
+}
+
+void bgpstream_id_bitmap_destroy(bgpstream_id_bitmap_t *bm)
+{
+  uint32_t i;
+
+  if (bm == NULL) {
+    return;
+  }
+  for (i = 0; i < bm->containers_cnt; i++) {
+    container_free(&bm->containers[i]);
+  }
+  free(bm->containers);
+  free(bm->keys);
+  free(bm);
+}
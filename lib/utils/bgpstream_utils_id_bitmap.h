@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_UTILS_ID_BITMAP_H
+#define __BGPSTREAM_UTILS_ID_BITMAP_H
+
+#include <stdint.h>
+
+#include "bgpstream_utils_id_set.h"
+
+/** @file
+ *
+ * @brief Header file that exposes the public interface of the BGP Stream ID
+ * Bitmap.
+ *
+ * An ID Bitmap is an immutable, read-optimized set of 32 bit IDs (e.g., AS
+ * numbers), meant for sets that are built once and then probed many times,
+ * such as the ASN filters. IDs are partitioned by their 16 most significant
+ * bits, and each partition is stored either as a sorted array of 16 bit values
+ * (up to 4096 IDs) or as a 65536 bit bitmap, so that a set of a few ASNs takes
+ * a few bytes, and a lookup is a search over a handful of keys followed by a
+ * search in a small array (or a single bit test).
+ *
+ * Unions and intersections operate directly on the compressed partitions.
+ *
+ */
+
+/**
+ * @name Opaque Data Structures
+ *
+ * @{ */
+
+/** Opaque structure containing an ID Bitmap instance */
+typedef struct bgpstream_id_bitmap bgpstream_id_bitmap_t;
+
+/** @} */
+
+/**
+ * @name Public API Functions
+ *
+ * @{ */
+
+/** Create a new ID Bitmap from an array of IDs
+ *
+ * @param ids           array of IDs (in any order, possibly with duplicates)
+ * @param ids_cnt       number of IDs in the array
+ * @return a pointer to the bitmap, or NULL if an error occurred
+ */
+bgpstream_id_bitmap_t *bgpstream_id_bitmap_create(const uint32_t *ids,
+                                                  int ids_cnt);
+
+/** Create a new ID Bitmap that contains the IDs of the given ID set
+ *
+ * @param set           pointer to the ID set to copy
+ * @return a pointer to the bitmap, or NULL if an error occurred
+ *
+ * @note this rewinds the internal iterator of the set
+ */
+bgpstream_id_bitmap_t *
+bgpstream_id_bitmap_create_from_set(bgpstream_id_set_t *set);
+
+/** Check whether an ID exists in the bitmap
+ *
+ * @param bm            pointer to the ID bitmap
+ * @param id            the ID to check
+ * @return 0 if the ID is not in the bitmap, 1 if it is
+ */
+int bgpstream_id_bitmap_exists(bgpstream_id_bitmap_t *bm, uint32_t id);
+
+/** Check whether each of the given IDs exists in the bitmap
+ *
+ * @param bm            pointer to the ID bitmap
+ * @param ids           array of IDs to check
+ * @param ids_cnt       number of IDs in the array
+ * @param[out] found    array of (at least) ids_cnt flags, set to 1 if the
+ *                      corresponding ID is in the bitmap, 0 otherwise. May be
+ *                      NULL if only the count is needed.
+ * @return the number of IDs that are in the bitmap
+ */
+int bgpstream_id_bitmap_exists_many(bgpstream_id_bitmap_t *bm,
+                                    const uint32_t *ids, int ids_cnt,
+                                    uint8_t *found);
+
+/** Get the number of IDs in the given bitmap
+ *
+ * @param bm            pointer to the ID bitmap
+ * @return the number of IDs in the bitmap
+ */
+uint32_t bgpstream_id_bitmap_size(bgpstream_id_bitmap_t *bm);
+
+/** Copy the IDs of the given bitmap into an array, in ascending order
+ *
+ * @param bm            pointer to the ID bitmap
+ * @param[out] ids      array of (at least) bgpstream_id_bitmap_size IDs
+ * @return the number of IDs copied
+ */
+uint32_t bgpstream_id_bitmap_get_ids(bgpstream_id_bitmap_t *bm, uint32_t *ids);
+
+/** Create a new ID Bitmap with the IDs that are in either of two bitmaps
+ *
+ * @param bm1           pointer to the first ID bitmap
+ * @param bm2           pointer to the second ID bitmap
+ * @return a pointer to the new bitmap, or NULL if an error occurred
+ */
+bgpstream_id_bitmap_t *bgpstream_id_bitmap_union(bgpstream_id_bitmap_t *bm1,
+                                                 bgpstream_id_bitmap_t *bm2);
+
+/** Create a new ID Bitmap with the IDs that are in both of two bitmaps
+ *
+ * @param bm1           pointer to the first ID bitmap
+ * @param bm2           pointer to the second ID bitmap
+ * @return a pointer to the new bitmap, or NULL if an error occurred
+ */
+bgpstream_id_bitmap_t *
+bgpstream_id_bitmap_intersect(bgpstream_id_bitmap_t *bm1,
+                              bgpstream_id_bitmap_t *bm2);
+
+/** Destroy the given ID bitmap
+ *
+ * @param bm            pointer to the ID bitmap to destroy
+ */
+void bgpstream_id_bitmap_destroy(bgpstream_id_bitmap_t *bm);
+
+/** @} */
+
+#endif /* __BGPSTREAM_UTILS_ID_BITMAP_H */
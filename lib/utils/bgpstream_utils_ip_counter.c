@@ -30,6 +30,7 @@
 #include "utils.h"
 #include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 /* static char buffer[INET6_ADDRSTRLEN]; */
@@ -48,10 +49,41 @@ typedef struct struct_v6pfx_int_t {
   struct struct_v6pfx_int_t *next;
 } v6pfx_int_t;
 
-/* IP Counter Linked List */
+typedef struct struct_v4pfx_range_t {
+  uint32_t start;
+  uint32_t end;
+} v4pfx_range_t;
+
+typedef struct struct_v6pfx_range_t {
+  uint64_t start_ms;
+  uint64_t start_ls;
+  uint64_t end_ms;
+  uint64_t end_ls;
+} v6pfx_range_t;
+
+/* minimum number of ranges allocated at once by the sorted backend */
+#define RANGES_MIN_ALLOC 64
+
+/* IP Counter */
 struct bgpstream_ip_counter {
+  bgpstream_ip_counter_backend_t backend;
+
+  /* BGPSTREAM_IP_COUNTER_BACKEND_LIST */
   v4pfx_int_t *v4list;
   v6pfx_int_t *v6list;
+
+  /* BGPSTREAM_IP_COUNTER_BACKEND_SORTED: the first *_merged_cnt ranges are
+   * sorted and disjoint (exactly the intervals of the list backend), the
+   * remaining ones have been added since the last query */
+  v4pfx_range_t *v4ranges;
+  uint32_t v4ranges_cnt;
+  uint32_t v4ranges_alloc_cnt;
+  uint32_t v4ranges_merged_cnt;
+
+  v6pfx_range_t *v6ranges;
+  uint32_t v6ranges_cnt;
+  uint32_t v6ranges_alloc_cnt;
+  uint32_t v6ranges_merged_cnt;
 };
 
 /* static void */
@@ -294,7 +326,339 @@ static int merge_in_sorted_queue6(v6pfx_int_t **pil, uint64_t start_ms,
   return 0;
 }
 
+/* Sorted backend: ranges are appended by add, and the pending ones are sorted
+ * and merged into the sorted head just before they are needed by a query.
+ * Only ranges that share at least one address are merged (as the list backend
+ * does), so both backends end up with exactly the same intervals. */
+
+static int ranges_add4(bgpstream_ip_counter_t *ipc, uint32_t start,
+                       uint32_t end)
+{
+  v4pfx_range_t *tmp;
+  uint32_t alloc_cnt;
+
+  if (ipc->v4ranges_cnt == ipc->v4ranges_alloc_cnt) {
+    alloc_cnt = ipc->v4ranges_alloc_cnt * 2;
+    if (alloc_cnt < RANGES_MIN_ALLOC) {
+      alloc_cnt = RANGES_MIN_ALLOC;
+    }
+    if ((tmp = realloc(ipc->v4ranges, sizeof(v4pfx_range_t) * alloc_cnt)) ==
+        NULL) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "can't realloc v4pfx_range_t array");
+      return -1;
+    }
+    ipc->v4ranges = tmp;
+    ipc->v4ranges_alloc_cnt = alloc_cnt;
+  }
+  ipc->v4ranges[ipc->v4ranges_cnt].start = start;
+  ipc->v4ranges[ipc->v4ranges_cnt].end = end;
+  ipc->v4ranges_cnt++;
+  return 0;
+}
+
+static int ranges_add6(bgpstream_ip_counter_t *ipc, uint64_t start_ms,
+                       uint64_t start_ls, uint64_t end_ms, uint64_t end_ls)
+{
+  v6pfx_range_t *tmp;
+  uint32_t alloc_cnt;
+
+  if (ipc->v6ranges_cnt == ipc->v6ranges_alloc_cnt) {
+    alloc_cnt = ipc->v6ranges_alloc_cnt * 2;
+    if (alloc_cnt < RANGES_MIN_ALLOC) {
+      alloc_cnt = RANGES_MIN_ALLOC;
+    }
+    if ((tmp = realloc(ipc->v6ranges, sizeof(v6pfx_range_t) * alloc_cnt)) ==
+        NULL) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "can't realloc v6pfx_range_t array");
+      return -1;
+    }
+    ipc->v6ranges = tmp;
+    ipc->v6ranges_alloc_cnt = alloc_cnt;
+  }
+  ipc->v6ranges[ipc->v6ranges_cnt].start_ms = start_ms;
+  ipc->v6ranges[ipc->v6ranges_cnt].start_ls = start_ls;
+  ipc->v6ranges[ipc->v6ranges_cnt].end_ms = end_ms;
+  ipc->v6ranges[ipc->v6ranges_cnt].end_ls = end_ls;
+  ipc->v6ranges_cnt++;
+  return 0;
+}
+
+static int range_cmp4(const void *a, const void *b)
+{
+  const v4pfx_range_t *ra = a;
+  const v4pfx_range_t *rb = b;
+  return (ra->start > rb->start) - (ra->start < rb->start);
+}
+
+static int range_cmp6(const void *a, const void *b)
+{
+  const v6pfx_range_t *ra = a;
+  const v6pfx_range_t *rb = b;
+  if (ra->start_ms != rb->start_ms) {
+    return (ra->start_ms > rb->start_ms) ? 1 : -1;
+  }
+  return (ra->start_ls > rb->start_ls) - (ra->start_ls < rb->start_ls);
+}
+
+/* append r to the n sorted ranges in out, merging it with the last one if
+ * they overlap */
+static inline void range_push4(v4pfx_range_t *out, uint32_t *n,
+                               const v4pfx_range_t *r)
+{
+  if (*n > 0 && r->start <= out[*n - 1].end) {
+    if (r->end > out[*n - 1].end) {
+      out[*n - 1].end = r->end;
+    }
+    return;
+  }
+  out[(*n)++] = *r;
+}
+
+static inline void range_push6(v6pfx_range_t *out, uint32_t *n,
+                               const v6pfx_range_t *r)
+{
+  v6pfx_range_t *last;
+  if (*n > 0) {
+    last = &out[*n - 1];
+    /* r->start <= last->end */
+    if (r->start_ms < last->end_ms ||
+        (r->start_ms == last->end_ms && r->start_ls <= last->end_ls)) {
+      /* r->end > last->end */
+      if (r->end_ms > last->end_ms ||
+          (r->end_ms == last->end_ms && r->end_ls > last->end_ls)) {
+        last->end_ms = r->end_ms;
+        last->end_ls = r->end_ls;
+      }
+      return;
+    }
+  }
+  out[(*n)++] = *r;
+}
+
+static void ranges_merge4(bgpstream_ip_counter_t *ipc)
+{
+  v4pfx_range_t *head = ipc->v4ranges;
+  v4pfx_range_t *tail = ipc->v4ranges + ipc->v4ranges_merged_cnt;
+  uint32_t head_cnt = ipc->v4ranges_merged_cnt;
+  uint32_t tail_cnt = ipc->v4ranges_cnt - ipc->v4ranges_merged_cnt;
+  v4pfx_range_t *out;
+  uint32_t i = 0, j = 0, n = 0;
+
+  if (tail_cnt == 0) {
+    return;
+  }
+  qsort(tail, tail_cnt, sizeof(v4pfx_range_t), range_cmp4);
+
+  if (head_cnt == 0 || (out = malloc(sizeof(v4pfx_range_t) *
+                                     ipc->v4ranges_alloc_cnt)) == NULL) {
+    /* nothing to merge with (or no memory for it): sort everything in place */
+    if (head_cnt != 0) {
+      qsort(head, ipc->v4ranges_cnt, sizeof(v4pfx_range_t), range_cmp4);
+    }
+    for (i = 0; i < ipc->v4ranges_cnt; i++) {
+      range_push4(head, &n, &head[i]);
+    }
+    ipc->v4ranges_cnt = ipc->v4ranges_merged_cnt = n;
+    return;
+  }
+
+  while (i < head_cnt || j < tail_cnt) {
+    if (j == tail_cnt || (i < head_cnt && head[i].start <= tail[j].start)) {
+      range_push4(out, &n, &head[i++]);
+    } else {
+      range_push4(out, &n, &tail[j++]);
+    }
+  }
+  free(ipc->v4ranges);
+  ipc->v4ranges = out;
+  ipc->v4ranges_cnt = ipc->v4ranges_merged_cnt = n;
+}
+
+static void ranges_merge6(bgpstream_ip_counter_t *ipc)
+{
+  v6pfx_range_t *head = ipc->v6ranges;
+  v6pfx_range_t *tail = ipc->v6ranges + ipc->v6ranges_merged_cnt;
+  uint32_t head_cnt = ipc->v6ranges_merged_cnt;
+  uint32_t tail_cnt = ipc->v6ranges_cnt - ipc->v6ranges_merged_cnt;
+  v6pfx_range_t *out;
+  uint32_t i = 0, j = 0, n = 0;
+
+  if (tail_cnt == 0) {
+    return;
+  }
+  qsort(tail, tail_cnt, sizeof(v6pfx_range_t), range_cmp6);
+
+  if (head_cnt == 0 || (out = malloc(sizeof(v6pfx_range_t) *
+                                     ipc->v6ranges_alloc_cnt)) == NULL) {
+    /* nothing to merge with (or no memory for it): sort everything in place */
+    if (head_cnt != 0) {
+      qsort(head, ipc->v6ranges_cnt, sizeof(v6pfx_range_t), range_cmp6);
+    }
+    for (i = 0; i < ipc->v6ranges_cnt; i++) {
+      range_push6(head, &n, &head[i]);
+    }
+    ipc->v6ranges_cnt = ipc->v6ranges_merged_cnt = n;
+    return;
+  }
+
+  while (i < head_cnt || j < tail_cnt) {
+    if (j == tail_cnt ||
+        (i < head_cnt && range_cmp6(&head[i], &tail[j]) <= 0)) {
+      range_push6(out, &n, &head[i++]);
+    } else {
+      range_push6(out, &n, &tail[j++]);
+    }
+  }
+  free(ipc->v6ranges);
+  ipc->v6ranges = out;
+  ipc->v6ranges_cnt = ipc->v6ranges_merged_cnt = n;
+}
+
+static uint32_t sorted_is_overlapping4(bgpstream_ip_counter_t *ipc,
+                                       uint32_t start, uint32_t end,
+                                       uint32_t pfx_size,
+                                       uint8_t *more_specific)
+{
+  v4pfx_range_t *current;
+  uint32_t lo = 0, hi, mid;
+  uint32_t int_start;
+  uint32_t int_end;
+  uint32_t overlap_count = 0;
+
+  ranges_merge4(ipc);
+
+  /* the ranges are disjoint, so their ends are sorted too: find the first
+   * one that ends at or after start */
+  hi = ipc->v4ranges_cnt;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (ipc->v4ranges[mid].end < start) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  for (; lo < ipc->v4ranges_cnt; lo++) {
+    current = &ipc->v4ranges[lo];
+    if (current->start > end) {
+      break;
+    }
+    int_start = current->start;
+    int_end = current->end;
+    if (current->start < start) {
+      int_start = start;
+    }
+    if (current->end > end) {
+      int_end = end;
+    }
+    if ((int_end - int_start + 1) == pfx_size) {
+      *more_specific = 1;
+    }
+    overlap_count += int_end - int_start + 1;
+  }
+  return overlap_count;
+}
+
+/* this mirrors the list walk in bgpstream_ip_counter_is_overlapping6
+ * (including the way it counts /64s) so that both backends agree */
+static uint64_t sorted_is_overlapping6(bgpstream_ip_counter_t *ipc,
+                                       uint64_t start_ms, uint64_t start_ls,
+                                       uint64_t end_ms, uint64_t end_ls,
+                                       uint64_t pfx_size,
+                                       uint8_t *more_specific)
+{
+  v6pfx_range_t *current;
+  v6pfx_range_t *previous;
+  uint32_t lo = 0, hi, mid;
+  uint64_t int_start_ms;
+  uint64_t int_end_ms;
+  uint64_t overlap_count = 0;
+
+  ranges_merge6(ipc);
+
+  /* find the first range that the list walk would not skip */
+  hi = ipc->v6ranges_cnt;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    current = &ipc->v6ranges[mid];
+    if (current->end_ms < start_ms ||
+        (current->end_ms == start_ms && current->end_ls < start_ls)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == ipc->v6ranges_cnt) {
+    return 0;
+  }
+  previous = &ipc->v6ranges[lo > 0 ? lo - 1 : 0];
+
+  for (; lo < ipc->v6ranges_cnt; lo++) {
+    current = &ipc->v6ranges[lo];
+    /* current->start > end */
+    if (current->start_ms > end_ms ||
+        (current->start_ms == end_ms && current->start_ls > end_ls)) {
+      break;
+    }
+    int_start_ms = current->start_ms;
+    int_end_ms = current->end_ms;
+    /* current->start < start */
+    if (current->start_ms < start_ms ||
+        (current->start_ms == start_ms && current->start_ls < start_ls)) {
+      int_start_ms = start_ms;
+    }
+    /* current->end > end */
+    if (current->end_ms > end_ms ||
+        (current->end_ms == end_ms && current->end_ls > end_ls)) {
+      int_end_ms = end_ms;
+    }
+    if (previous == current || current->start_ms != previous->start_ms ||
+        current->end_ms != previous->end_ms) {
+      if ((int_end_ms - int_start_ms + 1) == pfx_size) {
+        *more_specific = 1;
+      }
+      overlap_count += int_end_ms - int_start_ms + 1;
+    }
+    previous = current;
+  }
+  return overlap_count;
+}
+
+static uint64_t sorted_get_ipcount(bgpstream_ip_counter_t *ipc,
+                                   bgpstream_addr_version_t v)
+{
+  uint64_t ip_count = 0;
+  uint32_t i;
+
+  if (v == BGPSTREAM_ADDR_VERSION_IPV4) {
+    ranges_merge4(ipc);
+    for (i = 0; i < ipc->v4ranges_cnt; i++) {
+      ip_count += (ipc->v4ranges[i].end - ipc->v4ranges[i].start) + 1;
+    }
+  } else if (v == BGPSTREAM_ADDR_VERSION_IPV6) {
+    ranges_merge6(ipc);
+    for (i = 0; i < ipc->v6ranges_cnt; i++) {
+      /* as in the list backend, only add a new /64 if the previous interval
+       * was a different one */
+      if (i == 0 ||
+          ipc->v6ranges[i].start_ms != ipc->v6ranges[i - 1].start_ms ||
+          ipc->v6ranges[i].end_ms != ipc->v6ranges[i - 1].end_ms) {
+        ip_count += (ipc->v6ranges[i].end_ms - ipc->v6ranges[i].start_ms) + 1;
+      }
+    }
+  }
+  return ip_count;
+}
+
 bgpstream_ip_counter_t *bgpstream_ip_counter_create()
+{
+  return bgpstream_ip_counter_create_with_backend(
+    BGPSTREAM_IP_COUNTER_BACKEND_LIST);
+}
+
+bgpstream_ip_counter_t *
+bgpstream_ip_counter_create_with_backend(bgpstream_ip_counter_backend_t backend)
 {
   bgpstream_ip_counter_t *ipc;
   if ((ipc = (bgpstream_ip_counter_t *)malloc_zero(
@@ -303,6 +667,7 @@ bgpstream_ip_counter_t *bgpstream_ip_counter_create()
                   "can't malloc bgpstream_ip_counter_t structure");
     return NULL;
   }
+  ipc->backend = backend;
   ipc->v4list = NULL;
   ipc->v6list = NULL;
   return ipc;
@@ -326,6 +691,9 @@ int bgpstream_ip_counter_add(bgpstream_ip_counter_t *ipc, bgpstream_pfx_t *pfx)
     start = ntohl(((bgpstream_ipv4_pfx_t *)pfx)->address.ipv4.s_addr);
     start = start & mask;
     end = start | (~mask);
+    if (ipc->backend == BGPSTREAM_IP_COUNTER_BACKEND_SORTED) {
+      return ranges_add4(ipc, start, end);
+    }
     return merge_in_sorted_queue4(&ipc->v4list, start, end);
   } else {
     if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV6) {
@@ -359,6 +727,9 @@ int bgpstream_ip_counter_add(bgpstream_ip_counter_t *ipc, bgpstream_pfx_t *pfx)
       end_ls = start_ls | (~mask_ls);
       /* printf("LS:  %"PRIu64" %"PRIu64"\n", start_ls, end_ls); */
 
+      if (ipc->backend == BGPSTREAM_IP_COUNTER_BACKEND_SORTED) {
+        return ranges_add6(ipc, start_ms, start_ls, end_ms, end_ls);
+      }
       return merge_in_sorted_queue6(&ipc->v6list, start_ms, start_ls, end_ms,
                                     end_ls);
     }
@@ -389,6 +760,9 @@ uint32_t bgpstream_ip_counter_is_overlapping4(bgpstream_ip_counter_t *ipc,
   /* intersection endpoints */
   uint32_t int_start;
   uint32_t int_end;
+  if (ipc->backend == BGPSTREAM_IP_COUNTER_BACKEND_SORTED) {
+    return sorted_is_overlapping4(ipc, start, end, pfx_size, more_specific);
+  }
   while (current != NULL) {
     if (current->start > end) {
       break;
@@ -472,6 +846,11 @@ uint64_t bgpstream_ip_counter_is_overlapping6(bgpstream_ip_counter_t *ipc,
   uint64_t int_start_ms;
   uint64_t int_end_ms;
 
+  if (ipc->backend == BGPSTREAM_IP_COUNTER_BACKEND_SORTED) {
+    return sorted_is_overlapping6(ipc, start_ms, start_ls, end_ms, end_ls,
+                                  pfx_size, more_specific);
+  }
+
   while (current != NULL) {
     /* current->start > end */
     if (current->start_ms > end_ms ||
@@ -480,7 +859,7 @@ uint64_t bgpstream_ip_counter_is_overlapping6(bgpstream_ip_counter_t *ipc,
     }
     /* current->end < start */
     if (current->end_ms < start_ms ||
-        (current->end_ms == start_ms && current->end_ms < start_ls)) {
+        (current->end_ms == start_ms && current->end_ls < start_ls)) {
       previous = current;
       current = current->next;
       continue;
@@ -493,7 +872,7 @@ uint64_t bgpstream_ip_counter_is_overlapping6(bgpstream_ip_counter_t *ipc,
     /* int_end_ls = current->end_ls; */
     /* current->start < start */
     if (current->start_ms < start_ms ||
-        (current->start_ms == start_ms && current->start_ms < start_ls)) {
+        (current->start_ms == start_ms && current->start_ls < start_ls)) {
       int_start_ms = start_ms;
       /* int_start_ls = start_ls; */
     }
@@ -549,6 +928,10 @@ uint64_t bgpstream_ip_counter_get_ipcount(bgpstream_ip_counter_t *ipc,
   v6pfx_int_t *current6 = ipc->v6list;
   v6pfx_int_t *previous6 = ipc->v6list;
 
+  if (ipc->backend == BGPSTREAM_IP_COUNTER_BACKEND_SORTED) {
+    return sorted_get_ipcount(ipc, v);
+  }
+
   if (v == BGPSTREAM_ADDR_VERSION_IPV4) {
     while (current4 != NULL) {
       ip_count += (current4->end - current4->start) + 1;
@@ -596,10 +979,16 @@ void bgpstream_ip_counter_clear(bgpstream_ip_counter_t *ipc)
     free(current6);
   }
   ipc->v6list = NULL;
+
+  /* keep the range arrays around for reuse */
+  ipc->v4ranges_cnt = ipc->v4ranges_merged_cnt = 0;
+  ipc->v6ranges_cnt = ipc->v6ranges_merged_cnt = 0;
 }
 
 void bgpstream_ip_counter_destroy(bgpstream_ip_counter_t *ipc)
 {
   bgpstream_ip_counter_clear(ipc);
+  free(ipc->v4ranges);
+  free(ipc->v6ranges);
   free(ipc);
 }
@@ -50,6 +50,29 @@ typedef struct bgpstream_ip_counter bgpstream_ip_counter_t;
 
 /** @} */
 
+/**
+ * @name Public Enums
+ *
+ * @{ */
+
+/** How an IP Counter stores its intervals */
+typedef enum {
+
+  /** Sorted linked list of intervals, merged on every insertion. Each
+   * insertion is O(n), so this is best suited to small counters where adds
+   * and queries are interleaved. */
+  BGPSTREAM_IP_COUNTER_BACKEND_LIST = 0,
+
+  /** Array of intervals. Insertions are appended, and the pending ones are
+   * sorted and merged in bulk before the next query, so filling a counter
+   * with n prefixes and then querying it costs O(n log n). Queries use a
+   * binary search. */
+  BGPSTREAM_IP_COUNTER_BACKEND_SORTED = 1,
+
+} bgpstream_ip_counter_backend_t;
+
+/** @} */
+
 /**
  * @name Public API Functions
  *
@@ -61,6 +84,17 @@ typedef struct bgpstream_ip_counter bgpstream_ip_counter_t;
  */
 bgpstream_ip_counter_t *bgpstream_ip_counter_create();
 
+/** Create a new IP Counter instance that uses the given backend
+ *
+ * @param backend      how the IP Counter stores its intervals
+ * @return a pointer to the structure, or NULL if an error occurred
+ *
+ * All backends give the same results, bgpstream_ip_counter_create uses
+ * BGPSTREAM_IP_COUNTER_BACKEND_LIST.
+ */
+bgpstream_ip_counter_t *
+bgpstream_ip_counter_create_with_backend(bgpstream_ip_counter_backend_t backend);
+
 /** Add a prefix to the IP Counter
  *
  * @param counter      pointer to the IP Counter
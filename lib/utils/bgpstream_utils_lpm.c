@@ -0,0 +1,560 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_utils_lpm.h"
+#include "bgpstream_log.h"
+#include "config.h"
+#include "utils.h"
+#include <arpa/inet.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* number of address bits consumed at each level of the trie */
+#define LPM_STRIDE 6
+
+/* number of slots in a node (one bit of a uint64_t each) */
+#define LPM_SLOTS (1 << LPM_STRIDE)
+
+/* number of lookups interleaved by bgpstream_lpm_lookup_batch */
+#define LPM_BATCH_LANES 8
+
+/* mask of the slots up to (and including) slot s */
+#define LPM_SLOT_MASK(s) ((2ULL << (s)) - 1)
+
+/* A poptrie node.
+ *
+ * Slot s of a node is either an internal slot (bit s of vector is set), in
+ * which case it leads to the child node at base1 + (number of internal slots
+ * up to s) - 1, or a leaf slot. Consecutive leaf slots with the same value
+ * share a single leaf: bit s of leafvec is set if the value of leaf slot s
+ * differs from the previous leaf slot, and the value of slot s is the leaf at
+ * base0 + (number of leafvec bits up to s) - 1. */
+typedef struct lpm_node {
+  uint64_t vector;
+  uint64_t leafvec;
+  uint32_t base0;
+  uint32_t base1;
+} lpm_node_t;
+
+/* A prefix, as used while building a trie */
+typedef struct lpm_pfx {
+
+  /* address bits, left aligned (IPv4 addresses use the top of hi) */
+  uint64_t hi;
+  uint64_t lo;
+
+  /* mask length */
+  uint8_t len;
+
+  /* index of the patricia node in the values array */
+  uint32_t value;
+
+} lpm_pfx_t;
+
+/* The trie for a single IP version */
+typedef struct lpm_trie {
+
+  /* nodes (the root is always nodes[0]) */
+  lpm_node_t *nodes;
+  uint32_t nodes_cnt;
+  uint32_t nodes_alloc_cnt;
+
+  /* leaves (indices in the values array) */
+  uint32_t *leaves;
+  uint32_t leaves_cnt;
+  uint32_t leaves_alloc_cnt;
+
+  /* prefixes, only used while building */
+  lpm_pfx_t *pfxs;
+  uint32_t pfxs_cnt;
+  uint32_t pfxs_alloc_cnt;
+
+} lpm_trie_t;
+
+struct bgpstream_lpm {
+
+  /* IPv4 trie */
+  lpm_trie_t v4;
+
+  /* IPv6 trie */
+  lpm_trie_t v6;
+
+  /* patricia nodes referenced by the leaves, values[0] is always NULL */
+  bgpstream_patricia_node_t **values;
+  uint32_t values_cnt;
+  uint32_t values_alloc_cnt;
+
+  /* set if an error occurred while walking the patricia tree */
+  int build_error;
+};
+
+/* ======================= UTILITY FUNCTIONS ======================= */
+
+/* get the LPM_STRIDE bits of the address starting at bit depth (zero padded
+ * past the end of the address) */
+static inline int lpm_extract(uint64_t hi, uint64_t lo, int depth)
+{
+  if (depth <= 64 - LPM_STRIDE) {
+    return (hi >> (64 - LPM_STRIDE - depth)) & (LPM_SLOTS - 1);
+  }
+  if (depth < 64) {
+    return ((hi << (depth - (64 - LPM_STRIDE))) |
+            (lo >> (128 - LPM_STRIDE - depth))) &
+           (LPM_SLOTS - 1);
+  }
+  depth -= 64;
+  if (depth <= 64 - LPM_STRIDE) {
+    return (lo >> (64 - LPM_STRIDE - depth)) & (LPM_SLOTS - 1);
+  }
+  return (lo << (depth - (64 - LPM_STRIDE))) & (LPM_SLOTS - 1);
+}
+
+static inline uint64_t load_be64(const uint8_t *b)
+{
+  uint64_t v = 0;
+  int i;
+  for (i = 0; i < 8; i++) {
+    v = (v << 8) | b[i];
+  }
+  return v;
+}
+
+/* get the trie and the key bits for the given address */
+static inline lpm_trie_t *lpm_key(bgpstream_lpm_t *lpm,
+                                  bgpstream_ip_addr_t *addr, uint64_t *hi,
+                                  uint64_t *lo)
+{
+  switch (addr->version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    *hi = (uint64_t)ntohl(((bgpstream_ipv4_addr_t *)addr)->ipv4.s_addr) << 32;
+    *lo = 0;
+    return &lpm->v4;
+
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    *hi = load_be64(&((bgpstream_ipv6_addr_t *)addr)->ipv6.s6_addr[0]);
+    *lo = load_be64(&((bgpstream_ipv6_addr_t *)addr)->ipv6.s6_addr[8]);
+    return &lpm->v6;
+
+  default:
+    return NULL;
+  }
+}
+
+static int pfx_cmp(const void *a, const void *b)
+{
+  const lpm_pfx_t *p1 = (const lpm_pfx_t *)a;
+  const lpm_pfx_t *p2 = (const lpm_pfx_t *)b;
+
+  if (p1->hi != p2->hi) {
+    return (p1->hi < p2->hi) ? -1 : 1;
+  }
+  if (p1->lo != p2->lo) {
+    return (p1->lo < p2->lo) ? -1 : 1;
+  }
+  return (int)p1->len - (int)p2->len;
+}
+
+/* ======================= BUILD FUNCTIONS ======================= */
+
+static void collect_pfx(bgpstream_patricia_tree_t *pt,
+                        bgpstream_patricia_node_t *node, void *data)
+{
+  bgpstream_lpm_t *lpm = (bgpstream_lpm_t *)data;
+  bgpstream_pfx_t *pfx = bgpstream_patricia_tree_get_pfx(node);
+  lpm_trie_t *trie;
+  lpm_pfx_t *p;
+
+  if (lpm->build_error != 0) {
+    return;
+  }
+
+  if (lpm->values_cnt == lpm->values_alloc_cnt) {
+    uint32_t alloc_cnt = lpm->values_alloc_cnt * 2;
+    bgpstream_patricia_node_t **values;
+    if ((values = realloc(lpm->values,
+                          sizeof(bgpstream_patricia_node_t *) * alloc_cnt)) ==
+        NULL) {
+      goto err;
+    }
+    lpm->values = values;
+    lpm->values_alloc_cnt = alloc_cnt;
+  }
+
+  trie = (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) ? &lpm->v4
+                                                                 : &lpm->v6;
+  if (trie->pfxs_cnt == trie->pfxs_alloc_cnt) {
+    uint32_t alloc_cnt =
+      (trie->pfxs_alloc_cnt == 0) ? 1024 : trie->pfxs_alloc_cnt * 2;
+    lpm_pfx_t *pfxs;
+    if ((pfxs = realloc(trie->pfxs, sizeof(lpm_pfx_t) * alloc_cnt)) == NULL) {
+      goto err;
+    }
+    trie->pfxs = pfxs;
+    trie->pfxs_alloc_cnt = alloc_cnt;
+  }
+
+  p = &trie->pfxs[trie->pfxs_cnt++];
+  lpm_key(lpm, &pfx->address, &p->hi, &p->lo);
+  p->len = pfx->mask_len;
+  /* clear the host bits, the build relies on the sort order of the network
+   * addresses */
+  if (p->len == 0) {
+    p->hi = p->lo = 0;
+  } else if (p->len <= 64) {
+    p->hi &= ~0ULL << (64 - p->len);
+    p->lo = 0;
+  } else if (p->len < 128) {
+    p->lo &= ~0ULL << (128 - p->len);
+  }
+  p->value = lpm->values_cnt;
+  lpm->values[lpm->values_cnt++] = node;
+  return;
+
+err:
+  bgpstream_log(BGPSTREAM_LOG_ERR, "Could not collect LPM prefixes");
+  lpm->build_error = 1;
+}
+
+static int trie_add_nodes(lpm_trie_t *trie, uint32_t cnt)
+{
+  if (trie->nodes_cnt + cnt > trie->nodes_alloc_cnt) {
+    uint32_t alloc_cnt =
+      (trie->nodes_alloc_cnt == 0) ? 64 : trie->nodes_alloc_cnt;
+    lpm_node_t *nodes;
+    while (alloc_cnt < trie->nodes_cnt + cnt) {
+      alloc_cnt *= 2;
+    }
+    if ((nodes = realloc(trie->nodes, sizeof(lpm_node_t) * alloc_cnt)) ==
+        NULL) {
+      return -1;
+    }
+    trie->nodes = nodes;
+    trie->nodes_alloc_cnt = alloc_cnt;
+  }
+  trie->nodes_cnt += cnt;
+  return 0;
+}
+
+static int trie_add_leaf(lpm_trie_t *trie, uint32_t value)
+{
+  if (trie->leaves_cnt == trie->leaves_alloc_cnt) {
+    uint32_t alloc_cnt =
+      (trie->leaves_alloc_cnt == 0) ? 256 : trie->leaves_alloc_cnt * 2;
+    uint32_t *leaves;
+    if ((leaves = realloc(trie->leaves, sizeof(uint32_t) * alloc_cnt)) ==
+        NULL) {
+      return -1;
+    }
+    trie->leaves = leaves;
+    trie->leaves_alloc_cnt = alloc_cnt;
+  }
+  trie->leaves[trie->leaves_cnt++] = value;
+  return 0;
+}
+
+/* Build the node at index idx, covering the sorted prefixes [first, last)
+ * which all share the first depth bits. def is the value inherited from the
+ * (shorter) prefixes that cover the whole node. */
+static int build_node(lpm_trie_t *trie, uint32_t first, uint32_t last,
+                      int depth, uint32_t def, uint32_t idx)
+{
+  uint32_t slot_val[LPM_SLOTS];
+  uint32_t child_first[LPM_SLOTS];
+  uint32_t child_last[LPM_SLOTS];
+  uint64_t vector = 0;
+  uint64_t leafvec = 0;
+  uint32_t base0, base1;
+  uint32_t i, prev = 0;
+  int k, n, j;
+
+  for (k = 0; k < LPM_SLOTS; k++) {
+    slot_val[k] = def;
+  }
+
+  /* prefixes are sorted so that a prefix always comes before the prefixes it
+   * covers, hence painting them in order leaves the longest match in each
+   * slot */
+  for (i = first; i < last; i++) {
+    lpm_pfx_t *p = &trie->pfxs[i];
+    if (p->len < depth) {
+      /* already part of def */
+      continue;
+    }
+    k = lpm_extract(p->hi, p->lo, depth);
+    if (p->len <= depth + LPM_STRIDE) {
+      n = 1 << (depth + LPM_STRIDE - p->len);
+      k &= ~(n - 1);
+      for (j = k; j < k + n; j++) {
+        slot_val[j] = p->value;
+      }
+    } else {
+      /* prefixes in the same slot are contiguous */
+      if ((vector & (1ULL << k)) == 0) {
+        vector |= (1ULL << k);
+        child_first[k] = i;
+      }
+      child_last[k] = i + 1;
+    }
+  }
+
+  /* leaves */
+  base0 = trie->leaves_cnt;
+  for (k = 0; k < LPM_SLOTS; k++) {
+    if ((vector & (1ULL << k)) != 0) {
+      continue;
+    }
+    if (leafvec == 0 || slot_val[k] != prev) {
+      leafvec |= (1ULL << k);
+      if (trie_add_leaf(trie, slot_val[k]) != 0) {
+        return -1;
+      }
+      prev = slot_val[k];
+    }
+  }
+
+  /* children are allocated contiguously */
+  base1 = trie->nodes_cnt;
+  if (trie_add_nodes(trie, __builtin_popcountll(vector)) != 0) {
+    return -1;
+  }
+
+  trie->nodes[idx].vector = vector;
+  trie->nodes[idx].leafvec = leafvec;
+  trie->nodes[idx].base0 = base0;
+  trie->nodes[idx].base1 = base1;
+
+  j = 0;
+  for (k = 0; k < LPM_SLOTS; k++) {
+    if ((vector & (1ULL << k)) == 0) {
+      continue;
+    }
+    if (build_node(trie, child_first[k], child_last[k], depth + LPM_STRIDE,
+                   slot_val[k], base1 + j) != 0) {
+      return -1;
+    }
+    j++;
+  }
+
+  return 0;
+}
+
+static int trie_build(lpm_trie_t *trie)
+{
+  if (trie->pfxs_cnt > 0) {
+    qsort(trie->pfxs, trie->pfxs_cnt, sizeof(lpm_pfx_t), pfx_cmp);
+  }
+
+  trie->nodes_cnt = 0;
+  trie->leaves_cnt = 0;
+  /* root */
+  if (trie_add_nodes(trie, 1) != 0) {
+    return -1;
+  }
+  return build_node(trie, 0, trie->pfxs_cnt, 0, 0, 0);
+}
+
+static void trie_destroy(lpm_trie_t *trie)
+{
+  free(trie->nodes);
+  free(trie->leaves);
+  free(trie->pfxs);
+}
+
+/* ======================= LOOKUP FUNCTIONS ======================= */
+
+static inline uint32_t trie_lookup(const lpm_trie_t *trie, uint64_t hi,
+                                   uint64_t lo)
+{
+  const lpm_node_t *node = &trie->nodes[0];
+  int depth = 0;
+  int s = lpm_extract(hi, lo, 0);
+
+  while ((node->vector & (1ULL << s)) != 0) {
+    node = &trie->nodes[node->base1 +
+                        __builtin_popcountll(node->vector & LPM_SLOT_MASK(s)) -
+                        1];
+    depth += LPM_STRIDE;
+    s = lpm_extract(hi, lo, depth);
+  }
+  return trie->leaves[node->base0 +
+                      __builtin_popcountll(node->leafvec & LPM_SLOT_MASK(s)) -
+                      1];
+}
+
+/* ======================= PUBLIC API FUNCTIONS ======================= */
+
+bgpstream_lpm_t *bgpstream_lpm_create()
+{
+  bgpstream_lpm_t *lpm;
+
+  if ((lpm = malloc_zero(sizeof(bgpstream_lpm_t))) == NULL) {
+    return NULL;
+  }
+
+  if ((lpm->values = malloc(sizeof(bgpstream_patricia_node_t *) * 1024)) ==
+      NULL) {
+    goto err;
+  }
+  lpm->values_alloc_cnt = 1024;
+  lpm->values[0] = NULL;
+  lpm->values_cnt = 1;
+
+  /* an empty index must still have a root for each version */
+  if (trie_build(&lpm->v4) != 0 || trie_build(&lpm->v6) != 0) {
+    goto err;
+  }
+
+  return lpm;
+
+err:
+  bgpstream_lpm_destroy(lpm);
+  return NULL;
+}
+
+int bgpstream_lpm_build(bgpstream_lpm_t *lpm, bgpstream_patricia_tree_t *pt)
+{
+  lpm->values_cnt = 1;
+  lpm->v4.pfxs_cnt = 0;
+  lpm->v6.pfxs_cnt = 0;
+  lpm->build_error = 0;
+
+  bgpstream_patricia_tree_walk(pt, collect_pfx, lpm);
+  if (lpm->build_error != 0) {
+    goto err;
+  }
+
+  if (trie_build(&lpm->v4) != 0 || trie_build(&lpm->v6) != 0) {
+    bgpstream_log(BGPSTREAM_LOG_ERR, "Could not build LPM index");
+    goto err;
+  }
+
+  return 0;
+
+err:
+  /* leave a valid (empty) index behind */
+  lpm->values_cnt = 1;
+  lpm->v4.pfxs_cnt = 0;
+  lpm->v6.pfxs_cnt = 0;
+  if (trie_build(&lpm->v4) != 0 || trie_build(&lpm->v6) != 0) {
+    /* cannot happen, the root node is already allocated */
+    assert(0);
+  }
+  return -1;
+}
+
+bgpstream_patricia_node_t *bgpstream_lpm_lookup(bgpstream_lpm_t *lpm,
+                                                bgpstream_ip_addr_t *addr)
+{
+  lpm_trie_t *trie;
+  uint64_t hi, lo;
+
+  if ((trie = lpm_key(lpm, addr, &hi, &lo)) == NULL) {
+    return NULL;
+  }
+  return lpm->values[trie_lookup(trie, hi, lo)];
+}
+
+int bgpstream_lpm_lookup_batch(bgpstream_lpm_t *lpm,
+                               bgpstream_addr_storage_t *addrs, int addrs_cnt,
+                               bgpstream_patricia_node_t **nodes)
+{
+  const lpm_trie_t *trie[LPM_BATCH_LANES];
+  const lpm_node_t *node[LPM_BATCH_LANES];
+  uint64_t hi[LPM_BATCH_LANES];
+  uint64_t lo[LPM_BATCH_LANES];
+  int depth[LPM_BATCH_LANES];
+  int slot[LPM_BATCH_LANES];
+  int found = 0;
+  int base, lanes, active, i;
+
+  for (base = 0; base < addrs_cnt; base += LPM_BATCH_LANES) {
+    lanes = addrs_cnt - base;
+    if (lanes > LPM_BATCH_LANES) {
+      lanes = LPM_BATCH_LANES;
+    }
+
+    active = 0;
+    for (i = 0; i < lanes; i++) {
+      trie[i] =
+        lpm_key(lpm, (bgpstream_ip_addr_t *)&addrs[base + i], &hi[i], &lo[i]);
+      if (trie[i] == NULL) {
+        nodes[base + i] = NULL;
+        continue;
+      }
+      node[i] = &trie[i]->nodes[0];
+      depth[i] = 0;
+      slot[i] = lpm_extract(hi[i], lo[i], 0);
+      active++;
+    }
+
+    /* advance every lane by one level per round, so that the node loads of
+     * the different lanes overlap */
+    while (active > 0) {
+      for (i = 0; i < lanes; i++) {
+        if (trie[i] == NULL) {
+          continue;
+        }
+        if ((node[i]->vector & (1ULL << slot[i])) != 0) {
+          node[i] =
+            &trie[i]->nodes[node[i]->base1 +
+                            __builtin_popcountll(node[i]->vector &
+                                                 LPM_SLOT_MASK(slot[i])) -
+                            1];
+          __builtin_prefetch(node[i]);
+          depth[i] += LPM_STRIDE;
+          slot[i] = lpm_extract(hi[i], lo[i], depth[i]);
+          continue;
+        }
+        /* reached a leaf */
+        nodes[base + i] =
+          lpm->values[trie[i]->leaves[node[i]->base0 +
+                                      __builtin_popcountll(
+                                        node[i]->leafvec &
+                                        LPM_SLOT_MASK(slot[i])) -
+                                      1]];
+        if (nodes[base + i] != NULL) {
+          found++;
+        }
+        trie[i] = NULL;
+        active--;
+      }
+    }
+  }
+
+  return found;
+}
+
+void bgpstream_lpm_destroy(bgpstream_lpm_t *lpm)
+{
+  if (lpm == NULL) {
+    return;
+  }
+  trie_destroy(&lpm->v4);
+  trie_destroy(&lpm->v6);
+  free(lpm->values);
+  free(lpm);
+}
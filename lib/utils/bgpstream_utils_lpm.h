@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPSTREAM_UTILS_LPM_H
+#define __BGPSTREAM_UTILS_LPM_H
+
+#include "bgpstream_utils_addr.h"
+#include "bgpstream_utils_patricia.h"
+
+/** @file
+ *
+ * @brief Header file that exposes the public interface of the BGP Stream
+ * Longest Prefix Match index.
+ *
+ * The index is a read-optimized, compressed multibit trie (a "poptrie") built
+ * in bulk from the prefixes of a Patricia Tree. Every lookup consumes six bits
+ * of the address at a time, and each step is a single 24 byte node load plus
+ * a population count, instead of a branch per bit.
+ *
+ * The index does not copy the prefixes: lookups return the Patricia Tree node
+ * of the longest matching prefix, so the tree must outlive the index and the
+ * index must be rebuilt (using bgpstream_lpm_build) after the tree has been
+ * modified.
+ *
+ */
+
+/**
+ * @name Opaque Data Structures
+ *
+ * @{ */
+
+/** Opaque structure containing a Longest Prefix Match index instance */
+typedef struct bgpstream_lpm bgpstream_lpm_t;
+
+/** @} */
+
+/**
+ * @name Public API Functions
+ *
+ * @{ */
+
+/** Create a new (empty) Longest Prefix Match index
+ *
+ * @return a pointer to the index, or NULL if an error occurred
+ */
+bgpstream_lpm_t *bgpstream_lpm_create();
+
+/** (Re)build the index from the prefixes of the given Patricia Tree
+ *
+ * @param lpm           pointer to the index to build
+ * @param pt            pointer to the Patricia Tree to index
+ * @return 0 if the index was built successfully, -1 otherwise
+ *
+ * Any previous content of the index is discarded (but its memory is reused).
+ */
+int bgpstream_lpm_build(bgpstream_lpm_t *lpm, bgpstream_patricia_tree_t *pt);
+
+/** Find the longest prefix that contains the given address
+ *
+ * @param lpm           pointer to the index to search
+ * @param addr          pointer to the address to look up
+ * @return pointer to the Patricia Tree node of the longest matching prefix, or
+ * NULL if no prefix matches
+ */
+bgpstream_patricia_node_t *bgpstream_lpm_lookup(bgpstream_lpm_t *lpm,
+                                                bgpstream_ip_addr_t *addr);
+
+/** Find the longest prefix that contains each of the given addresses
+ *
+ * @param lpm           pointer to the index to search
+ * @param addrs         array of addresses to look up
+ * @param addrs_cnt     number of addresses in the array
+ * @param[out] nodes    array of (at least) addrs_cnt node pointers, filled
+ *                      with the result of the lookup of the corresponding
+ *                      address (NULL if no prefix matches)
+ * @return the number of addresses for which a matching prefix was found
+ *
+ * Lookups are interleaved so that the memory accesses of several addresses
+ * can be in flight at the same time, which makes this considerably faster
+ * than calling bgpstream_lpm_lookup in a loop.
+ */
+int bgpstream_lpm_lookup_batch(bgpstream_lpm_t *lpm,
+                               bgpstream_addr_storage_t *addrs, int addrs_cnt,
+                               bgpstream_patricia_node_t **nodes);
+
+/** Destroy the given index
+ *
+ * @param lpm           pointer to the index to destroy
+ */
+void bgpstream_lpm_destroy(bgpstream_lpm_t *lpm);
+
+/** @} */
+
+#endif /* __BGPSTREAM_UTILS_LPM_H */
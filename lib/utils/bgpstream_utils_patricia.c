@@ -43,8 +43,10 @@
 #include <assert.h>
 #include <limits.h>
 #include <netdb.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -59,8 +61,23 @@
 
 #define BGPSTREAM_PATRICIA_MAXBITS 128
 
+/* Nodes are allocated from per-version arenas made of fixed-size chunks of
+ * (1 << BGPSTREAM_PATRICIA_CHUNK_BITS) nodes. Chunks never move, so node
+ * pointers handed out to the user remain valid until the node is removed. */
+#define BGPSTREAM_PATRICIA_CHUNK_BITS 10
+#define BGPSTREAM_PATRICIA_CHUNK_NODES (1 << BGPSTREAM_PATRICIA_CHUNK_BITS)
+#define BGPSTREAM_PATRICIA_CHUNK_MASK (BGPSTREAM_PATRICIA_CHUNK_NODES - 1)
+
+/* arena index used for "no node" (slot 0 of the first chunk is never used) */
+#define BGPSTREAM_PATRICIA_NIL 0
+
 #define BIT_TEST(f, b) ((f) & (b))
 
+/* follow the left, right and parent links of a node */
+#define NODE_L(a, n) arena_node((a), (n)->l)
+#define NODE_R(a, n) arena_node((a), (n)->r)
+#define NODE_PARENT(a, n) arena_node((a), (n)->parent)
+
 static int comp_with_mask(void *addr, void *dest, u_int mask)
 {
 
@@ -76,30 +93,61 @@ static int comp_with_mask(void *addr, void *dest, u_int mask)
 
 struct bgpstream_patricia_node {
 
-  /* flag if this node used */
-  u_int bit;
+  /* pointer to user data */
+  void *user;
 
-  /* who we are in patricia tree */
-  bgpstream_pfx_storage_t prefix;
+  /* left and right children (arena indices) */
+  uint32_t l;
+  uint32_t r;
 
-  /* left and right children */
-  bgpstream_patricia_node_t *l;
-  bgpstream_patricia_node_t *r;
+  /* parent node (arena index), or next free node if this node is unused */
+  uint32_t parent;
 
-  /* parent node */
-  bgpstream_patricia_node_t *parent;
+  /* arena index of this node */
+  uint32_t idx;
 
-  /* pointer to user data */
-  void *user;
+  /* bit to test at this node */
+  uint8_t bit;
+
+  /* non-zero if this is a glue node (i.e. it holds no prefix) */
+  uint8_t glue;
+
+  /* who we are in patricia tree. This must be the last field: only as many
+   * bytes as needed by a bgpstream_ipv4_pfx_t (or bgpstream_ipv6_pfx_t) are
+   * allocated for it, depending on the tree the node belongs to. The address
+   * version is set also for glue nodes. */
+  bgpstream_pfx_t prefix;
 };
 
+/* Pool of nodes of a single IP version */
+typedef struct patricia_arena {
+
+  /* size of a node (depends on the prefix storage) */
+  size_t node_size;
+
+  /* array of chunks of nodes */
+  uint8_t **chunks;
+  uint32_t chunks_cnt;
+  uint32_t chunks_alloc_cnt;
+
+  /* index of the next node never handed out */
+  uint32_t used;
+
+  /* list of removed nodes (linked through the parent index) */
+  uint32_t free_head;
+
+  /* root of the tree */
+  uint32_t head;
+
+} patricia_arena_t;
+
 struct bgpstream_patricia_tree {
 
   /* IPv4 tree */
-  bgpstream_patricia_node_t *head4;
+  patricia_arena_t arena4;
 
   /* IPv6 tree */
-  bgpstream_patricia_node_t *head6;
+  patricia_arena_t arena6;
 
   /* Number of nodes per tree */
   uint64_t ipv4_active_nodes;
@@ -139,6 +187,122 @@ static unsigned char *bgpstream_pfx_get_first_byte(bgpstream_pfx_t *pfx)
   return NULL;
 }
 
+/* ======================= NODE ARENA FUNCTIONS ======================= */
+
+static void arena_init(patricia_arena_t *a, size_t pfx_size)
+{
+  /* keep nodes pointer-aligned */
+  a->node_size = offsetof(bgpstream_patricia_node_t, prefix) + pfx_size;
+  a->node_size = (a->node_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+  a->used = 1;
+  a->free_head = BGPSTREAM_PATRICIA_NIL;
+  a->head = BGPSTREAM_PATRICIA_NIL;
+}
+
+static inline bgpstream_patricia_node_t *arena_node(const patricia_arena_t *a,
+                                                    uint32_t idx)
+{
+  if (idx == BGPSTREAM_PATRICIA_NIL) {
+    return NULL;
+  }
+  return (bgpstream_patricia_node_t
+            *)(a->chunks[idx >> BGPSTREAM_PATRICIA_CHUNK_BITS] +
+               (size_t)(idx & BGPSTREAM_PATRICIA_CHUNK_MASK) * a->node_size);
+}
+
+static inline uint32_t node_idx(bgpstream_patricia_node_t *node)
+{
+  return (node == NULL) ? BGPSTREAM_PATRICIA_NIL : node->idx;
+}
+
+static bgpstream_patricia_node_t *arena_alloc(patricia_arena_t *a)
+{
+  bgpstream_patricia_node_t *node;
+  uint32_t idx;
+
+  if (a->free_head != BGPSTREAM_PATRICIA_NIL) {
+    idx = a->free_head;
+    node = arena_node(a, idx);
+    a->free_head = node->parent;
+  } else {
+    if (a->used == UINT32_MAX) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Patricia tree node arena is full");
+      return NULL;
+    }
+    /* chunks are kept across clears, so only allocate when the next node
+     * falls outside of the existing ones */
+    if ((a->used >> BGPSTREAM_PATRICIA_CHUNK_BITS) >= a->chunks_cnt) {
+      if (a->chunks_cnt == a->chunks_alloc_cnt) {
+        uint32_t alloc_cnt =
+          (a->chunks_alloc_cnt == 0) ? 8 : a->chunks_alloc_cnt * 2;
+        uint8_t **chunks;
+        if ((chunks = realloc(a->chunks, sizeof(uint8_t *) * alloc_cnt)) ==
+            NULL) {
+          bgpstream_log(BGPSTREAM_LOG_ERR, "could not realloc node chunks");
+          return NULL;
+        }
+        a->chunks = chunks;
+        a->chunks_alloc_cnt = alloc_cnt;
+      }
+      if ((a->chunks[a->chunks_cnt] =
+             malloc(a->node_size * BGPSTREAM_PATRICIA_CHUNK_NODES)) == NULL) {
+        bgpstream_log(BGPSTREAM_LOG_ERR, "could not malloc node chunk");
+        return NULL;
+      }
+      a->chunks_cnt++;
+    }
+    idx = a->used++;
+    node = arena_node(a, idx);
+  }
+
+  memset(node, 0, a->node_size);
+  node->idx = idx;
+  return node;
+}
+
+static void arena_free(patricia_arena_t *a, bgpstream_patricia_node_t *node)
+{
+  node->user = NULL;
+  node->l = BGPSTREAM_PATRICIA_NIL;
+  node->r = BGPSTREAM_PATRICIA_NIL;
+  node->parent = a->free_head;
+  a->free_head = node->idx;
+}
+
+/* drop all the nodes at once: unless a user destructor has to be called, this
+ * does not touch the nodes at all */
+static void arena_clear(bgpstream_patricia_tree_t *pt, patricia_arena_t *a)
+{
+  uint32_t idx;
+  bgpstream_patricia_node_t *node;
+
+  if (pt->node_user_destructor != NULL) {
+    /* removed nodes always have a NULL user pointer */
+    for (idx = 1; idx < a->used; idx++) {
+      node = arena_node(a, idx);
+      if (node->user != NULL) {
+        pt->node_user_destructor(node->user);
+        node->user = NULL;
+      }
+    }
+  }
+  a->used = 1;
+  a->free_head = BGPSTREAM_PATRICIA_NIL;
+  a->head = BGPSTREAM_PATRICIA_NIL;
+}
+
+static void arena_destroy(patricia_arena_t *a)
+{
+  uint32_t i;
+  for (i = 0; i < a->chunks_cnt; i++) {
+    free(a->chunks[i]);
+  }
+  free(a->chunks);
+  a->chunks = NULL;
+  a->chunks_cnt = 0;
+  a->chunks_alloc_cnt = 0;
+}
+
 /* ======================= RESULT SET FUNCTIONS  ======================= */
 
 static int bgpstream_patricia_tree_result_set_add_node(
@@ -172,6 +336,21 @@ static void bgpstream_patricia_tree_result_set_clear(
 
 /* ======================= PATRICIA NODE FUNCTIONS ======================= */
 
+static patricia_arena_t *
+bgpstream_patricia_get_arena(bgpstream_patricia_tree_t *pt,
+                             bgpstream_addr_version_t v)
+{
+  switch (v) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    return &pt->arena4;
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    return &pt->arena6;
+  default:
+    assert(0);
+  }
+  return NULL;
+}
+
 static bgpstream_patricia_node_t *
 bgpstream_patricia_node_create(bgpstream_patricia_tree_t *pt,
                                bgpstream_pfx_t *pfx)
@@ -182,7 +361,8 @@ bgpstream_patricia_node_create(bgpstream_patricia_tree_t *pt,
   assert(pfx->mask_len <= BGPSTREAM_PATRICIA_MAXBITS);
   assert(pfx->address.version != BGPSTREAM_ADDR_VERSION_UNKNOWN);
 
-  if ((node = malloc_zero(sizeof(bgpstream_patricia_node_t))) == NULL) {
+  if ((node = arena_alloc(bgpstream_patricia_get_arena(
+         pt, pfx->address.version))) == NULL) {
     return NULL;
   }
 
@@ -192,28 +372,23 @@ bgpstream_patricia_node_create(bgpstream_patricia_tree_t *pt,
     pt->ipv6_active_nodes++;
   }
 
-  bgpstream_pfx_copy((bgpstream_pfx_t *)&node->prefix, pfx);
+  bgpstream_pfx_copy(&node->prefix, pfx);
 
-  node->parent = NULL;
   node->bit = pfx->mask_len;
-  node->l = NULL;
-  node->r = NULL;
-  node->user = NULL;
   return node;
 }
 
-static bgpstream_patricia_node_t *bgpstream_patricia_gluenode_create()
+static bgpstream_patricia_node_t *
+bgpstream_patricia_gluenode_create(bgpstream_patricia_tree_t *pt,
+                                   bgpstream_addr_version_t v)
 {
   bgpstream_patricia_node_t *node;
 
-  if ((node = malloc_zero(sizeof(bgpstream_patricia_node_t))) == NULL) {
+  if ((node = arena_alloc(bgpstream_patricia_get_arena(pt, v))) == NULL) {
     return NULL;
   }
-  node->prefix.address.version = BGPSTREAM_ADDR_VERSION_UNKNOWN;
-  node->parent = NULL;
-  node->bit = 0;
-  node->l = NULL;
-  node->r = NULL;
+  node->prefix.address.version = v;
+  node->glue = 1;
   return node;
 }
 
@@ -223,35 +398,20 @@ static bgpstream_patricia_node_t *
 bgpstream_patricia_get_head(bgpstream_patricia_tree_t *pt,
                             bgpstream_addr_version_t v)
 {
-  switch (v) {
-  case BGPSTREAM_ADDR_VERSION_IPV4:
-    return pt->head4;
-  case BGPSTREAM_ADDR_VERSION_IPV6:
-    return pt->head6;
-  default:
-    assert(0);
-  }
-  return NULL;
+  patricia_arena_t *a = bgpstream_patricia_get_arena(pt, v);
+  return arena_node(a, a->head);
 }
 
 static void bgpstream_patricia_set_head(bgpstream_patricia_tree_t *pt,
                                         bgpstream_addr_version_t v,
                                         bgpstream_patricia_node_t *n)
 {
-  switch (v) {
-  case BGPSTREAM_ADDR_VERSION_IPV4:
-    pt->head4 = n;
-    break;
-  case BGPSTREAM_ADDR_VERSION_IPV6:
-    pt->head6 = n;
-    break;
-  default:
-    assert(0);
-  }
+  bgpstream_patricia_get_arena(pt, v)->head = node_idx(n);
 }
 
 static uint64_t
-bgpstream_patricia_tree_count_subnets(bgpstream_patricia_node_t *node,
+bgpstream_patricia_tree_count_subnets(const patricia_arena_t *a,
+                                      bgpstream_patricia_node_t *node,
                                       uint64_t subnet_size)
 {
   if (node == NULL) {
@@ -260,15 +420,17 @@ bgpstream_patricia_tree_count_subnets(bgpstream_patricia_node_t *node,
   /* if the node is a glue node, then the /subnet_size subnets are the sum of
    * the
    * /24 subnets contained in its left and right subtrees */
-  if (node->prefix.address.version == BGPSTREAM_ADDR_VERSION_UNKNOWN) {
+  if (node->glue) {
     /* if the glue node is already a /subnet_size, then just return 1 (even
      * though
      * the subnetworks below could be a non complete /subnet_size */
     if (node->bit >= subnet_size) {
       return 1;
     } else {
-      return bgpstream_patricia_tree_count_subnets(node->l, subnet_size) +
-             bgpstream_patricia_tree_count_subnets(node->r, subnet_size);
+      return bgpstream_patricia_tree_count_subnets(a, NODE_L(a, node),
+                                                   subnet_size) +
+             bgpstream_patricia_tree_count_subnets(a, NODE_R(a, node),
+                                                   subnet_size);
     }
   } else {
     /* otherwise we just count the subnet for the given network and return
@@ -291,8 +453,8 @@ bgpstream_patricia_tree_count_subnets(bgpstream_patricia_node_t *node,
 
 /* depth pecifies how many "children" to explore for each node */
 static int bgpstream_patricia_tree_add_more_specifics(
-  bgpstream_patricia_tree_result_set_t *set, bgpstream_patricia_node_t *node,
-  const uint8_t depth)
+  bgpstream_patricia_tree_result_set_t *set, const patricia_arena_t *a,
+  bgpstream_patricia_node_t *node, const uint8_t depth)
 {
   if (node == NULL || depth == 0) {
     return 0;
@@ -300,7 +462,7 @@ static int bgpstream_patricia_tree_add_more_specifics(
   uint8_t d = depth;
   /* if it is a node containing a real prefix, then copy the address to a new
    * result node */
-  if (node->prefix.address.version != BGPSTREAM_ADDR_VERSION_UNKNOWN) {
+  if (!node->glue) {
     if (bgpstream_patricia_tree_result_set_add_node(set, node) != 0) {
       return -1;
     }
@@ -308,10 +470,12 @@ static int bgpstream_patricia_tree_add_more_specifics(
   }
 
   /* using pre-order R - Left - Right */
-  if (bgpstream_patricia_tree_add_more_specifics(set, node->l, d) != 0) {
+  if (bgpstream_patricia_tree_add_more_specifics(set, a, NODE_L(a, node), d) !=
+      0) {
     return -1;
   }
-  if (bgpstream_patricia_tree_add_more_specifics(set, node->r, d) != 0) {
+  if (bgpstream_patricia_tree_add_more_specifics(set, a, NODE_R(a, node), d) !=
+      0) {
     return -1;
   }
   return 0;
@@ -319,8 +483,8 @@ static int bgpstream_patricia_tree_add_more_specifics(
 
 /* depth pecifies how many "children" to explore for each node */
 static int bgpstream_patricia_tree_add_less_specifics(
-  bgpstream_patricia_tree_result_set_t *set, bgpstream_patricia_node_t *node,
-  const uint8_t depth)
+  bgpstream_patricia_tree_result_set_t *set, const patricia_arena_t *a,
+  bgpstream_patricia_node_t *node, const uint8_t depth)
 {
   if (node == NULL) {
     return 0;
@@ -329,28 +493,30 @@ static int bgpstream_patricia_tree_add_less_specifics(
   while (node != NULL && d > 0) {
     /* if it is a node containing a real prefix, then copy the address to a new
      * result node */
-    if (node->prefix.address.version != BGPSTREAM_ADDR_VERSION_UNKNOWN) {
+    if (!node->glue) {
       if (bgpstream_patricia_tree_result_set_add_node(set, node) != 0) {
         return -1;
       }
       d--;
     }
-    node = node->parent;
+    node = NODE_PARENT(a, node);
   }
   return 0;
 }
 
 static int
-bgpstream_patricia_tree_find_more_specific(bgpstream_patricia_node_t *node)
+bgpstream_patricia_tree_find_more_specific(const patricia_arena_t *a,
+                                           bgpstream_patricia_node_t *node)
 {
   if (node == NULL) {
     return 0;
   }
   /* if it is a node containing a glue node, then we have to search for other
    * cases */
-  if (node->prefix.address.version == BGPSTREAM_ADDR_VERSION_UNKNOWN) {
-    if (bgpstream_patricia_tree_find_more_specific(node->l) == 0) {
-      if (bgpstream_patricia_tree_find_more_specific(node->r) == 0) {
+  if (node->glue) {
+    if (bgpstream_patricia_tree_find_more_specific(a, NODE_L(a, node)) == 0) {
+      if (bgpstream_patricia_tree_find_more_specific(a, NODE_R(a, node)) ==
+          0) {
         return 0;
       }
     }
@@ -360,78 +526,65 @@ bgpstream_patricia_tree_find_more_specific(bgpstream_patricia_node_t *node)
 }
 
 static void bgpstream_patricia_tree_merge_tree(bgpstream_patricia_tree_t *dst,
+                                               const patricia_arena_t *a,
                                                bgpstream_patricia_node_t *node)
 {
   if (node == NULL) {
     return;
   }
   /* Add the current node, if it is not a glue node */
-  if (node->prefix.address.version != BGPSTREAM_ADDR_VERSION_UNKNOWN) {
-    bgpstream_patricia_tree_insert(dst, (bgpstream_pfx_t *)&node->prefix);
+  if (!node->glue) {
+    bgpstream_patricia_tree_insert(dst, &node->prefix);
   }
   /* Recursively add left and right node */
-  bgpstream_patricia_tree_merge_tree(dst, node->l);
-  bgpstream_patricia_tree_merge_tree(dst, node->r);
+  bgpstream_patricia_tree_merge_tree(dst, a, NODE_L(a, node));
+  bgpstream_patricia_tree_merge_tree(dst, a, NODE_R(a, node));
 }
 
 static void bgpstream_patricia_tree_walk_tree(
-  bgpstream_patricia_tree_t *pt, bgpstream_patricia_node_t *node,
-  bgpstream_patricia_tree_process_node_t *fun, void *data)
+  bgpstream_patricia_tree_t *pt, const patricia_arena_t *a,
+  bgpstream_patricia_node_t *node, bgpstream_patricia_tree_process_node_t *fun,
+  void *data)
 {
   if (node == NULL) {
     return;
   }
 
   /* In order traversal: Left - Node - Right */
-  bgpstream_patricia_node_t *l = node->l;
-  bgpstream_patricia_node_t *r = node->r;
+  bgpstream_patricia_node_t *l = NODE_L(a, node);
+  bgpstream_patricia_node_t *r = NODE_R(a, node);
 
   /* Left */
-  bgpstream_patricia_tree_walk_tree(pt, l, fun, data);
+  bgpstream_patricia_tree_walk_tree(pt, a, l, fun, data);
 
   /* Node */
-  if (node->prefix.address.version != BGPSTREAM_ADDR_VERSION_UNKNOWN) {
+  if (!node->glue) {
     fun(pt, node, data);
   }
 
   /* Right */
-  bgpstream_patricia_tree_walk_tree(pt, r, fun, data);
+  bgpstream_patricia_tree_walk_tree(pt, a, r, fun, data);
 }
 
-static void bgpstream_patricia_tree_print_tree(bgpstream_patricia_node_t *node)
+static void bgpstream_patricia_tree_print_tree(const patricia_arena_t *a,
+                                               bgpstream_patricia_node_t *node)
 {
   if (node == NULL) {
     return;
   }
-  bgpstream_patricia_tree_print_tree(node->l);
+  bgpstream_patricia_tree_print_tree(a, NODE_L(a, node));
 
   char buffer[1024];
 
   /* if node is not a glue node, print the prefix */
-  if (node->prefix.address.version != BGPSTREAM_ADDR_VERSION_UNKNOWN) {
+  if (!node->glue) {
     memset(buffer, ' ', sizeof(char) * node->prefix.mask_len);
     bgpstream_pfx_snprintf(buffer + node->prefix.mask_len, 1024,
-                           (bgpstream_pfx_t *)&node->prefix);
+                           &node->prefix);
     fprintf(stdout, "%s\n", buffer);
   }
 
-  bgpstream_patricia_tree_print_tree(node->r);
-}
-
-static void
-bgpstream_patricia_tree_destroy_tree(bgpstream_patricia_tree_t *pt,
-                                     bgpstream_patricia_node_t *head)
-{
-  if (head != NULL) {
-    bgpstream_patricia_node_t *l = head->l;
-    bgpstream_patricia_node_t *r = head->r;
-    bgpstream_patricia_tree_destroy_tree(pt, l);
-    bgpstream_patricia_tree_destroy_tree(pt, r);
-    if (head->user != NULL && pt->node_user_destructor != NULL) {
-      pt->node_user_destructor(head->user);
-    }
-    free(head);
-  }
+  bgpstream_patricia_tree_print_tree(a, NODE_R(a, node));
 }
 
 /* ======================= PUBLIC API FUNCTIONS ======================= */
@@ -503,7 +656,7 @@ void bgpstream_patricia_tree_result_set_print(
   bgpstream_patricia_node_t *next;
   char buffer[1024];
   while ((next = bgpstream_patricia_tree_result_set_next(set)) != NULL) {
-    bgpstream_pfx_snprintf(buffer, 1024, (bgpstream_pfx_t *)&next->prefix);
+    bgpstream_pfx_snprintf(buffer, 1024, &next->prefix);
     fprintf(stdout, "%s\n", buffer);
   }
 }
@@ -515,8 +668,8 @@ bgpstream_patricia_tree_t *bgpstream_patricia_tree_create(
   if ((pt = malloc_zero(sizeof(bgpstream_patricia_tree_t))) == NULL) {
     return NULL;
   }
-  pt->head4 = NULL;
-  pt->head6 = NULL;
+  arena_init(&pt->arena4, sizeof(bgpstream_ipv4_pfx_t));
+  arena_init(&pt->arena6, sizeof(bgpstream_ipv6_pfx_t));
   pt->ipv4_active_nodes = 0;
   pt->ipv6_active_nodes = 0;
   pt->node_user_destructor = bspt_user_destructor;
@@ -537,6 +690,7 @@ bgpstream_patricia_tree_insert(bgpstream_patricia_tree_t *pt,
 
   bgpstream_patricia_node_t *new_node = NULL;
   bgpstream_addr_version_t v = pfx->address.version;
+  patricia_arena_t *a = bgpstream_patricia_get_arena(pt, v);
 
   /* if Patricia Tree is empty, then insert new node */
   if (bgpstream_patricia_get_head(pt, v) == NULL) {
@@ -562,30 +716,28 @@ bgpstream_patricia_tree_insert(bgpstream_patricia_tree_t *pt,
    * - the current node has the same mask length (or greater) and
    *   it contains a valid prefix (i.e. it is not a glue node)
    * */
-  while (node_it->bit < bitlen ||
-         node_it->prefix.address.version == BGPSTREAM_ADDR_VERSION_UNKNOWN) {
+  while (node_it->bit < bitlen || node_it->glue) {
     if (node_it->bit < BGPSTREAM_PATRICIA_MAXBITS &&
         BIT_TEST(addr[node_it->bit >> 3], 0x80 >> (node_it->bit & 0x07))) {
       /* no more nodes on the right, exit from loop */
-      if (node_it->r == NULL) {
+      if (node_it->r == BGPSTREAM_PATRICIA_NIL) {
         break;
       }
       /* patricia_lookup: take right at node->bit */
-      node_it = node_it->r;
+      node_it = NODE_R(a, node_it);
     } else {
       /* no more nodes on the left, exit from loop */
-      if (node_it->l == NULL) {
+      if (node_it->l == BGPSTREAM_PATRICIA_NIL) {
         break;
       }
       /* patricia_lookup: take left at node->bit */
-      node_it = node_it->l;
+      node_it = NODE_L(a, node_it);
     }
     assert(node_it);
   }
 
   /*  node_it->prefix is the prefix we stopped at */
-  unsigned char *test_addr =
-    bgpstream_pfx_get_first_byte((bgpstream_pfx_t *)&node_it->prefix);
+  unsigned char *test_addr = bgpstream_pfx_get_first_byte(&node_it->prefix);
 
   /* find the first bit different */
   uint8_t check_bit;
@@ -618,23 +770,24 @@ bgpstream_patricia_tree_insert(bgpstream_patricia_tree_t *pt,
   bgpstream_patricia_node_t *glue_node;
 
   /* go back up till we find the right parent **I.E.??** */
-  parent = node_it->parent;
+  parent = NODE_PARENT(a, node_it);
   while (parent && parent->bit >= differ_bit) {
     node_it = parent;
-    parent = node_it->parent;
+    parent = NODE_PARENT(a, node_it);
   }
 
   if (differ_bit == bitlen && node_it->bit == bitlen) {
     /* check the node contains a valid prefix,
      * i.e. it is not a glue node */
-    if (node_it->prefix.address.version != BGPSTREAM_ADDR_VERSION_UNKNOWN) {
+    if (!node_it->glue) {
       /* Exact node found */
       /* DEBUG  fprintf(stderr, "Prefix %s already in tree\n", buffer); */
       return node_it;
     }
     /* otherwise replace the info in the glue node with proper
      * prefix information and increment the right counter*/
-    node_it->prefix = *((bgpstream_pfx_storage_t *)pfx);
+    bgpstream_pfx_copy(&node_it->prefix, pfx);
+    node_it->glue = 0;
     if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
       pt->ipv4_active_nodes++;
     } else {
@@ -655,14 +808,14 @@ bgpstream_patricia_tree_insert(bgpstream_patricia_tree_t *pt,
   /* Insert the new node in the Patricia Tree: CHILD */
   if (node_it->bit == differ_bit) {
     /* appending the new node as a child of node_it */
-    new_node->parent = node_it;
+    new_node->parent = node_it->idx;
     if (node_it->bit < BGPSTREAM_PATRICIA_MAXBITS &&
         BIT_TEST(addr[node_it->bit >> 3], 0x80 >> (node_it->bit & 0x07))) {
-      assert(node_it->r == NULL);
-      node_it->r = new_node;
+      assert(node_it->r == BGPSTREAM_PATRICIA_NIL);
+      node_it->r = new_node->idx;
     } else {
-      assert(node_it->l == NULL);
-      node_it->l = new_node;
+      assert(node_it->l == BGPSTREAM_PATRICIA_NIL);
+      node_it->l = new_node->idx;
     }
     /* patricia_lookup: new_node #2 (child) */
     /* DEBUG  fprintf(stderr, "Adding %s as a CHILD node\n", buffer); */
@@ -674,22 +827,22 @@ bgpstream_patricia_tree_insert(bgpstream_patricia_tree_t *pt,
     /* attaching the new node as a parent of node_it */
     if (bitlen < BGPSTREAM_PATRICIA_MAXBITS &&
         BIT_TEST(test_addr[bitlen >> 3], 0x80 >> (bitlen & 0x07))) {
-      new_node->r = node_it;
+      new_node->r = node_it->idx;
     } else {
-      new_node->l = node_it;
+      new_node->l = node_it->idx;
     }
     new_node->parent = node_it->parent;
-    if (node_it->parent == NULL) {
+    if (parent == NULL) {
       assert(bgpstream_patricia_get_head(pt, v) == node_it);
       bgpstream_patricia_set_head(pt, v, new_node);
     } else {
-      if (node_it->parent->r == node_it) {
-        node_it->parent->r = new_node;
+      if (parent->r == node_it->idx) {
+        parent->r = new_node->idx;
       } else {
-        node_it->parent->l = new_node;
+        parent->l = new_node->idx;
       }
     }
-    node_it->parent = new_node;
+    node_it->parent = new_node->idx;
     /* patricia_lookup: new_node #3 (parent) */
     /* DEBUG fprintf(stderr, "Adding %s as a PARENT node\n", buffer); */
     return new_node;
@@ -697,32 +850,42 @@ bgpstream_patricia_tree_insert(bgpstream_patricia_tree_t *pt,
     /* Insert the new node in the Patricia Tree: CREATE A GLUE NODE AND APPEND
      * TO IT*/
 
-    glue_node = bgpstream_patricia_gluenode_create();
+    if ((glue_node = bgpstream_patricia_gluenode_create(pt, v)) == NULL) {
+      bgpstream_log(BGPSTREAM_LOG_ERR, "Error creating pt glue node");
+      /* new_node is not linked yet, just give it back */
+      arena_free(a, new_node);
+      if (v == BGPSTREAM_ADDR_VERSION_IPV4) {
+        pt->ipv4_active_nodes--;
+      } else {
+        pt->ipv6_active_nodes--;
+      }
+      return NULL;
+    }
 
     glue_node->bit = differ_bit;
     glue_node->parent = node_it->parent;
 
     if (differ_bit < BGPSTREAM_PATRICIA_MAXBITS &&
         BIT_TEST(addr[differ_bit >> 3], 0x80 >> (differ_bit & 0x07))) {
-      glue_node->r = new_node;
-      glue_node->l = node_it;
+      glue_node->r = new_node->idx;
+      glue_node->l = node_it->idx;
     } else {
-      glue_node->r = node_it;
-      glue_node->l = new_node;
+      glue_node->r = node_it->idx;
+      glue_node->l = new_node->idx;
     }
-    new_node->parent = glue_node;
+    new_node->parent = glue_node->idx;
 
-    if (node_it->parent == NULL) {
+    if (parent == NULL) {
       assert(bgpstream_patricia_get_head(pt, v) == node_it);
       bgpstream_patricia_set_head(pt, v, glue_node);
     } else {
-      if (node_it->parent->r == node_it) {
-        node_it->parent->r = glue_node;
+      if (parent->r == node_it->idx) {
+        parent->r = glue_node->idx;
       } else {
-        node_it->parent->l = glue_node;
+        parent->l = glue_node->idx;
       }
     }
-    node_it->parent = glue_node;
+    node_it->parent = glue_node->idx;
     /* "patricia_lookup: new_node #4 (glue+node) */
     /* DEBUG fprintf(stderr, "Adding %s as a CHILD of a NEW GLUE node\n",
      * buffer); */
@@ -764,7 +927,9 @@ bgpstream_patricia_tree_get_pfx_overlap_info(bgpstream_patricia_tree_t *pt,
   } else {
     /* we basically simulate an insertion, to understand whether the prefix
      * would overlap or not */
-    n = bgpstream_patricia_tree_insert(pt, pfx);
+    if ((n = bgpstream_patricia_tree_insert(pt, pfx)) == NULL) {
+      return 0;
+    }
     uint8_t mask = bgpstream_patricia_tree_get_node_overlap_info(pt, n);
     bgpstream_patricia_tree_remove_node(pt, n);
     return mask & (~BGPSTREAM_PATRICIA_EXACT_MATCH);
@@ -787,21 +952,21 @@ void bgpstream_patricia_tree_remove_node(bgpstream_patricia_tree_t *pt,
     return;
   }
 
+  /* we do not allow for explicit removal of glue nodes */
+  if (node->glue) {
+    return;
+  }
+
   bgpstream_addr_version_t v = node->prefix.address.version;
+  patricia_arena_t *a = bgpstream_patricia_get_arena(pt, v);
   bgpstream_patricia_node_t *parent;
   bgpstream_patricia_node_t *child;
 
   uint64_t *num_active_node = &pt->ipv4_active_nodes;
-  ;
-  if (node->prefix.address.version == BGPSTREAM_ADDR_VERSION_IPV6) {
+  if (v == BGPSTREAM_ADDR_VERSION_IPV6) {
     num_active_node = &pt->ipv6_active_nodes;
   }
 
-  /* we do not allow for explicit removal of glue nodes */
-  if (v == BGPSTREAM_ADDR_VERSION_UNKNOWN) {
-    return;
-  }
-
   if (node->user != NULL) {
     if (pt->node_user_destructor != NULL) {
       pt->node_user_destructor(node->user);
@@ -810,13 +975,11 @@ void bgpstream_patricia_tree_remove_node(bgpstream_patricia_tree_t *pt,
   }
 
   /* if node has both children */
-  if (node->r != NULL && node->l != NULL) {
+  if (node->r != BGPSTREAM_PATRICIA_NIL && node->l != BGPSTREAM_PATRICIA_NIL) {
     /* if it is a glue node, there is nothing to remove,
      * if it is node with a valid prefix, then it becomes a glue node
      */
-    if (node->prefix.address.version != BGPSTREAM_ADDR_VERSION_UNKNOWN) {
-      node->prefix.address.version = BGPSTREAM_ADDR_VERSION_UNKNOWN;
-    }
+    node->glue = 1;
     /* node data remains, unless we decide to pass a destroy function somewehere
      */
     /* node->user = NULL; */
@@ -825,9 +988,9 @@ void bgpstream_patricia_tree_remove_node(bgpstream_patricia_tree_t *pt,
   }
 
   /* if node has no children */
-  if (node->r == NULL && node->l == NULL) {
-    parent = node->parent;
-    free(node);
+  if (node->r == BGPSTREAM_PATRICIA_NIL && node->l == BGPSTREAM_PATRICIA_NIL) {
+    parent = NODE_PARENT(a, node);
+    arena_free(a, node);
     (*num_active_node) = (*num_active_node) - 1;
 
     /* removing head of tree */
@@ -839,17 +1002,17 @@ void bgpstream_patricia_tree_remove_node(bgpstream_patricia_tree_t *pt,
     }
 
     /* check if the node was the right or the left child */
-    if (parent->r == node) {
-      parent->r = NULL;
-      child = parent->l;
+    if (parent->r == node->idx) {
+      parent->r = BGPSTREAM_PATRICIA_NIL;
+      child = NODE_L(a, parent);
     } else {
-      assert(parent->l == node);
-      parent->l = NULL;
-      child = parent->r;
+      assert(parent->l == node->idx);
+      parent->l = BGPSTREAM_PATRICIA_NIL;
+      child = NODE_R(a, parent);
     }
 
     /* if the current parent was a valid prefix, return */
-    if (parent->prefix.address.version != BGPSTREAM_ADDR_VERSION_UNKNOWN) {
+    if (!parent->glue) {
       /* DEBUG fprintf(stderr, "Removing node with no children\n"); */
       return;
     }
@@ -857,36 +1020,37 @@ void bgpstream_patricia_tree_remove_node(bgpstream_patricia_tree_t *pt,
     /* otherwise it makes no sense to have a glue node
      * with only one child, the parent has to be removed */
 
-    if (parent->parent == NULL) { /* if the parent parent is the head, then
-                                   * attach the only child directly */
+    bgpstream_patricia_node_t *grandparent = NODE_PARENT(a, parent);
+    if (grandparent == NULL) { /* if the parent parent is the head, then
+                                * attach the only child directly */
       assert(parent == bgpstream_patricia_get_head(pt, v));
       bgpstream_patricia_set_head(pt, v, child);
     } else {
-      if (parent->parent->r == parent) { /* if the parent is a right child */
-        parent->parent->r = child;
+      if (grandparent->r == parent->idx) { /* if the parent is a right child */
+        grandparent->r = child->idx;
       } else { /* if the parent is a left child */
-        assert(parent->parent->l == parent);
-        parent->parent->l = child;
+        assert(grandparent->l == parent->idx);
+        grandparent->l = child->idx;
       }
     }
     /* the child parent, is now the grand-parent */
     child->parent = parent->parent;
-    free(parent);
+    arena_free(a, parent);
     return;
   }
 
   /* if node has only one child */
-  if (node->r) {
-    child = node->r;
+  if (node->r != BGPSTREAM_PATRICIA_NIL) {
+    child = NODE_R(a, node);
   } else {
-    assert(node->l);
-    child = node->l;
+    assert(node->l != BGPSTREAM_PATRICIA_NIL);
+    child = NODE_L(a, node);
   }
   /* the child parent, is now the grand-parent */
-  parent = node->parent;
-  child->parent = parent;
+  parent = NODE_PARENT(a, node);
+  child->parent = node->parent;
 
-  free(node);
+  arena_free(a, node);
   (*num_active_node) = (*num_active_node) - 1;
 
   if (parent == NULL) { /* if the parent is the head, then attach
@@ -896,11 +1060,11 @@ void bgpstream_patricia_tree_remove_node(bgpstream_patricia_tree_t *pt,
     return;
   } else {
     /* attach child node to the correct parent child pointer */
-    if (parent->r == node) { /* if node was a right child */
-      parent->r = child;
+    if (parent->r == node->idx) { /* if node was a right child */
+      parent->r = child->idx;
     } else { /* if node was a left child */
-      assert(parent->l == node);
-      parent->l = child;
+      assert(parent->l == node->idx);
+      parent->l = child->idx;
     }
   }
 }
@@ -915,23 +1079,24 @@ bgpstream_patricia_tree_search_exact(bgpstream_patricia_tree_t *pt,
   assert(pfx->address.version != BGPSTREAM_ADDR_VERSION_UNKNOWN);
 
   bgpstream_addr_version_t v = pfx->address.version;
+  patricia_arena_t *a = bgpstream_patricia_get_arena(pt, v);
 
   /* if Patricia Tree is empty*/
-  if (bgpstream_patricia_get_head(pt, v) == NULL) {
+  if (a->head == BGPSTREAM_PATRICIA_NIL) {
     return NULL;
   }
 
-  bgpstream_patricia_node_t *node_it = bgpstream_patricia_get_head(pt, v);
+  bgpstream_patricia_node_t *node_it = arena_node(a, a->head);
   uint8_t bitlen = pfx->mask_len;
   unsigned char *addr = bgpstream_pfx_get_first_byte(pfx);
 
   while (node_it->bit < bitlen) {
     if (BIT_TEST(addr[node_it->bit >> 3], 0x80 >> (node_it->bit & 0x07))) {
       /* patricia_lookup: take right at node->bit */
-      node_it = node_it->r;
+      node_it = NODE_R(a, node_it);
     } else {
       /* patricia_lookup: take left at node->bit */
-      node_it = node_it->l;
+      node_it = NODE_L(a, node_it);
     }
     if (node_it == NULL) {
       return NULL;
@@ -940,17 +1105,15 @@ bgpstream_patricia_tree_search_exact(bgpstream_patricia_tree_t *pt,
 
   /* if we passed the right mask, or if we stopped at a glue node, then
    * no exact match found */
-  if (node_it->bit > bitlen ||
-      node_it->prefix.address.version == BGPSTREAM_ADDR_VERSION_UNKNOWN) {
+  if (node_it->bit > bitlen || node_it->glue) {
     return NULL;
   }
 
   assert(node_it->bit == bitlen);
   /* compare the prefixes bit by bit
    * TODO: consider replacing with bgpstream_pfx_storage_equal */
-  if (comp_with_mask(
-        bgpstream_pfx_get_first_byte((bgpstream_pfx_t *)&node_it->prefix),
-        bgpstream_pfx_get_first_byte(pfx), bitlen)) {
+  if (comp_with_mask(bgpstream_pfx_get_first_byte(&node_it->prefix),
+                     bgpstream_pfx_get_first_byte(pfx), bitlen)) {
     /* exact match found */
     return node_it;
   }
@@ -973,12 +1136,14 @@ uint64_t bgpstream_patricia_prefix_count(bgpstream_patricia_tree_t *pt,
 
 uint64_t bgpstream_patricia_tree_count_24subnets(bgpstream_patricia_tree_t *pt)
 {
-  return bgpstream_patricia_tree_count_subnets(pt->head4, 24);
+  return bgpstream_patricia_tree_count_subnets(
+    &pt->arena4, arena_node(&pt->arena4, pt->arena4.head), 24);
 }
 
 uint64_t bgpstream_patricia_tree_count_64subnets(bgpstream_patricia_tree_t *pt)
 {
-  return bgpstream_patricia_tree_count_subnets(pt->head6, 64);
+  return bgpstream_patricia_tree_count_subnets(
+    &pt->arena6, arena_node(&pt->arena6, pt->arena6.head), 64);
 }
 
 int bgpstream_patricia_tree_get_more_specifics(
@@ -988,12 +1153,14 @@ int bgpstream_patricia_tree_get_more_specifics(
   bgpstream_patricia_tree_result_set_clear(results);
 
   if (node != NULL) { /* we do not return the node itself */
+    patricia_arena_t *a =
+      bgpstream_patricia_get_arena(pt, node->prefix.address.version);
     if (bgpstream_patricia_tree_add_more_specifics(
-          results, node->l, BGPSTREAM_PATRICIA_MAXBITS + 1) != 0) {
+          results, a, NODE_L(a, node), BGPSTREAM_PATRICIA_MAXBITS + 1) != 0) {
       return -1;
     }
     if (bgpstream_patricia_tree_add_more_specifics(
-          results, node->r, BGPSTREAM_PATRICIA_MAXBITS + 1) != 0) {
+          results, a, NODE_R(a, node), BGPSTREAM_PATRICIA_MAXBITS + 1) != 0) {
       return -1;
     }
   }
@@ -1009,8 +1176,11 @@ int bgpstream_patricia_tree_get_mincovering_prefix(
   if (node == NULL) {
     return 0;
   }
+  patricia_arena_t *a =
+    bgpstream_patricia_get_arena(pt, node->prefix.address.version);
   /* we do not return the node itself (that's why we pass the parent node) */
-  return bgpstream_patricia_tree_add_less_specifics(results, node->parent, 1);
+  return bgpstream_patricia_tree_add_less_specifics(results, a,
+                                                    NODE_PARENT(a, node), 1);
 }
 
 int bgpstream_patricia_tree_get_less_specifics(
@@ -1022,9 +1192,11 @@ int bgpstream_patricia_tree_get_less_specifics(
   if (node == NULL) {
     return 0;
   }
+  patricia_arena_t *a =
+    bgpstream_patricia_get_arena(pt, node->prefix.address.version);
   /* we do not return the node itself (that's why we pass the parent node) */
   return bgpstream_patricia_tree_add_less_specifics(
-    results, node->parent, BGPSTREAM_PATRICIA_MAXBITS + 1);
+    results, a, NODE_PARENT(a, node), BGPSTREAM_PATRICIA_MAXBITS + 1);
 }
 
 int bgpstream_patricia_tree_get_minimum_coverage(
@@ -1032,9 +1204,10 @@ int bgpstream_patricia_tree_get_minimum_coverage(
   bgpstream_patricia_tree_result_set_t *results)
 {
   bgpstream_patricia_tree_result_set_clear(results);
-  bgpstream_patricia_node_t *head = bgpstream_patricia_get_head(pt, v);
+  patricia_arena_t *a = bgpstream_patricia_get_arena(pt, v);
   /* we stop at the first layer, hence depth = 1 */
-  return bgpstream_patricia_tree_add_more_specifics(results, head, 1);
+  return bgpstream_patricia_tree_add_more_specifics(results, a,
+                                                    arena_node(a, a->head), 1);
 }
 
 uint8_t
@@ -1042,24 +1215,27 @@ bgpstream_patricia_tree_get_node_overlap_info(bgpstream_patricia_tree_t *pt,
                                               bgpstream_patricia_node_t *node)
 {
   uint8_t mask = BGPSTREAM_PATRICIA_EXACT_MATCH;
+  patricia_arena_t *a =
+    bgpstream_patricia_get_arena(pt, node->prefix.address.version);
 
-  bgpstream_patricia_node_t *node_it = node->parent;
+  bgpstream_patricia_node_t *node_it = NODE_PARENT(a, node);
   while (node_it != NULL) {
-    if (node_it->prefix.address.version != BGPSTREAM_ADDR_VERSION_UNKNOWN) {
+    if (!node_it->glue) {
       /* one more specific found */
       mask = mask | BGPSTREAM_PATRICIA_LESS_SPECIFICS;
       break;
     }
-    node_it = node_it->parent;
+    node_it = NODE_PARENT(a, node_it);
   }
 
   node_it = node;
   if (node_it != NULL) { /* we do not consider the node itself */
     /* if one of the subtree return 1 we can avoid the other */
-    if (bgpstream_patricia_tree_find_more_specific(node->l) == 1) {
+    if (bgpstream_patricia_tree_find_more_specific(a, NODE_L(a, node)) == 1) {
       mask = mask | BGPSTREAM_PATRICIA_MORE_SPECIFICS;
     } else {
-      if (bgpstream_patricia_tree_find_more_specific(node->r) == 1) {
+      if (bgpstream_patricia_tree_find_more_specific(a, NODE_R(a, node)) ==
+          1) {
         mask = mask | BGPSTREAM_PATRICIA_MORE_SPECIFICS;
       }
     }
@@ -1075,31 +1251,37 @@ void bgpstream_patricia_tree_merge(bgpstream_patricia_tree_t *dst,
     return;
   }
   /* Merge IPv4 */
-  bgpstream_patricia_tree_merge_tree(dst, src->head4);
+  bgpstream_patricia_tree_merge_tree(
+    dst, &src->arena4, arena_node(&src->arena4, src->arena4.head));
   /* Merge IPv6 */
-  bgpstream_patricia_tree_merge_tree(dst, src->head6);
+  bgpstream_patricia_tree_merge_tree(
+    dst, &src->arena6, arena_node(&src->arena6, src->arena6.head));
 }
 
 void bgpstream_patricia_tree_walk(bgpstream_patricia_tree_t *pt,
                                   bgpstream_patricia_tree_process_node_t *fun,
                                   void *data)
 {
-  bgpstream_patricia_tree_walk_tree(pt, pt->head4, fun, data);
-  bgpstream_patricia_tree_walk_tree(pt, pt->head6, fun, data);
+  bgpstream_patricia_tree_walk_tree(
+    pt, &pt->arena4, arena_node(&pt->arena4, pt->arena4.head), fun, data);
+  bgpstream_patricia_tree_walk_tree(
+    pt, &pt->arena6, arena_node(&pt->arena6, pt->arena6.head), fun, data);
 }
 
 void bgpstream_patricia_tree_print(bgpstream_patricia_tree_t *pt)
 {
-  bgpstream_patricia_tree_print_tree(pt->head4);
-  bgpstream_patricia_tree_print_tree(pt->head6);
+  bgpstream_patricia_tree_print_tree(&pt->arena4,
+                                     arena_node(&pt->arena4, pt->arena4.head));
+  bgpstream_patricia_tree_print_tree(&pt->arena6,
+                                     arena_node(&pt->arena6, pt->arena6.head));
 }
 
 bgpstream_pfx_t *
 bgpstream_patricia_tree_get_pfx(bgpstream_patricia_node_t *node)
 {
   assert(node);
-  if (node->prefix.address.version != BGPSTREAM_ADDR_VERSION_UNKNOWN) {
-    return (bgpstream_pfx_t *)&node->prefix;
+  if (!node->glue) {
+    return &node->prefix;
   }
   return NULL;
 }
@@ -1108,19 +1290,19 @@ void bgpstream_patricia_tree_clear(bgpstream_patricia_tree_t *pt)
 {
   assert(pt);
 
-  bgpstream_patricia_tree_destroy_tree(pt, pt->head4);
+  arena_clear(pt, &pt->arena4);
   pt->ipv4_active_nodes = 0;
-  pt->head4 = NULL;
 
-  bgpstream_patricia_tree_destroy_tree(pt, pt->head6);
+  arena_clear(pt, &pt->arena6);
   pt->ipv6_active_nodes = 0;
-  pt->head6 = NULL;
 }
 
 void bgpstream_patricia_tree_destroy(bgpstream_patricia_tree_t *pt)
 {
   if (pt != NULL) {
     bgpstream_patricia_tree_clear(pt);
+    arena_destroy(&pt->arena4);
+    arena_destroy(&pt->arena6);
     free(pt);
   }
 }
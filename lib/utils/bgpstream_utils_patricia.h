@@ -335,6 +335,12 @@ void bgpstream_patricia_tree_print(bgpstream_patricia_tree_t *pt);
 /** Clear the given Patricia Tree (i.e. remove all prefixes)
  *
  * @param pt           pointer to the patricia tree to clear
+ *
+ * Nodes are allocated in bulk from memory owned by the tree, so unless a user
+ * destructor was given to bgpstream_patricia_tree_create, this is a constant
+ * time operation. The memory is kept by the tree and reused by subsequent
+ * insertions; it is only released by bgpstream_patricia_tree_destroy. Any node
+ * pointer obtained before the call becomes invalid.
  */
 void bgpstream_patricia_tree_clear(bgpstream_patricia_tree_t *pt);
 
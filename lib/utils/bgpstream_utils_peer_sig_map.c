@@ -35,6 +35,12 @@
 #define IPV4_ID_OFFSET 1
 #define IPV6_ID_OFFSET 1
 
+/** Number of collectors with a peer ID cache */
+#define COLLECTOR_CACHE_CNT 8
+
+/** Number of peer IDs cached per collector (must be a power of two) */
+#define PEER_CACHE_CNT 64
+
 /** Hash a peer signature into a 64bit number
  *
  * @param               the peer signature to hash
@@ -77,12 +83,41 @@ KHASH_INIT(bgpstream_peer_sig_id_map, bgpstream_peer_sig_t *,
 KHASH_INIT(bgpstream_peer_id_sig_map, bgpstream_peer_id_t,
            bgpstream_peer_sig_t *, 1, kh_int_hash_func, kh_int_hash_equal);
 
+/** Direct-mapped cache of the peers last seen from a collector, indexed by
+    the hash of the peer IP */
+typedef struct collector_cache {
+
+  /** Name of the collector */
+  char collector_str[BGPSTREAM_UTILS_STR_NAME_LEN];
+
+  struct {
+    /** Signature of the cached peer (owned by the map), NULL if unused */
+    bgpstream_peer_sig_t *ps;
+
+    /** ID of the cached peer */
+    bgpstream_peer_id_t id;
+  } peers[PEER_CACHE_CNT];
+
+} collector_cache_t;
+
 /** Structure representing an instance of a Peer Signature Map */
 struct bgpstream_peer_sig_map {
   khash_t(bgpstream_peer_sig_id_map) * ps_id;
   khash_t(bgpstream_peer_id_sig_map) * id_ps;
   bgpstream_peer_id_t v4_next_id;
   bgpstream_peer_id_t v6_next_id;
+
+  /** Per-collector caches of recently seen peers */
+  collector_cache_t collectors[COLLECTOR_CACHE_CNT];
+
+  /** Number of collector caches in use */
+  int collectors_cnt;
+
+  /** Cache used by the last lookup */
+  int last_collector;
+
+  /** Cache to reuse when a new collector is seen and all are in use */
+  int next_victim;
 };
 
 /* PRIVATE FUNCTIONS (static) */
@@ -92,52 +127,105 @@ static void sig_free(bgpstream_peer_sig_t *sig)
   free(sig);
 }
 
-static bgpstream_peer_id_t
+/* look up the signature in the map, adding a copy of it if it is not there
+   already. returns the signature owned by the map, or NULL on failure */
+static bgpstream_peer_sig_t *
 bgpstream_peer_sig_map_set_and_get_ps(bgpstream_peer_sig_map_t *map,
-                                      bgpstream_peer_sig_t *ps)
+                                      bgpstream_peer_sig_t *key,
+                                      bgpstream_peer_id_t *id)
 {
+  bgpstream_peer_sig_t *ps;
   khiter_t k;
   int khret;
   bgpstream_peer_id_t new_id;
 
-  if ((k = kh_get(bgpstream_peer_sig_id_map, map->ps_id, ps)) ==
+  if ((k = kh_get(bgpstream_peer_sig_id_map, map->ps_id, key)) !=
       kh_end(map->ps_id)) {
-    /* was not already in the map */
-    /* what ID should we use? */
-    if (map->v4_next_id >= IPV6_ID_OFFSET) {
-      /* v4 peers are in v6 range */
-      /* regardless of the version, use the v6 id */
-      new_id = map->v6_next_id++;
-    } else if (ps->peer_ip_addr.version == BGPSTREAM_ADDR_VERSION_IPV6) {
-      assert(map->v4_next_id < IPV6_ID_OFFSET);
-      new_id = map->v6_next_id++;
-    } else {
-      new_id = map->v4_next_id++;
-    }
+    /* already exists... */
+    *id = kh_value(map->ps_id, k);
+    return kh_key(map->ps_id, k);
+  }
 
-    /* insert into both maps */
-    k = kh_put(bgpstream_peer_sig_id_map, map->ps_id, ps, &khret);
-    kh_value(map->ps_id, k) = new_id;
-    k = kh_put(bgpstream_peer_id_sig_map, map->id_ps, new_id, &khret);
-    kh_value(map->id_ps, k) = ps;
+  /* was not already in the map */
+  if ((ps = malloc(sizeof(bgpstream_peer_sig_t))) == NULL) {
+    return NULL;
+  }
+  *ps = *key;
+
+  /* what ID should we use? */
+  if (map->v4_next_id >= IPV6_ID_OFFSET) {
+    /* v4 peers are in v6 range */
+    /* regardless of the version, use the v6 id */
+    new_id = map->v6_next_id++;
+  } else if (ps->peer_ip_addr.version == BGPSTREAM_ADDR_VERSION_IPV6) {
+    assert(map->v4_next_id < IPV6_ID_OFFSET);
+    new_id = map->v6_next_id++;
+  } else {
+    new_id = map->v4_next_id++;
+  }
 
-    return new_id;
+  /* insert into both maps */
+  k = kh_put(bgpstream_peer_sig_id_map, map->ps_id, ps, &khret);
+  if (khret < 0) {
+    free(ps);
+    return NULL;
+  }
+  kh_value(map->ps_id, k) = new_id;
+  k = kh_put(bgpstream_peer_id_sig_map, map->id_ps, new_id, &khret);
+  if (khret < 0) {
+    kh_del(bgpstream_peer_sig_id_map, map->ps_id,
+           kh_get(bgpstream_peer_sig_id_map, map->ps_id, ps));
+    free(ps);
+    return NULL;
+  }
+  kh_value(map->id_ps, k) = ps;
+
+  *id = new_id;
+  return ps;
+}
+
+/* find (or claim) the peer cache for the given collector */
+static collector_cache_t *get_collector_cache(bgpstream_peer_sig_map_t *map,
+                                              const char *collector_str)
+{
+  collector_cache_t *cc;
+  int i;
+
+  /* records usually come in runs from the same collector */
+  cc = &map->collectors[map->last_collector];
+  if (map->collectors_cnt > 0 && strcmp(cc->collector_str, collector_str) == 0) {
+    return cc;
+  }
+
+  for (i = 0; i < map->collectors_cnt; i++) {
+    if (strcmp(map->collectors[i].collector_str, collector_str) == 0) {
+      map->last_collector = i;
+      return &map->collectors[i];
+    }
+  }
+
+  if (map->collectors_cnt < COLLECTOR_CACHE_CNT) {
+    i = map->collectors_cnt++;
   } else {
-    /* already exists... */
-    free(ps); /* it was mallocd for us...*/
-    return kh_value(map->ps_id, k);
+    i = map->next_victim;
+    map->next_victim = (map->next_victim + 1) % COLLECTOR_CACHE_CNT;
   }
-  return 0;
+  cc = &map->collectors[i];
+  strcpy(cc->collector_str, collector_str);
+  memset(cc->peers, 0, sizeof(cc->peers));
+  map->last_collector = i;
+  return cc;
 }
 
 /* PROTECTED FUNCTIONS (_int.h) */
 
 khint64_t bgpstream_peer_sig_hash(bgpstream_peer_sig_t *ps)
 {
-  /* assuming that the number of peers that have the same ip and belong to two
-   * different collectors is low (in this specific case there will be a
-   * collision in terms of hash). */
-  return bgpstream_addr_storage_hash(&ps->peer_ip_addr);
+  /* the collector is part of the hash so that peers that share an IP across
+   * collectors (e.g. route servers at IXPs) do not collide. the AS number is
+   * not, since it is not considered by bgpstream_peer_sig_equal. */
+  return bgpstream_addr_storage_hash(&ps->peer_ip_addr) ^
+         (kh_str_hash_func(ps->collector_str) * 2654435761U);
 }
 
 /** @note we do not need to take into account the peer AS number
@@ -182,20 +270,34 @@ bgpstream_peer_id_t bgpstream_peer_sig_map_get_id(
   bgpstream_peer_sig_map_t *map, char *collector_str,
   bgpstream_ip_addr_t *peer_ip_addr, uint32_t peer_asnumber)
 {
-  bgpstream_peer_sig_t *new_ps;
-  if ((new_ps = malloc(sizeof(bgpstream_peer_sig_t))) == NULL) {
-    return -1;
+  collector_cache_t *cc;
+  bgpstream_peer_sig_t key;
+  bgpstream_peer_sig_t *ps;
+  bgpstream_peer_id_t id;
+  uint32_t slot;
+
+  /* fast path: recently seen peer of this collector */
+  cc = get_collector_cache(map, collector_str);
+  slot = bgpstream_addr_storage_hash((bgpstream_addr_storage_t *)peer_ip_addr) &
+         (PEER_CACHE_CNT - 1);
+  if (cc->peers[slot].ps != NULL &&
+      bgpstream_addr_equal((bgpstream_ip_addr_t *)&cc->peers[slot]
+                             .ps->peer_ip_addr,
+                           peer_ip_addr)) {
+    return cc->peers[slot].id;
   }
 
-  new_ps->peer_ip_addr.version = peer_ip_addr->version;
+  /* probe the map with a key on the stack, it is only copied if the peer is
+     new */
+  key.peer_ip_addr.version = peer_ip_addr->version;
   switch (peer_ip_addr->version) {
   case BGPSTREAM_ADDR_VERSION_IPV4:
-    memcpy(&new_ps->peer_ip_addr.ipv4.s_addr,
+    memcpy(&key.peer_ip_addr.ipv4.s_addr,
            &((bgpstream_ipv4_addr_t *)peer_ip_addr)->ipv4.s_addr,
            sizeof(uint32_t));
     break;
   case BGPSTREAM_ADDR_VERSION_IPV6:
-    memcpy(&new_ps->peer_ip_addr.ipv6.s6_addr,
+    memcpy(&key.peer_ip_addr.ipv6.s6_addr,
            &((bgpstream_ipv6_addr_t *)peer_ip_addr)->ipv6.s6_addr,
            sizeof(uint8_t) * 16);
     break;
@@ -204,10 +306,16 @@ bgpstream_peer_id_t bgpstream_peer_sig_map_get_id(
     assert(0);
   }
 
-  strcpy(new_ps->collector_str, collector_str);
-  new_ps->peer_asnumber = peer_asnumber;
+  strcpy(key.collector_str, collector_str);
+  key.peer_asnumber = peer_asnumber;
 
-  return bgpstream_peer_sig_map_set_and_get_ps(map, new_ps);
+  if ((ps = bgpstream_peer_sig_map_set_and_get_ps(map, &key, &id)) == NULL) {
+    return -1;
+  }
+
+  cc->peers[slot].ps = ps;
+  cc->peers[slot].id = id;
+  return id;
 }
 
 bgpstream_peer_sig_t *
@@ -252,4 +360,9 @@ void bgpstream_peer_sig_map_clear(bgpstream_peer_sig_map_t *map)
   kh_free_vals(bgpstream_peer_id_sig_map, map->id_ps, sig_free);
   kh_clear(bgpstream_peer_id_sig_map, map->id_ps);
   kh_clear(bgpstream_peer_sig_id_map, map->ps_id);
+
+  /* the cached signatures have been freed */
+  map->collectors_cnt = 0;
+  map->last_collector = 0;
+  map->next_victim = 0;
 }
@@ -36,6 +36,7 @@
 
 #include "khash.h"
 
+#include "bgpstream_utils_fmt.h"
 #include "bgpstream_utils_pfx.h"
 
 char *bgpstream_pfx_snprintf(char *buf, size_t len, bgpstream_pfx_t *pfx)
@@ -43,7 +44,7 @@ char *bgpstream_pfx_snprintf(char *buf, size_t len, bgpstream_pfx_t *pfx)
   char *p = buf;
 
   /* print the address */
-  if (bgpstream_addr_ntop(buf, len, &(pfx->address)) == NULL) {
+  if (bgpstream_fmt_addr_ntop(buf, len, &(pfx->address)) == NULL) {
     return NULL;
   }
 
@@ -53,7 +54,12 @@ char *bgpstream_pfx_snprintf(char *buf, size_t len, bgpstream_pfx_t *pfx)
   }
 
   /* print the mask */
-  snprintf(p, len, "/%" PRIu8, pfx->mask_len);
+  if (len > 1) {
+    *p = '/';
+    bgpstream_fmt_uint32_snprintf(p + 1, len - 1, pfx->mask_len);
+  } else if (len == 1) {
+    *p = '\0';
+  }
 
   return buf;
 }
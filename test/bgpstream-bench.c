@@ -0,0 +1,496 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Throughput benchmark over the bundled sample data.
+ *
+ * Each scenario reads one of the sample files through a data interface, and
+ * either only scans the records, extracts the elems, or also converts the
+ * elems to text. Each run happens in a child process, so that the memory
+ * figures of one scenario are not inflated by those that ran before it.
+ * Results are written as JSON, so that they can be compared between releases.
+ * This must be run from the directory that contains the sample files (as for
+ * the other tests).
+ */
+
+#include "bgpstream.h"
+#include "config.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef HAVE_MALLINFO2
+#include <malloc.h>
+#endif
+
+#define RIS_UPD "ris.rrc06.updates.1427846400.gz"
+#define RIS_RIB "ris.rrc06.ribs.1427846400.gz"
+#define RV_UPD "routeviews.route-views.jinx.updates.1427846400.bz2"
+#define RV_RIB "routeviews.route-views.jinx.ribs.1427846400.bz2"
+#define RISLIVE "ris-live-stream.json"
+#define CSV "csv_test.csv"
+
+/* what each scenario does with the records it reads */
+typedef enum {
+  /* only read the records */
+  MODE_RECORDS = 0,
+  /* extract all the elems */
+  MODE_ELEMS = 1,
+  /* extract all the elems and convert them to text */
+  MODE_TEXT = 2,
+} bench_mode_t;
+
+typedef struct bench_scenario {
+  /* unique name of the scenario */
+  const char *name;
+  /* data interface to use */
+  const char *interface;
+  /* singlefile options (NULL if unset) */
+  const char *rib_file;
+  const char *upd_file;
+  const char *upd_type;
+  /* csvfile option (NULL if unset) */
+  const char *csv_file;
+  /* filter string (NULL if unset) */
+  const char *filter;
+  bench_mode_t mode;
+} bench_scenario_t;
+
+static const bench_scenario_t scenarios[] = {
+  /* raw record scan */
+  {"mrt-bz2-records", "singlefile", RV_RIB, RV_UPD, NULL, NULL, NULL,
+   MODE_RECORDS},
+  {"mrt-gz-records", "singlefile", RIS_RIB, RIS_UPD, NULL, NULL, NULL,
+   MODE_RECORDS},
+  {"csvfile-records", "csvfile", NULL, NULL, NULL, CSV, NULL, MODE_RECORDS},
+
+  /* elem extraction */
+  {"mrt-bz2-elems", "singlefile", RV_RIB, RV_UPD, NULL, NULL, NULL,
+   MODE_ELEMS},
+  {"mrt-gz-elems", "singlefile", RIS_RIB, RIS_UPD, NULL, NULL, NULL,
+   MODE_ELEMS},
+  {"rislive-elems", "singlefile", NULL, RISLIVE, "ris-live", NULL, NULL,
+   MODE_ELEMS},
+
+  /* elem filters (one of each type) */
+  {"filter-peer", "singlefile", RIS_RIB, RIS_UPD, NULL, NULL, "peer 25152",
+   MODE_ELEMS},
+  {"filter-aspath-origin", "singlefile", RIS_RIB, RIS_UPD, NULL, NULL,
+   "aspath _23752$", MODE_ELEMS},
+  {"filter-prefix-more", "singlefile", RIS_RIB, RIS_UPD, NULL, NULL,
+   "prefix more 202.0.0.0/8", MODE_ELEMS},
+  {"filter-prefix-less", "singlefile", RIS_RIB, RIS_UPD, NULL, NULL,
+   "prefix less 202.70.88.0/24", MODE_ELEMS},
+  {"filter-community", "singlefile", RIS_RIB, RIS_UPD, NULL, NULL,
+   "community 2914:*", MODE_ELEMS},
+  {"filter-aspath", "singlefile", RIS_RIB, RIS_UPD, NULL, NULL,
+   "aspath _2914_", MODE_ELEMS},
+  {"filter-ipversion", "singlefile", RIS_RIB, RIS_UPD, NULL, NULL, "ipv 6",
+   MODE_ELEMS},
+  {"filter-elemtype", "singlefile", RIS_RIB, RIS_UPD, NULL, NULL,
+   "elemtype withdrawals", MODE_ELEMS},
+  {"filter-combined", "singlefile", RIS_RIB, RIS_UPD, NULL, NULL,
+   "peer 25152 and community 2914:* and ipv 4", MODE_ELEMS},
+
+  /* text output */
+  {"mrt-gz-text", "singlefile", RIS_RIB, RIS_UPD, NULL, NULL, NULL,
+   MODE_TEXT},
+  {"rislive-text", "singlefile", NULL, RISLIVE, "ris-live", NULL, NULL,
+   MODE_TEXT},
+};
+
+#define SCENARIOS_CNT (sizeof(scenarios) / sizeof(scenarios[0]))
+
+/* counters collected during one run of a scenario */
+typedef struct bench_result {
+  uint64_t records;
+  uint64_t valid_records;
+  uint64_t elems;
+  uint64_t output_bytes;
+  double wall_sec;
+  double cpu_sec;
+  /* high-water mark of the resident set of the process that ran it */
+  long peak_rss_kb;
+  /* heap in use at the end of the run, before the stream is destroyed */
+  size_t heap_in_use;
+} bench_result_t;
+
+static char elem_buf[65536];
+static char filter_buf[1024];
+
+static double mono_sec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_sec(void)
+{
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec +
+         ru.ru_stime.tv_usec / 1e6;
+}
+
+static long peak_rss_kb(void)
+{
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_maxrss;
+}
+
+static int set_option(bgpstream_t *bs, bgpstream_data_interface_id_t di_id,
+                      const char *name, const char *value)
+{
+  bgpstream_data_interface_option_t *option;
+
+  if (value == NULL) {
+    return 0;
+  }
+  if ((option = bgpstream_get_data_interface_option_by_name(bs, di_id, name)) ==
+        NULL ||
+      bgpstream_set_data_interface_option(bs, option, value) != 0) {
+    fprintf(stderr, "ERROR: Could not set option %s\n", name);
+    return -1;
+  }
+  return 0;
+}
+
+/* returns 1 if the scenario ran, 0 if it is not supported by this build, -1
+   on error */
+static int run_scenario(const bench_scenario_t *sc, bench_result_t *res)
+{
+  bgpstream_t *bs = NULL;
+  bgpstream_data_interface_id_t di_id;
+  bgpstream_record_t *rec;
+  bgpstream_elem_t *elem;
+  double wall_start, cpu_start;
+  int rrc, erc;
+
+  memset(res, 0, sizeof(*res));
+
+  if ((bs = bgpstream_create()) == NULL) {
+    fprintf(stderr, "ERROR: Could not create BGPStream instance\n");
+    return -1;
+  }
+
+  if ((di_id = bgpstream_get_data_interface_id_by_name(bs, sc->interface)) ==
+      0) {
+    bgpstream_destroy(bs);
+    return 0;
+  }
+  bgpstream_set_data_interface(bs, di_id);
+
+  if (set_option(bs, di_id, "rib-file", sc->rib_file) != 0 ||
+      set_option(bs, di_id, "upd-type", sc->upd_type) != 0 ||
+      set_option(bs, di_id, "upd-file", sc->upd_file) != 0 ||
+      set_option(bs, di_id, "csv-file", sc->csv_file) != 0) {
+    goto err;
+  }
+
+  if (sc->filter != NULL) {
+    // the parser tokenizes the string in place
+    strncpy(filter_buf, sc->filter, sizeof(filter_buf) - 1);
+    if (bgpstream_parse_filter_string(bs, filter_buf) == 0) {
+      fprintf(stderr, "ERROR: Could not parse filter '%s'\n", sc->filter);
+      goto err;
+    }
+  }
+
+  wall_start = mono_sec();
+  cpu_start = cpu_sec();
+
+  if (bgpstream_start(bs) != 0) {
+    fprintf(stderr, "ERROR: Could not start stream\n");
+    goto err;
+  }
+
+  while ((rrc = bgpstream_get_next_record(bs, &rec)) > 0) {
+    res->records++;
+    if (rec->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+      continue;
+    }
+    res->valid_records++;
+    if (sc->mode == MODE_RECORDS) {
+      continue;
+    }
+    while ((erc = bgpstream_record_get_next_elem(rec, &elem)) > 0) {
+      res->elems++;
+      if (sc->mode == MODE_TEXT) {
+        if (bgpstream_record_elem_snprintf(elem_buf, sizeof(elem_buf), rec,
+                                           elem) == NULL) {
+          fprintf(stderr, "ERROR: Could not convert elem to string\n");
+          goto err;
+        }
+        res->output_bytes += strlen(elem_buf) + 1;
+      }
+    }
+    if (erc < 0) {
+      fprintf(stderr, "ERROR: Could not extract elems\n");
+      goto err;
+    }
+  }
+  if (rrc < 0) {
+    fprintf(stderr, "ERROR: Could not read record\n");
+    goto err;
+  }
+
+  res->wall_sec = mono_sec() - wall_start;
+  res->cpu_sec = cpu_sec() - cpu_start;
+#ifdef HAVE_MALLINFO2
+  res->heap_in_use = mallinfo2().uordblks;
+#endif
+
+  bgpstream_destroy(bs);
+  res->peak_rss_kb = peak_rss_kb();
+  return 1;
+
+err:
+  bgpstream_destroy(bs);
+  return -1;
+}
+
+/* run the scenario in a child process (since the peak RSS of a process never
+   goes down), and collect its results through a pipe. returns as
+   run_scenario */
+static int run_scenario_forked(const bench_scenario_t *sc, bench_result_t *res)
+{
+  int fds[2];
+  pid_t pid;
+  int status;
+  int rc;
+  ssize_t len = 0, n;
+
+  if (pipe(fds) != 0) {
+    fprintf(stderr, "ERROR: Could not create pipe\n");
+    return -1;
+  }
+  fflush(stdout);
+  if ((pid = fork()) < 0) {
+    fprintf(stderr, "ERROR: Could not fork\n");
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+
+  if (pid == 0) {
+    close(fds[0]);
+    rc = run_scenario(sc, res);
+    if (rc > 0 && write(fds[1], res, sizeof(*res)) != sizeof(*res)) {
+      rc = -1;
+    }
+    close(fds[1]);
+    _exit(rc < 0 ? 2 : rc);
+  }
+
+  close(fds[1]);
+  while (len < (ssize_t)sizeof(*res) &&
+         (n = read(fds[0], (char *)res + len, sizeof(*res) - len)) > 0) {
+    len += n;
+  }
+  close(fds[0]);
+
+  if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+    fprintf(stderr, "ERROR: Scenario process did not exit cleanly\n");
+    return -1;
+  }
+  switch (WEXITSTATUS(status)) {
+  case 0:
+    return 0;
+  case 1:
+    return (len == sizeof(*res)) ? 1 : -1;
+  default:
+    return -1;
+  }
+}
+
+static double rate(uint64_t cnt, double sec)
+{
+  return (sec > 0) ? cnt / sec : 0;
+}
+
+/* the JSON output: one object per scenario, with the best (i.e. least noisy)
+   and mean times over all iterations */
+static void dump_result(FILE *out, const bench_scenario_t *sc, int first,
+                        const bench_result_t *best, double wall_sum,
+                        double cpu_sum, int iterations)
+{
+  fprintf(out, "%s\n    {\n", first ? "" : ",");
+  fprintf(out, "      \"name\": \"%s\",\n", sc->name);
+  fprintf(out, "      \"interface\": \"%s\",\n", sc->interface);
+  fprintf(out, "      \"mode\": \"%s\",\n",
+          sc->mode == MODE_RECORDS ? "records"
+                                   : sc->mode == MODE_ELEMS ? "elems" : "text");
+  fprintf(out, "      \"filter\": \"%s\",\n",
+          sc->filter != NULL ? sc->filter : "");
+  fprintf(out, "      \"records\": %" PRIu64 ",\n", best->records);
+  fprintf(out, "      \"valid_records\": %" PRIu64 ",\n", best->valid_records);
+  fprintf(out, "      \"elems\": %" PRIu64 ",\n", best->elems);
+  fprintf(out, "      \"output_bytes\": %" PRIu64 ",\n", best->output_bytes);
+  fprintf(out, "      \"wall_sec\": %.6f,\n", best->wall_sec);
+  fprintf(out, "      \"wall_sec_mean\": %.6f,\n", wall_sum / iterations);
+  fprintf(out, "      \"cpu_sec\": %.6f,\n", best->cpu_sec);
+  fprintf(out, "      \"cpu_sec_mean\": %.6f,\n", cpu_sum / iterations);
+  fprintf(out, "      \"records_per_sec\": %.1f,\n",
+          rate(best->records, best->wall_sec));
+  fprintf(out, "      \"elems_per_sec\": %.1f,\n",
+          rate(best->elems, best->wall_sec));
+  fprintf(out, "      \"peak_rss_kb\": %ld", best->peak_rss_kb);
+#ifdef HAVE_MALLINFO2
+  fprintf(out, ",\n      \"heap_in_use_bytes\": %zu", best->heap_in_use);
+#endif
+  fprintf(out, "\n    }");
+}
+
+static void usage(const char *name)
+{
+  size_t i;
+
+  fprintf(stderr,
+          "usage: %s [-n <iterations>] [-s <scenario>] [-o <file>] [-l]\n"
+          "   -n <iterations>  run each scenario this many times (default: 3)\n"
+          "   -s <scenario>    only run the given scenario (repeatable)\n"
+          "   -o <file>        write JSON results to the given file (default: "
+          "stdout)\n"
+          "   -l               list the scenarios and exit\n"
+          "scenarios:\n",
+          name);
+  for (i = 0; i < SCENARIOS_CNT; i++) {
+    fprintf(stderr, "   %s\n", scenarios[i].name);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  const char *only[SCENARIOS_CNT];
+  int only_cnt = 0;
+  int iterations = 3;
+  FILE *out = stdout;
+  const char *out_file = NULL;
+  bench_result_t res, best;
+  double wall_sum, cpu_sum;
+  int first = 1;
+  int opt, rc, it, j;
+  size_t i;
+
+  while ((opt = getopt(argc, argv, "n:s:o:lh")) >= 0) {
+    switch (opt) {
+    case 'n':
+      iterations = atoi(optarg);
+      break;
+    case 's':
+      if (only_cnt == (int)SCENARIOS_CNT) {
+        fprintf(stderr, "ERROR: Too many scenarios given\n");
+        return -1;
+      }
+      only[only_cnt++] = optarg;
+      break;
+    case 'o':
+      out_file = optarg;
+      break;
+    case 'l':
+      for (i = 0; i < SCENARIOS_CNT; i++) {
+        printf("%s\n", scenarios[i].name);
+      }
+      return 0;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if (iterations < 1) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  if (out_file != NULL && (out = fopen(out_file, "w")) == NULL) {
+    fprintf(stderr, "ERROR: Could not open %s for writing\n", out_file);
+    return -1;
+  }
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"version\": \"%d.%d.%d\",\n", BGPSTREAM_MAJOR_VERSION,
+          BGPSTREAM_MID_VERSION, BGPSTREAM_MINOR_VERSION);
+  fprintf(out, "  \"iterations\": %d,\n", iterations);
+  fprintf(out, "  \"scenarios\": [");
+
+  for (i = 0; i < SCENARIOS_CNT; i++) {
+    if (only_cnt > 0) {
+      for (j = 0; j < only_cnt; j++) {
+        if (strcmp(only[j], scenarios[i].name) == 0) {
+          break;
+        }
+      }
+      if (j == only_cnt) {
+        continue;
+      }
+    }
+
+    wall_sum = cpu_sum = 0;
+    for (it = 0; it < iterations; it++) {
+      fprintf(stderr, "%s: iteration %d/%d\n", scenarios[i].name, it + 1,
+              iterations);
+      if ((rc = run_scenario_forked(&scenarios[i], &res)) < 0) {
+        fprintf(stderr, "ERROR: Scenario %s failed\n", scenarios[i].name);
+        goto err;
+      }
+      if (rc == 0) {
+        break;
+      }
+      wall_sum += res.wall_sec;
+      cpu_sum += res.cpu_sec;
+      if (it == 0 || res.wall_sec < best.wall_sec) {
+        best = res;
+      }
+    }
+    if (rc == 0) {
+      fprintf(stderr, "%s: SKIPPED (%s data interface not available)\n",
+              scenarios[i].name, scenarios[i].interface);
+      continue;
+    }
+
+    dump_result(out, &scenarios[i], first, &best, wall_sum, cpu_sum,
+                iterations);
+    first = 0;
+  }
+
+  fprintf(out, "\n  ]\n}\n");
+
+  if (out != stdout) {
+    fclose(out);
+  }
+  return 0;
+
+err:
+  if (out != stdout) {
+    fclose(out);
+  }
+  return -1;
+}
@@ -129,6 +129,16 @@ int test_bgpstream_filters()
 
   CHECK("elem total count", counter == 7);
 
+  /* peer ASN, prefix and community predicates */
+  bgpstream_filter_stats_t stats[8];
+  int i, stats_cnt = bgpstream_get_filter_stats(bs, stats, 8);
+  CHECK("filter stats count", stats_cnt == 3);
+  for (i = 0; i < stats_cnt; i++) {
+    CHECK("filter stats consistency",
+          stats[i].name != NULL && stats[i].passed <= stats[i].evaluated);
+  }
+  CHECK("filter stats passed", stats[stats_cnt - 1].passed >= 7);
+
   TEARDOWN;
   return 0;
 }
@@ -0,0 +1,430 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+#include "bs_http_client.h"
+
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/* larger than two parts, and not a multiple of the part length */
+#define BIG_LEN (2 * BS_HTTP_PART_LEN + 12345)
+#define SMALL_LEN (1024 * 1024)
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* resource served by the test server */
+static uint8_t *data;
+static uint64_t data_len;
+
+/* if set, the next response is cut after this many bytes of body */
+static uint64_t drop_after;
+
+static pthread_mutex_t server_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char url[64];
+
+/* resource whose body never comes */
+static char stall_url[64];
+
+/* resource that is redirected (twice, with relative locations) to the
+   served one */
+static char redirect_url[64];
+
+/* resource that does not exist */
+static char missing_url[64];
+
+/* ========== TEST SERVER ========== */
+
+static int send_all(int fd, const void *buf, size_t len)
+{
+  ssize_t n;
+
+  while (len > 0) {
+    if ((n = send(fd, buf, len, MSG_NOSIGNAL)) <= 0) {
+      return -1;
+    }
+    buf = (const uint8_t *)buf + n;
+    len -= n;
+  }
+  return 0;
+}
+
+/* responses to the requests that do not get the served resource */
+static const char *canned_response(const char *req)
+{
+  if (strncmp(req, "GET /missing ", 13) == 0) {
+    return "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+  }
+  if (strncmp(req, "GET /redirect ", 14) == 0) {
+    return "HTTP/1.1 302 Found\r\nLocation: /dir/redirect\r\n"
+           "Content-Length: 0\r\n\r\n";
+  }
+  if (strncmp(req, "GET /dir/redirect ", 18) == 0) {
+    return "HTTP/1.1 301 Moved Permanently\r\nLocation: dump.gz\r\n"
+           "Content-Length: 0\r\n\r\n";
+  }
+  return NULL;
+}
+
+/* serve the requests of one (keep-alive) connection */
+static void *serve_conn(void *user)
+{
+  int fd = (int)(intptr_t)user;
+  char req[4096];
+  char hdr[256];
+  const char *canned;
+  char *range;
+  uint64_t first, last, len, drop;
+  size_t req_len;
+  ssize_t n;
+  int hdr_len;
+
+  for (;;) {
+    // read the request headers
+    req_len = 0;
+    while (req_len < sizeof(req) - 1) {
+      if ((n = recv(fd, req + req_len, sizeof(req) - 1 - req_len, 0)) <= 0) {
+        goto done;
+      }
+      req_len += n;
+      req[req_len] = '\0';
+      if (strstr(req, "\r\n\r\n") != NULL) {
+        break;
+      }
+    }
+
+    if ((canned = canned_response(req)) != NULL) {
+      if (send_all(fd, canned, strlen(canned)) != 0) {
+        goto done;
+      }
+      continue;
+    }
+
+    first = 0;
+    last = data_len - 1;
+    if ((range = strstr(req, "Range: bytes=")) != NULL) {
+      first = strtoull(range + 13, &range, 10);
+      if (range[1] >= '0' && range[1] <= '9') {
+        last = strtoull(range + 1, NULL, 10);
+      }
+      if (last >= data_len) {
+        last = data_len - 1;
+      }
+    }
+    len = last - first + 1;
+
+    if (range != NULL) {
+      hdr_len = snprintf(hdr, sizeof(hdr),
+                         "HTTP/1.1 206 Partial Content\r\nContent-Length: "
+                         "%" PRIu64 "\r\nContent-Range: bytes %" PRIu64
+                         "-%" PRIu64 "/%" PRIu64 "\r\n\r\n",
+                         len, first, last, data_len);
+    } else {
+      hdr_len = snprintf(hdr, sizeof(hdr),
+                         "HTTP/1.1 200 OK\r\nContent-Length: %" PRIu64
+                         "\r\n\r\n",
+                         len);
+    }
+
+    pthread_mutex_lock(&server_mutex);
+    drop = drop_after;
+    drop_after = 0;
+    pthread_mutex_unlock(&server_mutex);
+
+    if (send_all(fd, hdr, hdr_len) != 0) {
+      goto done;
+    }
+    if (strncmp(req, "GET /stall", 10) == 0) {
+      // wait for the client to give up
+      while (recv(fd, req, sizeof(req), 0) > 0) {
+      }
+      goto done;
+    }
+    if (drop > 0) {
+      send_all(fd, data + first, drop);
+      goto done;
+    }
+    if (send_all(fd, data + first, len) != 0) {
+      goto done;
+    }
+  }
+
+done:
+  close(fd);
+  return NULL;
+}
+
+static void *server_thread(void *user)
+{
+  int listen_fd = (int)(intptr_t)user;
+  pthread_t thread;
+  int fd;
+
+  while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+    if (pthread_create(&thread, NULL, serve_conn, (void *)(intptr_t)fd) != 0) {
+      close(fd);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+  return NULL;
+}
+
+static int start_server()
+{
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof(addr);
+  pthread_t thread;
+  int fd;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+      bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(fd, 16) != 0 ||
+      getsockname(fd, (struct sockaddr *)&addr, &addr_len) != 0 ||
+      pthread_create(&thread, NULL, server_thread, (void *)(intptr_t)fd) !=
+        0) {
+    return -1;
+  }
+  pthread_detach(thread);
+
+  snprintf(url, sizeof(url), "http://127.0.0.1:%d/dump.gz",
+           ntohs(addr.sin_port));
+  snprintf(stall_url, sizeof(stall_url), "http://127.0.0.1:%d/stall",
+           ntohs(addr.sin_port));
+  snprintf(redirect_url, sizeof(redirect_url), "http://127.0.0.1:%d/redirect",
+           ntohs(addr.sin_port));
+  snprintf(missing_url, sizeof(missing_url), "http://127.0.0.1:%d/missing",
+           ntohs(addr.sin_port));
+  return 0;
+}
+
+static void set_data(uint64_t len)
+{
+  uint64_t i;
+
+  data_len = len;
+  for (i = 0; i < len; i++) {
+    data[i] = (i * 7 + i / 251) & 0xff;
+  }
+}
+
+/* ========== TESTS ========== */
+
+/* read the given range and compare it with the served resource */
+static int read_range(const char *res_url, uint64_t start, uint64_t end)
+{
+  static uint8_t buf[SMALL_LEN];
+  bs_http_req_t *req;
+  uint64_t len = 0;
+  int64_t n;
+
+  if ((req = bs_http_open(res_url, start, end, NULL, NULL)) == NULL) {
+    return -1;
+  }
+  while ((n = bs_http_read(req, buf + len, sizeof(buf) - len)) > 0) {
+    len += n;
+  }
+  if (n < 0 || bs_http_get_length(req) != (int64_t)data_len) {
+    bs_http_close(req);
+    return -1;
+  }
+  bs_http_close(req);
+
+  if (end == 0) {
+    end = data_len;
+  }
+  return (len == end - start && memcmp(buf, data + start, len) == 0) ? 0 : -1;
+}
+
+static int test_http_read()
+{
+  uint64_t conn_cnt;
+
+  set_data(SMALL_LEN);
+
+  CHECK("Read whole resource", read_range(url, 0, 0) == 0);
+  conn_cnt = bs_http_get_conn_cnt();
+  CHECK("Read range", read_range(url, 1000, 2000) == 0);
+  CHECK("Read range to the end", read_range(url, SMALL_LEN - 10, 0) == 0);
+  CHECK("Connection reuse", bs_http_get_conn_cnt() == conn_cnt);
+
+  pthread_mutex_lock(&server_mutex);
+  drop_after = 100000;
+  pthread_mutex_unlock(&server_mutex);
+  CHECK("Resume dropped transfer", read_range(url, 0, 0) == 0);
+  CHECK("Resume on a new connection", bs_http_get_conn_cnt() == conn_cnt + 1);
+
+  CHECK("Follow relative redirects", read_range(redirect_url, 0, 0) == 0);
+  CHECK("Missing resource", bs_http_open(missing_url, 0, 0, NULL, NULL) ==
+                              NULL);
+
+  return 0;
+}
+
+static int test_http_download()
+{
+  char path[] = "/tmp/bgpstream-test-http.XXXXXX";
+  uint8_t *buf = NULL;
+  FILE *fh;
+  size_t len;
+  int fd;
+  int ret = -1;
+
+  set_data(BIG_LEN);
+
+  CHECK("Create temporary file", (fd = mkstemp(path)) >= 0);
+  close(fd);
+
+  if (bs_http_download(url, path, 4) == 0 &&
+      (buf = malloc(BIG_LEN + 1)) != NULL &&
+      (fh = fopen(path, "r")) != NULL) {
+    len = fread(buf, 1, BIG_LEN + 1, fh);
+    fclose(fh);
+    ret = (len == BIG_LEN && memcmp(buf, data, len) == 0) ? 0 : -1;
+  }
+  free(buf);
+  remove(path);
+  CHECK("Parallel download", ret == 0);
+
+  return 0;
+}
+
+/* read the whole pipe into buf, returning the number of bytes read */
+static size_t read_pipe(int fd, uint8_t *buf, size_t len)
+{
+  size_t off = 0;
+  ssize_t n;
+
+  while (off < len && (n = read(fd, buf + off, len - off)) > 0) {
+    off += n;
+  }
+  return off;
+}
+
+static int test_http_download_stream()
+{
+  char path[] = "/tmp/bgpstream-test-http.XXXXXX";
+  bs_http_download_t *dl;
+  uint8_t *buf = NULL;
+  size_t len = 0;
+  time_t start;
+  int fds[2];
+  int fd;
+
+  set_data(BIG_LEN);
+
+  CHECK("Create temporary file", (fd = mkstemp(path)) >= 0);
+  close(fd);
+  CHECK("Create pipe", pipe(fds) == 0 && (buf = malloc(BIG_LEN + 1)) != NULL);
+
+  CHECK("Start streamed download",
+        (dl = bs_http_download_start(url, path, 4, fds[1])) != NULL);
+  len = read_pipe(fds[0], buf, BIG_LEN + 1);
+  close(fds[0]);
+  CHECK("Finish streamed download", bs_http_download_finish(dl, 0) == 0);
+  CHECK("Streamed content", len == BIG_LEN && memcmp(buf, data, len) == 0);
+  CHECK("Streamed download file", access(path, F_OK) == 0);
+  remove(path);
+
+  /* the reader goes away early */
+  CHECK("Create pipe", pipe(fds) == 0);
+  CHECK("Start aborted download",
+        (dl = bs_http_download_start(url, path, 4, fds[1])) != NULL);
+  close(fds[0]);
+  if (bs_http_download_finish(dl, 1) == 0) {
+    // the download ended before it was stopped
+    remove(path);
+  }
+  CHECK("Aborted download file removed", access(path, F_OK) != 0);
+
+  /* no file: the bytes go straight to the pipe */
+  CHECK("Create pipe", pipe(fds) == 0);
+  CHECK("Start stream-only download",
+        (dl = bs_http_download_start(url, NULL, 4, fds[1])) != NULL);
+  len = read_pipe(fds[0], buf, BIG_LEN + 1);
+  close(fds[0]);
+  CHECK("Finish stream-only download", bs_http_download_finish(dl, 0) == 0);
+  CHECK("Stream-only content", len == BIG_LEN && memcmp(buf, data, len) == 0);
+
+  /* stopping a stalled stream ends it, so that its reader can go away */
+  CHECK("Create pipe", pipe(fds) == 0);
+  CHECK("Start stalled stream",
+        (dl = bs_http_download_start(stall_url, NULL, 1, fds[1])) != NULL);
+  start = time(NULL);
+  bs_http_download_stop(dl);
+  CHECK("Stalled stream ended", read_pipe(fds[0], buf, 1) == 0);
+  close(fds[0]);
+  CHECK("Finish stalled stream", bs_http_download_finish(dl, 1) != 0);
+  CHECK("Stalled stream stopped promptly", time(NULL) - start < 5);
+
+  /* the server turns the request down: nothing is written */
+  CHECK("Create pipe", pipe(fds) == 0);
+  CHECK("Start missing download",
+        bs_http_download_start(missing_url, path, 4, fds[1]) == NULL);
+  CHECK("Missing download not streamed", read_pipe(fds[0], buf, 1) == 0);
+  close(fds[0]);
+  CHECK("Missing download file removed", access(path, F_OK) != 0);
+
+  /* the server stops sending: stopping must not wait for it to time out */
+  CHECK("Start stalled download",
+        (dl = bs_http_download_start(stall_url, path, 1, -1)) != NULL);
+  sleep(1); // so that it waits for the body
+  start = time(NULL);
+  CHECK("Abort stalled download", bs_http_download_finish(dl, 1) != 0);
+  CHECK("Stalled download aborted promptly", time(NULL) - start < 5);
+  CHECK("Stalled download file removed", access(path, F_OK) != 0);
+
+  free(buf);
+  return 0;
+}
+
+int main()
+{
+  CHECK("Allocate resource", (data = malloc(BIG_LEN)) != NULL);
+  CHECK("Start HTTP server", start_server() == 0);
+
+  CHECK_SECTION("HTTP read", test_http_read() == 0);
+  CHECK_SECTION("HTTP download", test_http_download() == 0);
+  CHECK_SECTION("HTTP streamed download", test_http_download_stream() == 0);
+
+  bs_http_pool_clear();
+  free(data);
+  return 0;
+}
@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COLLECTOR "rrc00"
+#define PEER_A_IP "192.0.2.1"
+#define PEER_A_ASN 65001
+#define PEER_B_IP "2001:db8::1"
+#define PEER_B_ASN 65002
+
+#define PFX_1 "203.0.113.0/24"
+#define PFX_2 "198.51.100.0/24"
+#define PFX_3 "2001:db8:1::/48"
+
+#define RIB_TIME_1 1000
+#define RIB_TIME_2 2000
+
+static bgpstream_rib_t *rib;
+static bgpstream_elem_t *elem;
+
+/* only the record header fields are used by the engine */
+static bgpstream_record_t record_buf;
+static bgpstream_record_t *record = &record_buf;
+
+/* fill the (global) record and elem with a route of the given peer */
+static void set_elem(bgpstream_record_type_t rec_type, uint32_t time,
+                     bgpstream_elem_type_t type, char *peer_ip,
+                     uint32_t peer_asn, const char *pfx, uint32_t origin_asn)
+{
+  bgpstream_as_path_seg_asn_t segs[2];
+  bgpstream_community_t comm;
+
+  record->type = rec_type;
+  record->time_sec = time;
+  strcpy(record->collector_name, COLLECTOR);
+
+  bgpstream_elem_clear(elem);
+  elem->type = type;
+  bgpstream_str2addr(peer_ip, &elem->peer_ip);
+  elem->peer_asn = peer_asn;
+  if (pfx != NULL) {
+    bgpstream_str2pfx(pfx, &elem->prefix);
+  }
+
+  segs[0].type = BGPSTREAM_AS_PATH_SEG_ASN;
+  segs[0].asn = peer_asn;
+  segs[1].type = BGPSTREAM_AS_PATH_SEG_ASN;
+  segs[1].asn = origin_asn;
+  bgpstream_as_path_populate_from_data(elem->as_path, (uint8_t *)segs,
+                                       sizeof(segs));
+
+  /* tag routes with the origin */
+  comm.asn = peer_asn;
+  comm.value = origin_asn;
+  bgpstream_community_set_insert(elem->communities, &comm);
+}
+
+static int apply(bgpstream_record_type_t rec_type, uint32_t time,
+                 bgpstream_elem_type_t type, char *peer_ip, uint32_t peer_asn,
+                 const char *pfx, uint32_t origin_asn)
+{
+  set_elem(rec_type, time, type, peer_ip, peer_asn, pfx, origin_asn);
+  return bgpstream_rib_apply_elem(rib, record, elem);
+}
+
+static bgpstream_peer_id_t peer_id(char *peer_ip, uint32_t peer_asn)
+{
+  bgpstream_addr_storage_t addr;
+
+  bgpstream_str2addr(peer_ip, &addr);
+  return bgpstream_peer_sig_map_get_id(bgpstream_rib_get_peer_sig_map(rib),
+                                       COLLECTOR, (bgpstream_ip_addr_t *)&addr,
+                                       peer_asn);
+}
+
+static int has_route(bgpstream_peer_id_t id, const char *pfx_str,
+                     bgpstream_rib_route_t *route)
+{
+  bgpstream_pfx_storage_t pfx;
+
+  bgpstream_str2pfx(pfx_str, &pfx);
+  return bgpstream_rib_get_route(rib, id, (bgpstream_pfx_t *)&pfx, route);
+}
+
+/* the origin ASN of the route, using the path store */
+static uint32_t route_origin(bgpstream_peer_id_t id,
+                             bgpstream_rib_route_t *route)
+{
+  bgpstream_as_path_store_path_t *spath;
+  bgpstream_as_path_t *path;
+  uint32_t origin = 0;
+
+  spath = bgpstream_as_path_store_get_store_path(
+    bgpstream_rib_get_as_path_store(rib), route->path_id);
+  if (spath == NULL) {
+    return 0;
+  }
+  path = bgpstream_as_path_store_path_get_path(
+    spath, bgpstream_peer_sig_map_get_sig(bgpstream_rib_get_peer_sig_map(rib),
+                                          id)
+             ->peer_asnumber);
+  bgpstream_as_path_get_origin_val(path, &origin);
+  bgpstream_as_path_destroy(path);
+  return origin;
+}
+
+static void count_route(bgpstream_pfx_t *pfx, bgpstream_peer_id_t peer_id,
+                        bgpstream_rib_route_t *route, void *user)
+{
+  (*(int *)user)++;
+}
+
+static int walk_cnt(bgpstream_peer_id_t id)
+{
+  int cnt = 0;
+  bgpstream_rib_walk(rib, id, count_route, &cnt);
+  return cnt;
+}
+
+static int test_rib_dump()
+{
+  bgpstream_peer_id_t a, b;
+  bgpstream_rib_route_t route;
+  bgpstream_community_set_t *comms;
+
+  CHECK("Create RIB state engine", (rib = bgpstream_rib_create()) != NULL);
+
+  CHECK("Apply RIB dump",
+        apply(BGPSTREAM_RIB, RIB_TIME_1, BGPSTREAM_ELEM_TYPE_RIB, PEER_A_IP,
+              PEER_A_ASN, PFX_1, 3356) == 0 &&
+          apply(BGPSTREAM_RIB, RIB_TIME_1, BGPSTREAM_ELEM_TYPE_RIB, PEER_A_IP,
+                PEER_A_ASN, PFX_2, 174) == 0 &&
+          apply(BGPSTREAM_RIB, RIB_TIME_1, BGPSTREAM_ELEM_TYPE_RIB, PEER_B_IP,
+                PEER_B_ASN, PFX_3, 2914) == 0);
+  bgpstream_rib_dump_end(rib, COLLECTOR);
+
+  a = peer_id(PEER_A_IP, PEER_A_ASN);
+  b = peer_id(PEER_B_IP, PEER_B_ASN);
+  CHECK("Peer prefix counts", bgpstream_rib_get_peer_pfx_cnt(rib, a) == 2 &&
+                                bgpstream_rib_get_peer_pfx_cnt(rib, b) == 1);
+  CHECK("Route lookup",
+        has_route(a, PFX_1, &route) && route.time == RIB_TIME_1 &&
+          route_origin(a, &route) == 3356 && !has_route(b, PFX_1, NULL));
+  CHECK("Route communities",
+        (comms = bgpstream_rib_get_communities(rib, route.communities_id)) !=
+            NULL &&
+          bgpstream_community_set_size(comms) == 1 &&
+          bgpstream_community_set_get(comms, 0)->value == 3356);
+  CHECK("Route attribute set",
+        route.attrs_id != 0 &&
+          bgpstream_attr_store_get_attrs(bgpstream_rib_get_attr_store(rib),
+                                         route.attrs_id)
+              ->communities_id == route.communities_id &&
+          bgpstream_attr_store_get_size(bgpstream_rib_get_attr_store(rib)) ==
+            3);
+  CHECK("Walk routes", walk_cnt(0) == 3 && walk_cnt(a) == 2);
+
+  return 0;
+}
+
+static int test_rib_updates()
+{
+  bgpstream_peer_id_t a = peer_id(PEER_A_IP, PEER_A_ASN);
+  bgpstream_rib_route_t route;
+
+  CHECK("Apply withdrawal",
+        apply(BGPSTREAM_UPDATE, RIB_TIME_1 + 10, BGPSTREAM_ELEM_TYPE_WITHDRAWAL,
+              PEER_A_IP, PEER_A_ASN, PFX_2, 0) == 0 &&
+          !has_route(a, PFX_2, NULL) &&
+          bgpstream_rib_get_peer_pfx_cnt(rib, a) == 1);
+  CHECK("Apply announcement",
+        apply(BGPSTREAM_UPDATE, RIB_TIME_1 + 20,
+              BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT, PEER_A_IP, PEER_A_ASN, PFX_1,
+              1299) == 0 &&
+          has_route(a, PFX_1, &route) && route.time == RIB_TIME_1 + 20 &&
+          route_origin(a, &route) == 1299 &&
+          bgpstream_rib_get_peer_pfx_cnt(rib, a) == 1);
+
+  return 0;
+}
+
+static int test_rib_redump()
+{
+  bgpstream_peer_id_t a = peer_id(PEER_A_IP, PEER_A_ASN);
+  bgpstream_peer_id_t b = peer_id(PEER_B_IP, PEER_B_ASN);
+
+  /* the new dump of peer A has PFX_3 and PFX_2 (but not PFX_1), and PFX_2 is
+     withdrawn (after the dump time) before the dump gets to it */
+  CHECK("Apply second RIB dump",
+        apply(BGPSTREAM_RIB, RIB_TIME_2, BGPSTREAM_ELEM_TYPE_RIB, PEER_A_IP,
+              PEER_A_ASN, PFX_3, 6939) == 0 &&
+          apply(BGPSTREAM_UPDATE, RIB_TIME_2 + 1,
+                BGPSTREAM_ELEM_TYPE_WITHDRAWAL, PEER_A_IP, PEER_A_ASN, PFX_2,
+                0) == 0 &&
+          apply(BGPSTREAM_RIB, RIB_TIME_2, BGPSTREAM_ELEM_TYPE_RIB, PEER_A_IP,
+                PEER_A_ASN, PFX_2, 174) == 0);
+  CHECK("Dump does not override withdrawal", !has_route(a, PFX_2, NULL));
+  CHECK("Stale route kept until end of dump", has_route(a, PFX_1, NULL));
+
+  bgpstream_rib_dump_end(rib, COLLECTOR);
+  CHECK("Stale route removed at end of dump",
+        !has_route(a, PFX_1, NULL) && has_route(a, PFX_3, NULL) &&
+          bgpstream_rib_get_peer_pfx_cnt(rib, a) == 1);
+  CHECK("Peer missing from dump is kept",
+        has_route(b, PFX_3, NULL) &&
+          bgpstream_rib_get_peer_pfx_cnt(rib, b) == 1);
+  CHECK("Walk routes after dump", walk_cnt(0) == 2);
+
+  return 0;
+}
+
+static int test_rib_peerstate()
+{
+  bgpstream_peer_id_t a = peer_id(PEER_A_IP, PEER_A_ASN);
+  bgpstream_peer_id_t b = peer_id(PEER_B_IP, PEER_B_ASN);
+
+  set_elem(BGPSTREAM_UPDATE, RIB_TIME_2 + 100, BGPSTREAM_ELEM_TYPE_PEERSTATE,
+           PEER_B_IP, PEER_B_ASN, NULL, 0);
+  elem->old_state = BGPSTREAM_ELEM_PEERSTATE_ESTABLISHED;
+  elem->new_state = BGPSTREAM_ELEM_PEERSTATE_IDLE;
+  CHECK("Apply peer state change",
+        bgpstream_rib_apply_elem(rib, record, elem) == 0);
+  CHECK("Peer routes cleared",
+        bgpstream_rib_get_peer_pfx_cnt(rib, b) == 0 &&
+          !has_route(b, PFX_3, NULL) && has_route(a, PFX_3, NULL));
+  CHECK("Engine time", bgpstream_rib_get_time(rib) == RIB_TIME_2 + 100);
+
+  return 0;
+}
+
+static int peer_down(char *peer_ip, uint32_t peer_asn, uint32_t time)
+{
+  set_elem(BGPSTREAM_UPDATE, time, BGPSTREAM_ELEM_TYPE_PEERSTATE, peer_ip,
+           peer_asn, NULL, 0);
+  elem->old_state = BGPSTREAM_ELEM_PEERSTATE_ESTABLISHED;
+  elem->new_state = BGPSTREAM_ELEM_PEERSTATE_IDLE;
+  return bgpstream_rib_apply_elem(rib, record, elem);
+}
+
+static int test_rib_flap()
+{
+  bgpstream_peer_id_t a = peer_id(PEER_A_IP, PEER_A_ASN);
+  bgpstream_peer_id_t b = peer_id(PEER_B_IP, PEER_B_ASN);
+  uint32_t time = RIB_TIME_2 + 200;
+  int i;
+  int rc = 0;
+
+  CHECK("Apply announcements after session reset",
+        apply(BGPSTREAM_UPDATE, time, BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT,
+              PEER_B_IP, PEER_B_ASN, PFX_3, 2914) == 0 &&
+          apply(BGPSTREAM_UPDATE, time, BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT,
+                PEER_B_IP, PEER_B_ASN, PFX_2, 2914) == 0 &&
+          bgpstream_rib_get_peer_pfx_cnt(rib, b) == 2);
+
+  /* flap the session more times than there are session generations */
+  for (i = 0; i < 300 && rc == 0; i++) {
+    time++;
+    rc = peer_down(PEER_B_IP, PEER_B_ASN, time);
+    if (rc == 0 && i % 2 == 0) {
+      rc = apply(BGPSTREAM_UPDATE, time, BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT,
+                 PEER_B_IP, PEER_B_ASN, PFX_1, 3356);
+    }
+  }
+  CHECK("Apply session flaps", rc == 0);
+  CHECK("Flapped routes cleared",
+        bgpstream_rib_get_peer_pfx_cnt(rib, b) == 0 &&
+          !has_route(b, PFX_1, NULL) && !has_route(b, PFX_2, NULL) &&
+          !has_route(b, PFX_3, NULL) && walk_cnt(b) == 0);
+
+  CHECK("Apply announcement after flaps",
+        apply(BGPSTREAM_UPDATE, time, BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT,
+              PEER_B_IP, PEER_B_ASN, PFX_3, 6939) == 0 &&
+          bgpstream_rib_get_peer_pfx_cnt(rib, b) == 1 &&
+          has_route(b, PFX_3, NULL) && !has_route(b, PFX_2, NULL));
+  CHECK("Walk routes after flaps",
+        walk_cnt(b) == 1 && walk_cnt(0) == 2 && has_route(a, PFX_3, NULL));
+
+  /* a withdrawal of a route of a previous session changes nothing */
+  CHECK("Apply withdrawal after flaps",
+        apply(BGPSTREAM_UPDATE, time, BGPSTREAM_ELEM_TYPE_WITHDRAWAL,
+              PEER_B_IP, PEER_B_ASN, PFX_1, 0) == 0 &&
+          bgpstream_rib_get_peer_pfx_cnt(rib, b) == 1);
+
+  bgpstream_rib_destroy(rib);
+  return 0;
+}
+
+int main()
+{
+  CHECK("Create elem", (elem = bgpstream_elem_create()) != NULL);
+
+  CHECK_SECTION("RIB dump", test_rib_dump() == 0);
+  CHECK_SECTION("RIB updates", test_rib_updates() == 0);
+  CHECK_SECTION("RIB re-dump", test_rib_redump() == 0);
+  CHECK_SECTION("RIB peer state", test_rib_peerstate() == 0);
+  CHECK_SECTION("RIB session flaps", test_rib_flap() == 0);
+
+  bgpstream_elem_destroy(elem);
+  return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* length of the long names, longer than any fixed-size name buffer */
+#define LONG_NAME_LEN 300
+
+static int test_collector_map()
+{
+  bgpstream_collector_map_t *map;
+  bgpstream_collector_id_t rrc00, rrc01, rv2;
+  bgpstream_collector_sig_t *sig;
+
+  CHECK("Create collector map",
+        (map = bgpstream_collector_map_create()) != NULL &&
+          bgpstream_collector_map_get_size(map) == 0);
+
+  CHECK("Collector IDs",
+        (rrc00 = bgpstream_collector_map_get_id(map, "ris", "rrc00")) == 1 &&
+          (rrc01 = bgpstream_collector_map_get_id(map, "ris", "rrc01")) ==
+            2 &&
+          (rv2 = bgpstream_collector_map_get_id(map, "routeviews",
+                                                "route-views2")) == 3 &&
+          bgpstream_collector_map_get_size(map) == 3);
+
+  /* the same collector twice in a row, and again after another one */
+  CHECK("Repeated lookups",
+        bgpstream_collector_map_get_id(map, "routeviews", "route-views2") ==
+            rv2 &&
+          bgpstream_collector_map_get_id(map, "ris", "rrc00") == rrc00 &&
+          bgpstream_collector_map_get_id(map, "ris", "rrc01") == rrc01 &&
+          bgpstream_collector_map_get_size(map) == 3);
+
+  /* the project is part of the signature */
+  CHECK("Same collector name in another project",
+        bgpstream_collector_map_get_id(map, "routeviews", "rrc00") == 4 &&
+          bgpstream_collector_map_get_id(map, "ris", "rrc0") == 5 &&
+          bgpstream_collector_map_get_id(map, "ri", "srrc0") == 6);
+
+  CHECK("Collector signature",
+        (sig = bgpstream_collector_map_get_sig(map, rv2)) != NULL &&
+          strcmp(sig->project, "routeviews") == 0 &&
+          strcmp(sig->collector, "route-views2") == 0);
+  CHECK("Unknown collector signature",
+        bgpstream_collector_map_get_sig(map, 0) == NULL &&
+          bgpstream_collector_map_get_sig(map, 7) == NULL);
+
+  bgpstream_collector_map_destroy(map);
+  return 0;
+}
+
+static int test_collector_map_long_names()
+{
+  bgpstream_collector_map_t *map;
+  bgpstream_collector_id_t id1, id2;
+  bgpstream_collector_sig_t *sig;
+  char name1[LONG_NAME_LEN + 1];
+  char name2[LONG_NAME_LEN + 1];
+
+  /* the names only differ in their last character */
+  memset(name1, 'c', LONG_NAME_LEN);
+  name1[LONG_NAME_LEN] = '\0';
+  strcpy(name2, name1);
+  name1[LONG_NAME_LEN - 1] = '1';
+  name2[LONG_NAME_LEN - 1] = '2';
+
+  CHECK("Create collector map", (map = bgpstream_collector_map_create()) !=
+                                  NULL);
+  CHECK("Long collector names do not collide",
+        (id1 = bgpstream_collector_map_get_id(map, "ris", name1)) != 0 &&
+          (id2 = bgpstream_collector_map_get_id(map, "ris", name2)) != 0 &&
+          id1 != id2 && bgpstream_collector_map_get_id(map, "ris", name1) ==
+                          id1 &&
+          bgpstream_collector_map_get_size(map) == 2);
+  CHECK("Long collector names are kept whole",
+        (sig = bgpstream_collector_map_get_sig(map, id2)) != NULL &&
+          strcmp(sig->collector, name2) == 0);
+
+  /* same with long project names */
+  CHECK("Long project names do not collide",
+        (id1 = bgpstream_collector_map_get_id(map, name1, "rrc00")) != 0 &&
+          (id2 = bgpstream_collector_map_get_id(map, name2, "rrc00")) != 0 &&
+          id1 != id2 && bgpstream_collector_map_get_size(map) == 4);
+
+  bgpstream_collector_map_destroy(map);
+  return 0;
+}
+
+int main()
+{
+  CHECK_SECTION("Collector map", test_collector_map() == 0);
+  CHECK_SECTION("Collector map long names",
+                test_collector_map_long_names() == 0);
+  return 0;
+}
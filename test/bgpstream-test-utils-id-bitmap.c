@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* number of random IDs in each of the test sets */
+#define RANDOM_ID_CNT 30000
+
+/* number of random IDs to look up */
+#define RANDOM_PROBE_CNT 100000
+
+static int test_id_bitmap()
+{
+  bgpstream_id_bitmap_t *bm;
+  uint32_t ids[] = {3356, 174, 2914, 3356, 4200000000U, 65536, 0};
+  uint32_t probes[] = {174, 175, 65536, 65537, 4200000000U, 0};
+  uint8_t found[6];
+  uint32_t out[6];
+
+  CHECK("Create ID bitmap",
+        (bm = bgpstream_id_bitmap_create(ids, sizeof(ids) / sizeof(ids[0]))) !=
+          NULL);
+  CHECK("ID bitmap size", bgpstream_id_bitmap_size(bm) == 6);
+  CHECK("ID bitmap exists", bgpstream_id_bitmap_exists(bm, 3356) &&
+                              bgpstream_id_bitmap_exists(bm, 0) &&
+                              !bgpstream_id_bitmap_exists(bm, 3357) &&
+                              !bgpstream_id_bitmap_exists(bm, 4200000001U));
+  CHECK("ID bitmap exists_many",
+        bgpstream_id_bitmap_exists_many(bm, probes, 6, found) == 4 &&
+          found[0] == 1 && found[1] == 0 && found[2] == 1 && found[3] == 0 &&
+          found[4] == 1 && found[5] == 1);
+  CHECK("ID bitmap get IDs",
+        bgpstream_id_bitmap_get_ids(bm, out) == 6 && out[0] == 0 &&
+          out[1] == 174 && out[2] == 2914 && out[3] == 3356 &&
+          out[4] == 65536 && out[5] == 4200000000U);
+  bgpstream_id_bitmap_destroy(bm);
+
+  CHECK("Create empty ID bitmap", (bm = bgpstream_id_bitmap_create(NULL, 0)) !=
+                                    NULL &&
+                                    bgpstream_id_bitmap_size(bm) == 0 &&
+                                    !bgpstream_id_bitmap_exists(bm, 0));
+  bgpstream_id_bitmap_destroy(bm);
+
+  return 0;
+}
+
+/* random IDs, some of them in dense ranges (so that they end up in bitmap
+   containers) */
+static void random_ids(uint32_t *ids, int cnt)
+{
+  int i;
+
+  for (i = 0; i < cnt; i++) {
+    if (i % 2) {
+      ids[i] = (rand() % 2) << 16 | (rand() & 0xffff);
+    } else {
+      ids[i] = ((uint32_t)rand() << 8) ^ rand();
+    }
+  }
+}
+
+static int test_id_bitmap_random()
+{
+  bgpstream_id_set_t *set1, *set2;
+  bgpstream_id_bitmap_t *bm1, *bm2, *bmu, *bmi;
+  uint32_t *ids1, *ids2, *probes;
+  uint8_t *found;
+  int i, in1, in2, mismatches = 0;
+  int isize = 0;
+  uint32_t *id;
+
+  CHECK("Allocate test data",
+        (ids1 = malloc(sizeof(uint32_t) * RANDOM_ID_CNT)) != NULL &&
+          (ids2 = malloc(sizeof(uint32_t) * RANDOM_ID_CNT)) != NULL &&
+          (probes = malloc(sizeof(uint32_t) * RANDOM_PROBE_CNT)) != NULL &&
+          (found = malloc(RANDOM_PROBE_CNT)) != NULL);
+  CHECK("Create ID sets", (set1 = bgpstream_id_set_create()) != NULL &&
+                            (set2 = bgpstream_id_set_create()) != NULL);
+
+  srand(42);
+  random_ids(ids1, RANDOM_ID_CNT);
+  random_ids(ids2, RANDOM_ID_CNT);
+  random_ids(probes, RANDOM_PROBE_CNT);
+  for (i = 0; i < RANDOM_ID_CNT; i++) {
+    bgpstream_id_set_insert(set1, ids1[i]);
+    bgpstream_id_set_insert(set2, ids2[i]);
+  }
+
+  CHECK("Create ID bitmaps",
+        (bm1 = bgpstream_id_bitmap_create_from_set(set1)) != NULL &&
+          (bm2 = bgpstream_id_bitmap_create(ids2, RANDOM_ID_CNT)) != NULL);
+  CHECK("ID bitmap sizes",
+        bgpstream_id_bitmap_size(bm1) == bgpstream_id_set_size(set1) &&
+          bgpstream_id_bitmap_size(bm2) == bgpstream_id_set_size(set2));
+
+  CHECK("ID bitmap union and intersection",
+        (bmu = bgpstream_id_bitmap_union(bm1, bm2)) != NULL &&
+          (bmi = bgpstream_id_bitmap_intersect(bm1, bm2)) != NULL);
+
+  bgpstream_id_bitmap_exists_many(bm1, probes, RANDOM_PROBE_CNT, found);
+  for (i = 0; i < RANDOM_PROBE_CNT; i++) {
+    in1 = bgpstream_id_set_exists(set1, probes[i]);
+    in2 = bgpstream_id_set_exists(set2, probes[i]);
+    if (bgpstream_id_bitmap_exists(bm1, probes[i]) != in1 ||
+        found[i] != in1 ||
+        bgpstream_id_bitmap_exists(bm2, probes[i]) != in2 ||
+        bgpstream_id_bitmap_exists(bmu, probes[i]) != (in1 || in2) ||
+        bgpstream_id_bitmap_exists(bmi, probes[i]) != (in1 && in2)) {
+      mismatches++;
+    }
+  }
+  CHECK("ID bitmap random lookups", mismatches == 0);
+
+  for (i = 0; i < RANDOM_ID_CNT; i++) {
+    if (!bgpstream_id_bitmap_exists(bmu, ids1[i]) ||
+        !bgpstream_id_bitmap_exists(bmu, ids2[i])) {
+      mismatches++;
+    }
+  }
+  bgpstream_id_set_rewind(set1);
+  while ((id = bgpstream_id_set_next(set1)) != NULL) {
+    isize += bgpstream_id_set_exists(set2, *id);
+  }
+  CHECK("ID bitmap union and intersection sizes",
+        mismatches == 0 &&
+          bgpstream_id_bitmap_size(bmu) ==
+            bgpstream_id_set_size(set1) + bgpstream_id_set_size(set2) -
+              isize &&
+          bgpstream_id_bitmap_size(bmi) == (uint32_t)isize);
+
+  bgpstream_id_bitmap_destroy(bm1);
+  bgpstream_id_bitmap_destroy(bm2);
+  bgpstream_id_bitmap_destroy(bmu);
+  bgpstream_id_bitmap_destroy(bmi);
+  bgpstream_id_set_destroy(set1);
+  bgpstream_id_set_destroy(set2);
+  free(ids1);
+  free(ids2);
+  free(probes);
+  free(found);
+  return 0;
+}
+
+int main()
+{
+  CHECK_SECTION("ID bitmap", test_id_bitmap() == 0);
+  CHECK_SECTION("ID bitmap random", test_id_bitmap_random() == 0);
+  return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* number of random prefixes used to cross-check the backends */
+#define RANDOM_PFX_CNT 50000
+
+/* number of random prefixes added between two queries */
+#define RANDOM_QUERY_INTERVAL 997
+
+static int add_pfx(bgpstream_ip_counter_t *ipc, char *pfx_str)
+{
+  bgpstream_pfx_storage_t pfx;
+  bgpstream_str2pfx(pfx_str, &pfx);
+  return bgpstream_ip_counter_add(ipc, (bgpstream_pfx_t *)&pfx);
+}
+
+static uint64_t overlap(bgpstream_ip_counter_t *ipc, char *pfx_str,
+                        uint8_t *more_specific)
+{
+  bgpstream_pfx_storage_t pfx;
+  bgpstream_str2pfx(pfx_str, &pfx);
+  return bgpstream_ip_counter_is_overlapping(ipc, (bgpstream_pfx_t *)&pfx,
+                                             more_specific);
+}
+
+static int test_ip_counter(bgpstream_ip_counter_backend_t backend)
+{
+  bgpstream_ip_counter_t *ipc;
+  uint8_t more_specific;
+
+  CHECK("Create IP Counter",
+        (ipc = bgpstream_ip_counter_create_with_backend(backend)) != NULL);
+
+  CHECK("Add prefixes", add_pfx(ipc, "192.0.43.0/24") == 0 &&
+                          add_pfx(ipc, "130.217.0.0/16") == 0 &&
+                          add_pfx(ipc, "130.217.250.0/24") == 0 &&
+                          add_pfx(ipc, "192.0.42.0/24") == 0 &&
+                          add_pfx(ipc, "2001:500:88::/48") == 0 &&
+                          add_pfx(ipc, "2001:500:88:beef::/64") == 0);
+
+  CHECK("IPv4 count", bgpstream_ip_counter_get_ipcount(
+                        ipc, BGPSTREAM_ADDR_VERSION_IPV4) == 65536 + 512);
+  CHECK("IPv6 /64 count", bgpstream_ip_counter_get_ipcount(
+                            ipc, BGPSTREAM_ADDR_VERSION_IPV6) == 65536);
+
+  CHECK("IPv4 overlap (less specific)",
+        overlap(ipc, "130.0.0.0/8", &more_specific) == 65536 &&
+          more_specific == 0);
+  CHECK("IPv4 overlap (more specific)",
+        overlap(ipc, "130.217.1.0/24", &more_specific) == 256 &&
+          more_specific == 1);
+  CHECK("IPv4 no overlap",
+        overlap(ipc, "8.8.8.0/24", &more_specific) == 0 &&
+          more_specific == 0);
+  CHECK("IPv6 overlap (more specific)",
+        overlap(ipc, "2001:500:88:1::/64", &more_specific) == 1 &&
+          more_specific == 1);
+
+  /* the counter can be reused after clear */
+  bgpstream_ip_counter_clear(ipc);
+  CHECK("Empty after clear", bgpstream_ip_counter_get_ipcount(
+                               ipc, BGPSTREAM_ADDR_VERSION_IPV4) == 0);
+  CHECK("Add after clear", add_pfx(ipc, "10.0.0.0/8") == 0 &&
+                             bgpstream_ip_counter_get_ipcount(
+                               ipc, BGPSTREAM_ADDR_VERSION_IPV4) == 1 << 24);
+
+  /* ranges that only differ in the low 64 bits */
+  bgpstream_ip_counter_clear(ipc);
+  CHECK("Add IPv6 /127", add_pfx(ipc, "2001:db8::/127") == 0);
+  CHECK("IPv6 no overlap (same high half)",
+        overlap(ipc, "2001:db8::4/126", &more_specific) == 0);
+  CHECK("IPv6 overlap (same high half)",
+        overlap(ipc, "2001:db8::/126", &more_specific) == 1);
+
+  bgpstream_ip_counter_destroy(ipc);
+  return 0;
+}
+
+static void random_pfx(bgpstream_pfx_storage_t *pfx, int v6)
+{
+  int i;
+
+  memset(pfx, 0, sizeof(bgpstream_pfx_storage_t));
+  if (!v6) {
+    pfx->address.version = BGPSTREAM_ADDR_VERSION_IPV4;
+    for (i = 0; i < 4; i++) {
+      ((uint8_t *)&pfx->address.ipv4.s_addr)[i] = rand() & 0xff;
+    }
+    /* keep prefixes dense enough to overlap */
+    ((uint8_t *)&pfx->address.ipv4.s_addr)[0] &= 0x0f;
+    pfx->mask_len = 8 + rand() % 25;
+  } else {
+    pfx->address.version = BGPSTREAM_ADDR_VERSION_IPV6;
+    pfx->address.ipv6.s6_addr[0] = 0x20;
+    pfx->address.ipv6.s6_addr[1] = rand() & 0x01;
+    for (i = 2; i < 16; i++) {
+      pfx->address.ipv6.s6_addr[i] = rand() & 0xff;
+    }
+    pfx->mask_len = 16 + rand() % 113;
+  }
+}
+
+static int same_answers(bgpstream_ip_counter_t *list,
+                        bgpstream_ip_counter_t *sorted,
+                        bgpstream_pfx_storage_t *pfx)
+{
+  uint8_t ms_list, ms_sorted;
+
+  return bgpstream_ip_counter_get_ipcount(list, BGPSTREAM_ADDR_VERSION_IPV4) ==
+           bgpstream_ip_counter_get_ipcount(sorted,
+                                            BGPSTREAM_ADDR_VERSION_IPV4) &&
+         bgpstream_ip_counter_get_ipcount(list, BGPSTREAM_ADDR_VERSION_IPV6) ==
+           bgpstream_ip_counter_get_ipcount(sorted,
+                                            BGPSTREAM_ADDR_VERSION_IPV6) &&
+         bgpstream_ip_counter_is_overlapping(list, (bgpstream_pfx_t *)pfx,
+                                             &ms_list) ==
+           bgpstream_ip_counter_is_overlapping(sorted, (bgpstream_pfx_t *)pfx,
+                                               &ms_sorted) &&
+         ms_list == ms_sorted;
+}
+
+static int test_ip_counter_random()
+{
+  bgpstream_ip_counter_t *list;
+  bgpstream_ip_counter_t *sorted;
+  bgpstream_pfx_storage_t pfx;
+  int i, mismatches = 0, add_failures = 0;
+
+  CHECK("Create IP Counters",
+        (list = bgpstream_ip_counter_create_with_backend(
+           BGPSTREAM_IP_COUNTER_BACKEND_LIST)) != NULL &&
+          (sorted = bgpstream_ip_counter_create_with_backend(
+             BGPSTREAM_IP_COUNTER_BACKEND_SORTED)) != NULL);
+
+  srand(42);
+  for (i = 0; i < RANDOM_PFX_CNT; i++) {
+    random_pfx(&pfx, (i % 4) == 0);
+    if (bgpstream_ip_counter_add(list, (bgpstream_pfx_t *)&pfx) != 0 ||
+        bgpstream_ip_counter_add(sorted, (bgpstream_pfx_t *)&pfx) != 0) {
+      add_failures++;
+    }
+    /* interleave queries with insertions */
+    if ((i % RANDOM_QUERY_INTERVAL) == 0) {
+      random_pfx(&pfx, (i % 2) == 0);
+      if (!same_answers(list, sorted, &pfx)) {
+        mismatches++;
+      }
+    }
+  }
+  CHECK("Add random prefixes", add_failures == 0);
+
+  for (i = 0; i < RANDOM_PFX_CNT / 10; i++) {
+    random_pfx(&pfx, (i % 4) == 0);
+    if (!same_answers(list, sorted, &pfx)) {
+      mismatches++;
+    }
+  }
+  CHECK("Sorted backend matches list backend", mismatches == 0);
+
+  bgpstream_ip_counter_destroy(list);
+  bgpstream_ip_counter_destroy(sorted);
+  return 0;
+}
+
+int main()
+{
+  CHECK_SECTION("IP Counter (list)",
+                test_ip_counter(BGPSTREAM_IP_COUNTER_BACKEND_LIST) == 0);
+  CHECK_SECTION("IP Counter (sorted)",
+                test_ip_counter(BGPSTREAM_IP_COUNTER_BACKEND_SORTED) == 0);
+  CHECK_SECTION("IP Counter random", test_ip_counter_random() == 0);
+  return 0;
+}
@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpstream_test.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IPV4_TEST_PFX_A "192.0.43.0/24"
+#define IPV4_TEST_PFX_B "130.217.0.0/16"
+#define IPV4_TEST_PFX_B_CHILD "130.217.250.0/24"
+#define IPV4_TEST_ADDR_A "192.0.43.8"
+#define IPV4_TEST_ADDR_B "130.217.1.1"
+#define IPV4_TEST_ADDR_B_CHILD "130.217.250.1"
+#define IPV4_TEST_ADDR_NONE "8.8.8.8"
+
+#define IPV6_TEST_PFX_A "2001:500:88::/48"
+#define IPV6_TEST_PFX_A_CHILD "2001:500:88:beef::/64"
+#define IPV6_TEST_ADDR_A "2001:500:88:1::1"
+#define IPV6_TEST_ADDR_A_CHILD "2001:500:88:beef::1"
+#define IPV6_TEST_ADDR_NONE "2001:db8::1"
+
+/* number of random prefixes and addresses used to cross-check lookups */
+#define RANDOM_PFX_CNT 20000
+#define RANDOM_ADDR_CNT 100000
+
+static int lookup_is(bgpstream_lpm_t *lpm, char *addr_str,
+                     const char *pfx_str)
+{
+  bgpstream_addr_storage_t addr;
+  bgpstream_pfx_storage_t pfx;
+  bgpstream_patricia_node_t *node;
+
+  bgpstream_str2addr(addr_str, &addr);
+  node = bgpstream_lpm_lookup(lpm, (bgpstream_ip_addr_t *)&addr);
+  if (pfx_str == NULL) {
+    return node == NULL;
+  }
+  bgpstream_str2pfx(pfx_str, &pfx);
+  return node != NULL &&
+         bgpstream_pfx_equal(bgpstream_patricia_tree_get_pfx(node),
+                             (bgpstream_pfx_t *)&pfx);
+}
+
+static void random_addr(bgpstream_addr_storage_t *addr, int v6)
+{
+  int i;
+
+  memset(addr, 0, sizeof(bgpstream_addr_storage_t));
+  if (!v6) {
+    addr->version = BGPSTREAM_ADDR_VERSION_IPV4;
+    for (i = 0; i < 4; i++) {
+      ((uint8_t *)&addr->ipv4.s_addr)[i] = rand() & 0xff;
+    }
+    /* keep addresses dense enough to hit nested prefixes */
+    ((uint8_t *)&addr->ipv4.s_addr)[0] &= 0x0f;
+  } else {
+    addr->version = BGPSTREAM_ADDR_VERSION_IPV6;
+    addr->ipv6.s6_addr[0] = 0x20;
+    addr->ipv6.s6_addr[1] = rand() & 0x01;
+    for (i = 2; i < 16; i++) {
+      addr->ipv6.s6_addr[i] = rand() & 0xff;
+    }
+  }
+}
+
+/* longest matching prefix, the slow way */
+static bgpstream_pfx_t *brute_force_lookup(bgpstream_pfx_storage_t *pfxs,
+                                           int pfxs_cnt,
+                                           bgpstream_addr_storage_t *addr)
+{
+  bgpstream_pfx_t *best = NULL;
+  bgpstream_pfx_storage_t host;
+  int i;
+
+  host.address = *addr;
+  host.mask_len = (addr->version == BGPSTREAM_ADDR_VERSION_IPV4) ? 32 : 128;
+
+  for (i = 0; i < pfxs_cnt; i++) {
+    if (bgpstream_pfx_contains((bgpstream_pfx_t *)&pfxs[i],
+                               (bgpstream_pfx_t *)&host) &&
+        (best == NULL || pfxs[i].mask_len > best->mask_len)) {
+      best = (bgpstream_pfx_t *)&pfxs[i];
+    }
+  }
+  return best;
+}
+
+static int test_lpm()
+{
+  bgpstream_patricia_tree_t *pt;
+  bgpstream_lpm_t *lpm;
+  bgpstream_pfx_storage_t pfx;
+
+  CHECK("Create Patricia Tree",
+        (pt = bgpstream_patricia_tree_create(NULL)) != NULL);
+  CHECK("Create LPM index", (lpm = bgpstream_lpm_create()) != NULL);
+
+  CHECK("Empty LPM index lookup", lookup_is(lpm, IPV4_TEST_ADDR_A, NULL) &&
+                                    lookup_is(lpm, IPV6_TEST_ADDR_A, NULL));
+
+  bgpstream_patricia_tree_insert(
+    pt, (bgpstream_pfx_t *)bgpstream_str2pfx(IPV4_TEST_PFX_A, &pfx));
+  bgpstream_patricia_tree_insert(
+    pt, (bgpstream_pfx_t *)bgpstream_str2pfx(IPV4_TEST_PFX_B, &pfx));
+  bgpstream_patricia_tree_insert(
+    pt, (bgpstream_pfx_t *)bgpstream_str2pfx(IPV4_TEST_PFX_B_CHILD, &pfx));
+  bgpstream_patricia_tree_insert(
+    pt, (bgpstream_pfx_t *)bgpstream_str2pfx(IPV6_TEST_PFX_A, &pfx));
+  bgpstream_patricia_tree_insert(
+    pt, (bgpstream_pfx_t *)bgpstream_str2pfx(IPV6_TEST_PFX_A_CHILD, &pfx));
+
+  CHECK("Build LPM index", bgpstream_lpm_build(lpm, pt) == 0);
+
+  CHECK("LPM index v4 lookup",
+        lookup_is(lpm, IPV4_TEST_ADDR_A, IPV4_TEST_PFX_A) &&
+          lookup_is(lpm, IPV4_TEST_ADDR_B, IPV4_TEST_PFX_B) &&
+          lookup_is(lpm, IPV4_TEST_ADDR_B_CHILD, IPV4_TEST_PFX_B_CHILD) &&
+          lookup_is(lpm, IPV4_TEST_ADDR_NONE, NULL));
+
+  CHECK("LPM index v6 lookup",
+        lookup_is(lpm, IPV6_TEST_ADDR_A, IPV6_TEST_PFX_A) &&
+          lookup_is(lpm, IPV6_TEST_ADDR_A_CHILD, IPV6_TEST_PFX_A_CHILD) &&
+          lookup_is(lpm, IPV6_TEST_ADDR_NONE, NULL));
+
+  /* rebuild after removing a prefix */
+  bgpstream_patricia_tree_remove(
+    pt, (bgpstream_pfx_t *)bgpstream_str2pfx(IPV4_TEST_PFX_B_CHILD, &pfx));
+  CHECK("Rebuild LPM index", bgpstream_lpm_build(lpm, pt) == 0);
+  CHECK("LPM index lookup after rebuild",
+        lookup_is(lpm, IPV4_TEST_ADDR_B_CHILD, IPV4_TEST_PFX_B));
+
+  /* default route */
+  bgpstream_patricia_tree_insert(
+    pt, (bgpstream_pfx_t *)bgpstream_str2pfx("0.0.0.0/0", &pfx));
+  CHECK("Rebuild LPM index", bgpstream_lpm_build(lpm, pt) == 0);
+  CHECK("LPM index lookup default route",
+        lookup_is(lpm, IPV4_TEST_ADDR_NONE, "0.0.0.0/0") &&
+          lookup_is(lpm, IPV4_TEST_ADDR_A, IPV4_TEST_PFX_A));
+
+  bgpstream_lpm_destroy(lpm);
+  bgpstream_patricia_tree_destroy(pt);
+  return 0;
+}
+
+static int test_lpm_random()
+{
+  bgpstream_patricia_tree_t *pt;
+  bgpstream_lpm_t *lpm;
+  bgpstream_pfx_storage_t *pfxs;
+  bgpstream_addr_storage_t *addrs;
+  bgpstream_patricia_node_t **nodes;
+  bgpstream_patricia_node_t *node;
+  bgpstream_pfx_t *expected;
+  int i, mismatches, batch_mismatches, found;
+
+  CHECK("Create Patricia Tree",
+        (pt = bgpstream_patricia_tree_create(NULL)) != NULL);
+  CHECK("Create LPM index", (lpm = bgpstream_lpm_create()) != NULL);
+  CHECK("Allocate test data",
+        (pfxs = malloc(sizeof(bgpstream_pfx_storage_t) * RANDOM_PFX_CNT)) !=
+            NULL &&
+          (addrs = malloc(sizeof(bgpstream_addr_storage_t) *
+                          RANDOM_ADDR_CNT)) != NULL &&
+          (nodes = malloc(sizeof(bgpstream_patricia_node_t *) *
+                          RANDOM_ADDR_CNT)) != NULL);
+
+  srand(42);
+  for (i = 0; i < RANDOM_PFX_CNT; i++) {
+    int v6 = (i % 4) == 0;
+    random_addr(&pfxs[i].address, v6);
+    pfxs[i].mask_len = v6 ? (16 + rand() % 113) : (4 + rand() % 29);
+    pfxs[i].allowed_matches = 0;
+    bgpstream_addr_mask((bgpstream_ip_addr_t *)&pfxs[i].address,
+                        pfxs[i].mask_len);
+    bgpstream_patricia_tree_insert(pt, (bgpstream_pfx_t *)&pfxs[i]);
+  }
+  for (i = 0; i < RANDOM_ADDR_CNT; i++) {
+    random_addr(&addrs[i], (i % 4) == 0);
+  }
+
+  CHECK("Build LPM index", bgpstream_lpm_build(lpm, pt) == 0);
+
+  mismatches = 0;
+  batch_mismatches = 0;
+  found = bgpstream_lpm_lookup_batch(lpm, addrs, RANDOM_ADDR_CNT, nodes);
+  for (i = 0; i < RANDOM_ADDR_CNT; i++) {
+    node = bgpstream_lpm_lookup(lpm, (bgpstream_ip_addr_t *)&addrs[i]);
+    expected = brute_force_lookup(pfxs, RANDOM_PFX_CNT, &addrs[i]);
+    if ((node == NULL) != (expected == NULL) ||
+        (node != NULL &&
+         bgpstream_patricia_tree_get_pfx(node)->mask_len !=
+           expected->mask_len)) {
+      mismatches++;
+    }
+    if (nodes[i] != node) {
+      batch_mismatches++;
+    }
+    if (node != NULL) {
+      found--;
+    }
+  }
+
+  CHECK("LPM index random lookups", mismatches == 0);
+  CHECK("LPM index random batch lookups",
+        batch_mismatches == 0 && found == 0);
+
+  free(pfxs);
+  free(addrs);
+  free(nodes);
+  bgpstream_lpm_destroy(lpm);
+  bgpstream_patricia_tree_destroy(pt);
+  return 0;
+}
+
+int main()
+{
+  CHECK_SECTION("LPM index", test_lpm() == 0);
+  CHECK_SECTION("LPM index random", test_lpm_random() == 0);
+  return 0;
+}
@@ -53,6 +53,11 @@ char buffer[BUFFER_LEN];
 #define IPV6_TEST_64_CNT 65537
 #define IPV6_TEST_PFX_CNT 4
 
+/* number of random prefixes used by the benchmark */
+#define BENCH_V4_PFX_CNT 500000
+#define BENCH_V6_PFX_CNT 100000
+#define BENCH_PFX_CNT (BENCH_V4_PFX_CNT + BENCH_V6_PFX_CNT)
+
 int test_patricia()
 {
   bgpstream_patricia_tree_t *pt;
@@ -176,8 +181,155 @@ int test_patricia()
   return 0;
 }
 
+static double bench_elapsed(struct timespec *start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* generate a random prefix, with the host bits cleared */
+static void bench_random_pfx(bgpstream_pfx_storage_t *pfx, int v6)
+{
+  int i, bits;
+
+  memset(pfx, 0, sizeof(bgpstream_pfx_storage_t));
+  if (!v6) {
+    pfx->address.version = BGPSTREAM_ADDR_VERSION_IPV4;
+    pfx->mask_len = 8 + rand() % 17;
+    for (i = 0; i < 4; i++) {
+      ((uint8_t *)&pfx->address.ipv4.s_addr)[i] = rand() & 0xff;
+    }
+  } else {
+    pfx->address.version = BGPSTREAM_ADDR_VERSION_IPV6;
+    pfx->mask_len = 16 + rand() % 49;
+    pfx->address.ipv6.s6_addr[0] = 0x20;
+    for (i = 1; i < 16; i++) {
+      pfx->address.ipv6.s6_addr[i] = rand() & 0xff;
+    }
+  }
+  for (i = 0; i < (v6 ? 16 : 4); i++) {
+    uint8_t *b = v6 ? &pfx->address.ipv6.s6_addr[i]
+                    : &((uint8_t *)&pfx->address.ipv4.s_addr)[i];
+    bits = pfx->mask_len - i * 8;
+    if (bits <= 0) {
+      *b = 0;
+    } else if (bits < 8) {
+      *b &= 0xff << (8 - bits);
+    }
+  }
+}
+
+int test_patricia_benchmark()
+{
+  bgpstream_patricia_tree_t *pt;
+  bgpstream_patricia_tree_result_set_t *res;
+  bgpstream_pfx_storage_t *pfxs;
+  struct timespec start;
+  uint64_t v4_cnt, v6_cnt;
+  int i, failed;
+
+  CHECK("Benchmark prefixes allocation",
+        (pfxs = malloc(sizeof(bgpstream_pfx_storage_t) * BENCH_PFX_CNT)) !=
+          NULL);
+  srand(42);
+  for (i = 0; i < BENCH_PFX_CNT; i++) {
+    bench_random_pfx(&pfxs[i], i >= BENCH_V4_PFX_CNT);
+  }
+
+  CHECK("Create Patricia Tree",
+        (pt = bgpstream_patricia_tree_create(NULL)) != NULL);
+  CHECK("Create Patricia Tree Result",
+        (res = bgpstream_patricia_tree_result_set_create()) != NULL);
+
+  /* Insert */
+  failed = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < BENCH_PFX_CNT; i++) {
+    if (bgpstream_patricia_tree_insert(pt, (bgpstream_pfx_t *)&pfxs[i]) ==
+        NULL) {
+      failed++;
+    }
+  }
+  fprintf(stderr, " * Benchmark insert %d prefixes: %.3fs\n", BENCH_PFX_CNT,
+          bench_elapsed(&start));
+  CHECK("Benchmark insert", failed == 0);
+  v4_cnt = bgpstream_patricia_prefix_count(pt, BGPSTREAM_ADDR_VERSION_IPV4);
+  v6_cnt = bgpstream_patricia_prefix_count(pt, BGPSTREAM_ADDR_VERSION_IPV6);
+
+  /* Exact search */
+  failed = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < BENCH_PFX_CNT; i++) {
+    if (bgpstream_patricia_tree_search_exact(pt, (bgpstream_pfx_t *)&pfxs[i]) ==
+        NULL) {
+      failed++;
+    }
+  }
+  fprintf(stderr, " * Benchmark search exact %d prefixes: %.3fs\n",
+          BENCH_PFX_CNT, bench_elapsed(&start));
+  CHECK("Benchmark search exact", failed == 0);
+
+  /* Minimum covering prefix */
+  failed = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < BENCH_PFX_CNT; i++) {
+    if (bgpstream_patricia_tree_get_mincovering_prefix(
+          pt,
+          bgpstream_patricia_tree_search_exact(pt, (bgpstream_pfx_t *)&pfxs[i]),
+          res) != 0) {
+      failed++;
+    }
+  }
+  fprintf(stderr, " * Benchmark min covering pfx %d prefixes: %.3fs\n",
+          BENCH_PFX_CNT, bench_elapsed(&start));
+  CHECK("Benchmark min covering pfx", failed == 0);
+
+  /* Clear */
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  bgpstream_patricia_tree_clear(pt);
+  fprintf(stderr, " * Benchmark clear: %.6fs\n", bench_elapsed(&start));
+  CHECK("Benchmark clear",
+        bgpstream_patricia_prefix_count(pt, BGPSTREAM_ADDR_VERSION_IPV4) == 0 &&
+          bgpstream_patricia_prefix_count(pt, BGPSTREAM_ADDR_VERSION_IPV6) ==
+            0 &&
+          bgpstream_patricia_tree_search_exact(
+            pt, (bgpstream_pfx_t *)&pfxs[0]) == NULL);
+
+  /* Insert again, reusing the memory released by clear */
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < BENCH_PFX_CNT; i++) {
+    bgpstream_patricia_tree_insert(pt, (bgpstream_pfx_t *)&pfxs[i]);
+  }
+  fprintf(stderr, " * Benchmark insert %d prefixes after clear: %.3fs\n",
+          BENCH_PFX_CNT, bench_elapsed(&start));
+  CHECK("Benchmark insert after clear",
+        bgpstream_patricia_prefix_count(pt, BGPSTREAM_ADDR_VERSION_IPV4) ==
+            v4_cnt &&
+          bgpstream_patricia_prefix_count(pt, BGPSTREAM_ADDR_VERSION_IPV6) ==
+            v6_cnt);
+
+  /* Remove everything, one prefix at a time */
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < BENCH_PFX_CNT; i++) {
+    bgpstream_patricia_tree_remove(pt, (bgpstream_pfx_t *)&pfxs[i]);
+  }
+  fprintf(stderr, " * Benchmark remove %d prefixes: %.3fs\n", BENCH_PFX_CNT,
+          bench_elapsed(&start));
+  CHECK("Benchmark remove",
+        bgpstream_patricia_tree_search_exact(pt, (bgpstream_pfx_t *)&pfxs[0]) ==
+          NULL);
+
+  bgpstream_patricia_tree_destroy(pt);
+  bgpstream_patricia_tree_result_set_destroy(&res);
+  free(pfxs);
+
+  return 0;
+}
+
 int main()
 {
   CHECK_SECTION("Patricia Tree", test_patricia() == 0);
+  CHECK_SECTION("Patricia Tree benchmark", test_patricia_benchmark() == 0);
   return 0;
 }
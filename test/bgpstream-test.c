@@ -25,10 +25,14 @@
  */
 
 #include "bgpstream_test.h"
+#include "bgpstream_filter.h"
+#include "bgpstream_log.h"
+#include "bgpstream_resource_mgr.h"
 
 #include "utils.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <wandio.h>
 
@@ -76,10 +80,53 @@ bgpstream_data_interface_option_t *option;
     bgpstream_set_data_interface(bs, di_id);                                   \
   } while (0)
 
+static int log_msgs_cnt = 0;
+static int log_errs_cnt = 0;
+static int log_fine_cnt = 0;
+
+static void log_sink(int level, const char *msg, size_t msg_len, void *user)
+{
+  if (strstr(msg, "Repeated test message") != NULL) {
+    log_msgs_cnt++;
+  }
+  if (strstr(msg, "Expected a valid term") != NULL) {
+    log_errs_cnt++;
+  }
+  if (level == BGPSTREAM_LOG_FINE) {
+    log_fine_cnt++;
+  }
+}
+
 int test_bgpstream()
 {
+  char filter[64];
+  int i;
+
   CHECK("BGPStream create", (bs = bgpstream_create()) != NULL);
 
+  // repeated messages from one statement are rate limited, unless they are
+  // errors
+  bgpstream_set_log_sink(log_sink, NULL);
+  for (i = 0; i < 30; i++) {
+    bgpstream_log(BGPSTREAM_LOG_WARN, "Repeated test message %d", i);
+  }
+  CHECK("log rate limit", log_msgs_cnt >= BGPSTREAM_LOG_RATE_LIMIT_DEFAULT &&
+                            log_msgs_cnt < 30);
+  for (i = 0; i < 30; i++) {
+    strcpy(filter, "bogus");
+    bgpstream_parse_filter_string(bs, filter);
+  }
+  CHECK("log errors not rate limited", log_errs_cnt == 30);
+  CHECK("log level (default)", log_fine_cnt == 0);
+
+  bgpstream_set_log_level(BGPSTREAM_LOG_FINE);
+  strcpy(filter, "project ris");
+  bgpstream_parse_filter_string(bs, filter);
+  CHECK("log level (fine)", log_fine_cnt > 0);
+
+  bgpstream_set_log_level(BGPSTREAM_LOG_INFO);
+  bgpstream_set_log_sink(NULL, NULL);
+
   TEARDOWN;
   return 0;
 }
@@ -110,6 +157,328 @@ int test_singlefile()
   return 0;
 }
 
+#define BATCH_SIZE 64
+
+/* read the updates file one record/elem at a time (0), in batches (1), in
+   batches of records and blocks of elems (2), by taking every record and
+   only reading the elems once the stream has ended (3), or one record at a
+   time without blocking (4). if filter is set, only IPv4 announcements whose
+   path does not contain AS 1 are read */
+static int read_updates(int batch, int filter, int *rec_cnt, int *elem_cnt)
+{
+  bgpstream_record_t *records[BATCH_SIZE];
+  bgpstream_elem_t *elems[BATCH_SIZE];
+  bgpstream_elem_t *elem;
+  bgpstream_elem_block_t *block = NULL;
+  bgpstream_record_t **taken = NULL;
+  int taken_cnt = 0;
+  bgpstream_stats_t stats[3];
+  int ret, erc, i;
+
+  *rec_cnt = 0;
+  *elem_cnt = 0;
+
+  SETUP;
+  CHECK_SET_INTERFACE(singlefile);
+  option = bgpstream_get_data_interface_option_by_name(bs, di_id, "upd-file");
+  bgpstream_set_data_interface_option(bs, option,
+                                      "ris.rrc06.updates.1427846400.gz");
+  if (filter != 0) {
+    bgpstream_add_filter(bs, BGPSTREAM_FILTER_TYPE_ELEM_TYPE, "announcements");
+    bgpstream_add_filter(bs, BGPSTREAM_FILTER_TYPE_ELEM_IP_VERSION, "4");
+    bgpstream_add_filter(bs, BGPSTREAM_FILTER_TYPE_ELEM_ASPATH, "!_1_");
+  }
+  // timing only applies to this instance, and not to those created later
+  if (batch == 1) {
+    bgpstream_set_stats_timing(bs, 1);
+  }
+  CHECK("stream start (singlefile batch)", bgpstream_start(bs) == 0);
+  if (batch == 2) {
+    CHECK("elem block create", (block = bgpstream_elem_block_create()) != NULL);
+  }
+
+  while (1) {
+    if (batch == 1 || batch == 2) {
+      ret = bgpstream_get_next_records(bs, records, BATCH_SIZE);
+    } else if (batch == 4) {
+      // a file stream is never waiting for data
+      ret = bgpstream_get_next_record_nb(bs, &records[0]);
+      CHECK("non-blocking return code", ret != BGPSTREAM_AGAIN);
+    } else {
+      ret = bgpstream_get_next_record(bs, &records[0]);
+    }
+    if (ret <= 0) {
+      break;
+    }
+    // with batches, every record in the batch must still be intact here
+    for (i = 0; i < ret; i++) {
+      if (records[i]->status != BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+        continue;
+      }
+      CHECK("batch record intact",
+            strcmp(records[i]->collector_name, "rrc06") == 0);
+      (*rec_cnt)++;
+      if (batch == 3) {
+        CHECK("take record", bgpstream_record_take(records[i]) == 0);
+        CHECK("store taken record",
+              (taken = realloc(taken, sizeof(bgpstream_record_t *) *
+                                        (taken_cnt + 1))) != NULL);
+        taken[taken_cnt++] = records[i];
+        erc = 0;
+      } else if (batch == 2) {
+        CHECK("elem block populate",
+              (erc = bgpstream_elem_block_populate(block, records[i])) >= 0);
+        *elem_cnt += erc;
+        erc = 0;
+      } else if (batch != 0) {
+        while ((erc = bgpstream_record_get_next_elems(records[i], elems,
+                                                      BATCH_SIZE)) > 0) {
+          *elem_cnt += erc;
+        }
+      } else {
+        while ((erc = bgpstream_record_get_next_elem(records[i], &elem)) > 0) {
+          (*elem_cnt)++;
+        }
+      }
+      CHECK("elem return code (singlefile batch)", erc == 0);
+    }
+  }
+  CHECK("final return code (singlefile batch)", ret == 0);
+
+  // all taken records must still be intact
+  for (i = 0; i < taken_cnt; i++) {
+    CHECK("taken record intact",
+          strcmp(taken[i]->collector_name, "rrc06") == 0);
+    while ((erc = bgpstream_record_get_next_elem(taken[i], &elem)) > 0) {
+      (*elem_cnt)++;
+    }
+    CHECK("elem return code (taken record)", erc == 0);
+    bgpstream_record_release(taken[i]);
+  }
+  free(taken);
+
+  // the stream statistics must agree with what was read
+  if (batch == 0) {
+    CHECK("get stats", bgpstream_get_stats(bs, stats, 3) == 2);
+    CHECK("stats collector", strcmp(stats[1].collector, "rrc06") == 0);
+    CHECK("stats resources", stats[0].resources == 1);
+    CHECK("stats records", stats[0].records >= *rec_cnt);
+    CHECK("stats msgs", stats[0].msgs_read == *rec_cnt);
+    CHECK("stats elems",
+          stats[0].elems - stats[0].elems_filtered == (uint64_t)*elem_cnt &&
+            (filter != 0 || stats[0].elems_filtered == 0));
+    CHECK("stats bytes", stats[1].bytes_read == stats[0].bytes_read &&
+                           stats[0].bytes_read > 0);
+    CHECK("stats untimed", stats[0].read_nsec == 0);
+  } else if (batch == 1) {
+    // the elems of batched records are not counted
+    CHECK("get stats (batch)", bgpstream_get_stats(bs, stats, 3) == 2);
+    CHECK("stats msgs (batch)", stats[0].msgs_read == *rec_cnt);
+    CHECK("stats elems (batch)",
+          stats[0].elems == 0 && stats[0].elems_filtered == 0);
+    CHECK("stats timed (batch)", stats[0].read_nsec > 0);
+  }
+
+  bgpstream_elem_block_destroy(block);
+  TEARDOWN;
+  return 0;
+}
+
+/* a taken record stays intact while the stream moves on, and is released
+   (the only order allowed) before the stream is destroyed */
+static int read_take_release()
+{
+  bgpstream_record_t *taken;
+  bgpstream_elem_t *elem;
+  uint32_t time_sec;
+  int i;
+
+  SETUP;
+  CHECK_SET_INTERFACE(singlefile);
+  option = bgpstream_get_data_interface_option_by_name(bs, di_id, "upd-file");
+  bgpstream_set_data_interface_option(bs, option,
+                                      "ris.rrc06.updates.1427846400.gz");
+  CHECK("stream start (take/release)", bgpstream_start(bs) == 0);
+
+  CHECK("take record", bgpstream_get_next_record(bs, &rec) > 0 &&
+                         bgpstream_record_take(rec) == 0);
+  taken = rec;
+  time_sec = taken->time_sec;
+  for (i = 0; i < 100 && bgpstream_get_next_record(bs, &rec) > 0; i++)
+    ;
+  CHECK("taken record intact", rec != taken && taken->time_sec == time_sec);
+  CHECK("taken record elems",
+        bgpstream_record_get_next_elem(taken, &elem) >= 0);
+
+  bgpstream_record_release(taken);
+  CHECK("read after release", bgpstream_get_next_record(bs, &rec) >= 0);
+
+  TEARDOWN;
+  return 0;
+}
+
+int test_singlefile_batch()
+{
+  int rec_cnt, elem_cnt;
+  int batch_rec_cnt, batch_elem_cnt;
+  int filtered_cnt;
+
+  CHECK("read updates", read_updates(0, 0, &rec_cnt, &elem_cnt) == 0);
+  CHECK("read updates (batch)",
+        read_updates(1, 0, &batch_rec_cnt, &batch_elem_cnt) == 0);
+
+  CHECK("read records (singlefile batch)",
+        rec_cnt > 0 && batch_rec_cnt == rec_cnt);
+  CHECK("read elems (singlefile batch)",
+        elem_cnt > 0 && batch_elem_cnt == elem_cnt);
+
+  CHECK("read updates (elem block)",
+        read_updates(2, 0, &batch_rec_cnt, &batch_elem_cnt) == 0);
+  CHECK("read elems (elem block)", batch_elem_cnt == elem_cnt);
+
+  // the block filters are evaluated column-wise, but must agree
+  CHECK("read updates (filtered)",
+        read_updates(0, 1, &batch_rec_cnt, &filtered_cnt) == 0);
+  CHECK("read elems (filtered)", filtered_cnt > 0 && filtered_cnt < elem_cnt);
+  CHECK("read updates (filtered elem block)",
+        read_updates(2, 1, &batch_rec_cnt, &batch_elem_cnt) == 0);
+  CHECK("read elems (filtered elem block)", batch_elem_cnt == filtered_cnt);
+
+  CHECK("read updates (taken records)",
+        read_updates(3, 0, &batch_rec_cnt, &batch_elem_cnt) == 0);
+  CHECK("read records (taken records)", batch_rec_cnt == rec_cnt);
+  CHECK("read elems (taken records)", batch_elem_cnt == elem_cnt);
+
+  CHECK("take and release a record", read_take_release() == 0);
+
+  CHECK("read updates (non-blocking)",
+        read_updates(4, 0, &batch_rec_cnt, &batch_elem_cnt) == 0);
+  CHECK("read records (non-blocking)", batch_rec_cnt == rec_cnt);
+  CHECK("read elems (non-blocking)", batch_elem_cnt == elem_cnt);
+
+  return 0;
+}
+
+#define CHECKPOINT_FILE "bgpstream-test.checkpoint"
+#define CHECKPOINT_RECORDS 1000
+
+/* read (up to max_cnt) valid records from the updates file, optionally
+   resuming from a checkpoint first, and then save a checkpoint */
+static int read_checkpointed(int resume, int max_cnt, int *rec_cnt)
+{
+  int ret;
+
+  *rec_cnt = 0;
+
+  SETUP;
+  CHECK_SET_INTERFACE(singlefile);
+  option = bgpstream_get_data_interface_option_by_name(bs, di_id, "upd-file");
+  bgpstream_set_data_interface_option(bs, option,
+                                      "ris.rrc06.updates.1427846400.gz");
+  if (resume != 0) {
+    CHECK("load checkpoint",
+          bgpstream_load_checkpoint(bs, CHECKPOINT_FILE) == 0);
+  } else {
+    bgpstream_set_checkpointing(bs, 1);
+  }
+  CHECK("stream start (singlefile checkpoint)", bgpstream_start(bs) == 0);
+  while ((max_cnt < 0 || *rec_cnt < max_cnt) &&
+         (ret = bgpstream_get_next_record(bs, &rec)) > 0) {
+    if (rec->status == BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+      (*rec_cnt)++;
+    }
+  }
+  CHECK("save checkpoint", bgpstream_save_checkpoint(bs, CHECKPOINT_FILE) == 0);
+
+  TEARDOWN;
+  return 0;
+}
+
+int test_singlefile_checkpoint()
+{
+  int rec_cnt, first_cnt, rest_cnt, again_cnt;
+
+  CHECK("read updates",
+        read_checkpointed(0, -1, &rec_cnt) == 0 && rec_cnt > 0);
+
+  CHECK("read updates (until checkpoint)",
+        read_checkpointed(0, CHECKPOINT_RECORDS, &first_cnt) == 0);
+  CHECK("read updates (from checkpoint)",
+        read_checkpointed(1, -1, &rest_cnt) == 0);
+  CHECK("read records (checkpoint)",
+        first_cnt == CHECKPOINT_RECORDS && first_cnt + rest_cnt == rec_cnt);
+
+  /* the last checkpoint was saved at the end of the stream */
+  CHECK("read updates (from final checkpoint)",
+        read_checkpointed(1, -1, &again_cnt) == 0);
+  CHECK("read records (final checkpoint)", again_cnt == 0);
+
+  remove(CHECKPOINT_FILE);
+  return 0;
+}
+
+#define REPUSH_URI "ris.rrc06.updates.1427846400.gz"
+
+/* push the updates file to the resource queue (as the singlefile data
+   interface does each time the file changes), and count the valid records
+   read from it. returns the push return code */
+static int push_and_read(bgpstream_resource_mgr_t *q, int *rec_cnt)
+{
+  bgpstream_record_t *record;
+  int rc, ret;
+
+  *rec_cnt = 0;
+  if ((rc = bgpstream_resource_mgr_push(
+         q, BGPSTREAM_RESOURCE_TRANSPORT_FILE, BGPSTREAM_RESOURCE_FORMAT_MRT,
+         REPUSH_URI, 1427846400, 120, "singlefile", "singlefile",
+         BGPSTREAM_UPDATE, NULL)) <= 0) {
+    return rc;
+  }
+  while ((ret = bgpstream_resource_mgr_get_record(q, &record)) > 0) {
+    if (record->status == BGPSTREAM_RECORD_STATUS_VALID_RECORD) {
+      (*rec_cnt)++;
+    }
+  }
+  return (ret < 0) ? -1 : rc;
+}
+
+int test_singlefile_repush()
+{
+  bgpstream_filter_mgr_t *filter_mgr;
+  bgpstream_resource_mgr_t *q;
+  int checkpointing;
+  int first_cnt, rec_cnt;
+
+  CHECK("filter manager create",
+        (filter_mgr = bgpstream_filter_mgr_create()) != NULL &&
+          bgpstream_filter_mgr_validate(filter_mgr) == 0);
+
+  // a URI that has been read to the end may be pushed again, with or without
+  // checkpointing
+  for (checkpointing = 0; checkpointing <= 1; checkpointing++) {
+    CHECK("resource queue create",
+          (q = bgpstream_resource_mgr_create(filter_mgr)) != NULL);
+    bgpstream_resource_mgr_set_checkpointing(q, checkpointing);
+    CHECK("push and read",
+          push_and_read(q, &first_cnt) == 1 && first_cnt > 0);
+    CHECK("push and read again",
+          push_and_read(q, &rec_cnt) == 1 && rec_cnt == first_cnt);
+    bgpstream_resource_mgr_destroy(q);
+  }
+
+  // but a URI that was done when a checkpoint was saved is skipped once
+  CHECK("resource queue create",
+        (q = bgpstream_resource_mgr_create(filter_mgr)) != NULL);
+  CHECK("set done", bgpstream_resource_mgr_set_done(q, REPUSH_URI) == 0);
+  CHECK("push done", push_and_read(q, &rec_cnt) == 0);
+  CHECK("push done again",
+        push_and_read(q, &rec_cnt) == 1 && rec_cnt == first_cnt);
+  bgpstream_resource_mgr_destroy(q);
+
+  bgpstream_filter_mgr_destroy(filter_mgr);
+  return 0;
+}
+
 int test_csvfile()
 {
   SETUP;
@@ -180,6 +549,12 @@ int main()
 
 #ifdef WITH_DATA_INTERFACE_SINGLEFILE
   CHECK_SECTION("singlefile data interface", test_singlefile() == 0);
+  CHECK_SECTION("singlefile data interface (batch)",
+                test_singlefile_batch() == 0);
+  CHECK_SECTION("singlefile data interface (checkpoint)",
+                test_singlefile_checkpoint() == 0);
+  CHECK_SECTION("singlefile data interface (re-push)",
+                test_singlefile_repush() == 0);
 #else
   SKIPPED_SECTION("singlefile data interface");
 #endif
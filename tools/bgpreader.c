@@ -41,6 +41,7 @@
 #ifdef WITH_RPKI
 #include "utils/bgpstream_utils_rpki.h"
 #endif
+#include "bgpreader_serializer.h"
 #include "bgpstream.h"
 #include "utils.h"
 #include "getopt.h"
@@ -149,6 +150,30 @@
       {{"output-headers", no_argument, 0, 'i'},                                \
        "",                                                                     \
        "print format information before output"},                              \
+      {{"threads", required_argument, 0, 'T'},                                 \
+       "<num>",                                                                \
+       "format output using <num> threads"},                                   \
+      {{"shards", required_argument, 0, 'S'},                                  \
+       "<num>",                                                                \
+       "split output across <num> files (see --shard-prefix)"},                \
+      {{"shard-by", required_argument, 0, 'b'},                                \
+       "<key>",                                                                \
+       "assign output lines to shards by collector, peer or prefix\n"          \
+       "(default: peer)"},                                                     \
+      {{"shard-prefix", required_argument, 0, 'O'},                            \
+       "<path>",                                                               \
+       "write shard <i> to <path>.<i> (default: bgpreader)"},                  \
+      {{"stats", no_argument, 0, 's'},                                         \
+       "",                                                                     \
+       "print per-collector read statistics to stderr at the end"},            \
+      {{"checkpoint", required_argument, 0, 'C'},                              \
+       "<file>",                                                               \
+       "resume from <file> if it exists, and save the stream\n"                \
+       "position to it every minute (not with --threads)"},                    \
+      {{"log-level", required_argument, 0, 'L'},                               \
+       "<level>",                                                              \
+       "log messages up to the given level (error, warning, info,\n"           \
+       "config, fine, veryfine, finest; default: info)"},                      \
       {{"version", no_argument, 0, 'v'},                                       \
        "",                                                                     \
        "print the version of bgpreader"},                                      \
@@ -196,9 +221,37 @@ enum rpki_options {
 static struct option long_options[OPTIONS_CNT + 1];
 static char short_options[OPTIONS_CNT * 2 + 1];
 
-static char buf[65536];
+/* maximum length of a single line of output */
+#define OUTPUT_LINE_LEN 65536
+
+/* output lines are accumulated in this buffer and written out in batches */
+#define OUTPUT_BUF_LEN (1024 * 1024)
+static char outbuf[OUTPUT_BUF_LEN];
+static size_t outbuf_len = 0;
+
+/* flush the output buffer after every record (used in live mode) */
+static int outbuf_flush_per_record = 0;
+
+/* how often (in seconds) the stream position is saved to the checkpoint
+   file */
+#define CHECKPOINT_INTERVAL 60
+
+/* multi-threaded serializer (NULL if output is formatted by the main
+   thread) */
+static bgpreader_serializer_t *ser = NULL;
 
 static bgpstream_t *bs;
+
+/* names accepted by --log-level */
+static const struct {
+  const char *name;
+  int level;
+} log_levels[] = {
+  {"error", BGPSTREAM_LOG_ERR},    {"warning", BGPSTREAM_LOG_WARN},
+  {"info", BGPSTREAM_LOG_INFO},    {"config", BGPSTREAM_LOG_CONFIG},
+  {"fine", BGPSTREAM_LOG_FINE},    {"veryfine", BGPSTREAM_LOG_VFINE},
+  {"finest", BGPSTREAM_LOG_FINEST},
+};
 static bgpstream_data_interface_id_t di_id_default = 0;
 static bgpstream_data_interface_id_t di_id = 0;
 static bgpstream_data_interface_info_t *di_info = NULL;
@@ -276,6 +329,8 @@ static void usage()
 
 // print / utility functions
 
+static int output_flush(void);
+static void print_stats(void);
 static int print_record(bgpstream_record_t *record);
 static int print_elem(bgpstream_record_t *record, bgpstream_elem_t *elem);
 static int print_elem_bgpdump(bgpstream_record_t *record,
@@ -333,6 +388,16 @@ int main(int argc, char *argv[])
 
   int rec_limit = -1;
 
+  int threads_cnt = 0;
+  int shards_cnt = 0;
+  bgpreader_shard_by_t shard_by = BGPREADER_SHARD_BY_PEER;
+  char *shard_prefix = "bgpreader";
+
+  int stats_on = 0;
+
+  char *checkpoint_file = NULL;
+  time_t next_checkpoint = 0;
+
   bgpstream_data_interface_option_t *option;
 
   int i;
@@ -505,6 +570,51 @@ int main(int argc, char *argv[])
     case 'i':
       output_info = 1;
       break;
+    case 'T':
+      threads_cnt = atoi(optarg);
+      if (threads_cnt < 1) {
+        fprintf(stderr, "ERROR: Invalid number of threads '%s'\n", optarg);
+        usage();
+        goto err;
+      }
+      break;
+    case 'S':
+      shards_cnt = atoi(optarg);
+      if (shards_cnt < 1) {
+        fprintf(stderr, "ERROR: Invalid number of shards '%s'\n", optarg);
+        usage();
+        goto err;
+      }
+      break;
+    case 'b':
+      if (bgpreader_serializer_parse_shard_by(optarg, &shard_by) != 0) {
+        fprintf(stderr, "ERROR: Invalid shard key '%s'\n", optarg);
+        usage();
+        goto err;
+      }
+      break;
+    case 'O':
+      shard_prefix = optarg;
+      break;
+    case 's':
+      stats_on = 1;
+      break;
+    case 'C':
+      checkpoint_file = optarg;
+      break;
+    case 'L':
+      for (i = 0; i < ARR_CNT(log_levels); i++) {
+        if (strcmp(optarg, log_levels[i].name) == 0) {
+          bgpstream_set_log_level(log_levels[i].level);
+          break;
+        }
+      }
+      if (i == ARR_CNT(log_levels)) {
+        fprintf(stderr, "ERROR: Invalid log level '%s'\n", optarg);
+        usage();
+        goto err;
+      }
+      break;
     case 'f':
       filterstring = optarg;
       break;
@@ -683,7 +793,47 @@ int main(int argc, char *argv[])
   /* live */
   if (live != 0) {
     bgpstream_set_live_mode(bs);
+    outbuf_flush_per_record = 1;
+  }
+
+  /* sharded output is always written by the serializer */
+  if (shards_cnt > 0 && threads_cnt == 0) {
+    threads_cnt = 1;
+  }
+#ifdef WITH_RPKI
+  /* RPKI validation happens while the elem is being printed, and the
+     validation state is not thread-safe */
+  if (threads_cnt > 0 && rpki_input != NULL && rpki_input->rpki_active) {
+    fprintf(stderr, "ERROR: RPKI validation cannot be used with --threads "
+                    "or --shards\n");
+    goto err;
   }
+#endif
+
+  /* with --threads, output is still being written when the stream moves on,
+     so there is no safe point to checkpoint */
+  if (checkpoint_file != NULL && threads_cnt > 0) {
+    fprintf(stderr, "ERROR: --checkpoint cannot be used with --threads or "
+                    "--shards\n");
+    goto err;
+  }
+
+  if (checkpoint_file != NULL) {
+    bgpstream_set_checkpointing(bs, 1);
+  }
+
+  /* resume from a previous run */
+  if (checkpoint_file != NULL && access(checkpoint_file, F_OK) == 0) {
+    if (bgpstream_load_checkpoint(bs, checkpoint_file) != 0) {
+      fprintf(stderr, "ERROR: Could not load checkpoint from %s\n",
+              checkpoint_file);
+      goto err;
+    }
+    fprintf(stderr, "INFO: Resuming from checkpoint %s\n", checkpoint_file);
+  }
+  next_checkpoint = time(NULL) + CHECKPOINT_INTERVAL;
+
+  bgpstream_set_stats_timing(bs, stats_on);
 
   /* turn on interface */
   if (bgpstream_start(bs) < 0) {
@@ -699,8 +849,15 @@ int main(int argc, char *argv[])
     }
   }
 
+  if (threads_cnt > 0 &&
+      (ser = bgpreader_serializer_create(threads_cnt, shards_cnt, shard_by,
+                                         shard_prefix)) == NULL) {
+    fprintf(stderr, "ERROR: Could not create output serializer\n");
+    goto err;
+  }
+
   /* use the interface */
-  int rrc = 0, erc = 0, rec_cnt = 0;
+  int rrc = 0, erc = 0, rec_cnt = 0, rc;
   bgpstream_elem_t *bs_elem;
 
 #ifdef WITH_RPKI
@@ -722,6 +879,10 @@ int main(int argc, char *argv[])
       continue;
     }
 
+    if (ser != NULL) {
+      bgpreader_serializer_begin_record(ser, bs_record);
+    }
+
     if (record_output_on && print_record(bs_record) != 0) {
       goto err;
     }
@@ -764,11 +925,42 @@ int main(int argc, char *argv[])
         goto err;
       }
     }
+
+    if (outbuf_flush_per_record && output_flush() != 0) {
+      goto err;
+    }
+
+    /* everything up to and including this record has been written out */
+    if (checkpoint_file != NULL && time(NULL) >= next_checkpoint) {
+      if (output_flush() != 0 ||
+          bgpstream_save_checkpoint(bs, checkpoint_file) != 0) {
+        goto err;
+      }
+      next_checkpoint = time(NULL) + CHECKPOINT_INTERVAL;
+    }
+  }
+  if (output_flush() != 0) {
+    goto err;
+  }
+  if (ser != NULL) {
+    rc = bgpreader_serializer_destroy(ser);
+    ser = NULL;
+    if (rc != 0) {
+      goto err;
+    }
   }
   if (rrc != 0) {
     fprintf(stderr, "ERROR: Failed to get record from stream\n");
     goto err;
   }
+  /* at the end of the stream, record that everything has been read */
+  if (checkpoint_file != NULL &&
+      bgpstream_save_checkpoint(bs, checkpoint_file) != 0) {
+    goto err;
+  }
+  if (stats_on) {
+    print_stats();
+  }
 
 #ifdef WITH_RPKI
   if (rpki_input != NULL && rpki_input->rpki_active) {
@@ -783,6 +975,8 @@ done:
   return 0;
 
 err:
+  output_flush();
+  bgpreader_serializer_destroy(ser);
   bgpstream_destroy(bs);
 #ifdef WITH_RPKI
   if (rpki_input != NULL && rpki_input->rpki_active) {
@@ -795,37 +989,109 @@ err:
 
 /* print utility functions */
 
-static int print_record(bgpstream_record_t *record)
+#define NSEC_TO_MSEC(nsec) ((double)(nsec) / 1000000)
+
+static void print_stats(void)
+{
+  bgpstream_stats_t *stats = NULL;
+  bgpstream_stats_t *st;
+  int stats_cnt;
+  int i;
+
+  if ((stats_cnt = bgpstream_get_stats(bs, NULL, 0)) <= 0 ||
+      (stats = malloc(sizeof(bgpstream_stats_t) * stats_cnt)) == NULL ||
+      (stats_cnt = bgpstream_get_stats(bs, stats, stats_cnt)) <= 0) {
+    fprintf(stderr, "ERROR: Could not get stream statistics\n");
+    free(stats);
+    return;
+  }
+
+  fprintf(stderr, "# collector|resources|records|bytes|msgs|msgs-filtered|"
+                  "msgs-skipped|msgs-corrupted|elems|elems-filtered|"
+                  "open-wait-ms|read-ms|decode-ms|filter-ms|elem-filter-ms\n");
+  for (i = 0; i < stats_cnt; i++) {
+    st = &stats[i];
+    if (i == 0) {
+      fprintf(stderr, "total");
+    } else {
+      fprintf(stderr, "%s.%s", st->project, st->collector);
+    }
+    fprintf(stderr,
+            "|%" PRIu64 "|%" PRIu64 "|%" PRIu64 "|%" PRIu64 "|%" PRIu64
+            "|%" PRIu64 "|%" PRIu64 "|%" PRIu64 "|%" PRIu64
+            "|%.3f|%.3f|%.3f|%.3f|%.3f\n",
+            st->resources, st->records, st->bytes_read, st->msgs_read,
+            st->msgs_filtered, st->msgs_skipped, st->msgs_corrupted, st->elems,
+            st->elems_filtered, NSEC_TO_MSEC(st->open_wait_nsec),
+            NSEC_TO_MSEC(st->read_nsec), NSEC_TO_MSEC(st->decode_nsec),
+            NSEC_TO_MSEC(st->filter_nsec), NSEC_TO_MSEC(st->elem_filter_nsec));
+  }
+
+  free(stats);
+}
+
+static int output_flush(void)
 {
-  if (bgpstream_record_snprintf(buf, sizeof(buf), record) == NULL) {
-    fprintf(stderr, "ERROR: Could not convert record to string\n");
+  if (ser != NULL) {
+    return bgpreader_serializer_flush(ser);
+  }
+  if (outbuf_len > 0 &&
+      fwrite(outbuf, 1, outbuf_len, stdout) != outbuf_len) {
+    fprintf(stderr, "ERROR: Could not write output\n");
+    outbuf_len = 0;
     return -1;
   }
+  outbuf_len = 0;
+  return 0;
+}
+
+/* write one line into the output buffer using the given snprintf-style call.
+   the buffer is flushed first unless a line of the maximum length (and its
+   newline) fits, so that the call only fails for lines that are too long */
+#define OUTPUT_LINE(snprintf_call, errmsg)                                     \
+  do {                                                                         \
+    char *line;                                                                \
+    size_t len = OUTPUT_LINE_LEN;                                              \
+    if (OUTPUT_BUF_LEN - outbuf_len < OUTPUT_LINE_LEN + 1 &&                   \
+        output_flush() != 0) {                                                 \
+      return -1;                                                               \
+    }                                                                          \
+    line = outbuf + outbuf_len;                                                \
+    if ((snprintf_call) == NULL) {                                             \
+      fprintf(stderr, "ERROR: " errmsg "\n");                                  \
+      return -1;                                                               \
+    }                                                                          \
+    outbuf_len += strlen(line);                                                \
+    outbuf[outbuf_len++] = '\n';                                               \
+  } while (0)
 
-  printf("%s\n", buf);
+static int print_record(bgpstream_record_t *record)
+{
+  if (ser != NULL) {
+    return bgpreader_serializer_add_line(ser, BGPREADER_LINE_RECORD, NULL);
+  }
+  OUTPUT_LINE(bgpstream_record_snprintf(line, len, record),
+              "Could not convert record to string");
   return 0;
 }
 
 static int print_elem(bgpstream_record_t *record, bgpstream_elem_t *elem)
 {
-  if (bgpstream_record_elem_snprintf(buf, sizeof(buf), record, elem) == NULL) {
-    fprintf(stderr, "ERROR: Could not convert record/elem to string\n");
-    return -1;
+  if (ser != NULL) {
+    return bgpreader_serializer_add_line(ser, BGPREADER_LINE_ELEM, elem);
   }
-
-  printf("%s\n", buf);
+  OUTPUT_LINE(bgpstream_record_elem_snprintf(line, len, record, elem),
+              "Could not convert record/elem to string");
   return 0;
 }
 
 static int print_elem_bgpdump(bgpstream_record_t *record,
                               bgpstream_elem_t *elem)
 {
-  if (bgpstream_record_elem_bgpdump_snprintf(buf, sizeof(buf), record, elem) ==
-      NULL) {
-    fprintf(stderr, "ERROR: Could not convert record/elem to string\n");
-    return -1;
+  if (ser != NULL) {
+    return bgpreader_serializer_add_line(ser, BGPREADER_LINE_BGPDUMP, elem);
   }
-
-  printf("%s\n", buf);
+  OUTPUT_LINE(bgpstream_record_elem_bgpdump_snprintf(line, len, record, elem),
+              "Could not convert record/elem to string");
   return 0;
 }
@@ -0,0 +1,662 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpreader_serializer.h"
+#include "config.h"
+#include "utils.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* number of lines in a batch */
+#define BATCH_LINES 4096
+
+/* number of batches allocated per serializer thread */
+#define BATCHES_PER_THREAD 4
+
+/* maximum length of a single line of output */
+#define LINE_LEN 65536
+
+/* initial size of a per-shard output buffer */
+#define OUTBUF_INIT_LEN (1024 * 1024)
+
+/* a single line to be formatted */
+typedef struct line {
+
+  /** Type of line */
+  bgpreader_line_type_t type;
+
+  /** Index of the record header in the batch */
+  int rec_idx;
+
+  /** Index of the elem in the batch (-1 for record lines) */
+  int elem_idx;
+
+} line_t;
+
+/* a growable output buffer */
+typedef struct outbuf {
+
+  char *buf;
+
+  size_t len;
+
+  size_t alloc_len;
+
+} outbuf_t;
+
+typedef struct batch {
+
+  /** Sequence number (batches are written in this order) */
+  uint64_t seq;
+
+  /** Lines to format */
+  line_t lines[BATCH_LINES];
+  int lines_cnt;
+
+  /** Copies of the record headers referenced by the lines */
+  bgpstream_record_t *records;
+  int records_cnt;
+  int records_alloc_cnt;
+
+  /** Copies of the elems referenced by the lines (reused between batches) */
+  bgpstream_elem_t **elems;
+  int elems_cnt;
+  int elems_alloc_cnt;
+
+  /** Formatted output (one buffer per shard) */
+  outbuf_t *out;
+
+  /** Next batch in the queue/free list */
+  struct batch *next;
+
+} batch_t;
+
+struct bgpreader_serializer {
+
+  /** Serializer threads */
+  pthread_t *threads;
+  int threads_cnt;
+
+  /** Output files (stdout if there are no shards) */
+  FILE **files;
+  int files_cnt;
+
+  /** Shard key (only used if files_cnt > 1) */
+  bgpreader_shard_by_t shard_by;
+
+  /** All batches (for cleanup) */
+  batch_t *batches;
+  int batches_cnt;
+
+  /** Batch currently being filled by the reading thread */
+  batch_t *cur;
+
+  /** Header of the current record */
+  bgpstream_record_t rec_hdr;
+
+  /** Index of the current record header in the current batch (-1 if it
+      has not been copied into the batch yet) */
+  int rec_hdr_idx;
+
+  /** Protects everything below */
+  pthread_mutex_t mutex;
+
+  /** Signalled when a batch is queued, or on shutdown */
+  pthread_cond_t work_cond;
+
+  /** Signalled when a batch is returned to the free list */
+  pthread_cond_t free_cond;
+
+  /** Signalled when write_seq changes */
+  pthread_cond_t write_cond;
+
+  /** Queue of batches waiting to be formatted */
+  batch_t *queue_head;
+  batch_t *queue_tail;
+
+  /** Batches available for filling */
+  batch_t *free_list;
+
+  /** Sequence number to assign to the next submitted batch */
+  uint64_t next_seq;
+
+  /** Sequence number of the next batch to write */
+  uint64_t write_seq;
+
+  /** Set when the threads should exit once the queue is drained */
+  int shutdown;
+
+  /** Set if any thread failed to format or write output (accessed
+      atomically, as the reading thread polls it without the lock) */
+  int error;
+};
+
+static int outbuf_reserve(outbuf_t *out, size_t len)
+{
+  size_t new_len;
+
+  if (out->alloc_len - out->len >= len) {
+    return 0;
+  }
+
+  new_len = (out->alloc_len == 0) ? OUTBUF_INIT_LEN : out->alloc_len;
+  while (new_len - out->len < len) {
+    new_len *= 2;
+  }
+  if ((out->buf = realloc(out->buf, new_len)) == NULL) {
+    return -1;
+  }
+  out->alloc_len = new_len;
+  return 0;
+}
+
+static int format_line(outbuf_t *out, bgpstream_record_t *record,
+                       bgpstream_elem_t *elem, bgpreader_line_type_t type)
+{
+  char *line;
+  char *ret = NULL;
+
+  /* one extra byte for the newline */
+  if (outbuf_reserve(out, LINE_LEN + 1) != 0) {
+    fprintf(stderr, "ERROR: Could not allocate output buffer\n");
+    return -1;
+  }
+  line = out->buf + out->len;
+
+  switch (type) {
+  case BGPREADER_LINE_RECORD:
+    ret = bgpstream_record_snprintf(line, LINE_LEN, record);
+    break;
+
+  case BGPREADER_LINE_ELEM:
+    ret = bgpstream_record_elem_snprintf(line, LINE_LEN, record, elem);
+    break;
+
+  case BGPREADER_LINE_BGPDUMP:
+    ret = bgpstream_record_elem_bgpdump_snprintf(line, LINE_LEN, record, elem);
+    break;
+  }
+
+  if (ret == NULL) {
+    fprintf(stderr, "ERROR: Could not convert record/elem to string\n");
+    return -1;
+  }
+
+  out->len += strlen(line);
+  out->buf[out->len++] = '\n';
+  return 0;
+}
+
+static int line_shard(bgpreader_serializer_t *ser, bgpstream_record_t *record,
+                      bgpstream_elem_t *elem)
+{
+  uint64_t h = 0;
+  const char *c;
+
+  switch (ser->shard_by) {
+  case BGPREADER_SHARD_BY_COLLECTOR:
+    /* same string hash as khash */
+    for (c = record->collector_name; *c != '\0'; c++) {
+      h = (h << 5) - h + (uint8_t)*c;
+    }
+    break;
+
+  case BGPREADER_SHARD_BY_PEER:
+    h = bgpstream_addr_storage_hash(&elem->peer_ip) ^ elem->peer_asn;
+    break;
+
+  case BGPREADER_SHARD_BY_PREFIX:
+    if (elem->type == BGPSTREAM_ELEM_TYPE_PEERSTATE) {
+      /* no prefix, keep peer state messages with the peer */
+      h = bgpstream_addr_storage_hash(&elem->peer_ip) ^ elem->peer_asn;
+    } else {
+      h = bgpstream_pfx_storage_hash(&elem->prefix);
+    }
+    break;
+  }
+
+  return h % ser->files_cnt;
+}
+
+static int format_batch(bgpreader_serializer_t *ser, batch_t *batch)
+{
+  int i, j;
+  line_t *line;
+  bgpstream_record_t *record;
+  bgpstream_elem_t *elem;
+
+  for (i = 0; i < batch->lines_cnt; i++) {
+    line = &batch->lines[i];
+    record = &batch->records[line->rec_idx];
+    elem = (line->elem_idx >= 0) ? batch->elems[line->elem_idx] : NULL;
+
+    if (ser->files_cnt == 1) {
+      if (format_line(&batch->out[0], record, elem, line->type) != 0) {
+        return -1;
+      }
+    } else if (elem != NULL ||
+               ser->shard_by == BGPREADER_SHARD_BY_COLLECTOR) {
+      if (elem == NULL) {
+        /* collector sharding only needs the record */
+        j = line_shard(ser, record, NULL);
+      } else {
+        j = line_shard(ser, record, elem);
+      }
+      if (format_line(&batch->out[j], record, elem, line->type) != 0) {
+        return -1;
+      }
+    } else {
+      /* record lines (e.g., RIB begin/end) are relevant to every shard */
+      for (j = 0; j < ser->files_cnt; j++) {
+        if (format_line(&batch->out[j], record, NULL, line->type) != 0) {
+          return -1;
+        }
+      }
+    }
+  }
+
+  return 0;
+}
+
+static int write_batch(bgpreader_serializer_t *ser, batch_t *batch)
+{
+  int i;
+  int rc = 0;
+
+  for (i = 0; i < ser->files_cnt; i++) {
+    if (batch->out[i].len > 0 &&
+        fwrite(batch->out[i].buf, 1, batch->out[i].len, ser->files[i]) !=
+          batch->out[i].len) {
+      fprintf(stderr, "ERROR: Could not write output\n");
+      rc = -1;
+    }
+    if (fflush(ser->files[i]) != 0) {
+      rc = -1;
+    }
+    batch->out[i].len = 0;
+  }
+
+  return rc;
+}
+
+/* check whether a serializer thread has failed (without taking the lock,
+   since this is called for every line) */
+static int get_error(bgpreader_serializer_t *ser)
+{
+  return __atomic_load_n(&ser->error, __ATOMIC_ACQUIRE);
+}
+
+static void *serializer_thread(void *user)
+{
+  bgpreader_serializer_t *ser = (bgpreader_serializer_t *)user;
+  batch_t *batch;
+  int rc;
+
+  while (1) {
+    pthread_mutex_lock(&ser->mutex);
+    while (ser->queue_head == NULL && !ser->shutdown) {
+      pthread_cond_wait(&ser->work_cond, &ser->mutex);
+    }
+    if (ser->queue_head == NULL) {
+      /* shutdown and nothing left to do */
+      pthread_mutex_unlock(&ser->mutex);
+      break;
+    }
+    batch = ser->queue_head;
+    ser->queue_head = batch->next;
+    if (ser->queue_head == NULL) {
+      ser->queue_tail = NULL;
+    }
+    pthread_mutex_unlock(&ser->mutex);
+
+    /* format in parallel with the other threads */
+    rc = format_batch(ser, batch);
+
+    /* and then wait for our turn to write */
+    pthread_mutex_lock(&ser->mutex);
+    while (ser->write_seq != batch->seq) {
+      pthread_cond_wait(&ser->write_cond, &ser->mutex);
+    }
+    pthread_mutex_unlock(&ser->mutex);
+
+    /* only one thread can hold the write turn, so no lock is needed here */
+    if (rc == 0 && !get_error(ser)) {
+      rc = write_batch(ser, batch);
+    }
+
+    pthread_mutex_lock(&ser->mutex);
+    if (rc != 0) {
+      __atomic_store_n(&ser->error, 1, __ATOMIC_RELEASE);
+    }
+    ser->write_seq++;
+    pthread_cond_broadcast(&ser->write_cond);
+
+    batch->next = ser->free_list;
+    ser->free_list = batch;
+    pthread_cond_signal(&ser->free_cond);
+    pthread_mutex_unlock(&ser->mutex);
+  }
+
+  return NULL;
+}
+
+/* get an empty batch to fill, waiting for one if necessary */
+static batch_t *get_free_batch(bgpreader_serializer_t *ser)
+{
+  batch_t *batch;
+  int i;
+
+  pthread_mutex_lock(&ser->mutex);
+  while (ser->free_list == NULL) {
+    pthread_cond_wait(&ser->free_cond, &ser->mutex);
+  }
+  batch = ser->free_list;
+  ser->free_list = batch->next;
+  pthread_mutex_unlock(&ser->mutex);
+
+  batch->next = NULL;
+  batch->lines_cnt = 0;
+  batch->records_cnt = 0;
+  batch->elems_cnt = 0;
+  for (i = 0; i < ser->files_cnt; i++) {
+    batch->out[i].len = 0;
+  }
+  return batch;
+}
+
+static void batch_free(bgpreader_serializer_t *ser, batch_t *batch)
+{
+  int i;
+
+  for (i = 0; i < batch->elems_alloc_cnt; i++) {
+    bgpstream_elem_destroy(batch->elems[i]);
+  }
+  free(batch->elems);
+  batch->elems = NULL;
+  batch->elems_alloc_cnt = 0;
+
+  free(batch->records);
+  batch->records = NULL;
+  batch->records_alloc_cnt = 0;
+
+  if (batch->out != NULL) {
+    for (i = 0; i < ser->files_cnt; i++) {
+      free(batch->out[i].buf);
+    }
+    free(batch->out);
+    batch->out = NULL;
+  }
+}
+
+/* ========== PUBLIC FUNCTIONS ========== */
+
+bgpreader_serializer_t *
+bgpreader_serializer_create(int threads_cnt, int shards_cnt,
+                            bgpreader_shard_by_t shard_by,
+                            const char *shard_prefix)
+{
+  bgpreader_serializer_t *ser;
+  char filename[1024];
+  int i;
+
+  if (threads_cnt < 1) {
+    threads_cnt = 1;
+  }
+
+  if ((ser = malloc_zero(sizeof(bgpreader_serializer_t))) == NULL) {
+    return NULL;
+  }
+  pthread_mutex_init(&ser->mutex, NULL);
+  pthread_cond_init(&ser->work_cond, NULL);
+  pthread_cond_init(&ser->free_cond, NULL);
+  pthread_cond_init(&ser->write_cond, NULL);
+  ser->shard_by = shard_by;
+  ser->rec_hdr_idx = -1;
+
+  /* open the output files */
+  ser->files_cnt = (shards_cnt > 0) ? shards_cnt : 1;
+  if ((ser->files = malloc_zero(sizeof(FILE *) * ser->files_cnt)) == NULL) {
+    goto err;
+  }
+  if (shards_cnt == 0) {
+    ser->files[0] = stdout;
+  } else {
+    for (i = 0; i < shards_cnt; i++) {
+      snprintf(filename, sizeof(filename), "%s.%d", shard_prefix, i);
+      if ((ser->files[i] = fopen(filename, "w")) == NULL) {
+        fprintf(stderr, "ERROR: Could not open shard file %s\n", filename);
+        goto err;
+      }
+    }
+  }
+
+  /* allocate the batches */
+  ser->batches_cnt = threads_cnt * BATCHES_PER_THREAD;
+  if ((ser->batches = malloc_zero(sizeof(batch_t) * ser->batches_cnt)) ==
+      NULL) {
+    goto err;
+  }
+  for (i = 0; i < ser->batches_cnt; i++) {
+    if ((ser->batches[i].out =
+           malloc_zero(sizeof(outbuf_t) * ser->files_cnt)) == NULL) {
+      goto err;
+    }
+    ser->batches[i].next = ser->free_list;
+    ser->free_list = &ser->batches[i];
+  }
+
+  /* start the threads */
+  if ((ser->threads = malloc_zero(sizeof(pthread_t) * threads_cnt)) == NULL) {
+    goto err;
+  }
+  for (i = 0; i < threads_cnt; i++) {
+    if (pthread_create(&ser->threads[i], NULL, serializer_thread, ser) != 0) {
+      fprintf(stderr, "ERROR: Could not start serializer thread\n");
+      goto err;
+    }
+    ser->threads_cnt++;
+  }
+
+  ser->cur = get_free_batch(ser);
+
+  return ser;
+
+err:
+  bgpreader_serializer_destroy(ser);
+  return NULL;
+}
+
+int bgpreader_serializer_parse_shard_by(const char *name,
+                                        bgpreader_shard_by_t *shard_by)
+{
+  if (strcmp(name, "collector") == 0) {
+    *shard_by = BGPREADER_SHARD_BY_COLLECTOR;
+  } else if (strcmp(name, "peer") == 0) {
+    *shard_by = BGPREADER_SHARD_BY_PEER;
+  } else if (strcmp(name, "prefix") == 0) {
+    *shard_by = BGPREADER_SHARD_BY_PREFIX;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+void bgpreader_serializer_begin_record(bgpreader_serializer_t *ser,
+                                       bgpstream_record_t *record)
+{
+  ser->rec_hdr = *record;
+  /* the internal state belongs to bgpstream and must not be used by the
+     serializer threads */
+  ser->rec_hdr.__int = NULL;
+  ser->rec_hdr_idx = -1;
+}
+
+int bgpreader_serializer_add_line(bgpreader_serializer_t *ser,
+                                  bgpreader_line_type_t type,
+                                  bgpstream_elem_t *elem)
+{
+  batch_t *batch = ser->cur;
+  line_t *line;
+
+  if (get_error(ser)) {
+    return -1;
+  }
+
+  /* copy the record header into this batch, if not already there */
+  if (ser->rec_hdr_idx < 0) {
+    if (batch->records_cnt == batch->records_alloc_cnt) {
+      if ((batch->records =
+             realloc(batch->records, sizeof(bgpstream_record_t) *
+                                       (batch->records_alloc_cnt + 64))) ==
+          NULL) {
+        return -1;
+      }
+      batch->records_alloc_cnt += 64;
+    }
+    batch->records[batch->records_cnt] = ser->rec_hdr;
+    ser->rec_hdr_idx = batch->records_cnt++;
+  }
+
+  line = &batch->lines[batch->lines_cnt];
+  line->type = type;
+  line->rec_idx = ser->rec_hdr_idx;
+  line->elem_idx = -1;
+
+  if (type != BGPREADER_LINE_RECORD) {
+    assert(elem != NULL);
+    if (batch->elems_cnt == batch->elems_alloc_cnt) {
+      if ((batch->elems = realloc(batch->elems, sizeof(bgpstream_elem_t *) *
+                                                  (batch->elems_alloc_cnt +
+                                                   1))) == NULL ||
+          (batch->elems[batch->elems_alloc_cnt] = bgpstream_elem_create()) ==
+            NULL) {
+        return -1;
+      }
+      batch->elems_alloc_cnt++;
+    }
+    bgpstream_elem_clear(batch->elems[batch->elems_cnt]);
+    if (bgpstream_elem_copy(batch->elems[batch->elems_cnt], elem) == NULL) {
+      return -1;
+    }
+    line->elem_idx = batch->elems_cnt++;
+  }
+
+  batch->lines_cnt++;
+
+  if (batch->lines_cnt == BATCH_LINES) {
+    return bgpreader_serializer_flush(ser);
+  }
+  return 0;
+}
+
+int bgpreader_serializer_flush(bgpreader_serializer_t *ser)
+{
+  batch_t *batch = ser->cur;
+
+  if (batch == NULL || batch->lines_cnt == 0) {
+    return get_error(ser) ? -1 : 0;
+  }
+
+  pthread_mutex_lock(&ser->mutex);
+  batch->seq = ser->next_seq++;
+  if (ser->queue_tail == NULL) {
+    ser->queue_head = ser->queue_tail = batch;
+  } else {
+    ser->queue_tail->next = batch;
+    ser->queue_tail = batch;
+  }
+  pthread_cond_signal(&ser->work_cond);
+  pthread_mutex_unlock(&ser->mutex);
+
+  /* the record header must be copied into the next batch */
+  ser->rec_hdr_idx = -1;
+  ser->cur = get_free_batch(ser);
+
+  return get_error(ser) ? -1 : 0;
+}
+
+int bgpreader_serializer_destroy(bgpreader_serializer_t *ser)
+{
+  int rc = 0;
+  int i;
+
+  if (ser == NULL) {
+    return 0;
+  }
+
+  if (ser->threads_cnt > 0) {
+    if (bgpreader_serializer_flush(ser) != 0) {
+      rc = -1;
+    }
+
+    pthread_mutex_lock(&ser->mutex);
+    ser->shutdown = 1;
+    pthread_cond_broadcast(&ser->work_cond);
+    pthread_mutex_unlock(&ser->mutex);
+
+    for (i = 0; i < ser->threads_cnt; i++) {
+      pthread_join(ser->threads[i], NULL);
+    }
+  }
+  free(ser->threads);
+  ser->threads = NULL;
+
+  if (get_error(ser)) {
+    rc = -1;
+  }
+
+  if (ser->batches != NULL) {
+    for (i = 0; i < ser->batches_cnt; i++) {
+      batch_free(ser, &ser->batches[i]);
+    }
+    free(ser->batches);
+    ser->batches = NULL;
+  }
+
+  if (ser->files != NULL) {
+    for (i = 0; i < ser->files_cnt; i++) {
+      if (ser->files[i] == stdout) {
+        fflush(stdout);
+      } else if (ser->files[i] != NULL && fclose(ser->files[i]) != 0) {
+        rc = -1;
+      }
+    }
+    free(ser->files);
+    ser->files = NULL;
+  }
+
+  pthread_mutex_destroy(&ser->mutex);
+  pthread_cond_destroy(&ser->work_cond);
+  pthread_cond_destroy(&ser->free_cond);
+  pthread_cond_destroy(&ser->write_cond);
+
+  free(ser);
+  return rc;
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2019 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPREADER_SERIALIZER_H
+#define __BGPREADER_SERIALIZER_H
+
+#include "bgpstream.h"
+
+/** @file
+ *
+ * @brief Multi-threaded output serializer used by bgpreader.
+ *
+ * The reading thread copies records and elems into batches, which are
+ * formatted by a pool of serializer threads. Batches are written out in the
+ * order in which they were submitted, either to stdout, or to a set of shard
+ * files selected by collector, peer or prefix.
+ *
+ */
+
+/** Opaque handle for a serializer instance */
+typedef struct bgpreader_serializer bgpreader_serializer_t;
+
+/** How lines are distributed across shard files */
+typedef enum {
+
+  /** Shard by collector name */
+  BGPREADER_SHARD_BY_COLLECTOR = 0,
+
+  /** Shard by peer (ASN and IP) */
+  BGPREADER_SHARD_BY_PEER = 1,
+
+  /** Shard by prefix */
+  BGPREADER_SHARD_BY_PREFIX = 2,
+
+} bgpreader_shard_by_t;
+
+/** Type of line to output */
+typedef enum {
+
+  /** bgpstream record format (-r) */
+  BGPREADER_LINE_RECORD = 0,
+
+  /** bgpstream elem format (-e) */
+  BGPREADER_LINE_ELEM = 1,
+
+  /** bgpdump -m format (-m) */
+  BGPREADER_LINE_BGPDUMP = 2,
+
+} bgpreader_line_type_t;
+
+/** Create a new serializer and start its threads
+ *
+ * @param threads_cnt   number of serializer threads to start (at least 1)
+ * @param shards_cnt    number of output shards. If 0, output is written to
+ *                      stdout
+ * @param shard_by      how to assign lines to shards
+ * @param shard_prefix  output file prefix; shard i is written to
+ *                      "<shard_prefix>.<i>"
+ * @return pointer to the serializer if successful, NULL otherwise
+ */
+bgpreader_serializer_t *
+bgpreader_serializer_create(int threads_cnt, int shards_cnt,
+                            bgpreader_shard_by_t shard_by,
+                            const char *shard_prefix);
+
+/** Parse the name of a shard key
+ *
+ * @param name          one of "collector", "peer" or "prefix"
+ * @param[out] shard_by set to the parsed shard key
+ * @return 0 if the name is valid, -1 otherwise
+ */
+int bgpreader_serializer_parse_shard_by(const char *name,
+                                        bgpreader_shard_by_t *shard_by);
+
+/** Start a new record
+ *
+ * @param ser           pointer to the serializer
+ * @param record        pointer to the record that subsequent lines refer to
+ *
+ * The record header fields are copied, so the record may be reused by
+ * bgpstream once all of its lines have been added.
+ */
+void bgpreader_serializer_begin_record(bgpreader_serializer_t *ser,
+                                       bgpstream_record_t *record);
+
+/** Queue a line for output
+ *
+ * @param ser           pointer to the serializer
+ * @param type          type of line to output
+ * @param elem          pointer to the elem to output (ignored for record
+ *                      lines). The elem is copied.
+ * @return 0 if successful, -1 if an error occurred (in this call, or in a
+ * serializer thread)
+ */
+int bgpreader_serializer_add_line(bgpreader_serializer_t *ser,
+                                  bgpreader_line_type_t type,
+                                  bgpstream_elem_t *elem);
+
+/** Hand the current (partial) batch to the serializer threads
+ *
+ * @param ser           pointer to the serializer
+ * @return 0 if successful, -1 if an error occurred
+ */
+int bgpreader_serializer_flush(bgpreader_serializer_t *ser);
+
+/** Flush all pending output, stop the threads and destroy the serializer
+ *
+ * @param ser           pointer to the serializer
+ * @return 0 if all output was written successfully, -1 otherwise
+ */
+int bgpreader_serializer_destroy(bgpreader_serializer_t *ser);
+
+#endif /* __BGPREADER_SERIALIZER_H */